@@ -0,0 +1,555 @@
+#include <string.h>
+#include <math.h>
+#include "Analyzer.h"
+#include "SampleConvert.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ANALYZE_X86 1
+#include <emmintrin.h>
+#else
+#define ANALYZE_X86 0
+#endif
+
+// how long the analysis thread naps when there is nothing to do
+#define ANALYZE_IDLE_MS 5
+// samples of the previous block the interpolator needs in front of the current one
+#define TRUE_PEAK_TAIL (TRUE_PEAK_TAPS - 1)
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void sleepMillis(int ms){
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+//----------------------------------------------------------------------------------
+// kernels, SSE2 is there on every x86 we build for
+
+static float absMax(const float *src, long count){
+	long n = 0;
+	float result = 0;
+#if ANALYZE_X86
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 max = _mm_setzero_ps();
+	for (; n + 4 <= count; n += 4)
+		max = _mm_max_ps(max, _mm_and_ps(_mm_loadu_ps(src + n), mask));
+	float lanes[4];
+	_mm_storeu_ps(lanes, max);
+	for (int i = 0; i < 4; i++)
+		if (lanes[i] > result)
+			result = lanes[i];
+#endif
+	for (; n < count; n++)
+		if (fabsf(src[n]) > result)
+			result = fabsf(src[n]);
+	return result;
+}
+
+static double sumSquares(const float *src, long count){
+	long n = 0;
+	double result = 0;
+#if ANALYZE_X86
+	// squares go to double before adding up, a long block of quiet samples stays exact enough
+	__m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+	for (; n + 4 <= count; n += 4){
+		__m128 x = _mm_loadu_ps(src + n);
+		__m128d a = _mm_cvtps_pd(x);
+		__m128d b = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+		low = _mm_add_pd(low, _mm_mul_pd(a, a));
+		high = _mm_add_pd(high, _mm_mul_pd(b, b));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(low, high));
+	result = lanes[0] + lanes[1];
+#endif
+	for (; n < count; n++)
+		result += (double)src[n] * src[n];
+	return result;
+}
+
+// largest magnitude of the 4x upsampled signal, src has TRUE_PEAK_TAIL samples of history in
+// front of the count new ones. taps are stored reversed so output n is a dot product with src + n
+static float interpolatedMax(const float *src, long count, const float taps[TRUE_PEAK_PHASES][TRUE_PEAK_TAPS]){
+	float result = 0;
+	for (int p = 0; p < TRUE_PEAK_PHASES; p++){
+		const float *h = taps[p];
+		long n = 0;
+#if ANALYZE_X86
+		const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 max = _mm_setzero_ps();
+		for (; n + 4 <= count; n += 4){
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < TRUE_PEAK_TAPS; k++)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(h[k]), _mm_loadu_ps(src + n + k)));
+			max = _mm_max_ps(max, _mm_and_ps(sum, mask));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, max);
+		for (int i = 0; i < 4; i++)
+			if (lanes[i] > result)
+				result = lanes[i];
+#endif
+		for (; n < count; n++){
+			float sum = 0;
+			for (int k = 0; k < TRUE_PEAK_TAPS; k++)
+				sum += h[k] * src[n + k];
+			if (fabsf(sum) > result)
+				result = fabsf(sum);
+		}
+	}
+	return result;
+}
+
+// one direct form II transposed biquad, c is b0 b1 b2 a1 a2
+static inline double biquad(const double *c, double *z, double x){
+	double y = c[0] * x + z[0];
+	z[0] = c[1] * x - c[3] * y + z[1];
+	z[1] = c[2] * x - c[4] * y;
+	return y;
+}
+
+static double loudness(double energy){
+	return energy > 0 ? -0.691 + 10 * log10(energy) : -INFINITY;
+}
+
+//----------------------------------------------------------------------------------
+
+Analyzer::Analyzer() : frames(0), channelBytes(0), sampleRate(0), publishSamples(0), publish(NULL), publishArg(NULL),
+	bufferBlocks(0), memory(NULL), samples(NULL), sampleStride(0), peak(NULL), truePeak(NULL), squares(NULL),
+	kState(NULL), kEnergy(NULL), fftHistory(NULL), fftPosition(0), fftSize(0), fftWindow(NULL), fftReal(NULL),
+	fftImag(NULL), twiddleCos(NULL), twiddleSin(NULL), bitReverse(NULL), subblockSamples(0), subblockFill(0),
+	subblockCount(0), intervalSamples(0), staging(NULL), snapshot(NULL), snapshotFloats(0), snapshotSequence(0),
+	running(false), busy(false), threadRunning(false), loudnessReset(false), snapshots(0), overruns(0)
+{
+}
+
+Analyzer::~Analyzer(){
+	close();
+}
+
+int Analyzer::open(const AnalyzerOptions &options, const ASIOSampleType *inputTypes, long inputs, long frameCount,
+	double rate, AnalyzerPublish publishHook, void *arg){
+	if (memory)
+		return -1;	// already running
+	if (options.channels.empty() || frameCount <= 0)
+		return -2;
+	sources = options.channels;
+	sourceTypes.clear();
+	weights.clear();
+	for (size_t c = 0; c < sources.size(); c++){
+		if (sources[c] < 0 || sources[c] >= inputs || !getToFloat(inputTypes[sources[c]]))
+			return -2;
+		sourceTypes.push_back(inputTypes[sources[c]]);
+		weights.push_back(c < options.weights.size() ? options.weights[c] : 1.);
+	}
+	if (options.rate <= 0 || options.fftSize < 64 || options.fftSize > 65536 || (options.fftSize & (options.fftSize - 1)))
+		return -3;
+
+	frames = frameCount;
+	sampleRate = rate;
+	fftSize = options.fftSize;
+	publishSamples = (long)(rate / options.rate);
+	if (publishSamples < 1)
+		publishSamples = 1;
+	publish = publishHook;
+	publishArg = arg;
+	long sourceBytes = 0;
+	for (size_t c = 0; c < sourceTypes.size(); c++)
+		if (sampleBytes(sourceTypes[c]) > sourceBytes)
+			sourceBytes = sampleBytes(sourceTypes[c]);
+	channelBytes = (long)alignUp(frames * sourceBytes);
+
+	// every piece on its own cache line, like the channel layout
+	size_t n = sources.size();
+	sampleStride = (long)(alignUp((TRUE_PEAK_TAIL + frames) * sizeof(float)) / sizeof(float));
+	snapshotFloats = (long)(ANALYSIS_HEADER + n * ANALYSIS_METERS + n * (fftSize / 2));
+	size_t bytes = alignUp(n * sampleStride * sizeof(float)) + 2 * alignUp(n * sizeof(float))
+		+ alignUp(n * sizeof(double)) + alignUp(4 * n * sizeof(double)) + alignUp(n * sizeof(double))
+		+ alignUp(n * fftSize * sizeof(float)) + 3 * alignUp(fftSize * sizeof(float))
+		+ 2 * alignUp(fftSize / 2 * sizeof(float)) + alignUp(fftSize * sizeof(long))
+		+ 2 * alignUp(snapshotFloats * sizeof(float));
+	long blocks = (long)(options.bufferSeconds * rate / frames) + 1;
+	if (blocks < 8)
+		blocks = 8;
+	memory = (char *)alignedAlloc(bytes);
+	if (!memory || !ring.allocate(blocks, n * channelBytes)){
+		close();
+		return -4;
+	}
+	memset(memory, 0, bytes);
+	char *p = memory;
+	samples = (float *)p; p += alignUp(n * sampleStride * sizeof(float));
+	peak = (float *)p; p += alignUp(n * sizeof(float));
+	truePeak = (float *)p; p += alignUp(n * sizeof(float));
+	squares = (double *)p; p += alignUp(n * sizeof(double));
+	kState = (double *)p; p += alignUp(4 * n * sizeof(double));
+	kEnergy = (double *)p; p += alignUp(n * sizeof(double));
+	fftHistory = (float *)p; p += alignUp(n * fftSize * sizeof(float));
+	fftWindow = (float *)p; p += alignUp(fftSize * sizeof(float));
+	fftReal = (float *)p; p += alignUp(fftSize * sizeof(float));
+	fftImag = (float *)p; p += alignUp(fftSize * sizeof(float));
+	twiddleCos = (float *)p; p += alignUp(fftSize / 2 * sizeof(float));
+	twiddleSin = (float *)p; p += alignUp(fftSize / 2 * sizeof(float));
+	bitReverse = (long *)p; p += alignUp(fftSize * sizeof(long));
+	staging = (float *)p; p += alignUp(snapshotFloats * sizeof(float));
+	snapshot = (float *)p;
+	bufferBlocks = (long)ring.capacity();
+
+	// Hann window, scaled so a full scale sine peaks at 1 in its bin
+	double windowSum = 0;
+	for (long i = 0; i < fftSize; i++){
+		fftWindow[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / fftSize));
+		windowSum += fftWindow[i];
+	}
+	for (long i = 0; i < fftSize; i++)
+		fftWindow[i] = (float)(fftWindow[i] * 2 / windowSum);
+	for (long i = 0; i < fftSize / 2; i++){
+		twiddleCos[i] = (float)cos(2 * M_PI * i / fftSize);
+		twiddleSin[i] = (float)-sin(2 * M_PI * i / fftSize);
+	}
+	int bits = 0;
+	while ((1L << bits) < fftSize)
+		bits++;
+	for (long i = 0; i < fftSize; i++){
+		long r = 0;
+		for (int b = 0; b < bits; b++)
+			if (i & (1L << b))
+				r |= 1L << (bits - 1 - b);
+		bitReverse[i] = r;
+	}
+
+	// windowed sinc, cut off at the original nyquist, split into phases that each pass DC unchanged
+	const int length = TRUE_PEAK_PHASES * TRUE_PEAK_TAPS;
+	for (int ph = 0; ph < TRUE_PEAK_PHASES; ph++){
+		double sum = 0;
+		double taps[TRUE_PEAK_TAPS];
+		for (int k = 0; k < TRUE_PEAK_TAPS; k++){
+			int i = k * TRUE_PEAK_PHASES + ph;
+			double x = M_PI * (i - (length - 1) / 2.) / TRUE_PEAK_PHASES;
+			double window = 0.42 - 0.5 * cos(2 * M_PI * (i + 0.5) / length) + 0.08 * cos(4 * M_PI * (i + 0.5) / length);
+			taps[k] = sin(x) / x * window;
+			sum += taps[k];
+		}
+		for (int k = 0; k < TRUE_PEAK_TAPS; k++)
+			truePeakTaps[ph][TRUE_PEAK_TAPS - 1 - k] = (float)(taps[k] / sum);
+	}
+
+	// ITU-R BS.1770 K-weighting, the 48kHz reference filters redone for our rate
+	double K = tan(M_PI * 1681.974450955533 / rate);
+	double Q = 0.7071752369554196;
+	double Vh = pow(10., 3.999843853973347 / 20);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1 + K / Q + K * K;
+	kShelf[0] = (Vh + Vb * K / Q + K * K) / a0;
+	kShelf[1] = 2 * (K * K - Vh) / a0;
+	kShelf[2] = (Vh - Vb * K / Q + K * K) / a0;
+	kShelf[3] = 2 * (K * K - 1) / a0;
+	kShelf[4] = (1 - K / Q + K * K) / a0;
+	K = tan(M_PI * 38.13547087602444 / rate);
+	Q = 0.5003270373238773;
+	a0 = 1 + K / Q + K * K;
+	kHighPass[0] = 1;
+	kHighPass[1] = -2;
+	kHighPass[2] = 1;
+	kHighPass[3] = 2 * (K * K - 1) / a0;
+	kHighPass[4] = (1 - K / Q + K * K) / a0;
+	subblockSamples = (long)(rate / 10 + 0.5);
+
+	fftPosition = 0;
+	subblockFill = 0;
+	subblockCount = 0;
+	intervalSamples = 0;
+	memset(subblocks, 0, sizeof(subblocks));
+	memset(binCount, 0, sizeof(binCount));
+	memset(binEnergy, 0, sizeof(binEnergy));
+	snapshotSequence = 0;
+	snapshots = 0;
+	overruns = 0;
+	loudnessReset = false;
+	threadRunning = true;
+	if (uv_thread_create(&thread, analysisThread, this) != 0){
+		threadRunning = false;
+		close();
+		return -5;
+	}
+	running.store(true);
+	return 0;
+}
+
+void Analyzer::close(){
+	// after this loop the driver thread is either out of capture() or sees running false
+	running.store(false);
+	while (busy.load())
+		sleepMillis(0);
+	if (threadRunning.load()){
+		threadRunning.store(false, std::memory_order_release);
+		uv_thread_join(&thread);
+	}
+	ring.release();
+	if (memory)
+		alignedFree(memory);
+	memory = NULL;
+	samples = staging = snapshot = NULL;
+	snapshotFloats = 0;
+}
+
+void Analyzer::stats(AnalyzerStats *out){
+	out->running = running.load(std::memory_order_relaxed);
+	out->snapshots = snapshots.load(std::memory_order_relaxed);
+	out->overruns = overruns.load(std::memory_order_relaxed);
+	out->bufferBlocks = bufferBlocks;
+}
+
+bool Analyzer::read(float *dst){
+	if (!snapshot)
+		return false;
+	// the analysis thread writes a few times a second, a retry or two covers any overlap
+	for (int attempt = 0; attempt < 16; attempt++){
+		uint32_t before = snapshotSequence.load(std::memory_order_acquire);
+		if (before & 1)
+			continue;
+		memcpy(dst, snapshot, snapshotFloats * sizeof(float));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (snapshotSequence.load(std::memory_order_relaxed) == before)
+			return true;
+	}
+	return false;
+}
+
+void Analyzer::capture(void *const *halves){
+	busy.store(true);
+	if (!running.load()){
+		busy.store(false);
+		return;
+	}
+	char *slot = ring.writeSlot();
+	if (slot){
+		for (size_t c = 0; c < sources.size(); c++, slot += channelBytes)
+			memcpy(slot, halves[sources[c]], frames * sampleBytes(sourceTypes[c]));
+		ring.commit();
+	}
+	else
+		overruns.fetch_add(1, std::memory_order_relaxed);
+	busy.store(false, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------------
+// analysis thread
+
+void Analyzer::analysisThread(void *arg){
+	Analyzer *analyzer = (Analyzer *)arg;
+	while (analyzer->threadRunning.load(std::memory_order_acquire)){
+		const char *slot;
+		bool any = false;
+		while ((slot = analyzer->ring.readSlot()) != NULL){
+			analyzer->analyzeBlock(slot);
+			analyzer->ring.consume();
+			any = true;
+		}
+		if (!any)
+			sleepMillis(ANALYZE_IDLE_MS);
+	}
+}
+
+void Analyzer::analyzeBlock(const char *block){
+	long channels = (long)sources.size();
+	if (loudnessReset.exchange(false, std::memory_order_acquire)){
+		memset(kState, 0, 4 * channels * sizeof(double));
+		memset(kEnergy, 0, channels * sizeof(double));
+		memset(binCount, 0, sizeof(binCount));
+		memset(binEnergy, 0, sizeof(binEnergy));
+		subblockFill = 0;
+		subblockCount = 0;
+	}
+
+	for (long c = 0; c < channels; c++){
+		float *history = samples + c * sampleStride;
+		float *current = history + TRUE_PEAK_TAIL;
+		// the tail of the last block moves to the front, the new one goes behind it
+		memmove(history, history + frames, TRUE_PEAK_TAIL * sizeof(float));
+		getToFloat(sourceTypes[c])(block + c * channelBytes, current, frames);
+
+		float blockPeak = absMax(current, frames);
+		if (blockPeak > peak[c])
+			peak[c] = blockPeak;
+		float blockTrue = interpolatedMax(history, frames, truePeakTaps);
+		if (blockTrue < blockPeak)
+			blockTrue = blockPeak;
+		if (blockTrue > truePeak[c])
+			truePeak[c] = blockTrue;
+		squares[c] += sumSquares(current, frames);
+
+		// keep the latest fftSize samples, older ones fall off the ring
+		float *window = fftHistory + c * fftSize;
+		long skip = frames > fftSize ? frames - fftSize : 0;
+		long position = (fftPosition + skip) & (fftSize - 1);
+		for (long n = skip; n < frames; n++){
+			window[position] = current[n];
+			position = (position + 1) & (fftSize - 1);
+		}
+	}
+	fftPosition = (fftPosition + frames) & (fftSize - 1);
+
+	// loudness in 100ms pieces, a block can finish one and start the next
+	for (long offset = 0; offset < frames; ){
+		long count = subblockSamples - subblockFill;
+		if (count > frames - offset)
+			count = frames - offset;
+		for (long c = 0; c < channels; c++)
+			addLoudness(c, samples + c * sampleStride + TRUE_PEAK_TAIL + offset, count);
+		offset += count;
+		subblockFill += count;
+		if (subblockFill == subblockSamples)
+			finishSubblock();
+	}
+
+	intervalSamples += frames;
+	if (intervalSamples >= publishSamples)
+		publishSnapshot();
+}
+
+void Analyzer::addLoudness(long channel, const float *src, long count){
+	double *z = kState + 4 * channel;
+	double energy = 0;
+	for (long n = 0; n < count; n++){
+		double y = biquad(kHighPass, z + 2, biquad(kShelf, z, src[n]));
+		energy += y * y;
+	}
+	// don't let silence decay into denormals
+	for (int i = 0; i < 4; i++)
+		if (fabs(z[i]) < 1e-30)
+			z[i] = 0;
+	kEnergy[channel] += energy;
+}
+
+void Analyzer::finishSubblock(){
+	double energy = 0;
+	for (size_t c = 0; c < sources.size(); c++){
+		energy += weights[c] * kEnergy[c];
+		kEnergy[c] = 0;
+	}
+	subblocks[subblockCount % LOUDNESS_SUBBLOCKS] = energy / subblockSamples;
+	subblockCount++;
+	subblockFill = 0;
+	if (subblockCount < 4)
+		return;
+	// every 400ms gating block, overlapping by 75%, goes into the histogram once
+	double block = 0;
+	for (long i = 1; i <= 4; i++)
+		block += subblocks[(subblockCount - i) % LOUDNESS_SUBBLOCKS];
+	block /= 4;
+	double level = loudness(block);
+	if (level < -70)
+		return;	// absolute gate
+	long bin = (long)((level + 70) * 10);
+	if (bin >= LOUDNESS_BINS)
+		bin = LOUDNESS_BINS - 1;
+	binCount[bin]++;
+	binEnergy[bin] += block;
+}
+
+double Analyzer::integratedLoudness(){
+	uint64_t count = 0;
+	double energy = 0;
+	for (long i = 0; i < LOUDNESS_BINS; i++){
+		count += binCount[i];
+		energy += binEnergy[i];
+	}
+	if (!count)
+		return -INFINITY;
+	// relative gate 10 LU below the absolute gated mean, to the resolution of the bins
+	double gate = loudness(energy / count) - 10;
+	long first = (long)ceil((gate + 70) * 10);
+	if (first < 0)
+		first = 0;
+	count = 0;
+	energy = 0;
+	for (long i = first; i < LOUDNESS_BINS; i++){
+		count += binCount[i];
+		energy += binEnergy[i];
+	}
+	return count ? loudness(energy / count) : -INFINITY;
+}
+
+void Analyzer::spectrum(long channel, float *out){
+	const float *window = fftHistory + channel * fftSize;
+	// oldest sample first, into bit reversed order for the in place radix 2 passes
+	for (long i = 0; i < fftSize; i++){
+		long r = bitReverse[i];
+		fftReal[r] = window[(fftPosition + i) & (fftSize - 1)] * fftWindow[i];
+		fftImag[r] = 0;
+	}
+	for (long size = 2; size <= fftSize; size <<= 1){
+		long half = size >> 1;
+		long step = fftSize / size;
+		for (long start = 0; start < fftSize; start += size){
+			for (long k = 0; k < half; k++){
+				float wr = twiddleCos[k * step], wi = twiddleSin[k * step];
+				long a = start + k, b = a + half;
+				float tr = fftReal[b] * wr - fftImag[b] * wi;
+				float ti = fftReal[b] * wi + fftImag[b] * wr;
+				fftReal[b] = fftReal[a] - tr;
+				fftImag[b] = fftImag[a] - ti;
+				fftReal[a] += tr;
+				fftImag[a] += ti;
+			}
+		}
+	}
+	for (long k = 0; k < fftSize / 2; k++)
+		out[k] = sqrtf(fftReal[k] * fftReal[k] + fftImag[k] * fftImag[k]);
+}
+
+void Analyzer::publishSnapshot(){
+	long channels = (long)sources.size();
+	long bins = fftSize / 2;
+	double momentary = 0, shortTerm = 0;
+	for (long i = 1; i <= LOUDNESS_SUBBLOCKS && i <= subblockCount; i++){
+		double energy = subblocks[(subblockCount - i) % LOUDNESS_SUBBLOCKS];
+		if (i <= 4)
+			momentary += energy;
+		shortTerm += energy;
+	}
+	uint64_t count = snapshots.load(std::memory_order_relaxed) + 1;
+	staging[0] = (float)count;
+	staging[1] = (float)channels;
+	staging[2] = (float)bins;
+	// only once a whole window has been measured
+	staging[3] = subblockCount >= 4 ? (float)loudness(momentary / 4) : -INFINITY;
+	staging[4] = subblockCount >= LOUDNESS_SUBBLOCKS ? (float)loudness(shortTerm / LOUDNESS_SUBBLOCKS) : -INFINITY;
+	staging[5] = (float)integratedLoudness();
+	staging[6] = (float)(sampleRate / fftSize);
+	staging[7] = (float)overruns.load(std::memory_order_relaxed);
+	float *meters = staging + ANALYSIS_HEADER;
+	for (long c = 0; c < channels; c++, meters += ANALYSIS_METERS){
+		meters[0] = peak[c];
+		meters[1] = truePeak[c];
+		meters[2] = (float)sqrt(squares[c] / intervalSamples);
+		peak[c] = truePeak[c] = 0;
+		squares[c] = 0;
+	}
+	for (long c = 0; c < channels; c++)
+		spectrum(c, staging + ANALYSIS_HEADER + channels * ANALYSIS_METERS + c * bins);
+	intervalSamples = 0;
+
+	// odd while the copy is in flight, read() retries across it
+	uint32_t sequence = snapshotSequence.load(std::memory_order_relaxed);
+	snapshotSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(snapshot, staging, snapshotFloats * sizeof(float));
+	snapshotSequence.store(sequence + 2, std::memory_order_release);
+	snapshots.store(count, std::memory_order_relaxed);
+	if (publish)
+		publish(publishArg);
+}
@@ -0,0 +1,140 @@
+#ifndef __Analyzer__
+#define __Analyzer__
+
+#include <uv.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "asiosys.h"
+#include "asio.h"
+#include "RingBuffer.h"
+
+// Meters and spectra of input channels, computed on their own thread instead of in JS.
+// The driver thread only copies its input halves into a ring, the analysis thread converts
+// them and keeps per channel peak, true peak (4x oversampled), RMS and a window for the FFT,
+// and EBU R128 loudness over all analyzed channels. A few times a second (rate, counted in
+// samples) it writes everything into one snapshot of floats, laid out like this:
+//   [0] sequence, [1] channels, [2] bins, [3] momentary, [4] short term, [5] integrated (LUFS),
+//   [6] hertz per bin, [7] blocks the ring had no room for
+//   then peak, true peak, rms (linear, since the previous snapshot) of every channel
+//   then bins magnitudes (linear, 1 is a full scale sine) of every channel
+// and calls the publish hook, JS copies it with read().
+
+#define ANALYSIS_HEADER 8
+#define ANALYSIS_METERS 3
+// 100ms blocks, momentary loudness covers 4 of them, short term 30
+#define LOUDNESS_SUBBLOCKS 30
+// integrated loudness gating keeps block energies in 0.1 LU bins from -70 to +30 LUFS
+#define LOUDNESS_BINS 1000
+// true peak interpolator, 4 phases of a 48 tap lowpass
+#define TRUE_PEAK_PHASES 4
+#define TRUE_PEAK_TAPS 12
+
+typedef void (*AnalyzerPublish)(void *arg);
+
+typedef struct AnalyzerOptions{
+	std::vector<int> channels;	// indices into the created input buffers
+	std::vector<double> weights;	// BS.1770 channel weights for loudness, 1 when missing
+	double rate;				// snapshots per second
+	long fftSize;				// power of two
+	double bufferSeconds;		// how far the analysis thread may fall behind
+}AnalyzerOptions;
+
+typedef struct AnalyzerStats{
+	bool running;
+	uint64_t snapshots;
+	uint64_t overruns;		// blocks the ring had no room for
+	long bufferBlocks;
+}AnalyzerStats;
+
+class Analyzer{
+public:
+	Analyzer();
+	~Analyzer();
+
+	// JS thread. publish gets called from the analysis thread after every snapshot.
+	// 0 on success, otherwise the negative codes in Analyzer.cpp
+	int open(const AnalyzerOptions &options, const ASIOSampleType *inputTypes, long inputs, long frames,
+		double sampleRate, AnalyzerPublish publish, void *publishArg);
+	void close();
+	void stats(AnalyzerStats *out);
+	// the ring the driver thread writes into, to lock it in memory
+	const BlockRing &blocks() const { return ring; }
+	// floats in a snapshot, 0 when closed
+	long snapshotLength() const { return snapshotFloats; }
+	// any thread, copies the latest consistent snapshot, false if the analysis thread kept overwriting it
+	bool read(float *dst);
+	// forgets the integrated loudness and starts measuring again
+	void resetLoudness() { loudnessReset.store(true, std::memory_order_release); }
+
+	// driver thread, halves has the current buffer of every input
+	void capture(void *const *halves);
+
+private:
+	static void analysisThread(void *arg);
+	void analyzeBlock(const char *block);
+	void addLoudness(long channel, const float *samples, long count);
+	void finishSubblock();
+	void publishSnapshot();
+	double integratedLoudness();
+	void spectrum(long channel, float *out);
+
+	std::vector<int> sources;
+	std::vector<ASIOSampleType> sourceTypes;
+	std::vector<double> weights;
+	long frames;
+	long channelBytes;
+	double sampleRate;
+	long publishSamples;		// samples between snapshots
+	AnalyzerPublish publish;
+	void *publishArg;
+
+	BlockRing ring;
+	long bufferBlocks;
+	char *memory;				// all the per channel state below lives in here
+
+	// analysis thread state
+	float *samples;				// one block of every channel as float, each behind the tail of the block before,
+								// the true peak interpolator looks back that far
+	long sampleStride;
+	float *peak;
+	float *truePeak;
+	double *squares;
+	double *kState;				// K-weighting filter state, 4 per channel
+	double *kEnergy;			// K-weighted sum of squares of the current 100ms block
+	float *fftHistory;			// last fftSize samples of every channel, circular
+	long fftPosition;
+	long fftSize;
+	float *fftWindow;
+	float *fftReal;
+	float *fftImag;
+	float *twiddleCos;
+	float *twiddleSin;
+	long *bitReverse;
+	float truePeakTaps[TRUE_PEAK_PHASES][TRUE_PEAK_TAPS];
+	double kShelf[5];			// b0 b1 b2 a1 a2
+	double kHighPass[5];
+	long subblockSamples;
+	long subblockFill;
+	double subblocks[LOUDNESS_SUBBLOCKS];	// mean square of the latest 100ms blocks, newest at subblockCount % N
+	long subblockCount;
+	uint64_t binCount[LOUDNESS_BINS];
+	double binEnergy[LOUDNESS_BINS];
+	long intervalSamples;		// since the last snapshot
+	float *staging;			// the next snapshot, built up outside the sequence
+
+	// snapshot, guarded by a sequence that is odd while it is being written
+	float *snapshot;
+	long snapshotFloats;
+	std::atomic<uint32_t> snapshotSequence;
+
+	uv_thread_t thread;
+	std::atomic<bool> running;
+	std::atomic<bool> busy;			// driver thread inside capture()
+	std::atomic<bool> threadRunning;
+	std::atomic<bool> loudnessReset;
+	std::atomic<uint64_t> snapshots;
+	std::atomic<uint64_t> overruns;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "AsioBackend.h"
+
+#if HAVE_HARDWARE_BACKEND
+#include "asiodrivers.h"
+
+// some external references
+extern AsioDrivers* asioDrivers;
+bool loadAsioDriver(char *name);
+
+static bool hardwareLoad(char *name){
+	return loadAsioDriver(name);
+}
+static void hardwareUnload(){
+	if (asioDrivers)
+		asioDrivers->removeCurrentDriver();
+}
+
+// straight through to the SDK, which talks to whatever driver loadAsioDriver() picked
+const AsioBackend hardwareBackend = {
+	"hardware",
+	hardwareLoad,
+	hardwareUnload,
+	ASIOInit,
+	ASIOExit,
+	ASIOStart,
+	ASIOStop,
+	ASIOGetChannels,
+	ASIOGetLatencies,
+	ASIOGetBufferSize,
+	ASIOCanSampleRate,
+	ASIOGetSampleRate,
+	ASIOSetSampleRate,
+	ASIOGetSamplePosition,
+	ASIOGetChannelInfo,
+	ASIOCreateBuffers,
+	ASIODisposeBuffers,
+	ASIOControlPanel,
+	ASIOOutputReady
+};
+#endif
@@ -0,0 +1,50 @@
+#ifndef __AsioBackend__
+#define __AsioBackend__
+
+#include <stdint.h>
+#include "asiosys.h"
+#include "asio.h"
+
+// The part of the ASIO host API Source.cpp uses, as a table so the same callback
+// pipeline can run against a real driver loaded through the SDK or against the
+// built-in virtual device (which needs no driver and also builds on Linux).
+typedef struct AsioBackend{
+	const char *name;
+	bool (*load)(char *driverName);
+	void (*unload)();
+	ASIOError (*init)(ASIODriverInfo *info);
+	ASIOError (*exit)();
+	ASIOError (*start)();
+	ASIOError (*stop)();
+	ASIOError (*getChannels)(long *numInputChannels, long *numOutputChannels);
+	ASIOError (*getLatencies)(long *inputLatency, long *outputLatency);
+	ASIOError (*getBufferSize)(long *minSize, long *maxSize, long *preferredSize, long *granularity);
+	ASIOError (*canSampleRate)(ASIOSampleRate sampleRate);
+	ASIOError (*getSampleRate)(ASIOSampleRate *currentRate);
+	ASIOError (*setSampleRate)(ASIOSampleRate sampleRate);
+	ASIOError (*getSamplePosition)(ASIOSamples *sPos, ASIOTimeStamp *tStamp);
+	ASIOError (*getChannelInfo)(ASIOChannelInfo *info);
+	ASIOError (*createBuffers)(ASIOBufferInfo *bufferInfos, long numChannels, long bufferSize, ASIOCallbacks *callbacks);
+	ASIOError (*disposeBuffers)();
+	ASIOError (*controlPanel)();
+	ASIOError (*outputReady)();
+}AsioBackend;
+
+// drivers installed on the machine, only where the SDK host code builds
+#if WINDOWS || MAC
+#define HAVE_HARDWARE_BACKEND 1
+extern const AsioBackend hardwareBackend;
+#else
+#define HAVE_HARDWARE_BACKEND 0
+#endif
+
+// ASIO keeps 64 bit values as a hi/lo pair unless the platform has native 64 bit ints
+#if NATIVE_INT64
+#define ASIO64toUInt64(a) ((uint64_t)(a))
+#define UInt64toASIO64(v, a) ((a) = (v))
+#else
+#define ASIO64toUInt64(a) (((uint64_t)(a).hi << 32) | (uint64_t)(a).lo)
+#define UInt64toASIO64(v, a) ((a).hi = (unsigned long)((uint64_t)(v) >> 32), (a).lo = (unsigned long)((v) & 0xffffffffu))
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+#include <string.h>
+#include <new>
+#include "BlockPool.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+static void yieldThread(){
+#if defined(_WIN32)
+	Sleep(0);
+#else
+	sched_yield();
+#endif
+}
+
+BlockPool::BlockPool() : memory(NULL), slotCount(0), slotBytes(0), references(NULL), reserved(0), cursor(0),
+	current(-1), busy(false), attachedCount(0)
+{
+	for (int i = 0; i < POOL_MAX_SUBSCRIBERS; i++){
+		Subscriber &s = subscribers[i];
+		s.attached = false;
+		s.dropSlow = false;
+		s.pending = s.mask = 0;
+		s.entries = NULL;
+		s.active = false;
+		s.dropped = false;
+		s.head = 0;
+		s.tail = 0;
+		s.delivered = 0;
+		s.lost = 0;
+	}
+}
+
+BlockPool::~BlockPool(){
+	release();
+}
+
+bool BlockPool::allocate(size_t slots, size_t bytes){
+	release();
+	slotBytes = alignUp(bytes);
+	memory = (char *)alignedAlloc(slots * slotBytes);
+	references = (std::atomic<int> *)alignedAlloc(alignUp(slots * sizeof(std::atomic<int>)));
+	if (!memory || !references){
+		release();
+		return false;
+	}
+	for (size_t i = 0; i < slots; i++)
+		new (&references[i]) std::atomic<int>(0);
+	slotCount = slots;
+	cursor = 0;
+	current = -1;
+	return true;
+}
+
+void BlockPool::release(){
+	for (int id = 0; id < POOL_MAX_SUBSCRIBERS; id++)
+		if (subscribers[id].attached)
+			detach(id);
+	if (memory)
+		alignedFree(memory);
+	if (references)
+		alignedFree(references);
+	memory = NULL;
+	references = NULL;
+	slotCount = slotBytes = 0;
+	reserved = 0;
+}
+
+int BlockPool::attach(size_t pending, bool dropSlow){
+	if (!pending)
+		pending = 1;
+	// it may hold its whole queue plus the one it is working on, and the driver one more
+	if (reserved + pending + 1 + 1 > slotCount)
+		return -1;
+	int id = 0;
+	while (id < POOL_MAX_SUBSCRIBERS && subscribers[id].attached)
+		id++;
+	if (id == POOL_MAX_SUBSCRIBERS)
+		return -2;
+	Subscriber &s = subscribers[id];
+	size_t n = 1;
+	while (n < pending)
+		n <<= 1;
+	s.entries = (uint32_t *)alignedAlloc(alignUp(n * sizeof(uint32_t)));
+	if (!s.entries)
+		return -1;
+	s.pending = pending;
+	s.mask = n - 1;
+	s.dropSlow = dropSlow;
+	s.head.store(0, std::memory_order_relaxed);
+	s.tail.store(0, std::memory_order_relaxed);
+	s.delivered.store(0, std::memory_order_relaxed);
+	s.lost.store(0, std::memory_order_relaxed);
+	s.dropped.store(false, std::memory_order_relaxed);
+	s.attached = true;
+	reserved += pending + 1;
+	attachedCount.fetch_add(1);
+	// everything above is visible to the driver thread once it sees this
+	s.active.store(true, std::memory_order_release);
+	return id;
+}
+
+void BlockPool::detach(int id){
+	if (!attached(id))
+		return;
+	Subscriber &s = subscribers[id];
+	// after this loop the driver thread is either out of publish() or sees active false
+	s.active.store(false);
+	while (busy.load())
+		yieldThread();
+	long slot;
+	while ((slot = take(id)) >= 0)
+		release(slot);
+	alignedFree(s.entries);
+	s.entries = NULL;
+	s.attached = false;
+	reserved -= s.pending + 1;
+	attachedCount.fetch_sub(1);
+}
+
+void BlockPool::stats(int id, PoolSubscriberStats *out){
+	Subscriber &s = subscribers[id];
+	out->attached = s.attached;
+	out->dropped = s.dropped.load(std::memory_order_relaxed);
+	out->delivered = s.delivered.load(std::memory_order_relaxed);
+	out->lost = s.lost.load(std::memory_order_relaxed);
+	out->pending = s.attached ? (long)(s.head.load(std::memory_order_relaxed) - s.tail.load(std::memory_order_relaxed)) : 0;
+}
+
+char *BlockPool::acquire(){
+	if (current >= 0)
+		return slot(current);
+	for (size_t i = 0; i < slotCount; i++){
+		size_t n = cursor + i < slotCount ? cursor + i : cursor + i - slotCount;
+		// acquire pairs with release(), whoever read the slot last is done with it
+		if (references[n].load(std::memory_order_acquire) == 0){
+			// the driver's own reference, dropped again at the end of publish()
+			references[n].store(1, std::memory_order_relaxed);
+			cursor = n + 1 < slotCount ? n + 1 : 0;
+			current = (long)n;
+			return slot(n);
+		}
+	}
+	return NULL;
+}
+
+bool BlockPool::hasRoom(int id) const{
+	const Subscriber &s = subscribers[id];
+	return s.head.load(std::memory_order_relaxed) - s.tail.load(std::memory_order_acquire) < s.pending;
+}
+
+void BlockPool::publish(){
+	if (current < 0)
+		return;
+	busy.store(true);
+	for (int id = 0; id < POOL_MAX_SUBSCRIBERS; id++){
+		Subscriber &s = subscribers[id];
+		if (!s.active.load() || s.dropped.load(std::memory_order_relaxed))
+			continue;
+		if (!hasRoom(id)){
+			s.lost.fetch_add(1, std::memory_order_relaxed);
+			// rather than let it sit on slots everybody else needs
+			if (s.dropSlow)
+				s.dropped.store(true, std::memory_order_release);
+			continue;
+		}
+		references[current].fetch_add(1, std::memory_order_relaxed);
+		size_t h = s.head.load(std::memory_order_relaxed);
+		s.entries[h & s.mask] = (uint32_t)current;
+		s.head.store(h + 1, std::memory_order_release);
+		s.delivered.fetch_add(1, std::memory_order_relaxed);
+	}
+	busy.store(false, std::memory_order_release);
+	release(current);
+	current = -1;
+}
+
+bool BlockPool::idle() const{
+	for (size_t n = 0; n < slotCount; n++){
+		if ((long)n != current && references[n].load(std::memory_order_acquire) != 0)
+			return false;
+	}
+	return true;
+}
+
+long BlockPool::take(int id){
+	Subscriber &s = subscribers[id];
+	size_t t = s.tail.load(std::memory_order_relaxed);
+	if (t == s.head.load(std::memory_order_acquire))
+		return -1;
+	long slot = s.entries[t & s.mask];
+	s.tail.store(t + 1, std::memory_order_release);
+	return slot;
+}
@@ -0,0 +1,96 @@
+#ifndef __BlockPool__
+#define __BlockPool__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "RingBuffer.h"
+
+// Fixed pool of reference counted blocks, filled once by the driver thread and read in
+// place by any number of subscribers. Every subscriber has its own single producer /
+// single consumer queue of slot numbers, publish() pushes the filled slot into all of
+// them and counts one reference per queue it went into. A subscriber takes slots out of
+// its queue on whatever thread it runs on and releases them when done, the slot is
+// reused once nobody holds it anymore.
+// A subscriber whose queue is full either just misses the block (the start() callback,
+// which counts it as dropped) or, with dropSlow, is cut off for good so it can't hold
+// slots the others need. attach() only hands out as much queue as the pool has slots
+// for, so the driver thread always finds a free one while everybody keeps up.
+
+#define POOL_MAX_SUBSCRIBERS 32
+
+typedef struct PoolSubscriberStats{
+	bool attached;
+	bool dropped;		// cut off for falling behind
+	uint64_t delivered;
+	uint64_t lost;		// blocks its queue had no room for
+	long pending;		// blocks waiting in its queue right now
+}PoolSubscriberStats;
+
+class BlockPool{
+public:
+	BlockPool();
+	~BlockPool();
+
+	// JS thread, only while the driver thread isn't publishing. Detaches everybody
+	bool allocate(size_t slots, size_t bytes);
+	void release();
+	size_t capacity() const { return slotCount; }
+	size_t blockBytes() const { return slotBytes; }
+	char *slot(size_t i) const { return memory + i * slotBytes; }
+
+	// control thread. the queue holds up to pending blocks, id on success, -1 when the pool can't
+	// spare that many slots, -2 when every subscriber is taken
+	int attach(size_t pending, bool dropSlow);
+	// the subscriber's own thread (or once it stopped taking), waits for the driver thread to let go
+	// and releases whatever was still queued for it
+	void detach(int id);
+	// attached subscribers, the driver thread skips filling slots without any
+	int subscriberCount() const { return attachedCount.load(std::memory_order_acquire); }
+	bool attached(int id) const { return id >= 0 && id < POOL_MAX_SUBSCRIBERS && subscribers[id].attached; }
+	bool dropped(int id) const { return subscribers[id].dropped.load(std::memory_order_acquire); }
+	void stats(int id, PoolSubscriberStats *out);
+
+	// driver thread. acquire() hands out a free slot (NULL when there is none) that stays the
+	// driver's until publish() passes it on, hasRoom() tells whether a subscriber would get it
+	char *acquire();
+	bool hasRoom(int id) const;
+	void publish();
+	// true once everybody let go of every slot published so far
+	bool idle() const;
+
+	// subscriber side: the next slot for it or -1, it holds a reference until release()
+	long take(int id);
+	void release(long slot) { references[slot].fetch_sub(1, std::memory_order_release); }
+
+private:
+	BlockPool(const BlockPool &);
+	BlockPool &operator=(const BlockPool &);
+
+	typedef struct Subscriber{
+		bool attached;				// control thread only
+		bool dropSlow;
+		size_t pending;				// queue limit
+		size_t mask;
+		uint32_t *entries;
+		std::atomic<bool> active;	// the driver thread delivers to it
+		std::atomic<bool> dropped;
+		std::atomic<size_t> head;	// written by the driver thread
+		std::atomic<size_t> tail;	// written by the subscriber
+		std::atomic<uint64_t> delivered;
+		std::atomic<uint64_t> lost;
+	}Subscriber;
+
+	char *memory;
+	size_t slotCount;
+	size_t slotBytes;
+	std::atomic<int> *references;
+	size_t reserved;		// slots promised to attached subscribers
+	size_t cursor;			// where acquire() looks first
+	long current;			// slot acquired and not yet published
+	std::atomic<bool> busy;	// driver thread inside publish()
+	std::atomic<int> attachedCount;
+	Subscriber subscribers[POOL_MAX_SUBSCRIBERS];
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include <string.h>
+#include <math.h>
+#include "Bridge.h"
+#include "RingBuffer.h"
+#include "Stats.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// the rate estimates slide over this many seconds and say nothing before RATE_MIN_SECONDS
+#define RATE_WINDOW_SECONDS 60.
+#define RATE_MIN_SECONDS 2.
+// the fill level is smoothed over about a second, network jitter shouldn't move the ratio
+#define FILL_SMOOTHING_SECONDS 1.
+// an error as big as the target is worked off in about this long
+#define PULL_SECONDS 10.
+// the integral takes over from the proportional part this much slower
+#define INTEGRAL_SECONDS 30.
+// the most the ratio moves away from the measured one, the resampler allows 5%
+#define MAX_CORRECTION 0.005
+#define BRIDGE_MAX_CHANNELS 256
+
+static void sleepMillis(int ms){
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void rateReset(RateEstimate *e){
+	e->anchored = e->hasNext = false;
+	e->frames0 = e->time0 = e->frames1 = e->time1 = 0;
+	e->rate = 0;
+}
+
+static void rateUpdate(RateEstimate *e, double frames, double nanos){
+	double elapsed = nanos - e->time0;
+	// a clock or position going backwards is a restart, not a rate
+	if (!e->anchored || elapsed <= 0 || frames < e->frames0){
+		e->anchored = true;
+		e->hasNext = false;
+		e->frames0 = frames;
+		e->time0 = nanos;
+		return;
+	}
+	if (elapsed >= RATE_MIN_SECONDS * 1e9)
+		e->rate = (frames - e->frames0) / elapsed * 1e9;
+	// halfway through the window the next anchor gets picked, at its end it takes over
+	if (!e->hasNext && elapsed >= RATE_WINDOW_SECONDS * 0.5e9){
+		e->hasNext = true;
+		e->frames1 = frames;
+		e->time1 = nanos;
+	}
+	if (e->hasNext && elapsed >= RATE_WINDOW_SECONDS * 1e9){
+		e->frames0 = e->frames1;
+		e->time0 = e->time1;
+		e->hasNext = false;
+	}
+}
+
+static double clampRatio(double value, double around, double range){
+	if (value > around * (1. + range))
+		return around * (1. + range);
+	if (value < around * (1. - range))
+		return around * (1. - range);
+	return value;
+}
+
+Bridge::Bridge() : numOutputs(0), frames(0), stride(0), deviceNominal(0), streamNominal(0), target(0), memory(NULL),
+	memoryBytes(0), fifo(NULL), capacity(0), mask(0), outputs(NULL), streamOut(NULL), running(false), filtered(0),
+	integral(0), deviceFrames(0), isOpen(false), busy(false), head(0), tail(0), restartStream(false), isRunning(false),
+	fillFrames(0), deviceRate(0), streamRate(0), ratio(1.), framesWritten(0), framesDropped(0), underruns(0)
+{
+	options.channels = 0;
+	options.sampleRate = options.latencyMs = options.bufferSeconds = 0;
+	rateReset(&device);
+	rateReset(&stream);
+}
+
+Bridge::~Bridge(){
+	close();
+}
+
+// -1 already open, -2 bad channels or outputs, -3 bad rate or latency, -4 out of memory
+int Bridge::open(const BridgeOptions &bridgeOptions, long numOut, long blockFrames, double rate){
+	if (memory)
+		return -1;
+	options = bridgeOptions;
+	if (options.channels <= 0 || options.channels > BRIDGE_MAX_CHANNELS)
+		return -2;
+	// stream channel i plays on output i unless told otherwise
+	if (options.outputs.empty())
+		for (int c = 0; c < options.channels; c++)
+			options.outputs.push_back(c < numOut ? c : -1);
+	options.outputs.resize(options.channels, -1);
+	for (int c = 0; c < options.channels; c++)
+		if (options.outputs[c] >= numOut)
+			return -2;
+	deviceNominal = rate;
+	streamNominal = options.sampleRate > 0 ? options.sampleRate : rate;
+	if (deviceNominal <= 0 || options.latencyMs <= 0 || options.bufferSeconds <= 0)
+		return -3;
+	target = options.latencyMs / 1000. * streamNominal;
+	double nominalRatio = streamNominal / deviceNominal;
+	numOutputs = numOut;
+	frames = blockFrames;
+	stride = (long)(alignUp(frames * sizeof(float)) / sizeof(float));
+
+	// the target, a few blocks of slack and whatever else was asked for
+	uint64_t wanted = (uint64_t)(options.bufferSeconds * streamNominal);
+	if (wanted < (uint64_t)(2 * target + 4 * frames * nominalRatio))
+		wanted = (uint64_t)(2 * target + 4 * frames * nominalRatio);
+	capacity = 1;
+	while (capacity < wanted)
+		capacity <<= 1;
+	mask = capacity - 1;
+	size_t fifoBytes = alignUp((size_t)capacity * options.channels * sizeof(float));
+	size_t outputBytes = (numOutputs ? numOutputs : 1) * stride * sizeof(float);
+	memoryBytes = fifoBytes + outputBytes + options.channels * stride * sizeof(float);
+	memory = (char *)alignedAlloc(memoryBytes);
+	if (!memory || !resampler.allocate(options.channels, nominalRatio, frames, RESAMPLER_SHORT_TAPS)){
+		close();
+		return -4;
+	}
+	memset(memory, 0, memoryBytes);
+	fifo = (float *)memory;
+	outputs = (float *)(memory + fifoBytes);
+	streamOut = (float *)(memory + fifoBytes + outputBytes);
+	outputUsed.assign(numOutputs, false);
+	for (int c = 0; c < options.channels; c++)
+		if (options.outputs[c] >= 0)
+			outputUsed[options.outputs[c]] = true;
+
+	running = false;
+	filtered = 0;
+	integral = 0;
+	deviceFrames = 0;
+	rateReset(&device);
+	rateReset(&stream);
+	head = 0;
+	tail = 0;
+	restartStream = false;
+	isRunning = false;
+	fillFrames = 0;
+	deviceRate = 0;
+	streamRate = 0;
+	ratio = nominalRatio;
+	framesWritten = 0;
+	framesDropped = 0;
+	underruns = 0;
+	isOpen.store(true);
+	return 0;
+}
+
+void Bridge::close(){
+	// after this loop the driver thread is either out of process() or sees isOpen false
+	isOpen.store(false);
+	while (busy.load())
+		sleepMillis(0);
+	resampler.release();
+	if (memory)
+		alignedFree(memory);
+	memory = NULL;
+	memoryBytes = 0;
+	fifo = outputs = streamOut = NULL;
+	capacity = mask = 0;
+	isRunning = false;
+}
+
+long Bridge::write(const void *src, ToFloatKernel convert, long bytes, long count, double nanos){
+	if (!memory || count <= 0)
+		return 0;
+	uint64_t h = head.load(std::memory_order_relaxed);
+	uint64_t room = capacity - (h - tail.load(std::memory_order_acquire));
+	long n = count < (long)room ? count : (long)room;
+	const char *from = (const char *)src;
+	long channels = options.channels;
+	// at most two pieces, up to the end of the FIFO and from its start
+	long done = 0;
+	while (done < n){
+		uint64_t at = (h + done) & mask;
+		long piece = n - done;
+		if ((uint64_t)piece > capacity - at)
+			piece = (long)(capacity - at);
+		float *dst = fifo + at * channels;
+		if (convert)
+			convert(from + done * channels * bytes, dst, piece * channels);
+		else
+			memcpy(dst, from + done * channels * bytes, piece * channels * sizeof(float));
+		done += piece;
+	}
+	head.store(h + n, std::memory_order_release);
+	framesWritten.fetch_add(n, std::memory_order_relaxed);
+	if (n < count)
+		framesDropped.fetch_add(count - n, std::memory_order_relaxed);
+
+	// everything that arrived counts for the stream's rate, dropped or not
+	if (restartStream.exchange(false))
+		rateReset(&stream);
+	uint64_t total = framesWritten.load(std::memory_order_relaxed) + framesDropped.load(std::memory_order_relaxed);
+	rateUpdate(&stream, (double)total, nanos);
+	streamRate.store(stream.rate, std::memory_order_relaxed);
+	return n;
+}
+
+void Bridge::stats(BridgeStats *out){
+	out->open = isOpen.load(std::memory_order_relaxed);
+	out->running = isRunning.load(std::memory_order_relaxed);
+	double perMs = streamNominal > 0 ? streamNominal / 1000. : 1.;
+	out->fill = fillFrames.load(std::memory_order_relaxed) / perMs;
+	out->target = target / perMs;
+	out->latency = out->open ? (target + resampler.latency()) / perMs : 0;
+	out->deviceRate = deviceRate.load(std::memory_order_relaxed);
+	out->devicePpm = out->deviceRate > 0 ? (out->deviceRate / deviceNominal - 1.) * 1e6 : 0;
+	out->streamRate = streamRate.load(std::memory_order_relaxed);
+	out->streamPpm = out->streamRate > 0 ? (out->streamRate / streamNominal - 1.) * 1e6 : 0;
+	out->ratio = ratio.load(std::memory_order_relaxed);
+	out->driftPpm = out->open ? (out->ratio / (streamNominal / deviceNominal) - 1.) * 1e6 : 0;
+	out->framesWritten = framesWritten.load(std::memory_order_relaxed);
+	out->framesDropped = framesDropped.load(std::memory_order_relaxed);
+	out->underruns = underruns.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------------
+// driver thread
+
+// moves count frames out of the FIFO into the resampler, one channel each
+void Bridge::pull(long count){
+	uint64_t t = tail.load(std::memory_order_relaxed);
+	long channels = options.channels;
+	for (long c = 0; c < channels; c++){
+		float *dst = resampler.input(c);
+		for (long i = 0; i < count; i++)
+			dst[i] = fifo[((t + i) & mask) * channels + c];
+	}
+	resampler.commit(count);
+	tail.store(t + count, std::memory_order_release);
+}
+
+bool Bridge::process(double samplePosition, double systemNanos){
+	busy.store(true);
+	if (!isOpen.load()){
+		busy.store(false);
+		return false;
+	}
+	// the device clock, from the driver's own time stamps when it has them
+	deviceFrames += frames;
+	if (systemNanos > 0)
+		rateUpdate(&device, samplePosition, systemNanos);
+	else
+		rateUpdate(&device, deviceFrames, (double)monotonicNanos());
+	deviceRate.store(device.rate, std::memory_order_relaxed);
+
+	uint64_t available = head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+	double fill = available + resampler.buffered();
+	double blockSeconds = frames / deviceNominal;
+	if (!running){
+		// buffering up to the target before anything plays
+		fillFrames.store(fill, std::memory_order_relaxed);
+		if (fill < target){
+			busy.store(false, std::memory_order_release);
+			return false;
+		}
+		running = true;
+		filtered = fill;
+		isRunning.store(true, std::memory_order_relaxed);
+	}
+
+	// where the two clocks say the ratio is, trimmed by how far the fill is off the target
+	double nominalRatio = streamNominal / deviceNominal;
+	double measured = nominalRatio;
+	double streamMeasured = streamRate.load(std::memory_order_relaxed);
+	if (device.rate > 0 && streamMeasured > 0)
+		measured = clampRatio(streamMeasured / device.rate, nominalRatio, MAX_CORRECTION);
+	filtered += (fill - filtered) * (blockSeconds / FILL_SMOOTHING_SECONDS < 1. ? blockSeconds / FILL_SMOOTHING_SECONDS : 1.);
+	double error = (filtered - target) / target;
+	double gain = target / streamNominal / PULL_SECONDS;
+	integral += gain * error * blockSeconds / INTEGRAL_SECONDS;
+	if (integral > MAX_CORRECTION)
+		integral = MAX_CORRECTION;
+	else if (integral < -MAX_CORRECTION)
+		integral = -MAX_CORRECTION;
+	double correction = gain * error + integral;
+	double applied = clampRatio(measured * (1. + correction), nominalRatio, 2 * MAX_CORRECTION);
+	resampler.setRatio(applied);
+	ratio.store(applied, std::memory_order_relaxed);
+	fillFrames.store(filtered, std::memory_order_relaxed);
+
+	long need = resampler.required(frames);
+	if ((uint64_t)need > available){
+		// ran dry: silence, and back to buffering up to the target
+		underruns.fetch_add(1, std::memory_order_relaxed);
+		running = false;
+		isRunning.store(false, std::memory_order_relaxed);
+		resampler.reset();
+		integral = 0;
+		restartStream.store(true);
+		busy.store(false, std::memory_order_release);
+		return false;
+	}
+	pull(need);
+	float *planes[BRIDGE_MAX_CHANNELS];
+	long channels = options.channels;
+	for (long c = 0; c < channels; c++)
+		planes[c] = streamOut + c * stride;
+	resampler.process(planes, frames);
+
+	for (long o = 0; o < numOutputs; o++)
+		if (outputUsed[o])
+			memset(outputs + o * stride, 0, frames * sizeof(float));
+	for (long c = 0; c < channels; c++){
+		if (options.outputs[c] < 0)
+			continue;
+		const float *x = planes[c];
+		float *y = outputs + options.outputs[c] * stride;
+		for (long n = 0; n < frames; n++)
+			y[n] += x[n];
+	}
+	busy.store(false, std::memory_order_release);
+	return true;
+}
@@ -0,0 +1,128 @@
+#ifndef __Bridge__
+#define __Bridge__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "SampleConvert.h"
+#include "Resampler.h"
+
+// Plays a stream with its own clock (network audio, another device) into output channels.
+// JS writes interleaved frames into a FIFO whenever they arrive, the driver thread pulls one
+// block per callback through a variable ratio resampler. Both clocks get measured against
+// the system clock, the device's from the sample position / system time pairs of every
+// callback, the stream's from what arrives when; their ratio is where the resampler starts,
+// and a slow PI loop on the FIFO fill level trims it so the latency stays at the target.
+// In steady state nothing is dropped or repeated, the ratio just follows the drift. When
+// the FIFO runs dry the outputs get silence and the bridge buffers up to the target again.
+
+typedef struct BridgeOptions{
+	int channels;				// in the stream
+	std::vector<int> outputs;	// output for every stream channel, -1 leaves it out
+	double sampleRate;			// the stream's nominal rate, 0 for the device's
+	double latencyMs;			// fill level to hold
+	double bufferSeconds;		// FIFO capacity
+}BridgeOptions;
+
+typedef struct BridgeStats{
+	bool open;
+	bool running;				// false while buffering up to the target
+	double fill;				// ms buffered, FIFO and resampler, smoothed
+	double target;				// ms
+	double latency;				// ms from write() to the output, target plus the filter
+	double deviceRate;			// measured, Hz
+	double devicePpm;			// against its nominal rate
+	double streamRate;
+	double streamPpm;
+	double driftPpm;			// the ratio being applied against the nominal one
+	double ratio;				// stream frames per device frame
+	uint64_t framesWritten;
+	uint64_t framesDropped;		// write() had no room for them
+	uint64_t underruns;			// blocks the FIFO ran dry in
+}BridgeStats;
+
+// frames counted against the system clock, over a window that grows to a minute and then
+// slides. Any thread, but only one at a time
+typedef struct RateEstimate{
+	bool anchored;
+	double frames0;
+	double time0;
+	bool hasNext;
+	double frames1;
+	double time1;
+	double rate;
+}RateEstimate;
+
+class Bridge{
+public:
+	Bridge();
+	~Bridge();
+
+	// JS thread. 0 on success, otherwise the negative codes in Bridge.cpp
+	int open(const BridgeOptions &options, long outputs, long frames, double deviceRate);
+	void close();
+	// one writer at a time. frames of interleaved samples bytes wide each, convert turns them
+	// into float (NULL when they are float already), nanos is when they arrived on
+	// monotonicNanos()'s clock; returns the frames that fit
+	long write(const void *src, ToFloatKernel convert, long bytes, long frames, double nanos);
+	void stats(BridgeStats *out);
+	int channels() const { return options.channels; }
+	// the FIFO and the output buffers, to lock them in memory
+	void *buffer() const { return memory; }
+	size_t bufferBytes() const { return memoryBytes; }
+
+	// driver thread, samplePosition and systemNanos as the driver reported them (0 when it didn't),
+	// false when there is nothing to mix in
+	bool process(double samplePosition, double systemNanos);
+	// only valid after process() returned true, NULL for outputs the stream doesn't play on
+	const float *output(long o) const { return outputUsed[o] ? outputs + o * stride : NULL; }
+
+private:
+	Bridge(const Bridge &);
+	Bridge &operator=(const Bridge &);
+	void pull(long count);
+
+	BridgeOptions options;
+	long numOutputs;
+	long frames;
+	long stride;
+	double deviceNominal;
+	double streamNominal;
+	double target;				// stream frames
+
+	char *memory;
+	size_t memoryBytes;
+	float *fifo;				// interleaved, capacity frames
+	uint64_t capacity;
+	uint64_t mask;
+	float *outputs;
+	float *streamOut;			// resampled stream channels, before they go to their outputs
+	std::vector<bool> outputUsed;
+	Resampler resampler;
+
+	// driver thread state
+	bool running;
+	double filtered;			// fill level, stream frames
+	double integral;
+	double deviceFrames;		// when the driver gives no sample position
+	RateEstimate device;
+
+	// writer state
+	RateEstimate stream;
+
+	std::atomic<bool> isOpen;
+	std::atomic<bool> busy;		// driver thread inside process()
+	std::atomic<uint64_t> head;	// frames written
+	std::atomic<uint64_t> tail;	// frames read
+	std::atomic<bool> restartStream;	// the stream estimate starts over after an underrun
+	std::atomic<bool> isRunning;
+	std::atomic<double> fillFrames;
+	std::atomic<double> deviceRate;
+	std::atomic<double> streamRate;
+	std::atomic<double> ratio;
+	std::atomic<uint64_t> framesWritten;
+	std::atomic<uint64_t> framesDropped;
+	std::atomic<uint64_t> underruns;
+};
+
+#endif
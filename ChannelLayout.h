@@ -0,0 +1,72 @@
+#ifndef __ChannelLayout__
+#define __ChannelLayout__
+
+#include <string.h>
+#include "asiosys.h"
+#include "asio.h"
+#include "RingBuffer.h"
+#include "SampleConvert.h"
+
+// Per channel state of one direction as a structure of arrays, sized for however many
+// channels the driver created. The per block loops walk one array at a time instead of
+// striding over ASIOBufferInfo/ASIOChannelInfo, and every array starts on its own
+// cache line so inputs and outputs never share one.
+class ChannelSet{
+public:
+	ChannelSet() : count(0), type(NULL), nativeBytes(NULL), blockBytes(NULL), slotBytes(NULL), slotOffset(NULL),
+		toFloat(NULL), fromFloat(NULL), memory(NULL) { half[0] = half[1] = NULL; }
+	~ChannelSet() { release(); }
+
+	bool allocate(long channels){
+		release();
+		size_t n = channels > 0 ? channels : 1;
+		size_t pointers = alignUp(n * sizeof(void *));
+		size_t longs = alignUp(n * sizeof(long));
+		size_t bytes = 2 * pointers + alignUp(n * sizeof(ASIOSampleType)) + 4 * longs
+			+ alignUp(n * sizeof(ToFloatKernel)) + alignUp(n * sizeof(FromFloatKernel));
+		memory = (char *)alignedAlloc(bytes);
+		if (!memory)
+			return false;
+		memset(memory, 0, bytes);
+		char *p = memory;
+		half[0] = (void **)p; p += pointers;
+		half[1] = (void **)p; p += pointers;
+		type = (ASIOSampleType *)p; p += alignUp(n * sizeof(ASIOSampleType));
+		nativeBytes = (long *)p; p += longs;
+		blockBytes = (long *)p; p += longs;
+		slotBytes = (long *)p; p += longs;
+		slotOffset = (long *)p; p += longs;
+		toFloat = (ToFloatKernel *)p; p += alignUp(n * sizeof(ToFloatKernel));
+		fromFloat = (FromFloatKernel *)p;
+		count = channels;
+		return true;
+	}
+	void release(){
+		if (memory)
+			alignedFree(memory);
+		memory = NULL;
+		half[0] = half[1] = NULL;
+		type = NULL;
+		nativeBytes = blockBytes = slotBytes = slotOffset = NULL;
+		toFloat = NULL;
+		fromFloat = NULL;
+		count = 0;
+	}
+
+	long count;
+	void **half[2];				// the driver's buffer of every channel, for buffer index 0 and 1
+	ASIOSampleType *type;
+	long *nativeBytes;			// one block in the driver's format
+	long *blockBytes;			// one driver block the way JS sees it
+	long *slotBytes;			// what a ring slot holds, one or more driver blocks of it
+	long *slotOffset;			// where it starts within the slot
+	ToFloatKernel *toFloat;		// picked once per channel, NULL for types we can't convert
+	FromFloatKernel *fromFloat;
+
+private:
+	ChannelSet(const ChannelSet &);
+	ChannelSet &operator=(const ChannelSet &);
+	char *memory;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <uv.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include "DeviceProbe.h"
+#include "AsioBackend.h"
+#include "VirtualDevice.h"
+#if WINDOWS
+#include <windows.h>
+#include <objbase.h>
+#endif
+#if HAVE_HARDWARE_BACKEND
+#include "asiodrivers.h"
+extern AsioDrivers* asioDrivers;
+#endif
+
+// the SDK hands out names in 32 byte arrays
+#define DRIVER_NAME_BYTES 32
+#define MAX_DRIVERS 64
+
+// asked for one by one with canSampleRate()
+static const double commonRates[] = {
+	8000., 11025., 16000., 22050., 32000., 44100., 48000., 88200., 96000., 176400., 192000., 352800., 384000.
+};
+
+static uv_mutex_t driverMutex;
+static std::string loadedDriver;	// empty while nothing is loaded
+static uv_mutex_t cacheMutex;
+static std::map<std::string, DriverCapabilities> cache;
+
+void initDeviceProbe(){
+	uv_mutex_init(&driverMutex);
+	uv_mutex_init(&cacheMutex);
+}
+
+void lockDrivers(){
+	uv_mutex_lock(&driverMutex);
+}
+void unlockDrivers(){
+	uv_mutex_unlock(&driverMutex);
+}
+void driverLoaded(const std::string &name){
+	loadedDriver = name;
+}
+void driverUnloaded(){
+	loadedDriver.clear();
+}
+
+std::vector<std::string> driverNames(){
+	std::vector<std::string> names;
+	names.push_back(VIRTUAL_DRIVER_NAME);
+#if HAVE_HARDWARE_BACKEND
+	DriverLock lock;
+	// one list for the whole process, the same one loadAsioDriver() uses
+	if (!asioDrivers)
+		asioDrivers = new AsioDrivers();
+	char storage[MAX_DRIVERS][DRIVER_NAME_BYTES];
+	char *pointers[MAX_DRIVERS];
+	for (int i = 0; i < MAX_DRIVERS; i++){
+		storage[i][0] = 0;
+		pointers[i] = storage[i];
+	}
+	long count = asioDrivers->getDriverNames(pointers, MAX_DRIVERS);
+	for (long i = 0; i < count && i < MAX_DRIVERS; i++){
+		storage[i][DRIVER_NAME_BYTES - 1] = 0;
+		names.push_back(storage[i]);
+	}
+#endif
+	return names;
+}
+
+static void readChannels(const AsioBackend *backend, bool input, long count, std::vector<ChannelCapabilities> *out){
+	out->clear();
+	for (long c = 0; c < count; c++){
+		ASIOChannelInfo info;
+		memset(&info, 0, sizeof(info));
+		info.channel = c;
+		info.isInput = input ? ASIOTrue : ASIOFalse;
+		ChannelCapabilities channel;
+		channel.type = -1;
+		channel.group = 0;
+		if (backend->getChannelInfo(&info) == ASE_OK){
+			info.name[sizeof(info.name) - 1] = 0;
+			channel.name = info.name;
+			channel.type = info.type;
+			channel.group = info.channelGroup;
+		}
+		out->push_back(channel);
+	}
+}
+
+// with the driver lock held and nothing loaded
+static int probeLocked(const AsioBackend *backend, const std::string &name, DriverCapabilities *out){
+	std::vector<char> driverName(name.begin(), name.end());
+	driverName.push_back(0);
+	if (!backend->load(&driverName[0]))
+		return kProbeNotFound;
+	ASIODriverInfo driverInfo;
+	memset(&driverInfo, 0, sizeof(driverInfo));
+	driverInfo.asioVersion = 2;
+	if (backend->init(&driverInfo) != ASE_OK){
+		driverInfo.errorMessage[sizeof(driverInfo.errorMessage) - 1] = 0;
+		out->message = driverInfo.errorMessage;
+		backend->unload();
+		return kProbeInitFailed;
+	}
+	out->asioVersion = driverInfo.asioVersion;
+	out->driverVersion = driverInfo.driverVersion;
+	if (backend->getChannels(&out->inputs, &out->outputs) != ASE_OK)
+		out->inputs = out->outputs = 0;
+	if (backend->getBufferSize(&out->minSize, &out->maxSize, &out->preferredSize, &out->granularity) != ASE_OK)
+		out->minSize = out->maxSize = out->preferredSize = out->granularity = 0;
+	ASIOSampleRate rate = 0;
+	out->sampleRate = backend->getSampleRate(&rate) == ASE_OK ? rate : 0;
+	for (size_t i = 0; i < sizeof(commonRates) / sizeof(commonRates[0]); i++)
+		if (backend->canSampleRate(commonRates[i]) == ASE_OK)
+			out->sampleRates.push_back(commonRates[i]);
+	if (backend->getLatencies(&out->inputLatency, &out->outputLatency) != ASE_OK)
+		out->inputLatency = out->outputLatency = 0;
+	readChannels(backend, true, out->inputs, &out->inputChannels);
+	readChannels(backend, false, out->outputs, &out->outputChannels);
+	backend->exit();
+	backend->unload();
+	return kProbeOk;
+}
+
+int probeDriver(const std::string &name, DriverCapabilities *out){
+	*out = DriverCapabilities();
+	out->name = name;
+	out->asioVersion = out->driverVersion = 0;
+	out->inputs = out->outputs = 0;
+	out->minSize = out->maxSize = out->preferredSize = out->granularity = 0;
+	out->sampleRate = 0;
+	out->inputLatency = out->outputLatency = 0;
+	out->probedAt = (double)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	const AsioBackend *backend = NULL;
+	if (name == VIRTUAL_DRIVER_NAME)
+		backend = &virtualBackend;
+#if HAVE_HARDWARE_BACKEND
+	else
+		backend = &hardwareBackend;
+#endif
+	if (!backend){
+		out->error = kProbeUnsupported;
+		return out->error;
+	}
+	{
+		DriverLock lock;
+		// the virtual device and the SDK each hold one driver, they don't get in each other's way
+		bool virtualLoaded = loadedDriver == VIRTUAL_DRIVER_NAME;
+		if (!loadedDriver.empty() && virtualLoaded == (backend == &virtualBackend))
+			out->error = kProbeBusy;
+		else{
+#if WINDOWS
+			// drivers are COM objects, this is a pool thread that never set COM up
+			HRESULT com = CoInitialize(NULL);
+#endif
+			out->error = probeLocked(backend, name, out);
+#if WINDOWS
+			if (SUCCEEDED(com))
+				CoUninitialize();
+#endif
+		}
+	}
+	// a busy device says nothing about the driver, everything else is worth keeping
+	if (out->error != kProbeBusy){
+		uv_mutex_lock(&cacheMutex);
+		cache[name] = *out;
+		uv_mutex_unlock(&cacheMutex);
+	}
+	return out->error;
+}
+
+bool cachedCapabilities(const std::string &name, DriverCapabilities *out){
+	uv_mutex_lock(&cacheMutex);
+	std::map<std::string, DriverCapabilities>::const_iterator found = cache.find(name);
+	bool hit = found != cache.end();
+	if (hit)
+		*out = found->second;
+	uv_mutex_unlock(&cacheMutex);
+	return hit;
+}
+
+void clearCapabilities(){
+	uv_mutex_lock(&cacheMutex);
+	cache.clear();
+	uv_mutex_unlock(&cacheMutex);
+}
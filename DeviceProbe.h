@@ -0,0 +1,74 @@
+#ifndef __DeviceProbe__
+#define __DeviceProbe__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "asiosys.h"
+#include "asio.h"
+
+// Driver enumeration and capability probing without init(). Probing loads a driver, asks it
+// for channels, buffer sizes, the rates it can run at and the type of every channel, and
+// unloads it again; that takes a while, so it runs on the libuv thread pool and the result is
+// kept per driver name. The SDK holds one driver at a time, every load and unload in the
+// process goes through lockDrivers(), init() and deInit() included.
+
+typedef struct ChannelCapabilities{
+	std::string name;
+	ASIOSampleType type;
+	long group;
+}ChannelCapabilities;
+
+typedef struct DriverCapabilities{
+	std::string name;
+	int error;					// 0, or one of the kProbe codes below
+	std::string message;		// what the driver said when it failed
+	long asioVersion;
+	long driverVersion;
+	long inputs;
+	long outputs;
+	long minSize;
+	long maxSize;
+	long preferredSize;
+	long granularity;
+	double sampleRate;			// the one it runs at right now
+	std::vector<double> sampleRates;	// out of the common ones, those it can run at
+	long inputLatency;			// 0 when the driver won't tell before buffers exist
+	long outputLatency;
+	std::vector<ChannelCapabilities> inputChannels;
+	std::vector<ChannelCapabilities> outputChannels;
+	double probedAt;			// milliseconds since the epoch
+}DriverCapabilities;
+
+enum {
+	kProbeOk = 0,
+	kProbeBusy = -1,		// a driver is loaded, the SDK can't take a second one
+	kProbeNotFound = -2,	// can't load it
+	kProbeInitFailed = -3,
+	kProbeUnsupported = -4	// no SDK host code on this platform
+};
+
+// once per process, before anything else in here
+void initDeviceProbe();
+
+// any thread. Held around every load/init and exit/unload
+void lockDrivers();
+void unlockDrivers();
+class DriverLock{
+public:
+	DriverLock() { lockDrivers(); }
+	~DriverLock() { unlockDrivers(); }
+};
+// with the lock held, init() tells us which driver it loaded, deInit() that it's gone again
+void driverLoaded(const std::string &name);
+void driverUnloaded();
+
+// every driver name on the machine, the virtual device first. Takes the lock
+std::vector<std::string> driverNames();
+// loads, asks and unloads the driver and caches the result, takes the lock. kProbe code
+int probeDriver(const std::string &name, DriverCapabilities *out);
+// the cached result, false when there is none
+bool cachedCapabilities(const std::string &name, DriverCapabilities *out);
+void clearCapabilities();
+
+#endif
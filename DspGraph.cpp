@@ -0,0 +1,210 @@
+#include <string.h>
+#include <math.h>
+#include "DspGraph.h"
+
+// commands JS can queue before the driver gets to them
+#define DSP_COMMAND_BLOCKS 256
+#define DEFAULT_SMOOTHING_MS 10.0
+#define DEFAULT_RELEASE_MS 50.0
+// close enough to stop gliding
+#define GLIDE_EPSILON 1e-5f
+
+DspGraph::DspGraph() : numInputs(0), numOutputs(0), frames(0), stride(0), sampleRate(0), memory(NULL), memoryBytes(0),
+	inputs(NULL), outputs(NULL), temp(NULL), inputGain(NULL), inputGainTarget(NULL), outputGain(NULL),
+	outputGainTarget(NULL), matrix(NULL), matrixTarget(NULL), limiterGain(NULL), smoothing(1.f), ceiling(0),
+	release_(0), releaseMs(0), isActive(false), gliding(false) {}
+
+DspGraph::~DspGraph(){
+	release();
+}
+
+bool DspGraph::allocate(long numIn, long numOut, long blockFrames, double rate){
+	release();
+	numInputs = numIn;
+	numOutputs = numOut;
+	frames = blockFrames;
+	sampleRate = rate > 0 ? rate : 44100.;
+	stride = (long)(alignUp(frames * sizeof(float)) / sizeof(float));
+
+	// one block for everything, channel buffers first, then the parameters
+	long floats = stride * (numInputs + numOutputs + 1)
+		+ 2 * numInputs + 3 * numOutputs + 2 * numInputs * numOutputs + numInputs;
+	memory = (float *)alignedAlloc(floats * sizeof(float));
+	if (!memory || !commands.allocate(DSP_COMMAND_BLOCKS, sizeof(DspCommand))){
+		release();
+		return false;
+	}
+	memoryBytes = floats * sizeof(float);
+	memset(memory, 0, memoryBytes);
+	inputs = memory;
+	outputs = inputs + stride * numInputs;
+	temp = outputs + stride * numOutputs;
+	inputGain = temp + stride;
+	inputGainTarget = inputGain + numInputs;
+	outputGain = inputGainTarget + numInputs;
+	outputGainTarget = outputGain + numOutputs;
+	limiterGain = outputGainTarget + numOutputs;
+	matrix = limiterGain + numOutputs;
+	matrixTarget = matrix + numInputs * numOutputs;
+	// the last numInputs floats hold the input gains at the start of the block, see process()
+	for (long i = 0; i < numInputs; i++)
+		inputGain[i] = inputGainTarget[i] = 1.f;
+	for (long o = 0; o < numOutputs; o++)
+		outputGain[o] = outputGainTarget[o] = limiterGain[o] = 1.f;
+
+	ceiling = 0;
+	releaseMs = DEFAULT_RELEASE_MS;
+	release_ = (float)(1. - exp(-1. / (sampleRate * releaseMs / 1000.)));
+	smoothing = (float)(1. - exp(-frames / (sampleRate * DEFAULT_SMOOTHING_MS / 1000.)));
+	isActive = gliding = false;
+	return true;
+}
+
+void DspGraph::release(){
+	if (memory)
+		alignedFree(memory);
+	memory = inputs = outputs = temp = NULL;
+	memoryBytes = 0;
+	commands.release();
+	numInputs = numOutputs = frames = 0;
+	isActive = gliding = false;
+}
+
+bool DspGraph::push(const DspCommand &command){
+	if (!memory)
+		return false;
+	char *slot = commands.writeSlot();
+	if (!slot)
+		return false;
+	memcpy(slot, &command, sizeof(DspCommand));
+	commands.commit();
+	return true;
+}
+
+void DspGraph::applyCommands(){
+	bool changed = false;
+	char *slot;
+	while ((slot = commands.readSlot()) != NULL){
+		DspCommand command;
+		memcpy(&command, slot, sizeof(DspCommand));
+		commands.consume();
+		changed = true;
+		switch (command.type){
+			case kDspInputGain:
+				if (command.a >= 0 && command.a < numInputs)
+					inputGainTarget[command.a] = command.value;
+				break;
+			case kDspOutputGain:
+				if (command.a >= 0 && command.a < numOutputs)
+					outputGainTarget[command.a] = command.value;
+				break;
+			case kDspRoute:
+				if (command.a >= 0 && command.a < numOutputs)
+					memset(matrixTarget + command.a * numInputs, 0, numInputs * sizeof(float));
+				// fall through - a route is a row with a single coefficient
+			case kDspMix:
+				if (command.a >= 0 && command.a < numOutputs && command.b >= 0 && command.b < numInputs)
+					matrixTarget[command.a * numInputs + command.b] = command.value;
+				break;
+			case kDspClear:
+				memset(matrixTarget, 0, numInputs * numOutputs * sizeof(float));
+				for (long i = 0; i < numInputs; i++)
+					inputGainTarget[i] = 1.f;
+				for (long o = 0; o < numOutputs; o++)
+					outputGainTarget[o] = 1.f;
+				break;
+			case kDspLimiter:
+				ceiling = command.value > 0 ? command.value : 0;
+				releaseMs = command.value2 > 0 ? command.value2 : (float)DEFAULT_RELEASE_MS;
+				release_ = (float)(1. - exp(-1. / (sampleRate * releaseMs / 1000.)));
+				break;
+			case kDspSmoothing:
+				smoothing = command.value > 0 ? (float)(1. - exp(-frames / (sampleRate * command.value / 1000.))) : 1.f;
+				break;
+		}
+	}
+	if (changed || gliding)
+		updateActive();
+}
+
+void DspGraph::updateActive(){
+	// the graph costs nothing until something is patched, gained or limited
+	bool active = ceiling > 0;
+	gliding = false;
+	for (long k = 0; k < numInputs * numOutputs; k++){
+		active = active || matrix[k] != 0 || matrixTarget[k] != 0;
+		gliding = gliding || matrix[k] != matrixTarget[k];
+	}
+	for (long o = 0; o < numOutputs; o++){
+		active = active || outputGain[o] != 1.f || outputGainTarget[o] != 1.f;
+		gliding = gliding || outputGain[o] != outputGainTarget[o];
+	}
+	for (long i = 0; i < numInputs; i++)
+		gliding = gliding || inputGain[i] != inputGainTarget[i];
+	isActive = active;
+}
+
+float DspGraph::glide(float current, float target) const{
+	float next = current + (target - current) * smoothing;
+	return fabsf(next - target) < GLIDE_EPSILON ? target : next;
+}
+
+void DspGraph::process(){
+	// every value moves one block closer to its target, within the block it ramps linearly
+	float *startGain = matrixTarget + numInputs * numOutputs;
+	for (long i = 0; i < numInputs; i++){
+		startGain[i] = inputGain[i];
+		inputGain[i] = glide(inputGain[i], inputGainTarget[i]);
+	}
+	float step = 1.f / frames;
+	for (long o = 0; o < numOutputs; o++){
+		float *y = output(o);
+		memset(y, 0, frames * sizeof(float));
+		for (long i = 0; i < numInputs; i++){
+			long k = o * numInputs + i;
+			float from = matrix[k] * startGain[i];
+			matrix[k] = glide(matrix[k], matrixTarget[k]);
+			float to = matrix[k] * inputGain[i];
+			if (from == 0 && to == 0)
+				continue;
+			const float *x = input(i);
+			if (from == to){
+				for (long n = 0; n < frames; n++)
+					y[n] += to * x[n];
+			}
+			else{
+				float delta = (to - from) * step;
+				for (long n = 0; n < frames; n++)
+					y[n] += (from + delta * (n + 1)) * x[n];
+			}
+		}
+	}
+}
+
+void DspGraph::finish(long o){
+	float *y = output(o);
+	float from = outputGain[o];
+	outputGain[o] = glide(from, outputGainTarget[o]);
+	float to = outputGain[o];
+	if (from != to){
+		float delta = (to - from) * (1.f / frames);
+		for (long n = 0; n < frames; n++)
+			y[n] *= from + delta * (n + 1);
+	}
+	else if (to != 1.f){
+		for (long n = 0; n < frames; n++)
+			y[n] *= to;
+	}
+	if (ceiling <= 0)
+		return;
+	// hard limiter: instant attack so nothing passes the ceiling, exponential release
+	float g = limiterGain[o];
+	for (long n = 0; n < frames; n++){
+		float a = fabsf(y[n]);
+		if (a * g > ceiling)
+			g = ceiling / a;
+		y[n] *= g;
+		g += (1.f - g) * release_;
+	}
+	limiterGain[o] = g;
+}
@@ -0,0 +1,90 @@
+#ifndef __DspGraph__
+#define __DspGraph__
+
+#include "RingBuffer.h"
+
+// Small processing graph that runs right inside bufferSwitchTimeInfo, so monitoring
+// and routing keep working while the loop is busy with GC or I/O:
+//   inputs -> input gain -> NxM mix matrix -> (+ what JS rendered) -> output gain -> limiter
+// Routing is a matrix row with a single 1. JS never touches the state directly, it
+// pushes commands through a lock-free queue the driver thread applies at block start.
+// Every gain and matrix coefficient glides to its new value, nothing clicks.
+
+enum {
+	kDspInputGain = 0,	// a = input, value = gain
+	kDspOutputGain,		// a = output, value = gain
+	kDspMix,			// a = output, b = input, value = gain
+	kDspRoute,			// a = output, b = input, clears the row of the output first
+	kDspClear,			// every matrix coefficient to 0, gains back to 1
+	kDspLimiter,		// value = ceiling (linear, 0 turns it off), value2 = release in ms
+	kDspSmoothing		// value = time constant in ms
+};
+
+typedef struct DspCommand{
+	int type;
+	int a;
+	int b;
+	float value;
+	float value2;
+}DspCommand;
+
+class DspGraph{
+public:
+	DspGraph();
+	~DspGraph();
+
+	bool allocate(long inputs, long outputs, long frames, double sampleRate);
+	void release();
+
+	// JS thread, false when the queue is full or the graph isn't set up
+	bool push(const DspCommand &command);
+
+	// driver thread
+	void applyCommands();
+	// anything to do at all, when false the driver skips the graph completely
+	bool active() const { return isActive; }
+	float *input(long i) { return inputs + i * stride; }
+	float *output(long o) { return outputs + o * stride; }
+	float *scratch() { return temp; }
+	// every channel buffer and parameter in one block, to lock it in memory
+	void *buffer() const { return memory; }
+	size_t bufferBytes() const { return memoryBytes; }
+	// mixes the inputs into the outputs, overwriting them
+	void process();
+	// output gain and limiter on one output, after whatever else got mixed in
+	void finish(long o);
+
+private:
+	void updateActive();
+	float glide(float current, float target) const;
+
+	BlockRing commands;
+	long numInputs;
+	long numOutputs;
+	long frames;
+	long stride;	// floats between channels, keeps every channel on its own cache line
+	double sampleRate;
+
+	float *memory;
+	size_t memoryBytes;
+	float *inputs;
+	float *outputs;
+	float *temp;
+	// current and target values, matrix is numOutputs rows of numInputs
+	float *inputGain;
+	float *inputGainTarget;
+	float *outputGain;
+	float *outputGainTarget;
+	float *matrix;
+	float *matrixTarget;
+	float *limiterGain;
+
+	float smoothing;	// per block fraction of the way to the target
+	float ceiling;		// 0 means no limiter
+	float release_;	// per sample recovery towards unity gain
+	float releaseMs;
+	bool isActive;
+	bool gliding;
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include <string.h>
+#include "Player.h"
+#include "SampleConvert.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// start/stop commands JS can queue before the driver gets to them
+#define PLAYER_COMMAND_BLOCKS 64
+// how long the prefetch thread naps when the ring is full
+#define PLAYER_IDLE_MS 2
+
+// every slot starts with this, followed by one block of every played file channel
+typedef struct PlayerHeader{
+	unsigned int epoch;	// seek generation it was read for
+	bool end;			// the file ends after this block
+	long frames;		// valid frames, less than a block only at the end
+	uint64_t position;	// file frame of the first one
+}PlayerHeader;
+#define PLAYER_HEADER_BYTES alignUp(sizeof(PlayerHeader))
+
+static void sleepMillis(int ms){
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+Player::Player() : file(NULL), type(0), numOutputs(0), frames(0), stride(0), readPosition(0), readEpoch(0),
+	bufferBlocks(0), outputs(NULL), current(NULL), currentOffset(0), startAt(-1), stopAt(-1), playing(false),
+	isOpen(false), busy(false), prefetchRunning(false), epoch(0), seekTarget(0), position(0), isPlaying(false),
+	ended(false), underruns(0), lastClock(0)
+{
+	memset(&info, 0, sizeof(info));
+}
+
+Player::~Player(){
+	close();
+}
+
+// -1 already open, -2 can't open the file, -3 not a format we can play, -4 bad outputs, -5 out of memory,
+// -6 no prefetch thread
+int Player::open(const char *path, const PlayerOptions &playerOptions, long numOut, long blockFrames, double sampleRate){
+	if (file)
+		return -1;
+	file = fopen(path, "rb");
+	if (!file)
+		return -2;
+	options = playerOptions;
+	if (options.raw){
+		// no header, the whole file is samples
+		memset(&info, 0, sizeof(info));
+		info.channels = options.rawChannels;
+		info.type = options.rawType;
+		info.sampleRate = sampleRate;
+		info.dataOffset = 0;
+		info.dataBytes = fileSize(file);
+		if (info.channels <= 0 || !getToFloat(info.type)){
+			close();
+			return -3;
+		}
+		info.frames = info.dataBytes / (info.channels * sampleBytes(info.type));
+	}
+	else if (!wavReadHeader(file, &info) || !getToFloat(info.type)){
+		close();
+		return -3;
+	}
+	type = info.type;
+	// file channel i plays on output i unless told otherwise
+	if (options.outputs.empty())
+		for (int c = 0; c < info.channels; c++)
+			options.outputs.push_back(c < numOut ? c : -1);
+	options.outputs.resize(info.channels, -1);
+	long played = 0;
+	for (int c = 0; c < info.channels; c++){
+		if (options.outputs[c] >= numOut){
+			close();
+			return -4;
+		}
+		if (options.outputs[c] >= 0)
+			played++;
+	}
+
+	numOutputs = numOut;
+	frames = blockFrames;
+	stride = (long)(alignUp(frames * sizeof(float)) / sizeof(float));
+	long blocks = (long)(options.readAheadSeconds * sampleRate / frames) + 1;
+	if (blocks < 4)
+		blocks = 4;
+	raw.resize((size_t)(frames * info.channels * sampleBytes(type)));
+	decoded.resize((size_t)(frames * info.channels));
+	outputs = (float *)alignedAlloc((numOutputs ? numOutputs : 1) * stride * sizeof(float));
+	if (!outputs || !ring.allocate(blocks, PLAYER_HEADER_BYTES + played * stride * sizeof(float))
+		|| !commands.allocate(PLAYER_COMMAND_BLOCKS, sizeof(PlayerCommand))){
+		close();
+		return -5;
+	}
+	bufferBlocks = (long)ring.capacity();
+	outputUsed.assign(numOutputs, false);
+	for (int c = 0; c < info.channels; c++)
+		if (options.outputs[c] >= 0)
+			outputUsed[options.outputs[c]] = true;
+
+	readPosition = 0;
+	readEpoch = 0;
+	epoch = 0;
+	seekTarget = 0;
+	position = 0;
+	current = NULL;
+	currentOffset = 0;
+	startAt = stopAt = -1;
+	playing = false;
+	isPlaying = false;
+	ended = false;
+	underruns = 0;
+	prefetchRunning = true;
+	if (uv_thread_create(&thread, prefetchThread, this) != 0){
+		prefetchRunning = false;
+		close();
+		return -6;
+	}
+	isOpen.store(true);
+	return 0;
+}
+
+void Player::close(){
+	// after this loop the driver thread is either out of process() or sees isOpen false
+	isOpen.store(false);
+	while (busy.load())
+		sleepMillis(0);
+	if (prefetchRunning.load()){
+		prefetchRunning.store(false, std::memory_order_release);
+		uv_thread_join(&thread);
+	}
+	if (file)
+		fclose(file);
+	file = NULL;
+	ring.release();
+	commands.release();
+	if (outputs)
+		alignedFree(outputs);
+	outputs = NULL;
+	bufferBlocks = 0;
+	isPlaying = false;
+}
+
+bool Player::push(const PlayerCommand &command){
+	if (!file)
+		return false;
+	char *slot = commands.writeSlot();
+	if (!slot)
+		return false;
+	memcpy(slot, &command, sizeof(PlayerCommand));
+	commands.commit();
+	return true;
+}
+
+void Player::seek(uint64_t frame){
+	if (!file)
+		return;
+	seekTarget.store(frame < info.frames ? frame : 0, std::memory_order_relaxed);
+	epoch.fetch_add(1, std::memory_order_release);
+}
+
+void Player::stats(PlayerStats *out){
+	out->open = isOpen.load(std::memory_order_relaxed);
+	out->playing = isPlaying.load(std::memory_order_relaxed);
+	out->ended = ended.load(std::memory_order_relaxed);
+	out->position = position.load(std::memory_order_relaxed);
+	out->frames = info.frames;
+	out->clock = lastClock.load(std::memory_order_relaxed);
+	out->underruns = underruns.load(std::memory_order_relaxed);
+	out->bufferBlocks = bufferBlocks;
+	out->buffered = file ? (long)ring.pending() : 0;
+}
+
+//----------------------------------------------------------------------------------
+// prefetch thread
+
+void Player::prefetchThread(void *arg){
+	Player *player = (Player *)arg;
+	bool atEnd = false;
+	while (player->prefetchRunning.load(std::memory_order_acquire)){
+		unsigned int e = player->epoch.load(std::memory_order_acquire);
+		if (e != player->readEpoch){
+			player->readEpoch = e;
+			player->readPosition = player->seekTarget.load(std::memory_order_relaxed);
+			atEnd = false;
+		}
+		char *slot = atEnd ? NULL : player->ring.writeSlot();
+		if (!slot){
+			sleepMillis(PLAYER_IDLE_MS);
+			continue;
+		}
+		atEnd = !player->fill(slot, e);
+		player->ring.commit();
+	}
+}
+
+// reads the next block into slot, false once the file is done (and not looping)
+bool Player::fill(char *slot, unsigned int e){
+	PlayerHeader *header = (PlayerHeader *)slot;
+	float *channels = (float *)(slot + PLAYER_HEADER_BYTES);
+	long sampleSize = sampleBytes(type);
+	long frameSize = info.channels * sampleSize;
+	header->epoch = e;
+	header->position = readPosition;
+	header->end = false;
+
+	long got = 0;
+	while (got < frames){
+		if (readPosition >= info.frames){
+			if (!options.loop || info.frames == 0){
+				header->end = true;
+				break;
+			}
+			readPosition = 0;
+		}
+		uint64_t left = info.frames - readPosition;
+		long want = (long)((uint64_t)(frames - got) < left ? (uint64_t)(frames - got) : left);
+		size_t bytes = (size_t)want * frameSize;
+		size_t read = 0;
+		if (fileSeek(file, info.dataOffset + readPosition * frameSize) == 0)
+			read = fread(raw.data() + got * frameSize, 1, bytes, file);
+		if (read < bytes){
+			// a short read is the end as far as we're concerned
+			want = (long)(read / frameSize);
+			info.frames = readPosition + want;
+		}
+		got += want;
+		readPosition += want;
+	}
+	header->frames = got;
+
+	// decode everything at once, then spread the played channels out
+	getToFloat(type)(raw.data(), decoded.data(), got * info.channels);
+	long k = 0;
+	for (int c = 0; c < info.channels; c++){
+		if (options.outputs[c] < 0)
+			continue;
+		float *dst = channels + k++ * stride;
+		for (long n = 0; n < got; n++)
+			dst[n] = decoded[n * info.channels + c];
+	}
+	return !header->end;
+}
+
+//----------------------------------------------------------------------------------
+// driver thread
+
+void Player::applyCommands(int64_t blockStart){
+	const char *slot;
+	while ((slot = commands.readSlot()) != NULL){
+		const PlayerCommand *command = (const PlayerCommand *)slot;
+		int64_t at = command->at < 0 ? blockStart : command->at;
+		if (command->type == kPlayerStart){
+			startAt = at;
+			stopAt = -1;
+		}
+		else{
+			stopAt = at;
+			startAt = -1;
+		}
+		commands.consume();
+	}
+}
+
+// mixes count frames of the stream into the output buffers at offset, returns how many it had
+long Player::take(long offset, long count, bool *atEnd){
+	long done = 0;
+	unsigned int wanted = epoch.load(std::memory_order_acquire);
+	while (done < count){
+		if (!current){
+			const char *slot = ring.readSlot();
+			if (!slot)
+				break;
+			current = slot;
+			currentOffset = 0;
+		}
+		const PlayerHeader *header = (const PlayerHeader *)current;
+		if (header->epoch != wanted || currentOffset >= header->frames){
+			bool end = header->epoch == wanted && header->end;
+			current = NULL;
+			ring.consume();
+			if (end){
+				*atEnd = true;
+				break;
+			}
+			continue;
+		}
+		long n = header->frames - currentOffset;
+		if (n > count - done)
+			n = count - done;
+		const float *src = (const float *)(current + PLAYER_HEADER_BYTES);
+		long k = 0;
+		for (int c = 0; c < info.channels; c++){
+			if (options.outputs[c] < 0)
+				continue;
+			const float *x = src + k++ * stride + currentOffset;
+			float *y = outputs + options.outputs[c] * stride + offset + done;
+			for (long i = 0; i < n; i++)
+				y[i] += x[i];
+		}
+		currentOffset += n;
+		done += n;
+		position.store(header->position + currentOffset, std::memory_order_relaxed);
+		if (currentOffset >= header->frames && header->end){
+			current = NULL;
+			ring.consume();
+			*atEnd = true;
+			break;
+		}
+	}
+	return done;
+}
+
+bool Player::process(double clock){
+	busy.store(true);
+	if (!isOpen.load()){
+		busy.store(false);
+		return false;
+	}
+	int64_t blockStart = (int64_t)clock;
+	int64_t blockEnd = blockStart + frames;
+	lastClock.store(clock, std::memory_order_relaxed);
+	applyCommands(blockStart);
+
+	// drop whatever was read ahead for an older seek, so the prefetch thread has room for the new one
+	unsigned int wanted = epoch.load(std::memory_order_acquire);
+	if (current && ((const PlayerHeader *)current)->epoch != wanted){
+		current = NULL;
+		ring.consume();
+	}
+	const char *slot;
+	while (!current && (slot = ring.readSlot()) != NULL && ((const PlayerHeader *)slot)->epoch != wanted)
+		ring.consume();
+
+	// which part of this block plays: [from, to)
+	long from = 0, to = frames;
+	bool starting = !playing && startAt >= 0 && startAt < blockEnd;
+	if (starting){
+		from = startAt > blockStart ? (long)(startAt - blockStart) : 0;
+		startAt = -1;
+		playing = true;
+		// starting again after the end plays from the top
+		if (ended.load(std::memory_order_relaxed)){
+			seekTarget.store(0, std::memory_order_relaxed);
+			epoch.fetch_add(1, std::memory_order_release);
+		}
+		ended.store(false, std::memory_order_relaxed);
+	}
+	bool stopping = playing && stopAt >= 0 && stopAt < blockEnd;
+	if (stopping){
+		long at = stopAt > blockStart ? (long)(stopAt - blockStart) : 0;
+		to = at > from ? at : from;
+		stopAt = -1;
+	}
+	if (!playing){
+		isPlaying.store(false, std::memory_order_relaxed);
+		busy.store(false, std::memory_order_release);
+		return false;
+	}
+
+	for (long o = 0; o < numOutputs; o++)
+		if (outputUsed[o])
+			memset(outputs + o * stride, 0, frames * sizeof(float));
+	bool atEnd = false;
+	long got = take(from, to - from, &atEnd);
+	if (got < to - from && !atEnd)
+		underruns.fetch_add(1, std::memory_order_relaxed);
+	if (atEnd){
+		ended.store(true, std::memory_order_relaxed);
+		playing = false;
+	}
+	if (stopping)
+		playing = false;
+	isPlaying.store(playing, std::memory_order_relaxed);
+	busy.store(false, std::memory_order_release);
+	return true;
+}
@@ -0,0 +1,121 @@
+#ifndef __Player__
+#define __Player__
+
+#include <uv.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "asiosys.h"
+#include "asio.h"
+#include "RingBuffer.h"
+#include "WavFile.h"
+
+// Plays a WAV/RF64 or raw file into output channels without JS on the critical path.
+// A prefetch thread reads ahead and decodes into a ring of float blocks, the driver
+// thread takes one block's worth per callback and mixes it into the outputs.
+// Start and stop are sample accurate: they take effect at a driver sample position,
+// queued from JS the same way the DspGraph gets its commands. A seek bumps an epoch,
+// the prefetch thread refills from the new position and the driver thread skips
+// everything read for the old one.
+
+enum {
+	kPlayerStart = 0,	// at = sample position
+	kPlayerStop			// at = sample position
+};
+
+typedef struct PlayerCommand{
+	int type;
+	int64_t at;		// driver sample position, < 0 for the next block
+}PlayerCommand;
+
+typedef struct PlayerOptions{
+	std::vector<int> outputs;	// output for every file channel, -1 leaves it out
+	bool loop;
+	double readAheadSeconds;
+	// raw files have no header, these describe them
+	bool raw;
+	int rawChannels;
+	ASIOSampleType rawType;
+}PlayerOptions;
+
+typedef struct PlayerStats{
+	bool open;
+	bool playing;
+	bool ended;			// ran off the end of the file
+	uint64_t position;	// file frame the next block starts at
+	uint64_t frames;	// length of the file
+	double clock;		// sample position of the last block
+	uint64_t underruns;	// blocks the prefetch thread didn't have ready
+	long bufferBlocks;
+	long buffered;		// blocks read ahead right now
+}PlayerStats;
+
+class Player{
+public:
+	Player();
+	~Player();
+
+	// JS thread. 0 on success, otherwise the negative codes in Player.cpp
+	int open(const char *path, const PlayerOptions &options, long outputs, long frames, double sampleRate);
+	void close();
+	bool push(const PlayerCommand &command);
+	// where the next start plays from, applies once the prefetch thread got there
+	void seek(uint64_t frame);
+	void stats(PlayerStats *out);
+	// the ring the driver thread reads from, to lock it in memory
+	const BlockRing &blocks() const { return ring; }
+
+	// driver thread, renders one block starting at sample position clock into the
+	// output buffers, false when there is nothing to mix in
+	bool process(double clock);
+	// only valid after process() returned true, NULL for outputs the file doesn't play on
+	const float *output(long o) const { return outputUsed[o] ? outputs + o * stride : NULL; }
+
+private:
+	static void prefetchThread(void *arg);
+	bool fill(char *slot, unsigned int epoch);
+	void applyCommands(int64_t blockStart);
+	long take(long offset, long count, bool *atEnd);
+
+	FILE *file;
+	WavInfo info;
+	PlayerOptions options;
+	ASIOSampleType type;
+	long numOutputs;
+	long frames;
+	long stride;
+
+	// prefetch thread state
+	std::vector<char> raw;		// one block of the file as it is on disk
+	std::vector<float> decoded;	// the same, interleaved float
+	uint64_t readPosition;
+	unsigned int readEpoch;
+
+	BlockRing ring;
+	BlockRing commands;
+	long bufferBlocks;
+	float *outputs;
+	std::vector<bool> outputUsed;
+
+	// driver thread state
+	const char *current;	// slot being played, NULL when we need the next one
+	long currentOffset;		// frames of it already played
+	int64_t startAt;		// pending start, -1 for none
+	int64_t stopAt;			// pending stop, -1 for none
+	bool playing;
+
+	uv_thread_t thread;
+	std::atomic<bool> isOpen;
+	std::atomic<bool> busy;		// driver thread inside process()
+	std::atomic<bool> prefetchRunning;
+	std::atomic<unsigned int> epoch;
+	std::atomic<uint64_t> seekTarget;
+	std::atomic<uint64_t> position;
+	std::atomic<bool> isPlaying;
+	std::atomic<bool> ended;
+	std::atomic<uint64_t> underruns;
+	std::atomic<double> lastClock;
+};
+
+#endif
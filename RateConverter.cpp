@@ -0,0 +1,204 @@
+#include <string.h>
+#include <math.h>
+#include "RateConverter.h"
+
+RateConverter::RateConverter() : inputs(NULL), outputs(NULL), deviceFrames(0), hostFrames(0), deviceRate(0), hostRate(0),
+	inputSlack(0), outputSlack(0), memory(NULL), memoryBytes(0), inputHeld(0), outputHeld(0), callbacks(0),
+	underruns(0), inputLatency(0), outputLatency(0)
+{
+}
+
+RateConverter::~RateConverter(){
+	release();
+}
+
+bool RateConverter::allocate(ChannelSet &inputSet, ChannelSet &outputSet, long devFrames, double devRate, long frames, double rate){
+	release();
+	if (devFrames <= 0 || frames <= 0 || devRate <= 0 || rate <= 0 || inputSet.count + outputSet.count == 0)
+		return false;
+	double inRatio = devRate / rate;
+	double outRatio = rate / devRate;
+	// the input side takes whole device blocks and hands out host blocks, so it holds a callback's
+	// worth on top of what one host block needs; the output side the other way around
+	if (inputSet.count && !in.allocate(inputSet.count, inRatio, frames + 2 * (long)ceil(devFrames / inRatio) + 4, RESAMPLER_TAPS)){
+		release();
+		return false;
+	}
+	if (outputSet.count && !out.allocate(outputSet.count, outRatio, devFrames + 2 * (long)ceil(frames / outRatio) + 4, RESAMPLER_TAPS)){
+		release();
+		return false;
+	}
+	ChannelSet *sets[2] = { &inputSet, &outputSet };
+	size_t bytes = 0;
+	for (int d = 0; d < 2; d++)
+		for (long c = 0; c < sets[d]->count; c++)
+			bytes += 2 * alignUp(frames * sampleBytes(sets[d]->type[c]));
+	bytes += inputSet.count * alignUp(frames * sizeof(float)) + outputSet.count * alignUp(devFrames * sizeof(float));
+	memory = (char *)alignedAlloc(bytes);
+	if (!memory){
+		release();
+		return false;
+	}
+	memset(memory, 0, bytes);
+	memoryBytes = bytes;
+
+	// the driver's halves are kept here, the sets get host halves in the same format
+	char *p = memory;
+	for (int d = 0; d < 2; d++){
+		ChannelSet &set = *sets[d];
+		for (int h = 0; h < 2; h++)
+			deviceHalf[d][h].assign(set.half[h], set.half[h] + set.count);
+		for (long c = 0; c < set.count; c++){
+			size_t half = alignUp(frames * sampleBytes(set.type[c]));
+			set.half[0][c] = p;
+			set.half[1][c] = p + half;
+			p += 2 * half;
+			set.nativeBytes[c] = frames * sampleBytes(set.type[c]);
+		}
+	}
+	inputPlanes.assign(inputSet.count, NULL);
+	for (long c = 0; c < inputSet.count; c++, p += alignUp(frames * sizeof(float)))
+		inputPlanes[c] = (float *)p;
+	outputPlanes.assign(outputSet.count, NULL);
+	for (long c = 0; c < outputSet.count; c++, p += alignUp(devFrames * sizeof(float)))
+		outputPlanes[c] = (float *)p;
+
+	inputs = &inputSet;
+	outputs = &outputSet;
+	deviceFrames = devFrames;
+	hostFrames = frames;
+	deviceRate = devRate;
+	hostRate = rate;
+	// a host block of slack on either side: device and host blocks don't line up, some callbacks
+	// run one host block more than others and find their inputs (and leave outputs) there
+	inputSlack = (long)ceil(frames * inRatio) + 1;
+	outputSlack = frames;
+	reset();
+	return true;
+}
+
+void RateConverter::release(){
+	in.release();
+	out.release();
+	if (memory)
+		alignedFree(memory);
+	memory = NULL;
+	memoryBytes = 0;
+	for (int d = 0; d < 2; d++)
+		for (int h = 0; h < 2; h++)
+			deviceHalf[d][h].clear();
+	inputPlanes.clear();
+	outputPlanes.clear();
+	inputs = outputs = NULL;
+	deviceFrames = hostFrames = 0;
+}
+
+void RateConverter::reset(){
+	if (!memory)
+		return;
+	// reset() leaves the history silent, committing the slack just counts it in
+	if (in.allocated()){
+		in.reset();
+		in.commit(inputSlack);
+	}
+	if (out.allocated()){
+		out.reset();
+		out.commit(outputSlack);
+	}
+	inputHeld = outputHeld = 0;
+	callbacks = 0;
+	underruns.store(0, std::memory_order_relaxed);
+	inputLatency.store(0, std::memory_order_relaxed);
+	outputLatency.store(0, std::memory_order_relaxed);
+}
+
+void RateConverter::stats(RateConverterStats *result) const{
+	result->active = active();
+	result->deviceRate = deviceRate;
+	result->hostRate = hostRate;
+	result->deviceFrames = deviceFrames;
+	result->hostFrames = hostFrames;
+	result->inputLatency = inputLatency.load(std::memory_order_relaxed);
+	result->outputLatency = outputLatency.load(std::memory_order_relaxed);
+	result->underruns = underruns.load(std::memory_order_relaxed);
+}
+
+void RateConverter::input(long index){
+	if (!in.allocated())
+		return;
+	// only short when the host side stopped keeping up, what doesn't fit is lost
+	long frames = deviceFrames < in.space() ? deviceFrames : in.space();
+	void **halves = deviceHalf[0][index].data();
+	for (long c = 0; c < inputs->count; c++){
+		if (inputs->toFloat[c])
+			inputs->toFloat[c](halves[c], in.input(c), frames);
+		else
+			memset(in.input(c), 0, frames * sizeof(float));
+	}
+	in.commit(frames);
+}
+
+bool RateConverter::nextBlock() const{
+	bool ready = !in.allocated() || in.required(hostFrames) == 0;
+	// without outputs the inputs set the pace
+	if (!out.allocated())
+		return in.allocated() && ready;
+	return ready && out.required(deviceFrames) > 0 && out.space() >= hostFrames;
+}
+
+void RateConverter::pullInputs(long hostIndex){
+	if (!in.allocated())
+		return;
+	in.process(inputPlanes.data(), hostFrames);
+	void **halves = inputs->half[hostIndex];
+	for (long c = 0; c < inputs->count; c++){
+		if (inputs->fromFloat[c])
+			inputs->fromFloat[c](inputPlanes[c], halves[c], hostFrames);
+		else
+			memset(halves[c], 0, inputs->nativeBytes[c]);
+	}
+}
+
+void RateConverter::pushOutputs(long hostIndex){
+	if (!out.allocated())
+		return;
+	void **halves = outputs->half[hostIndex];
+	for (long c = 0; c < outputs->count; c++){
+		if (outputs->toFloat[c])
+			outputs->toFloat[c](halves[c], out.input(c), hostFrames);
+		else
+			memset(out.input(c), 0, hostFrames * sizeof(float));
+	}
+	out.commit(hostFrames);
+}
+
+bool RateConverter::output(long index){
+	bool played = true;
+	if (out.allocated()){
+		void **halves = deviceHalf[1][index].data();
+		if (out.required(deviceFrames) > 0){
+			for (long c = 0; c < outputs->count; c++)
+				memset(halves[c], 0, deviceFrames * sampleBytes(outputs->type[c]));
+			underruns.fetch_add(1, std::memory_order_relaxed);
+			played = false;
+		}
+		else{
+			out.process(outputPlanes.data(), deviceFrames);
+			for (long c = 0; c < outputs->count; c++){
+				if (outputs->fromFloat[c])
+					outputs->fromFloat[c](outputPlanes[c], halves[c], deviceFrames);
+				else
+					memset(halves[c], 0, deviceFrames * sampleBytes(outputs->type[c]));
+			}
+		}
+	}
+	// how many host blocks a callback runs varies, so does the fill, its mean is the delay
+	if (in.allocated())
+		inputHeld += in.buffered() / deviceRate;
+	if (out.allocated())
+		outputHeld += out.buffered() / hostRate;
+	callbacks++;
+	inputLatency.store(inputHeld / callbacks, std::memory_order_relaxed);
+	outputLatency.store(outputHeld / callbacks, std::memory_order_relaxed);
+	return played;
+}
@@ -0,0 +1,88 @@
+#ifndef __RateConverter__
+#define __RateConverter__
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "ChannelLayout.h"
+#include "Resampler.h"
+
+// Runs the host side at the rate init() asked for when the device can't be switched to it.
+// It takes the driver's halves out of both channel sets and puts halves of its own in their
+// place, hostFrames long and in the same native format, so everything downstream (the graph,
+// JS, the recorder) sees blocks at the host rate and doesn't know. Each callback the device
+// inputs go into one resampler; host blocks are run for as long as the device needs more
+// output and the inputs can make one, their outputs go through the other resampler back into
+// the driver's halves. The two rates share the device's clock, so the ratios are fixed.
+
+typedef struct RateConverterStats{
+	bool active;
+	double deviceRate;
+	double hostRate;
+	long deviceFrames;
+	long hostFrames;
+	double inputLatency;		// seconds the input side holds on average, filter and slack
+	double outputLatency;		// the output side, the two add up to what a loopback gets delayed
+	uint64_t underruns;			// device blocks the output side had nothing for
+}RateConverterStats;
+
+class RateConverter{
+public:
+	RateConverter();
+	~RateConverter();
+
+	// JS thread, right after the driver created its buffers. false without memory, the sets
+	// are left alone then
+	bool allocate(ChannelSet &inputs, ChannelSet &outputs, long deviceFrames, double deviceRate, long hostFrames, double hostRate);
+	// the sets still point at the host halves, they go right after
+	void release();
+	bool active() const { return memory != NULL; }
+	// driver stopped: both sides start over on silence, with a block of slack each
+	void reset();
+	void stats(RateConverterStats *result) const;
+	// the host halves and the conversion buffers, to lock them in memory
+	void *buffer() const { return memory; }
+	size_t bufferBytes() const { return memoryBytes; }
+
+	// driver thread, once per callback with the driver's buffer index: the device inputs go in
+	void input(long index);
+	// true while the device wants another host block and the inputs have one
+	bool nextBlock() const;
+	// the next host block of inputs into host half hostIndex, before it gets processed
+	void pullInputs(long hostIndex);
+	// the host block just processed in host half hostIndex, into the output resampler
+	void pushOutputs(long hostIndex);
+	// the device outputs for this callback, silence and false when there wasn't enough;
+	// last thing in the callback, what is left in both resamplers then is the latency
+	bool output(long index);
+
+private:
+	RateConverter(const RateConverter &);
+	RateConverter &operator=(const RateConverter &);
+
+	ChannelSet *inputs;
+	ChannelSet *outputs;
+	long deviceFrames;
+	long hostFrames;
+	double deviceRate;
+	double hostRate;
+	long inputSlack;			// device frames of silence the input side starts with
+	long outputSlack;			// host frames
+
+	char *memory;
+	size_t memoryBytes;
+	std::vector<void *> deviceHalf[2][2];	// the driver's, [0 inputs, 1 outputs][buffer index][channel]
+	std::vector<float *> inputPlanes;		// hostFrames each
+	std::vector<float *> outputPlanes;		// deviceFrames each
+	Resampler in;				// device to host
+	Resampler out;				// host to device
+	double inputHeld;			// summed over the callbacks since reset(), driver thread
+	double outputHeld;
+	uint64_t callbacks;
+
+	std::atomic<uint64_t> underruns;
+	std::atomic<double> inputLatency;
+	std::atomic<double> outputLatency;
+};
+
+#endif
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <string.h>
+#include "Realtime.h"
+#if defined(_WIN32)
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#endif
+#endif
+
+void defaultRealtimeConfig(RealtimeConfig *config){
+	config->priority = 0;
+	config->cpus.clear();
+	config->jsThread = false;
+	config->jsCpus.clear();
+	config->lockMemory = false;
+}
+
+void clearThreadSettings(ThreadSettings *out){
+	memset(out, 0, sizeof(*out));
+	out->policy = "other";
+}
+
+static void failed(ThreadSettings *out, const char *what, int error){
+	if (out->message[0])
+		return;
+#if defined(_WIN32)
+	snprintf(out->message, sizeof(out->message), "%s: error %d", what, error);
+#else
+	snprintf(out->message, sizeof(out->message), "%s: %s", what, strerror(error));
+#endif
+}
+
+static size_t pageSize(){
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	long size = sysconf(_SC_PAGESIZE);
+	return size > 0 ? (size_t)size : 4096;
+#endif
+}
+
+#if defined(_WIN32)
+
+void applyThreadRealtime(int priority, const std::vector<int> &cpus, uint64_t periodNanos, ThreadSettings *out, SavedThread *saved){
+	clearThreadSettings(out);
+	out->applied = true;
+	HANDLE self = GetCurrentThread();
+	// MMCSS schedules by task class, not by period
+	(void)periodNanos;
+	if (saved){
+		saved->saved = true;
+		saved->task = NULL;
+		saved->affinitySaved = false;
+	}
+	HANDLE task = NULL;
+	if (priority > 0){
+		// MMCSS boosts the thread into the realtime range for as long as the task is registered
+		DWORD taskIndex = 0;
+		task = AvSetMmThreadCharacteristicsA("Pro Audio", &taskIndex);
+		if (!task){
+			out->schedulingError = (int)GetLastError();
+			failed(out, "MMCSS Pro Audio", out->schedulingError);
+		}
+		else{
+			AvSetMmThreadPriority(task, priority > 66 ? AVRT_PRIORITY_CRITICAL : priority > 33 ? AVRT_PRIORITY_HIGH : AVRT_PRIORITY_NORMAL);
+			out->policy = "mmcss";
+			if (saved)
+				saved->task = task;
+		}
+	}
+	if (!cpus.empty()){
+		DWORD_PTR mask = 0;
+		for (size_t i = 0; i < cpus.size(); i++)
+			if (cpus[i] >= 0 && cpus[i] < (int)(sizeof(DWORD_PTR) * 8))
+				mask |= (DWORD_PTR)1 << cpus[i];
+		DWORD_PTR previous = mask ? SetThreadAffinityMask(self, mask) : 0;
+		if (!previous){
+			out->affinityError = mask ? (int)GetLastError() : ERROR_INVALID_PARAMETER;
+			failed(out, "affinity", out->affinityError);
+		}
+		else{
+			if (saved){
+				saved->affinitySaved = true;
+				saved->affinity = previous;
+			}
+			// there is no call that reads it back, what SetThreadAffinityMask took is it
+			for (int c = 0; c < (int)(sizeof(DWORD_PTR) * 8) && out->cpuCount < REALTIME_MAX_CPUS; c++)
+				if (mask & ((DWORD_PTR)1 << c))
+					out->cpus[out->cpuCount++] = c;
+		}
+	}
+	out->priority = GetThreadPriority(self);
+}
+
+void restoreThread(SavedThread *saved){
+	if (!saved->saved)
+		return;
+	if (saved->task)
+		AvRevertMmThreadCharacteristics((HANDLE)saved->task);
+	if (saved->affinitySaved)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)saved->affinity);
+	saved->saved = false;
+	saved->task = NULL;
+}
+
+#else
+
+static void readBack(ThreadSettings *out){
+	pthread_t self = pthread_self();
+	int policy = 0;
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	if (pthread_getschedparam(self, &policy, &param) == 0){
+		out->priority = param.sched_priority;
+		if (policy == SCHED_FIFO)
+			out->policy = "fifo";
+		else if (policy == SCHED_RR)
+			out->policy = "rr";
+	}
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (pthread_getaffinity_np(self, sizeof(set), &set) == 0){
+		for (int c = 0; c < CPU_SETSIZE && out->cpuCount < REALTIME_MAX_CPUS; c++)
+			if (CPU_ISSET(c, &set))
+				out->cpus[out->cpuCount++] = c;
+	}
+#endif
+}
+
+void applyThreadRealtime(int priority, const std::vector<int> &cpus, uint64_t periodNanos, ThreadSettings *out, SavedThread *saved){
+	clearThreadSettings(out);
+	out->applied = true;
+	pthread_t self = pthread_self();
+	if (saved){
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		saved->saved = pthread_getschedparam(self, &saved->policy, &param) == 0;
+		saved->priority = param.sched_priority;
+		saved->affinitySaved = false;
+		saved->cpus.clear();
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (!cpus.empty() && pthread_getaffinity_np(self, sizeof(set), &set) == 0){
+			for (int c = 0; c < CPU_SETSIZE; c++)
+				if (CPU_ISSET(c, &set))
+					saved->cpus.push_back(c);
+			saved->affinitySaved = true;
+		}
+#endif
+	}
+	if (priority > 0){
+#if defined(__APPLE__)
+		// the time constraint policy is what Core Audio's own threads run with
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		double ticksPerNano = (double)timebase.denom / timebase.numer;
+		uint64_t period = periodNanos ? periodNanos : 5000000;
+		thread_time_constraint_policy_data_t policy;
+		policy.period = (uint32_t)(period * ticksPerNano);
+		policy.computation = (uint32_t)(period * ticksPerNano / 2);
+		policy.constraint = (uint32_t)(period * ticksPerNano);
+		policy.preemptible = 1;
+		kern_return_t result = thread_policy_set(pthread_mach_thread_np(self), THREAD_TIME_CONSTRAINT_POLICY,
+			(thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+		if (result != KERN_SUCCESS){
+			out->schedulingError = (int)result;
+			snprintf(out->message, sizeof(out->message), "time constraint policy: kern_return %d", (int)result);
+		}
+#else
+		// SCHED_FIFO has no notion of a period, only the mach policy above uses it
+		(void)periodNanos;
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		int lowest = sched_get_priority_min(SCHED_FIFO);
+		int highest = sched_get_priority_max(SCHED_FIFO);
+		param.sched_priority = priority < lowest ? lowest : priority > highest ? highest : priority;
+		// EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO that allows it
+		int error = pthread_setschedparam(self, SCHED_FIFO, &param);
+		if (error){
+			out->schedulingError = error;
+			failed(out, "SCHED_FIFO", error);
+		}
+#endif
+	}
+	if (!cpus.empty()){
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (size_t i = 0; i < cpus.size(); i++)
+			if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE)
+				CPU_SET(cpus[i], &set);
+		int error = CPU_COUNT(&set) ? pthread_setaffinity_np(self, sizeof(set), &set) : EINVAL;
+		if (error){
+			out->affinityError = error;
+			failed(out, "affinity", error);
+		}
+#else
+		out->affinityError = ENOTSUP;
+		failed(out, "affinity", ENOTSUP);
+#endif
+	}
+	readBack(out);
+#if defined(__APPLE__)
+	if (priority > 0 && !out->schedulingError)
+		out->policy = "timeConstraint";
+#endif
+}
+
+void restoreThread(SavedThread *saved){
+	if (!saved->saved)
+		return;
+	pthread_t self = pthread_self();
+#if defined(__APPLE__)
+	thread_standard_policy_data_t standard;
+	thread_policy_set(pthread_mach_thread_np(self), THREAD_STANDARD_POLICY, (thread_policy_t)&standard, THREAD_STANDARD_POLICY_COUNT);
+#endif
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = saved->priority;
+	pthread_setschedparam(self, saved->policy, &param);
+#if defined(__linux__)
+	if (saved->affinitySaved){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (size_t i = 0; i < saved->cpus.size(); i++)
+			if (saved->cpus[i] < CPU_SETSIZE)
+				CPU_SET(saved->cpus[i], &set);
+		pthread_setaffinity_np(self, sizeof(set), &set);
+	}
+#endif
+	saved->saved = false;
+}
+
+#endif
+
+MemoryLock::MemoryLock() : prefaulted(0), lastError(0)
+{
+}
+
+MemoryLock::~MemoryLock(){
+	unlockAll();
+}
+
+static bool lockPages(void *memory, size_t bytes, int *error){
+#if defined(_WIN32)
+	if (VirtualLock(memory, bytes))
+		return true;
+	*error = (int)GetLastError();
+	if (*error != ERROR_WORKING_SET_QUOTA)
+		return false;
+	// the default working set only takes a few hundred KB of locked pages, make room and try again
+	SIZE_T minimum, maximum;
+	if (!GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum)
+		|| !SetProcessWorkingSetSize(GetCurrentProcess(), minimum + bytes + pageSize() * 2, maximum + bytes + pageSize() * 2))
+		return false;
+	if (VirtualLock(memory, bytes))
+		return true;
+	*error = (int)GetLastError();
+	return false;
+#else
+	// ENOMEM or EPERM once RLIMIT_MEMLOCK is used up
+	if (mlock(memory, bytes) == 0)
+		return true;
+	*error = errno;
+	return false;
+#endif
+}
+
+static void unlockPages(void *memory, size_t bytes){
+#if defined(_WIN32)
+	VirtualUnlock(memory, bytes);
+#else
+	munlock(memory, bytes);
+#endif
+}
+
+void MemoryLock::lock(void *memory, size_t bytes, bool prefault){
+	if (!memory || !bytes)
+		return;
+	Region region;
+	region.memory = (char *)memory;
+	region.bytes = bytes;
+	if (prefault){
+		// a write, reading a fresh page only maps the shared zero page
+		volatile char *p = region.memory;
+		size_t page = pageSize();
+		for (size_t i = 0; i < bytes; i += page)
+			p[i] = p[i];
+		p[bytes - 1] = p[bytes - 1];
+		prefaulted += bytes;
+	}
+	int error = 0;
+	region.locked = lockPages(memory, bytes, &error);
+	if (!region.locked)
+		lastError = error;
+	regions.push_back(region);
+}
+
+void MemoryLock::unlock(void *memory){
+	for (size_t i = 0; i < regions.size(); i++){
+		if (regions[i].memory != memory)
+			continue;
+		if (regions[i].locked)
+			unlockPages(regions[i].memory, regions[i].bytes);
+		regions.erase(regions.begin() + i);
+		return;
+	}
+}
+
+void MemoryLock::unlockAll(){
+	for (size_t i = 0; i < regions.size(); i++)
+		if (regions[i].locked)
+			unlockPages(regions[i].memory, regions[i].bytes);
+	regions.clear();
+	prefaulted = 0;
+	lastError = 0;
+}
+
+void MemoryLock::stats(MemoryLockStats *out) const{
+	out->regions = regions.size();
+	out->lockedBytes = out->failedBytes = 0;
+	for (size_t i = 0; i < regions.size(); i++){
+		if (regions[i].locked)
+			out->lockedBytes += regions[i].bytes;
+		else
+			out->failedBytes += regions[i].bytes;
+	}
+	out->prefaultedBytes = prefaulted;
+	out->error = lastError;
+}
@@ -0,0 +1,88 @@
+#ifndef __Realtime__
+#define __Realtime__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Scheduling, placement and paging for the threads and memory the audio path runs on.
+// Everything here works on the calling thread, so the driver thread sets itself up in its
+// first callback after start() and the loop thread JS gets its blocks on does it in start().
+// Linux gets SCHED_FIFO and an affinity mask, Windows the MMCSS "Pro Audio" task and a thread
+// affinity mask, macOS the time constraint policy (it has no pinning). What the thread ended
+// up with is read back, so a missing permission shows as an error and the old setting.
+
+#define REALTIME_MAX_CPUS 64
+#define REALTIME_MESSAGE_BYTES 96
+
+typedef struct RealtimeConfig{
+	int priority;				// 1-99, 0 leaves scheduling alone
+	std::vector<int> cpus;		// cores the driver thread may run on, empty leaves it anywhere
+	bool jsThread;				// the loop thread too, one priority below the driver thread
+	std::vector<int> jsCpus;
+	bool lockMemory;			// lock and prefault every buffer the driver thread touches
+}RealtimeConfig;
+
+// what a thread asked for and got, filled in by the thread itself
+typedef struct ThreadSettings{
+	bool applied;
+	const char *policy;			// "fifo", "mmcss", "timeConstraint", "other"
+	int priority;				// as read back
+	int cpus[REALTIME_MAX_CPUS];
+	int cpuCount;				// 0 when it can run anywhere or the platform can't tell
+	int schedulingError;		// errno / GetLastError(), 0 when it worked
+	int affinityError;
+	char message[REALTIME_MESSAGE_BYTES];	// the first thing that failed, empty when nothing did
+}ThreadSettings;
+
+// what it was before, so the loop thread can go back to it
+typedef struct SavedThread{
+	bool saved;
+	int policy;
+	int priority;
+	bool affinitySaved;
+	uint64_t affinity;			// Windows only, Linux keeps the set below
+	std::vector<int> cpus;
+	void *task;					// MMCSS handle
+}SavedThread;
+
+void defaultRealtimeConfig(RealtimeConfig *config);
+void clearThreadSettings(ThreadSettings *out);
+// calling thread. priority 0 only pins it; periodNanos is how often it wakes up, macOS wants to know
+void applyThreadRealtime(int priority, const std::vector<int> &cpus, uint64_t periodNanos, ThreadSettings *out, SavedThread *saved);
+void restoreThread(SavedThread *saved);
+
+// Memory the driver thread touches, locked into RAM and written once so no block ever waits on a
+// page fault. Regions are counted, a failed lock (RLIMIT_MEMLOCK, working set quota) is kept as
+// the error and the pages are still faulted in.
+typedef struct MemoryLockStats{
+	size_t regions;
+	size_t lockedBytes;
+	size_t prefaultedBytes;
+	size_t failedBytes;			// couldn't be locked
+	int error;					// of the last failed lock
+}MemoryLockStats;
+
+class MemoryLock{
+public:
+	MemoryLock();
+	~MemoryLock();
+
+	// control thread. prefault writes every page, only for memory no other thread uses yet
+	void lock(void *memory, size_t bytes, bool prefault);
+	void unlock(void *memory);
+	void unlockAll();
+	void stats(MemoryLockStats *out) const;
+
+private:
+	typedef struct Region{
+		char *memory;
+		size_t bytes;
+		bool locked;
+	}Region;
+	std::vector<Region> regions;
+	size_t prefaulted;
+	int lastError;
+};
+
+#endif
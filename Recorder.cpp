@@ -0,0 +1,274 @@
+#include <string.h>
+#include "Recorder.h"
+#include "SampleConvert.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// big enough that the disk sees long sequential writes
+#define RECORD_WRITE_BYTES (4 << 20)
+// how long the writer naps when there is nothing to do
+#define RECORD_IDLE_MS 5
+
+// every slot starts with this, followed by the channels in the driver's format
+typedef struct RecordHeader{
+	uint64_t gapBefore;	// blocks dropped right before this one
+}RecordHeader;
+#define RECORD_HEADER_BYTES alignUp(sizeof(RecordHeader))
+
+static void sleepMillis(int ms){
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// types a WAV holds as they are
+static bool wavType(ASIOSampleType type){
+	return type == ASIOSTInt16LSB || type == ASIOSTInt24LSB || type == ASIOSTInt32LSB || type == ASIOSTFloat32LSB;
+}
+
+Recorder::Recorder() : file(NULL), direct(false), frames(0), channelBytes(0), frameBytes(0),
+	bufferBlocks(0), writeBuffer(NULL), writeCapacity(0), writeFill(0), scratch(NULL),
+	recording(false), busy(false), writerRunning(false), missed(0),
+	overruns(0), highWater(0), framesWritten(0), bytesWritten(0), writeErrors(0)
+{
+	memset(&info, 0, sizeof(info));
+}
+
+Recorder::~Recorder(){
+	close();
+}
+
+int Recorder::open(const char *path, const std::vector<int> &channels, ASIOSampleType format,
+	const ASIOSampleType *inputTypes, long inputs, long frameCount, double sampleRate, double bufferSeconds){
+	if (file)
+		return -1;	// already recording
+	if (channels.empty() || frameCount <= 0)
+		return -2;
+	sources = channels;
+	sourceTypes.clear();
+	for (size_t c = 0; c < sources.size(); c++){
+		if (sources[c] < 0 || sources[c] >= inputs || !getToFloat(inputTypes[sources[c]]))
+			return -2;
+		sourceTypes.push_back(inputTypes[sources[c]]);
+	}
+	bool sameType = true;
+	for (size_t c = 1; c < sourceTypes.size(); c++)
+		sameType = sameType && sourceTypes[c] == sourceTypes[0];
+	if (format == kRecordNative)
+		format = (sameType && wavType(sourceTypes[0])) ? sourceTypes[0] : (ASIOSampleType)ASIOSTFloat32LSB;
+	if (!wavType(format))
+		return -3;
+	direct = sameType && format == sourceTypes[0];
+
+	frames = frameCount;
+	long sourceBytes = 0;
+	for (size_t c = 0; c < sourceTypes.size(); c++)
+		if (sampleBytes(sourceTypes[c]) > sourceBytes)
+			sourceBytes = sampleBytes(sourceTypes[c]);
+	channelBytes = (long)alignUp(frames * sourceBytes);
+	frameBytes = (long)(sources.size() * sampleBytes(format));
+
+	long blocks = (long)(bufferSeconds * sampleRate / frames) + 1;
+	if (blocks < 8)
+		blocks = 8;
+	size_t blockBytes = (size_t)frames * frameBytes;
+	writeCapacity = blockBytes > RECORD_WRITE_BYTES ? blockBytes : RECORD_WRITE_BYTES - RECORD_WRITE_BYTES % blockBytes;
+	writeBuffer = (char *)alignedAlloc(writeCapacity);
+	scratch = (float *)alignedAlloc(2 * sources.size() * frames * sizeof(float));
+	if (!writeBuffer || !scratch || !ring.allocate(blocks, RECORD_HEADER_BYTES + sources.size() * channelBytes)){
+		close();
+		return -4;
+	}
+	writeFill = 0;
+	bufferBlocks = (long)ring.capacity();
+
+	file = fopen(path, "wb");
+	if (!file){
+		close();
+		return -5;
+	}
+	// we batch ourselves, stdio buffering would only add a copy
+	setvbuf(file, NULL, _IONBF, 0);
+	memset(&info, 0, sizeof(info));
+	info.channels = (int)sources.size();
+	info.sampleRate = sampleRate;
+	info.type = format;
+	if (!wavWriteHeader(file, &info)){
+		close();
+		return -5;
+	}
+
+	missed = 0;
+	overruns = 0;
+	highWater = 0;
+	framesWritten = 0;
+	bytesWritten = 0;
+	writeErrors = 0;
+	writerRunning = true;
+	if (uv_thread_create(&thread, writerThread, this) != 0){
+		writerRunning = false;
+		close();
+		return -6;
+	}
+	recording.store(true);
+	return 0;
+}
+
+void Recorder::close(){
+	// after this loop the driver thread is either out of capture() or sees recording false
+	recording.store(false);
+	while (busy.load())
+		sleepMillis(0);
+	if (writerRunning.load()){
+		writerRunning.store(false, std::memory_order_release);
+		uv_thread_join(&thread);
+	}
+	if (file){
+		// blocks lost after the last one that made it still count
+		writeSilence(missed);
+		missed = 0;
+		flush();
+		info.frames = framesWritten.load(std::memory_order_relaxed);
+		info.dataBytes = bytesWritten.load(std::memory_order_relaxed);
+		if (!wavFinishHeader(file, &info))
+			writeErrors.fetch_add(1, std::memory_order_relaxed);
+		fclose(file);
+		file = NULL;
+	}
+	ring.release();
+	if (writeBuffer)
+		alignedFree(writeBuffer);
+	if (scratch)
+		alignedFree(scratch);
+	writeBuffer = NULL;
+	scratch = NULL;
+}
+
+void Recorder::stats(RecorderStats *out){
+	out->recording = recording.load(std::memory_order_relaxed);
+	out->framesWritten = framesWritten.load(std::memory_order_relaxed);
+	out->bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+	out->overruns = overruns.load(std::memory_order_relaxed);
+	out->writeErrors = writeErrors.load(std::memory_order_relaxed);
+	out->bufferBlocks = bufferBlocks;
+	out->highWater = highWater.load(std::memory_order_relaxed);
+}
+
+void Recorder::capture(void *const *halves){
+	busy.store(true);
+	if (!recording.load()){
+		busy.store(false);
+		return;
+	}
+	char *slot = ring.writeSlot();
+	if (slot){
+		((RecordHeader *)slot)->gapBefore = missed;
+		missed = 0;
+		char *dst = slot + RECORD_HEADER_BYTES;
+		for (size_t c = 0; c < sources.size(); c++, dst += channelBytes)
+			memcpy(dst, halves[sources[c]], frames * sampleBytes(sourceTypes[c]));
+		ring.commit();
+		long waiting = (long)ring.pending();
+		if (waiting > highWater.load(std::memory_order_relaxed))
+			highWater.store(waiting, std::memory_order_relaxed);
+	}
+	else{
+		missed++;
+		overruns.fetch_add(1, std::memory_order_relaxed);
+	}
+	busy.store(false, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------------
+// writer thread
+
+void Recorder::writerThread(void *arg){
+	Recorder *recorder = (Recorder *)arg;
+	for (;;){
+		// read the flag first, so a stop can't slip in between the last drain and the check
+		bool stopping = !recorder->writerRunning.load(std::memory_order_acquire);
+		const char *slot;
+		bool any = false;
+		while ((slot = recorder->ring.readSlot()) != NULL){
+			recorder->writeSilence(((const RecordHeader *)slot)->gapBefore);
+			recorder->writeBlock(slot + RECORD_HEADER_BYTES);
+			recorder->ring.consume();
+			any = true;
+		}
+		if (stopping)
+			break;
+		if (!any)
+			sleepMillis(RECORD_IDLE_MS);
+	}
+}
+
+void Recorder::flush(){
+	if (!writeFill)
+		return;
+	if (fwrite(writeBuffer, 1, writeFill, file) != writeFill)
+		writeErrors.fetch_add(1, std::memory_order_relaxed);
+	bytesWritten.fetch_add(writeFill, std::memory_order_relaxed);
+	framesWritten.fetch_add(writeFill / frameBytes, std::memory_order_relaxed);
+	writeFill = 0;
+}
+
+void Recorder::writeSilence(uint64_t blocks){
+	size_t blockBytes = (size_t)frames * frameBytes;
+	for (uint64_t b = 0; b < blocks; b++){
+		if (writeFill + blockBytes > writeCapacity)
+			flush();
+		// zero is silence in every format we write
+		memset(writeBuffer + writeFill, 0, blockBytes);
+		writeFill += blockBytes;
+	}
+}
+
+void Recorder::writeBlock(const char *block){
+	size_t blockBytes = (size_t)frames * frameBytes;
+	if (writeFill + blockBytes > writeCapacity)
+		flush();
+	char *dst = writeBuffer + writeFill;
+	long channels = (long)sources.size();
+
+	if (direct){
+		// same format on both sides, only interleave
+		long bytes = sampleBytes(info.type);
+		for (long c = 0; c < channels; c++){
+			const char *src = block + c * channelBytes;
+			char *out = dst + c * bytes;
+			switch (bytes){
+				case 2:
+					for (long n = 0; n < frames; n++, src += 2, out += frameBytes)
+						memcpy(out, src, 2);
+					break;
+				case 3:
+					for (long n = 0; n < frames; n++, src += 3, out += frameBytes)
+						memcpy(out, src, 3);
+					break;
+				default:
+					for (long n = 0; n < frames; n++, src += 4, out += frameBytes)
+						memcpy(out, src, 4);
+			}
+		}
+	}
+	else{
+		// through float: planar into the first half of scratch, interleaved into the second
+		float *planar = scratch;
+		float *interleaved = scratch + channels * frames;
+		for (long c = 0; c < channels; c++){
+			getToFloat(sourceTypes[c])(block + c * channelBytes, planar + c * frames, frames);
+			for (long n = 0; n < frames; n++)
+				interleaved[n * channels + c] = planar[c * frames + n];
+		}
+		getFromFloat(info.type)(interleaved, dst, frames * channels);
+	}
+	writeFill += blockBytes;
+}
@@ -0,0 +1,86 @@
+#ifndef __Recorder__
+#define __Recorder__
+
+#include <uv.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "asiosys.h"
+#include "asio.h"
+#include "RingBuffer.h"
+#include "WavFile.h"
+
+// Streams input channels to a WAV (RF64 past 4GB) without JS seeing a single block.
+// The driver thread only copies its input halves into a ring sized for seconds of audio,
+// a writer thread interleaves and converts them and writes big sequential chunks.
+// When the disk falls so far behind that the ring fills up, the block is counted as an
+// overrun and written as silence later, so the file keeps its timing.
+
+enum {
+	kRecordNative = -1	// file format: the driver's own if a WAV can hold it, otherwise float
+};
+
+typedef struct RecorderStats{
+	bool recording;
+	uint64_t framesWritten;
+	uint64_t bytesWritten;
+	uint64_t overruns;		// blocks the ring had no room for
+	uint64_t writeErrors;
+	long bufferBlocks;		// ring capacity
+	long highWater;			// most blocks ever waiting for the writer
+}RecorderStats;
+
+class Recorder{
+public:
+	Recorder();
+	~Recorder();
+
+	// JS thread. channels index the created input buffers, format is kRecordNative or an
+	// LSB ASIO type. 0 on success, otherwise the negative codes in Recorder.cpp
+	int open(const char *path, const std::vector<int> &channels, ASIOSampleType format,
+		const ASIOSampleType *inputTypes, long inputs, long frames, double sampleRate, double bufferSeconds);
+	// waits for the driver thread to let go, flushes everything and fixes up the header
+	void close();
+	void stats(RecorderStats *out);
+	// the ring the driver thread writes into, to lock it in memory
+	const BlockRing &blocks() const { return ring; }
+
+	// driver thread, halves has the current buffer of every input
+	void capture(void *const *halves);
+
+private:
+	static void writerThread(void *arg);
+	void writeBlock(const char *slot);
+	void writeSilence(uint64_t blocks);
+	void flush();
+
+	FILE *file;
+	WavInfo info;
+	std::vector<int> sources;
+	std::vector<ASIOSampleType> sourceTypes;
+	bool direct;		// file format is the driver's, interleave the bytes as they are
+	long frames;
+	long channelBytes;	// one channel of one block in the driver's format, padded
+	long frameBytes;	// one interleaved frame in the file's format
+
+	BlockRing ring;
+	long bufferBlocks;
+	char *writeBuffer;
+	size_t writeCapacity;
+	size_t writeFill;
+	float *scratch;		// planar, then interleaved floats for converting
+
+	uv_thread_t thread;
+	std::atomic<bool> recording;
+	std::atomic<bool> busy;		// driver thread inside capture()
+	std::atomic<bool> writerRunning;
+	uint64_t missed;			// driver thread, blocks lost since the last committed one
+	std::atomic<uint64_t> overruns;
+	std::atomic<long> highWater;
+	std::atomic<uint64_t> framesWritten;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> writeErrors;
+};
+
+#endif
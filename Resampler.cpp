@@ -0,0 +1,179 @@
+#include <string.h>
+#include <math.h>
+#include "Resampler.h"
+#include "RingBuffer.h"
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RESAMPLE_X86 1
+#include <emmintrin.h>
+#else
+#define RESAMPLE_X86 0
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// stopband around -80 dB
+#define KAISER_BETA 8.0
+// the passband ends this far below the lower Nyquist, the rest is transition
+#define PASSBAND 0.91
+// how far setRatio() may move from what allocate() got
+#define RATIO_SLACK 1.05
+
+static double besselI0(double x){
+	double sum = 1., term = 1.;
+	for (int k = 1; k < 50; k++){
+		term *= (x / (2. * k)) * (x / (2. * k));
+		sum += term;
+		if (term < 1e-12 * sum)
+			break;
+	}
+	return sum;
+}
+
+// sum of x[k] * row[k] over taps, rows are aligned, x isn't
+static inline float dot(const float *x, const float *row, long taps){
+#if RESAMPLE_X86
+	__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+	for (long k = 0; k < taps; k += 8){
+		a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_load_ps(row + k)));
+		a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + k + 4), _mm_load_ps(row + k + 4)));
+	}
+	a0 = _mm_add_ps(a0, a1);
+	a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+	a0 = _mm_add_ss(a0, _mm_shuffle_ps(a0, a0, 1));
+	return _mm_cvtss_f32(a0);
+#else
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for (long k = 0; k < taps; k += 4){
+		s0 += x[k] * row[k];
+		s1 += x[k + 1] * row[k + 1];
+		s2 += x[k + 2] * row[k + 2];
+		s3 += x[k + 3] * row[k + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+Resampler::Resampler() : numChannels(0), taps(0), maxFrames(0), step(1.), maxStep(1.), memory(NULL), table(NULL),
+	history(NULL), historyStride(0), fill(0), position(0)
+{
+}
+
+Resampler::~Resampler(){
+	release();
+}
+
+bool Resampler::allocate(long channels, double ratio, long frames, long tapCount){
+	release();
+	if (channels <= 0 || ratio <= 0 || frames <= 0)
+		return false;
+	numChannels = channels;
+	taps = tapCount >= 8 ? (tapCount + 7) & ~7L : 8;
+	maxFrames = frames;
+	maxStep = ratio * RATIO_SLACK;
+	step = ratio;
+	// room for the window plus everything one process() can move past
+	historyStride = (long)(alignUp((taps + (size_t)ceil(maxFrames * maxStep) + 4) * sizeof(float)) / sizeof(float));
+	size_t tableBytes = alignUp((RESAMPLER_PHASES + 1) * taps * sizeof(float));
+	memory = (char *)alignedAlloc(tableBytes + numChannels * historyStride * sizeof(float));
+	if (!memory){
+		release();
+		return false;
+	}
+	table = (float *)memory;
+	history = (float *)(memory + tableBytes);
+
+	// cutoff at the lower of the two Nyquists, relative to the input rate
+	double cutoff = 0.5 * PASSBAND * (ratio > 1. ? 1. / ratio : 1.);
+	double half = taps / 2.;
+	for (long p = 0; p <= RESAMPLER_PHASES; p++){
+		float *row = table + p * taps;
+		double frac = (double)p / RESAMPLER_PHASES;
+		double sum = 0;
+		for (long k = 0; k < taps; k++){
+			// distance of tap k from the point being interpolated
+			double d = k - (half - 1.) - frac;
+			double x = 2. * cutoff * d;
+			double sinc = fabs(x) < 1e-9 ? 1. : sin(M_PI * x) / (M_PI * x);
+			double w = d / half;
+			double window = fabs(w) >= 1. ? 0. : besselI0(KAISER_BETA * sqrt(1. - w * w)) / besselI0(KAISER_BETA);
+			row[k] = (float)(2. * cutoff * sinc * window);
+			sum += row[k];
+		}
+		// unity gain at DC for every phase, or the interpolation between them ripples
+		for (long k = 0; k < taps; k++)
+			row[k] = (float)(row[k] / sum);
+	}
+	reset();
+	return true;
+}
+
+void Resampler::release(){
+	if (memory)
+		alignedFree(memory);
+	memory = NULL;
+	table = history = NULL;
+	numChannels = taps = maxFrames = historyStride = fill = 0;
+	position = 0;
+}
+
+void Resampler::reset(){
+	if (!memory)
+		return;
+	memset(history, 0, numChannels * historyStride * sizeof(float));
+	// silence up to the first window's centre, the first input sample comes out first
+	fill = taps / 2 - 1;
+	position = 0;
+}
+
+void Resampler::setRatio(double ratio){
+	if (ratio > maxStep)
+		ratio = maxStep;
+	if (ratio < maxStep / (RATIO_SLACK * RATIO_SLACK))
+		ratio = maxStep / (RATIO_SLACK * RATIO_SLACK);
+	step = ratio;
+}
+
+long Resampler::required(long outFrames) const{
+	if (outFrames <= 0)
+		return 0;
+	// the last window starts here and reaches taps + 1 frames on for the interpolation
+	long last = (long)(position + (outFrames - 1) * step);
+	long need = last + taps + 1 - fill;
+	return need > 0 ? need : 0;
+}
+
+void Resampler::process(float *const *out, long outFrames){
+	if (outFrames > maxFrames)
+		outFrames = maxFrames;
+	for (long c = 0; c < numChannels; c++){
+		const float *x = history + c * historyStride;
+		float *y = out[c];
+		double pos = position;
+		for (long n = 0; n < outFrames; n++){
+			long i = (long)pos;
+			double phase = (pos - i) * RESAMPLER_PHASES;
+			long p = (long)phase;
+			float t = (float)(phase - p);
+			const float *row = table + p * taps;
+			float a = dot(x + i, row, taps);
+			float b = dot(x + i, row + taps, taps);
+			y[n] = a + t * (b - a);
+			pos += step;
+		}
+	}
+	position += outFrames * step;
+	// slide what the next windows still need to the front
+	long consumed = (long)position;
+	if (consumed > fill)
+		consumed = fill;
+	if (consumed > 0){
+		for (long c = 0; c < numChannels; c++){
+			float *x = history + c * historyStride;
+			memmove(x, x + consumed, (fill - consumed) * sizeof(float));
+		}
+		fill -= consumed;
+		position -= consumed;
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef __Resampler__
+#define __Resampler__
+
+#include <stddef.h>
+
+// Variable ratio polyphase resampler on planar float channels. A Kaiser windowed sinc is
+// tabulated at RESAMPLER_PHASES fractional offsets, every output sample is the dot product
+// of the input around it with the two neighbouring phases, interpolated linearly, so the
+// ratio can move continuously from block to block (drift compensation) as well as sit at a
+// fixed rate conversion. The cutoff follows the lower of the two rates the table is built
+// for. SSE2 does the dot products where there is SSE2, with a scalar reference otherwise.
+// Pull model: ask required() how much input the next outFrames need, commit() that much
+// into input(c) of every channel, process() hands out exactly outFrames.
+
+#define RESAMPLER_PHASES 256
+// taps per phase, rounded up to a multiple of 8; the drift bridge gets away with fewer
+#define RESAMPLER_TAPS 64
+#define RESAMPLER_SHORT_TAPS 32
+
+class Resampler{
+public:
+	Resampler();
+	~Resampler();
+
+	// ratio is input frames per output frame, the table is built for it and the ratio may
+	// stray a few percent from it later. maxFrames is the most one process() makes
+	bool allocate(long channels, double ratio, long maxFrames, long taps);
+	void release();
+	// forget every input, the filter starts over on silence
+	void reset();
+	bool allocated() const { return memory != NULL; }
+
+	void setRatio(double ratio);
+	double ratio() const { return step; }
+	// input frames still missing for outFrames more output frames, 0 when enough is buffered
+	long required(long outFrames) const;
+	// where the next input frames of channel c go, there's room for what required() asked for
+	float *input(long c) { return history + c * historyStride + fill; }
+	void commit(long frames) { fill += frames; }
+	// frames input() has room for right now
+	long space() const { return historyStride - fill; }
+	// input frames buffered and not consumed yet
+	double buffered() const { return fill - position - (taps / 2 - 1); }
+	void process(float *const *out, long outFrames);
+	// input frames the filter looks ahead, what it adds to the latency
+	double latency() const { return taps / 2.; }
+
+private:
+	Resampler(const Resampler &);
+	Resampler &operator=(const Resampler &);
+
+	long numChannels;
+	long taps;
+	long maxFrames;
+	double step;			// current ratio
+	double maxStep;			// what history was sized for
+
+	char *memory;
+	float *table;			// RESAMPLER_PHASES + 1 rows of taps
+	float *history;			// per channel, historyStride floats each
+	long historyStride;
+	long fill;				// frames of history that hold input
+	double position;		// where the next output's window starts, in history frames
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef __RingBuffer__
+#define __RingBuffer__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <atomic>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// all ring memory is aligned to a cache line, slots are padded to it as well
+#define RING_ALIGN 64
+
+static inline void *alignedAlloc(size_t bytes){
+#if defined(_WIN32)
+	return _aligned_malloc(bytes, RING_ALIGN);
+#else
+	void *p = NULL;
+	if(posix_memalign(&p, RING_ALIGN, bytes) != 0)
+		return NULL;
+	return p;
+#endif
+}
+static inline void alignedFree(void *p){
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+static inline size_t alignUp(size_t bytes){
+	return (bytes + RING_ALIGN - 1) & ~(size_t)(RING_ALIGN - 1);
+}
+
+// Single producer / single consumer ring of fixed size blocks.
+// Everything is allocated by allocate() so the producer (the driver thread)
+// never touches the heap, it only claims a slot, fills it and commits it.
+// The head and tail counters are free running and live on their own cache lines.
+class BlockRing{
+public:
+	BlockRing() : memory(NULL), slotCount(0), slotBytes(0), mask(0), head(0), tail(0) {}
+	~BlockRing() { release(); }
+
+	// slotCount gets rounded up to a power of two
+	bool allocate(size_t count, size_t bytes){
+		release();
+		size_t n = 1;
+		while(n < count)
+			n <<= 1;
+		slotBytes = alignUp(bytes);
+		memory = (char *)alignedAlloc(n * slotBytes);
+		if(!memory)
+			return false;
+		slotCount = n;
+		mask = n - 1;
+		reset();
+		return true;
+	}
+	void release(){
+		if(memory)
+			alignedFree(memory);
+		memory = NULL;
+		slotCount = slotBytes = mask = 0;
+	}
+	// only call while neither side is running
+	void reset(){
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+	}
+
+	// producer side, returns NULL when the ring is full
+	char *writeSlot(){
+		size_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) >= slotCount)
+			return NULL;
+		return memory + (h & mask) * slotBytes;
+	}
+	// position of the slot writeSlot() returns
+	size_t writePosition() const { return head.load(std::memory_order_relaxed) & mask; }
+	void commit(){
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// consumer side, returns NULL when the ring is empty
+	char *readSlot(){
+		size_t t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire))
+			return NULL;
+		return memory + (t & mask) * slotBytes;
+	}
+	// position of the slot readSlot() returns, for looking up per slot state
+	size_t readPosition() const { return tail.load(std::memory_order_relaxed) & mask; }
+	void consume(){
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	size_t pending() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+	size_t capacity() const { return slotCount; }
+	size_t blockBytes() const { return slotBytes; }
+	// slot memory by absolute position, used to set up views over the whole pool once
+	char *slot(size_t i) const { return memory + (i & mask) * slotBytes; }
+
+private:
+	char *memory;
+	size_t slotCount;
+	size_t slotBytes;
+	size_t mask;
+	alignas(RING_ALIGN) std::atomic<size_t> head;
+	alignas(RING_ALIGN) std::atomic<size_t> tail;
+	char pad[RING_ALIGN - sizeof(std::atomic<size_t>)];
+};
+
+#endif
@@ -0,0 +1,620 @@
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "SampleConvert.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CONVERT_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC emits any intrinsic without extra flags
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+// gcc/clang need the instruction set enabled per function, the rest of the file stays SSE2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CONVERT_X86 0
+#endif
+
+#define MAX_SAMPLE_TYPES 64
+
+static ToFloatKernel toFloatKernels[3][MAX_SAMPLE_TYPES];
+static FromFloatKernel fromFloatKernels[3][MAX_SAMPLE_TYPES];
+static int activeLevel = -1;
+
+long sampleBytes(ASIOSampleType type){
+	switch (type){
+		case ASIOSTInt16LSB:
+		case ASIOSTInt16MSB:
+			return 2;
+		case ASIOSTInt24LSB:		// used for 20 bits as well
+		case ASIOSTInt24MSB:
+			return 3;
+		case ASIOSTFloat64LSB:
+		case ASIOSTFloat64MSB:
+			return 8;
+		case ASIOSTDSDInt8LSB1:
+		case ASIOSTDSDInt8MSB1:
+		case ASIOSTDSDInt8NER8:
+			return 1;
+		default:
+			return 4;
+	}
+}
+
+const char *sampleTypeName(ASIOSampleType type){
+	switch (type){
+		case ASIOSTInt16LSB: return "int16";
+		case ASIOSTInt24LSB: return "int24";
+		case ASIOSTInt32LSB: return "int32";
+		case ASIOSTFloat32LSB: return "float32";
+		case ASIOSTFloat64LSB: return "float64";
+		case ASIOSTInt32LSB16: return "int32lsb16";
+		case ASIOSTInt32LSB18: return "int32lsb18";
+		case ASIOSTInt32LSB20: return "int32lsb20";
+		case ASIOSTInt32LSB24: return "int32lsb24";
+		case ASIOSTInt16MSB: return "int16msb";
+		case ASIOSTInt24MSB: return "int24msb";
+		case ASIOSTInt32MSB: return "int32msb";
+		case ASIOSTFloat32MSB: return "float32msb";
+		case ASIOSTFloat64MSB: return "float64msb";
+		case ASIOSTInt32MSB16: return "int32msb16";
+		case ASIOSTInt32MSB18: return "int32msb18";
+		case ASIOSTInt32MSB20: return "int32msb20";
+		case ASIOSTInt32MSB24: return "int32msb24";
+		case ASIOSTDSDInt8LSB1: return "dsd8lsb1";
+		case ASIOSTDSDInt8MSB1: return "dsd8msb1";
+		case ASIOSTDSDInt8NER8: return "dsd8ner8";
+		default: return "unknown";
+	}
+}
+
+//----------------------------------------------------------------------------------
+// scalar reference kernels, the vector versions below have to match these bit for bit
+
+static inline uint16_t swap16(uint16_t v){ return (uint16_t)((v >> 8) | (v << 8)); }
+static inline uint32_t swap32(uint32_t v){
+	return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+static inline uint64_t swap64(uint64_t v){
+	return ((uint64_t)swap32((uint32_t)v) << 32) | swap32((uint32_t)(v >> 32));
+}
+
+// 2^(bits-1) and the largest value we quantize to, 2^31-1 is not a float so 32 bits stop just below it
+#define SCALE(bits) ((float)(1u << ((bits) - 1)))
+#define MAXQ(bits) ((bits) == 32 ? 2147483520.f : SCALE(bits) - 1.f)
+
+template <int bits> static inline int32_t quantize(float x){
+	float v = x * SCALE(bits);
+	// same operand order as minps/maxps, so NaN ends up at the same place too
+	v = v < MAXQ(bits) ? v : MAXQ(bits);
+	v = v > -SCALE(bits) ? v : -SCALE(bits);
+	return (int32_t)lrintf(v);
+}
+
+template <bool msb> static void int16ToFloat(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	for (long i = 0; i < count; i++, p += 2){
+		uint16_t v;
+		memcpy(&v, p, 2);
+		if (msb)
+			v = swap16(v);
+		dst[i] = (float)(int16_t)v * (1.f / SCALE(16));
+	}
+}
+template <bool msb> static void int24ToFloat(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	for (long i = 0; i < count; i++, p += 3){
+		uint32_t v = msb ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)
+			: ((uint32_t)p[2] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 8);
+		dst[i] = (float)((int32_t)v >> 8) * (1.f / SCALE(24));
+	}
+}
+// 32 bit containers, bits says where the data is aligned (Int32LSB16 etc.)
+template <int bits, bool msb> static void int32ToFloat(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	for (long i = 0; i < count; i++, p += 4){
+		uint32_t v;
+		memcpy(&v, p, 4);
+		if (msb)
+			v = swap32(v);
+		dst[i] = (float)(int32_t)v * (1.f / SCALE(bits));
+	}
+}
+template <bool msb> static void float32ToFloat(const void *src, float *dst, long count){
+	if (!msb){
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
+	const unsigned char *p = (const unsigned char *)src;
+	for (long i = 0; i < count; i++, p += 4){
+		uint32_t v;
+		memcpy(&v, p, 4);
+		v = swap32(v);
+		memcpy(&dst[i], &v, 4);
+	}
+}
+template <bool msb> static void float64ToFloat(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	for (long i = 0; i < count; i++, p += 8){
+		uint64_t v;
+		double d;
+		memcpy(&v, p, 8);
+		if (msb)
+			v = swap64(v);
+		memcpy(&d, &v, 8);
+		dst[i] = (float)d;
+	}
+}
+
+template <bool msb> static void floatToInt16(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	for (long i = 0; i < count; i++, p += 2){
+		uint16_t v = (uint16_t)(int16_t)quantize<16>(src[i]);
+		if (msb)
+			v = swap16(v);
+		memcpy(p, &v, 2);
+	}
+}
+template <bool msb> static void floatToInt24(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	for (long i = 0; i < count; i++, p += 3){
+		uint32_t v = (uint32_t)quantize<24>(src[i]);
+		p[msb ? 2 : 0] = (unsigned char)v;
+		p[1] = (unsigned char)(v >> 8);
+		p[msb ? 0 : 2] = (unsigned char)(v >> 16);
+	}
+}
+template <int bits, bool msb> static void floatToInt32(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	for (long i = 0; i < count; i++, p += 4){
+		uint32_t v = (uint32_t)quantize<bits>(src[i]);
+		if (msb)
+			v = swap32(v);
+		memcpy(p, &v, 4);
+	}
+}
+template <bool msb> static void floatToFloat32(const float *src, void *dst, long count){
+	if (!msb){
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
+	unsigned char *p = (unsigned char *)dst;
+	for (long i = 0; i < count; i++, p += 4){
+		uint32_t v;
+		memcpy(&v, &src[i], 4);
+		v = swap32(v);
+		memcpy(p, &v, 4);
+	}
+}
+template <bool msb> static void floatToFloat64(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	for (long i = 0; i < count; i++, p += 8){
+		double d = src[i];
+		uint64_t v;
+		memcpy(&v, &d, 8);
+		if (msb)
+			v = swap64(v);
+		memcpy(p, &v, 8);
+	}
+}
+
+#if CONVERT_X86
+//----------------------------------------------------------------------------------
+// SSE2, part of every x64 cpu
+
+static inline __m128i swap16x8(__m128i v){
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+static inline __m128i swap32x4(__m128i v){
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return swap16x8(v);
+}
+template <int bits> static inline __m128i quantizeSSE2(__m128 x){
+	__m128 v = _mm_mul_ps(x, _mm_set1_ps(SCALE(bits)));
+	v = _mm_min_ps(v, _mm_set1_ps(MAXQ(bits)));
+	v = _mm_max_ps(v, _mm_set1_ps(-SCALE(bits)));
+	return _mm_cvtps_epi32(v);
+}
+static inline uint32_t load32(const unsigned char *p){
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+template <bool msb> static void int16ToFloatSSE2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	const __m128 scale = _mm_set1_ps(1.f / SCALE(16));
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i * 2));
+		if (msb)
+			v = swap16x8(v);
+		// put every sample in the top half of a dword, the arithmetic shift sign extends it
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	int16ToFloat<msb>(p + i * 2, dst + i, count - i);
+}
+template <bool msb> static void int24ToFloatSSE2(const void *src, float *dst, long count){
+	// no byte shuffle in SSE2, so gather four overlapping dwords and shift the sample to the top
+	const unsigned char *p = (const unsigned char *)src;
+	const __m128 scale = _mm_set1_ps(1.f / SCALE(24));
+	long i = 0;
+	// the dword load of the last sample reads one byte past it
+	for (; i + 5 <= count; i += 4){
+		const unsigned char *s = p + i * 3;
+		__m128i v = _mm_set_epi32((int)load32(s + 9), (int)load32(s + 6), (int)load32(s + 3), (int)load32(s));
+		if (msb)
+			v = swap32x4(v);
+		else
+			v = _mm_slli_epi32(v, 8);
+		v = _mm_srai_epi32(v, 8);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	int24ToFloat<msb>(p + i * 3, dst + i, count - i);
+}
+template <int bits, bool msb> static void int32ToFloatSSE2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	const __m128 scale = _mm_set1_ps(1.f / SCALE(bits));
+	long i = 0;
+	for (; i + 4 <= count; i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i * 4));
+		if (msb)
+			v = swap32x4(v);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	int32ToFloat<bits, msb>(p + i * 4, dst + i, count - i);
+}
+static void float32MSBToFloatSSE2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	long i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i), swap32x4(_mm_loadu_si128((const __m128i *)(p + i * 4))));
+	float32ToFloat<true>(p + i * 4, dst + i, count - i);
+}
+
+template <bool msb> static void floatToInt16SSE2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m128i v = _mm_packs_epi32(quantizeSSE2<16>(_mm_loadu_ps(src + i)), quantizeSSE2<16>(_mm_loadu_ps(src + i + 4)));
+		if (msb)
+			v = swap16x8(v);
+		_mm_storeu_si128((__m128i *)(p + i * 2), v);
+	}
+	floatToInt16<msb>(src + i, p + i * 2, count - i);
+}
+template <bool msb> static void floatToInt24SSE2(const float *src, void *dst, long count){
+	// quantizing is vectorized, the 3 byte stores are not without a byte shuffle
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 4 <= count; i += 4){
+		uint32_t q[4];
+		_mm_storeu_si128((__m128i *)q, quantizeSSE2<24>(_mm_loadu_ps(src + i)));
+		unsigned char *d = p + i * 3;
+		for (int k = 0; k < 4; k++, d += 3){
+			d[msb ? 2 : 0] = (unsigned char)q[k];
+			d[1] = (unsigned char)(q[k] >> 8);
+			d[msb ? 0 : 2] = (unsigned char)(q[k] >> 16);
+		}
+	}
+	floatToInt24<msb>(src + i, p + i * 3, count - i);
+}
+template <int bits, bool msb> static void floatToInt32SSE2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 4 <= count; i += 4){
+		__m128i v = quantizeSSE2<bits>(_mm_loadu_ps(src + i));
+		if (msb)
+			v = swap32x4(v);
+		_mm_storeu_si128((__m128i *)(p + i * 4), v);
+	}
+	floatToInt32<bits, msb>(src + i, p + i * 4, count - i);
+}
+static void floatToFloat32MSBSSE2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(p + i * 4), swap32x4(_mm_loadu_si128((const __m128i *)(src + i))));
+	floatToFloat32<true>(src + i, p + i * 4, count - i);
+}
+
+//----------------------------------------------------------------------------------
+// AVX2, eight samples per step and a real byte shuffle for the packed 24 bit types
+
+#define SHUF_SWAP16 _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14, 1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14)
+#define SHUF_SWAP32 _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12, 3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12)
+// four packed samples of a lane into the top three bytes of each dword
+#define SHUF_UNPACK24_LSB _mm256_setr_epi8(-1,0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11, -1,0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11)
+#define SHUF_UNPACK24_MSB _mm256_setr_epi8(-1,2,1,0,-1,5,4,3,-1,8,7,6,-1,11,10,9, -1,2,1,0,-1,5,4,3,-1,8,7,6,-1,11,10,9)
+// the low three bytes of each dword packed into the first twelve bytes of a lane
+#define SHUF_PACK24_LSB _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1, 0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1)
+#define SHUF_PACK24_MSB _mm256_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1, 2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1)
+
+template <int bits> TARGET_AVX2 static inline __m256i quantizeAVX2(__m256 x){
+	__m256 v = _mm256_mul_ps(x, _mm256_set1_ps(SCALE(bits)));
+	v = _mm256_min_ps(v, _mm256_set1_ps(MAXQ(bits)));
+	v = _mm256_max_ps(v, _mm256_set1_ps(-SCALE(bits)));
+	return _mm256_cvtps_epi32(v);
+}
+
+template <bool msb> TARGET_AVX2 static void int16ToFloatAVX2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	const __m256 scale = _mm256_set1_ps(1.f / SCALE(16));
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i * 2));
+		if (msb)
+			v = _mm_shuffle_epi8(v, _mm256_castsi256_si128(SHUF_SWAP16));
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v)), scale));
+	}
+	int16ToFloat<msb>(p + i * 2, dst + i, count - i);
+}
+template <bool msb> TARGET_AVX2 static void int24ToFloatAVX2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	const __m256 scale = _mm256_set1_ps(1.f / SCALE(24));
+	const __m256i shuffle = msb ? SHUF_UNPACK24_MSB : SHUF_UNPACK24_LSB;
+	long i = 0;
+	// each lane loads 16 bytes for 12 bytes of samples, keep the last load inside the buffer
+	for (; i + 10 <= count; i += 8){
+		const unsigned char *s = p + i * 3;
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+			_mm_loadu_si128((const __m128i *)(s + 12)), 1);
+		v = _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8);
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	int24ToFloat<msb>(p + i * 3, dst + i, count - i);
+}
+template <int bits, bool msb> TARGET_AVX2 static void int32ToFloatAVX2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	const __m256 scale = _mm256_set1_ps(1.f / SCALE(bits));
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i * 4));
+		if (msb)
+			v = _mm256_shuffle_epi8(v, SHUF_SWAP32);
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	int32ToFloat<bits, msb>(p + i * 4, dst + i, count - i);
+}
+TARGET_AVX2 static void float32MSBToFloatAVX2(const void *src, float *dst, long count){
+	const unsigned char *p = (const unsigned char *)src;
+	long i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(p + i * 4)), SHUF_SWAP32));
+	float32ToFloat<true>(p + i * 4, dst + i, count - i);
+}
+
+template <bool msb> TARGET_AVX2 static void floatToInt16AVX2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m256i q = quantizeAVX2<16>(_mm256_loadu_ps(src + i));
+		// packs works per lane, so pack the two halves with the 128 bit version to keep the order
+		__m128i v = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+		if (msb)
+			v = _mm_shuffle_epi8(v, _mm256_castsi256_si128(SHUF_SWAP16));
+		_mm_storeu_si128((__m128i *)(p + i * 2), v);
+	}
+	floatToInt16<msb>(src + i, p + i * 2, count - i);
+}
+template <bool msb> TARGET_AVX2 static void floatToInt24AVX2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	const __m256i shuffle = msb ? SHUF_PACK24_MSB : SHUF_PACK24_LSB;
+	long i = 0;
+	// every lane stores 16 bytes of which 12 are samples, the next store overwrites the rest,
+	// stop early enough that the last one stays inside the buffer
+	for (; i + 10 <= count; i += 8){
+		__m256i v = _mm256_shuffle_epi8(quantizeAVX2<24>(_mm256_loadu_ps(src + i)), shuffle);
+		unsigned char *d = p + i * 3;
+		_mm_storeu_si128((__m128i *)d, _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(d + 12), _mm256_extracti128_si256(v, 1));
+	}
+	floatToInt24<msb>(src + i, p + i * 3, count - i);
+}
+template <int bits, bool msb> TARGET_AVX2 static void floatToInt32AVX2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m256i v = quantizeAVX2<bits>(_mm256_loadu_ps(src + i));
+		if (msb)
+			v = _mm256_shuffle_epi8(v, SHUF_SWAP32);
+		_mm256_storeu_si256((__m256i *)(p + i * 4), v);
+	}
+	floatToInt32<bits, msb>(src + i, p + i * 4, count - i);
+}
+TARGET_AVX2 static void floatToFloat32MSBAVX2(const float *src, void *dst, long count){
+	unsigned char *p = (unsigned char *)dst;
+	long i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(p + i * 4), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), SHUF_SWAP32));
+	floatToFloat32<true>(src + i, p + i * 4, count - i);
+}
+
+static bool cpuHasAVX2(){
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// the OS has to save the ymm registers as well
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+//----------------------------------------------------------------------------------
+
+#define SET_TO(level, type, fn) toFloatKernels[level][type] = fn
+#define SET_FROM(level, type, fn) fromFloatKernels[level][type] = fn
+
+void initSampleConvert(){
+	if (activeLevel >= 0)
+		return;
+	memset(toFloatKernels, 0, sizeof(toFloatKernels));
+	memset(fromFloatKernels, 0, sizeof(fromFloatKernels));
+
+	// every level starts out as the scalar set, the vector ones only replace what they speed up
+	for (int level = kConvertScalar; level <= kConvertAVX2; level++){
+		SET_TO(level, ASIOSTInt16LSB, int16ToFloat<false>);
+		SET_TO(level, ASIOSTInt16MSB, int16ToFloat<true>);
+		SET_TO(level, ASIOSTInt24LSB, int24ToFloat<false>);
+		SET_TO(level, ASIOSTInt24MSB, int24ToFloat<true>);
+		SET_TO(level, ASIOSTInt32LSB, (int32ToFloat<32, false>));
+		SET_TO(level, ASIOSTInt32MSB, (int32ToFloat<32, true>));
+		SET_TO(level, ASIOSTInt32LSB16, (int32ToFloat<16, false>));
+		SET_TO(level, ASIOSTInt32LSB18, (int32ToFloat<18, false>));
+		SET_TO(level, ASIOSTInt32LSB20, (int32ToFloat<20, false>));
+		SET_TO(level, ASIOSTInt32LSB24, (int32ToFloat<24, false>));
+		SET_TO(level, ASIOSTInt32MSB16, (int32ToFloat<16, true>));
+		SET_TO(level, ASIOSTInt32MSB18, (int32ToFloat<18, true>));
+		SET_TO(level, ASIOSTInt32MSB20, (int32ToFloat<20, true>));
+		SET_TO(level, ASIOSTInt32MSB24, (int32ToFloat<24, true>));
+		SET_TO(level, ASIOSTFloat32LSB, float32ToFloat<false>);
+		SET_TO(level, ASIOSTFloat32MSB, float32ToFloat<true>);
+		SET_TO(level, ASIOSTFloat64LSB, float64ToFloat<false>);
+		SET_TO(level, ASIOSTFloat64MSB, float64ToFloat<true>);
+
+		SET_FROM(level, ASIOSTInt16LSB, floatToInt16<false>);
+		SET_FROM(level, ASIOSTInt16MSB, floatToInt16<true>);
+		SET_FROM(level, ASIOSTInt24LSB, floatToInt24<false>);
+		SET_FROM(level, ASIOSTInt24MSB, floatToInt24<true>);
+		SET_FROM(level, ASIOSTInt32LSB, (floatToInt32<32, false>));
+		SET_FROM(level, ASIOSTInt32MSB, (floatToInt32<32, true>));
+		SET_FROM(level, ASIOSTInt32LSB16, (floatToInt32<16, false>));
+		SET_FROM(level, ASIOSTInt32LSB18, (floatToInt32<18, false>));
+		SET_FROM(level, ASIOSTInt32LSB20, (floatToInt32<20, false>));
+		SET_FROM(level, ASIOSTInt32LSB24, (floatToInt32<24, false>));
+		SET_FROM(level, ASIOSTInt32MSB16, (floatToInt32<16, true>));
+		SET_FROM(level, ASIOSTInt32MSB18, (floatToInt32<18, true>));
+		SET_FROM(level, ASIOSTInt32MSB20, (floatToInt32<20, true>));
+		SET_FROM(level, ASIOSTInt32MSB24, (floatToInt32<24, true>));
+		SET_FROM(level, ASIOSTFloat32LSB, floatToFloat32<false>);
+		SET_FROM(level, ASIOSTFloat32MSB, floatToFloat32<true>);
+		SET_FROM(level, ASIOSTFloat64LSB, floatToFloat64<false>);
+		SET_FROM(level, ASIOSTFloat64MSB, floatToFloat64<true>);
+	}
+	activeLevel = kConvertScalar;
+
+#if CONVERT_X86
+	SET_TO(kConvertSSE2, ASIOSTInt16LSB, int16ToFloatSSE2<false>);
+	SET_TO(kConvertSSE2, ASIOSTInt16MSB, int16ToFloatSSE2<true>);
+	SET_TO(kConvertSSE2, ASIOSTInt24LSB, int24ToFloatSSE2<false>);
+	SET_TO(kConvertSSE2, ASIOSTInt24MSB, int24ToFloatSSE2<true>);
+	SET_TO(kConvertSSE2, ASIOSTInt32LSB, (int32ToFloatSSE2<32, false>));
+	SET_TO(kConvertSSE2, ASIOSTInt32MSB, (int32ToFloatSSE2<32, true>));
+	SET_TO(kConvertSSE2, ASIOSTInt32LSB16, (int32ToFloatSSE2<16, false>));
+	SET_TO(kConvertSSE2, ASIOSTInt32LSB18, (int32ToFloatSSE2<18, false>));
+	SET_TO(kConvertSSE2, ASIOSTInt32LSB20, (int32ToFloatSSE2<20, false>));
+	SET_TO(kConvertSSE2, ASIOSTInt32LSB24, (int32ToFloatSSE2<24, false>));
+	SET_TO(kConvertSSE2, ASIOSTInt32MSB16, (int32ToFloatSSE2<16, true>));
+	SET_TO(kConvertSSE2, ASIOSTInt32MSB18, (int32ToFloatSSE2<18, true>));
+	SET_TO(kConvertSSE2, ASIOSTInt32MSB20, (int32ToFloatSSE2<20, true>));
+	SET_TO(kConvertSSE2, ASIOSTInt32MSB24, (int32ToFloatSSE2<24, true>));
+	SET_TO(kConvertSSE2, ASIOSTFloat32MSB, float32MSBToFloatSSE2);
+	SET_FROM(kConvertSSE2, ASIOSTInt16LSB, floatToInt16SSE2<false>);
+	SET_FROM(kConvertSSE2, ASIOSTInt16MSB, floatToInt16SSE2<true>);
+	SET_FROM(kConvertSSE2, ASIOSTInt24LSB, floatToInt24SSE2<false>);
+	SET_FROM(kConvertSSE2, ASIOSTInt24MSB, floatToInt24SSE2<true>);
+	SET_FROM(kConvertSSE2, ASIOSTInt32LSB, (floatToInt32SSE2<32, false>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32MSB, (floatToInt32SSE2<32, true>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32LSB16, (floatToInt32SSE2<16, false>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32LSB18, (floatToInt32SSE2<18, false>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32LSB20, (floatToInt32SSE2<20, false>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32LSB24, (floatToInt32SSE2<24, false>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32MSB16, (floatToInt32SSE2<16, true>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32MSB18, (floatToInt32SSE2<18, true>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32MSB20, (floatToInt32SSE2<20, true>));
+	SET_FROM(kConvertSSE2, ASIOSTInt32MSB24, (floatToInt32SSE2<24, true>));
+	SET_FROM(kConvertSSE2, ASIOSTFloat32MSB, floatToFloat32MSBSSE2);
+
+	// AVX2 falls back to SSE2 for whatever it doesn't cover
+	memcpy(toFloatKernels[kConvertAVX2], toFloatKernels[kConvertSSE2], sizeof(toFloatKernels[0]));
+	memcpy(fromFloatKernels[kConvertAVX2], fromFloatKernels[kConvertSSE2], sizeof(fromFloatKernels[0]));
+	SET_TO(kConvertAVX2, ASIOSTInt16LSB, int16ToFloatAVX2<false>);
+	SET_TO(kConvertAVX2, ASIOSTInt16MSB, int16ToFloatAVX2<true>);
+	SET_TO(kConvertAVX2, ASIOSTInt24LSB, int24ToFloatAVX2<false>);
+	SET_TO(kConvertAVX2, ASIOSTInt24MSB, int24ToFloatAVX2<true>);
+	SET_TO(kConvertAVX2, ASIOSTInt32LSB, (int32ToFloatAVX2<32, false>));
+	SET_TO(kConvertAVX2, ASIOSTInt32MSB, (int32ToFloatAVX2<32, true>));
+	SET_TO(kConvertAVX2, ASIOSTInt32LSB16, (int32ToFloatAVX2<16, false>));
+	SET_TO(kConvertAVX2, ASIOSTInt32LSB18, (int32ToFloatAVX2<18, false>));
+	SET_TO(kConvertAVX2, ASIOSTInt32LSB20, (int32ToFloatAVX2<20, false>));
+	SET_TO(kConvertAVX2, ASIOSTInt32LSB24, (int32ToFloatAVX2<24, false>));
+	SET_TO(kConvertAVX2, ASIOSTInt32MSB16, (int32ToFloatAVX2<16, true>));
+	SET_TO(kConvertAVX2, ASIOSTInt32MSB18, (int32ToFloatAVX2<18, true>));
+	SET_TO(kConvertAVX2, ASIOSTInt32MSB20, (int32ToFloatAVX2<20, true>));
+	SET_TO(kConvertAVX2, ASIOSTInt32MSB24, (int32ToFloatAVX2<24, true>));
+	SET_TO(kConvertAVX2, ASIOSTFloat32MSB, float32MSBToFloatAVX2);
+	SET_FROM(kConvertAVX2, ASIOSTInt16LSB, floatToInt16AVX2<false>);
+	SET_FROM(kConvertAVX2, ASIOSTInt16MSB, floatToInt16AVX2<true>);
+	SET_FROM(kConvertAVX2, ASIOSTInt24LSB, floatToInt24AVX2<false>);
+	SET_FROM(kConvertAVX2, ASIOSTInt24MSB, floatToInt24AVX2<true>);
+	SET_FROM(kConvertAVX2, ASIOSTInt32LSB, (floatToInt32AVX2<32, false>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32MSB, (floatToInt32AVX2<32, true>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32LSB16, (floatToInt32AVX2<16, false>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32LSB18, (floatToInt32AVX2<18, false>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32LSB20, (floatToInt32AVX2<20, false>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32LSB24, (floatToInt32AVX2<24, false>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32MSB16, (floatToInt32AVX2<16, true>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32MSB18, (floatToInt32AVX2<18, true>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32MSB20, (floatToInt32AVX2<20, true>));
+	SET_FROM(kConvertAVX2, ASIOSTInt32MSB24, (floatToInt32AVX2<24, true>));
+	SET_FROM(kConvertAVX2, ASIOSTFloat32MSB, floatToFloat32MSBAVX2);
+
+	activeLevel = cpuHasAVX2() ? kConvertAVX2 : kConvertSSE2;
+#else
+	// no vector kernels on this architecture, the other levels stay scalar
+#endif
+}
+
+int convertLevel(){
+	initSampleConvert();
+	return activeLevel;
+}
+const char *convertLevelName(int level){
+	switch (level){
+		case kConvertSSE2:
+			return "sse2";
+		case kConvertAVX2:
+			return "avx2";
+		default:
+			return "scalar";
+	}
+}
+
+ToFloatKernel getToFloat(ASIOSampleType type, int level){
+	initSampleConvert();
+	if (type < 0 || type >= MAX_SAMPLE_TYPES || level < kConvertScalar || level > kConvertAVX2)
+		return NULL;
+	return toFloatKernels[level][type];
+}
+FromFloatKernel getFromFloat(ASIOSampleType type, int level){
+	initSampleConvert();
+	if (type < 0 || type >= MAX_SAMPLE_TYPES || level < kConvertScalar || level > kConvertAVX2)
+		return NULL;
+	return fromFloatKernels[level][type];
+}
+ToFloatKernel getToFloat(ASIOSampleType type){
+	return getToFloat(type, convertLevel());
+}
+FromFloatKernel getFromFloat(ASIOSampleType type){
+	return getFromFloat(type, convertLevel());
+}
@@ -0,0 +1,40 @@
+#ifndef __SampleConvert__
+#define __SampleConvert__
+
+#include "asiosys.h"
+#include "asio.h"
+
+// Conversion between the native ASIO sample types and normalized Float32.
+// Integer types are scaled by 2^(bits-1) in both directions, so a round trip
+// is lossless, floats coming back are clamped to the range of the type.
+// Every kernel has a scalar reference, SSE2/AVX2 versions are picked at runtime
+// and produce bit identical results.
+
+typedef void (*ToFloatKernel)(const void *src, float *dst, long count);
+typedef void (*FromFloatKernel)(const float *src, void *dst, long count);
+
+// kernel sets, convertLevel() reports which one getToFloat/getFromFloat hand out
+enum {
+	kConvertScalar = 0,
+	kConvertSSE2,
+	kConvertAVX2
+};
+
+// detects the cpu and picks the fastest kernels, safe to call more than once
+void initSampleConvert();
+int convertLevel();
+const char *convertLevelName(int level);
+
+// NULL for types we can't convert (DSD)
+ToFloatKernel getToFloat(ASIOSampleType type);
+FromFloatKernel getFromFloat(ASIOSampleType type);
+// same, but from a given kernel set, meant for comparing against the scalar reference
+ToFloatKernel getToFloat(ASIOSampleType type, int level);
+FromFloatKernel getFromFloat(ASIOSampleType type, int level);
+
+// bytes one sample of the given type takes up in the driver buffers
+long sampleBytes(ASIOSampleType type);
+// short name for reporting, like 'int24' or 'float32msb'
+const char *sampleTypeName(ASIOSampleType type);
+
+#endif
@@ -0,0 +1,320 @@
+#include <string.h>
+#include "SharedRing.h"
+#include "RingBuffer.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SHARED_MAX_NAME 200
+#define SHARED_MAX_SLOTS 65536
+
+static_assert(sizeof(SharedHeader) == SHARED_HEADER_BYTES, "SharedHeader is part of the shared layout");
+static_assert(sizeof(SharedSlot) == SHARED_SLOT_HEADER_BYTES, "SharedSlot is part of the shared layout");
+
+static void sleepMillis(int ms){
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static bool validName(const std::string &name){
+	if (name.empty() || name.size() > SHARED_MAX_NAME)
+		return false;
+	for (size_t i = 0; i < name.size(); i++)
+		if (name[i] == '/' || name[i] == '\\')
+			return false;
+	return true;
+}
+
+static bool processAlive(uint32_t pid){
+#if defined(_WIN32)
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+	if (!process)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+#else
+	// EPERM is somebody else's process, it's there all the same
+	return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+// a name that's taken is only ours when the ring on it was closed or the process that had it is gone
+static bool abandoned(const char *data, size_t bytes){
+	if (bytes < SHARED_HEADER_BYTES)
+		return true;
+	const SharedHeader *header = (const SharedHeader *)data;
+	return header->open.load(std::memory_order_acquire) == 0 || !processAlive(header->pid);
+}
+
+#if !defined(_WIN32)
+static bool abandoned(int fd){
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+		return false;
+	if ((size_t)info.st_size < SHARED_HEADER_BYTES)
+		return true;
+	void *data = mmap(NULL, SHARED_HEADER_BYTES, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+	bool gone = abandoned((const char *)data, SHARED_HEADER_BYTES);
+	munmap(data, SHARED_HEADER_BYTES);
+	return gone;
+}
+#endif
+
+bool mapSharedMemory(const std::string &name, bool create, size_t bytes, SharedMapping *mapping){
+	mapping->data = NULL;
+	mapping->bytes = 0;
+	mapping->handle = NULL;
+	if (!validName(name))
+		return false;
+#if defined(_WIN32)
+	std::string path = "Local\\" + name;
+	HANDLE handle = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, path.c_str())
+		: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+	if (!handle)
+		return false;
+	bool existed = create && GetLastError() == ERROR_ALREADY_EXISTS;
+	void *data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, create && !existed ? bytes : 0);
+	if (!data){
+		CloseHandle(handle);
+		return false;
+	}
+	if (!create || existed){
+		// the view covers the whole section, rounded up to pages
+		MEMORY_BASIC_INFORMATION info;
+		size_t size = VirtualQuery(data, &info, sizeof(info)) ? info.RegionSize : 0;
+		// a section somebody still holds can't grow, it's taken over as it is
+		if (existed && (size < bytes || !abandoned((const char *)data, size))){
+			UnmapViewOfFile(data);
+			CloseHandle(handle);
+			return false;
+		}
+		bytes = size;
+	}
+	mapping->handle = handle;
+#else
+	std::string path = "/" + name;
+	// only a name this call created gets removed again when something fails
+	bool created = create;
+	int fd = shm_open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+	if (fd < 0 && create && errno == EEXIST){
+		created = false;
+		fd = shm_open(path.c_str(), O_RDWR, 0600);
+		if (fd >= 0 && !abandoned(fd)){
+			close(fd);
+			return false;
+		}
+	}
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (create ? ftruncate(fd, (off_t)bytes) != 0 : fstat(fd, &info) != 0){
+		close(fd);
+		if (created)
+			shm_unlink(path.c_str());
+		return false;
+	}
+	if (!create)
+		bytes = (size_t)info.st_size;
+	void *data = bytes ? mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	// the mapping keeps the memory, the descriptor isn't needed anymore
+	close(fd);
+	if (data == MAP_FAILED){
+		if (created)
+			shm_unlink(path.c_str());
+		return false;
+	}
+#endif
+	mapping->data = (char *)data;
+	mapping->bytes = bytes;
+	mapping->name = name;
+	return true;
+}
+
+void unmapSharedMemory(SharedMapping *mapping, bool unlink){
+	if (!mapping->data)
+		return;
+#if defined(_WIN32)
+	// a pagefile backed section goes with its last handle, there is no name to drop
+	UnmapViewOfFile(mapping->data);
+	CloseHandle((HANDLE)mapping->handle);
+#else
+	munmap(mapping->data, mapping->bytes);
+	if (unlink)
+		shm_unlink(("/" + mapping->name).c_str());
+#endif
+	mapping->data = NULL;
+	mapping->bytes = 0;
+	mapping->handle = NULL;
+}
+
+SharedRing::SharedRing() : header(NULL), direction(kSharedCapture), channels(0), frames(0), slotCount(0), slotBytes(0),
+	channelBytes(0), sequence(0), current(NULL), isOpen(false), busy(false)
+{
+	mapping.data = NULL;
+	mapping.bytes = 0;
+	mapping.handle = NULL;
+}
+
+SharedRing::~SharedRing(){
+	close();
+}
+
+// -1 already open, -2 bad name, direction or size, -3 the memory couldn't be mapped or the name is
+// another open ring's
+int SharedRing::open(const std::string &name, int dir, const ChannelSet &set, long blockFrames, long slots, double sampleRate){
+	if (isOpen.load())
+		return -1;
+	if (!validName(name) || (dir != kSharedCapture && dir != kSharedPlayback) || set.count <= 0 || blockFrames <= 0
+		|| slots < 2 || slots > SHARED_MAX_SLOTS)
+		return -2;
+	size_t planeBytes = alignUp(blockFrames * sizeof(float));
+	size_t stride = SHARED_SLOT_HEADER_BYTES + set.count * planeBytes;
+	if (stride > 0xffffffffu)
+		return -2;
+	if (!mapSharedMemory(name, true, SHARED_HEADER_BYTES + slots * stride, &mapping))
+		return -3;
+	// a ring left behind by a process that died or closed it gets taken over, readers see it start over
+	header = (SharedHeader *)mapping.data;
+	header->magic = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	memset(mapping.data + sizeof(uint32_t), 0, mapping.bytes - sizeof(uint32_t));
+	header->version = SHARED_VERSION;
+	header->headerBytes = SHARED_HEADER_BYTES;
+	header->direction = dir;
+	header->channels = (uint32_t)set.count;
+	header->frames = (uint32_t)blockFrames;
+	header->slotCount = (uint32_t)slots;
+	header->slotBytes = (uint32_t)stride;
+	header->channelBytes = (uint32_t)planeBytes;
+	header->format = kSharedFloat32;
+	header->sampleRate = sampleRate;
+#if defined(_WIN32)
+	header->pid = (uint32_t)GetCurrentProcessId();
+#else
+	header->pid = (uint32_t)getpid();
+#endif
+	header->open.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHARED_MAGIC;
+
+	direction = dir;
+	channels = set.count;
+	frames = blockFrames;
+	slotCount = (uint64_t)slots;
+	slotBytes = stride;
+	channelBytes = planeBytes;
+	toFloat.assign(set.toFloat, set.toFloat + set.count);
+	sequence = 0;
+	current = NULL;
+	isOpen.store(true);
+	return 0;
+}
+
+void SharedRing::close(){
+	// after this loop the driver thread is out of the ring or sees isOpen false
+	isOpen.store(false);
+	while (busy.load())
+		sleepMillis(0);
+	if (header)
+		header->open.store(0, std::memory_order_release);
+	unmapSharedMemory(&mapping, true);
+	header = NULL;
+	current = NULL;
+	toFloat.clear();
+	channels = frames = 0;
+	slotCount = 0;
+}
+
+void SharedRing::stats(SharedRingStats *out) const{
+	out->open = isOpen.load();
+	out->direction = direction;
+	out->name = out->open ? mapping.name : std::string();
+	out->channels = out->open ? channels : 0;
+	out->frames = out->open ? frames : 0;
+	out->slots = out->open ? (long)slotCount : 0;
+	out->bytes = out->open ? mapping.bytes : 0;
+	out->blocks = out->queued = out->underruns = 0;
+	if (!out->open || !header)
+		return;
+	uint64_t written = header->writeSequence.load(std::memory_order_acquire);
+	uint64_t played = header->readSequence.load(std::memory_order_acquire);
+	out->blocks = direction == kSharedCapture ? written : played;
+	out->queued = direction == kSharedPlayback && written > played ? written - played : 0;
+	out->underruns = header->underruns.load(std::memory_order_relaxed);
+}
+
+void SharedRing::publish(void **halves, double samples, double nanoSeconds, double timeCode, uint32_t flags, uint64_t entryTime){
+	busy.store(true);
+	if (!isOpen.load() || direction != kSharedCapture){
+		busy.store(false);
+		return;
+	}
+	SharedSlot *s = slot(sequence);
+	// readers still on the block that was here see it change under them
+	s->sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s->samplePosition = samples;
+	s->systemTime = nanoSeconds;
+	s->timeCode = timeCode;
+	s->entryTime = entryTime;
+	s->frames = (uint32_t)frames;
+	s->flags = flags;
+	char *planes = (char *)s + SHARED_SLOT_HEADER_BYTES;
+	for (long c = 0; c < channels; c++){
+		float *dst = (float *)(planes + c * channelBytes);
+		if (toFloat[c])
+			toFloat[c](halves[c], dst, frames);
+		else
+			memset(dst, 0, frames * sizeof(float));
+	}
+	sequence++;
+	s->sequence.store(sequence, std::memory_order_release);
+	header->writeSequence.store(sequence, std::memory_order_release);
+	busy.store(false, std::memory_order_release);
+}
+
+bool SharedRing::acquire(){
+	busy.store(true);
+	if (!isOpen.load() || direction != kSharedPlayback){
+		busy.store(false);
+		return false;
+	}
+	uint64_t written = header->writeSequence.load(std::memory_order_acquire);
+	if (written <= sequence){
+		// nothing from a producer that hasn't started isn't an underrun
+		if (written)
+			header->underruns.fetch_add(1, std::memory_order_relaxed);
+		busy.store(false, std::memory_order_release);
+		return false;
+	}
+	// busy stays up while the outputs read the slot in place
+	current = (char *)slot(sequence);
+	return true;
+}
+
+void SharedRing::release(){
+	if (!current)
+		return;
+	current = NULL;
+	sequence++;
+	header->readSequence.store(sequence, std::memory_order_release);
+	busy.store(false, std::memory_order_release);
+}
@@ -0,0 +1,165 @@
+#ifndef __SharedRing__
+#define __SharedRing__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "ChannelLayout.h"
+
+// Blocks in named shared memory, for other processes to read inputs from or write outputs to
+// without a copy through JS or a syscall per block: POSIX shm (shm_open("/name")) on Linux and
+// macOS, a pagefile backed file mapping ("Local\name") on Windows. The layout is fixed and
+// little endian, so a reader in any language can map it:
+//
+//   0     SharedHeader, headerBytes (256) long
+//   256   slotCount slots slotBytes apart, block n lives in slot n % slotCount
+//
+//   a slot: SharedSlot (64 bytes), then channels planes of frames float32 samples,
+//   normalized to +-1, channelBytes apart
+//
+// Counters are 64 bit, written with release and meant to be read with acquire (a reader
+// that only has 32 bit atomics can load the low word, the high one takes months to move).
+//
+// Capture, the driver writes every processed input block and never waits. A block is a seqlock:
+// the slot's sequence goes to 0, the samples and timing are written, then the sequence becomes
+// n + 1 and the header's writeSequence n + 1. A reader follows writeSequence at its own pace,
+// block n is there while writeSequence - slotCount <= n < writeSequence. It checks the slot's
+// sequence is n + 1 before reading and again after (with an acquire fence in between), anything
+// else means the driver lapped it and what it read is torn. Any number of readers.
+//
+// Playback, one producer writes blocks the driver plays into the outputs, mixed with whatever
+// else plays there. It may write block w while w - readSequence < slotCount, stores the slot's
+// sequence as w + 1 and then writeSequence as w + 1. The driver plays block readSequence in
+// place once writeSequence is past it and then moves readSequence on; how far ahead the
+// producer keeps writing is the latency. A block it doesn't have in time is silence and an
+// underrun.
+
+#define SHARED_MAGIC 0x5253414e		// "NASR"
+#define SHARED_VERSION 1
+#define SHARED_HEADER_BYTES 256
+#define SHARED_SLOT_HEADER_BYTES 64
+
+enum {
+	kSharedCapture = 0,
+	kSharedPlayback = 1
+};
+
+enum {
+	kSharedFloat32 = 0			// planar float32, the only format so far
+};
+
+// SharedSlot flags, which of the timing fields the driver filled in
+enum {
+	kSharedSystemTime = 1,
+	kSharedSamplePosition = 2,
+	kSharedTimeCode = 4
+};
+
+typedef struct SharedHeader{
+	uint32_t magic;							// 0, SHARED_MAGIC once the rest is filled in
+	uint32_t version;						// 4
+	uint32_t headerBytes;					// 8, where slot 0 starts
+	uint32_t direction;						// 12, kSharedCapture or kSharedPlayback
+	uint32_t channels;						// 16
+	uint32_t frames;						// 20, per block
+	uint32_t slotCount;						// 24
+	uint32_t slotBytes;						// 28
+	uint32_t channelBytes;					// 32, from one channel's plane to the next
+	uint32_t format;						// 36, kSharedFloat32
+	double sampleRate;						// 40, the host rate blocks run at
+	uint32_t pid;							// 48, the process with the device
+	std::atomic<uint32_t> open;				// 52, 1 until that process closes the ring
+	char reserved0[8];
+	std::atomic<uint64_t> writeSequence;	// 64, blocks written
+	char reserved1[56];
+	std::atomic<uint64_t> readSequence;		// 128, blocks played, playback only
+	char reserved2[56];
+	std::atomic<uint64_t> underruns;		// 192, blocks playback had nothing for
+	char reserved3[56];
+}SharedHeader;
+
+typedef struct SharedSlot{
+	std::atomic<uint64_t> sequence;			// 0, block number + 1 once complete, 0 while written
+	double samplePosition;					// 8, ASIOTimeInfo.samplePosition, host frames
+	double systemTime;						// 16, ASIOTimeInfo.systemTime, nanoseconds
+	double timeCode;						// 24, ASIOTimeCode.timeCodeSamples
+	uint64_t entryTime;						// 32, monotonic nanoseconds the driver callback started
+	uint32_t frames;						// 40
+	uint32_t flags;							// 44, kSharedSystemTime and so on
+	char reserved[16];
+}SharedSlot;
+
+// a mapping of a whole ring, ours or another process's
+typedef struct SharedMapping{
+	char *data;
+	size_t bytes;
+	std::string name;
+	void *handle;				// the file mapping on Windows
+}SharedMapping;
+
+// maps the ring called name, created (or taken over when it was closed or its process is gone) bytes
+// long or an existing one whole
+bool mapSharedMemory(const std::string &name, bool create, size_t bytes, SharedMapping *mapping);
+// unlink drops the name as well, mappings elsewhere stay valid until they go
+void unmapSharedMemory(SharedMapping *mapping, bool unlink);
+
+typedef struct SharedRingStats{
+	bool open;
+	int direction;
+	std::string name;
+	long channels;
+	long frames;
+	long slots;
+	size_t bytes;
+	uint64_t blocks;			// written (capture) or played (playback)
+	uint64_t queued;			// playback, written and not played yet
+	uint64_t underruns;
+}SharedRingStats;
+
+class SharedRing{
+public:
+	SharedRing();
+	~SharedRing();
+
+	// JS thread. Every channel of the set, frames per block. 0 on success, otherwise the
+	// negative codes in SharedRing.cpp
+	int open(const std::string &name, int direction, const ChannelSet &channels, long frames, long slots, double sampleRate);
+	void close();
+	void stats(SharedRingStats *out) const;
+	// the mapping, to lock it in memory
+	void *buffer() const { return mapping.data; }
+	size_t bufferBytes() const { return mapping.bytes; }
+
+	// driver thread, capture: one block of every channel in its native format
+	void publish(void **halves, double samples, double nanoSeconds, double timeCode, uint32_t flags, uint64_t entryTime);
+	// driver thread, playback: true when the producer had the next block ready, output() reads it
+	// in place until release() hands the slot back. false leaves nothing to release
+	bool acquire();
+	const float *output(long c) const { return c < channels ? (const float *)(current + SHARED_SLOT_HEADER_BYTES + c * channelBytes) : NULL; }
+	void release();
+
+private:
+	SharedRing(const SharedRing &);
+	SharedRing &operator=(const SharedRing &);
+	SharedSlot *slot(uint64_t n) const { return (SharedSlot *)(mapping.data + SHARED_HEADER_BYTES + (n % slotCount) * slotBytes); }
+
+	SharedMapping mapping;
+	SharedHeader *header;
+	int direction;
+	long channels;
+	long frames;
+	uint64_t slotCount;
+	size_t slotBytes;
+	size_t channelBytes;
+	std::vector<ToFloatKernel> toFloat;
+
+	// driver thread state
+	uint64_t sequence;			// next block to write or play
+	char *current;				// the slot acquire() got
+
+	std::atomic<bool> isOpen;
+	std::atomic<bool> busy;		// driver thread between acquire() and release(), or in publish()
+};
+
+#endif
@@ -1,11 +1,31 @@
 #include <uv.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <string>
-#include <windows.h>
 #include <vector>
 #include "asiosys.h"
+#if WINDOWS
+#include <windows.h>
+#endif
 #include "asio.h"
-#include "asiodrivers.h"
+#include "AsioBackend.h"
+#include "VirtualDevice.h"
+#include "RingBuffer.h"
+#include "BlockPool.h"
+#include "SampleConvert.h"
+#include "DspGraph.h"
+#include "Stats.h"
+#include "Recorder.h"
+#include "Player.h"
+#include "Analyzer.h"
+#include "Bridge.h"
+#include "RateConverter.h"
+#include "SharedRing.h"
+#include "ChannelLayout.h"
+#include "DeviceProbe.h"
+#include "Realtime.h"
+#include "Trace.h"
 
 #include <node.h>
 #include <nan.h>
@@ -17,15 +37,22 @@
 #endif
 #define MAX_THREADS 3
 #define BUF_SIZE 255
+// default number of blocks the driver thread can queue up before JS has to catch up
+#define DEFAULT_RING_BLOCKS 32
+// rendered output blocks that can wait for the driver by default, more only adds latency
+#define OUTPUT_RING_BLOCKS 4
+#define MAX_OUTPUT_BLOCKS 256
 
 using namespace v8;
 
-enum {
-	kMaxInputChannels = 32,
-	kMaxOutputChannels = 32
-};
-
+// one array of input channel Buffers per pool slot, created once at start() and
+// handed to JS again every time that slot comes around
 Persistent<Array> buffersForInput;
+// subscribe() callbacks by subscriber id, and how many lost blocks each has been told about
+Persistent<Function> subscriberCallbacks[POOL_MAX_SUBSCRIBERS];
+uint64_t subscriberReportedLost[POOL_MAX_SUBSCRIBERS];
+// same for the output slots JS renders into, the last entry is the spare slot
+Persistent<Array> buffersForOutput;
 
 typedef struct DriverInfo{
 	//A strucutre needed by ASIOInit do initialize the AudioSteamIO
@@ -44,6 +71,12 @@ typedef struct DriverInfo{
 
 	//ASIOGetSampleRate() get the current sample rate
 	ASIOSampleRate sampleRate;
+	// what the device really runs at, and the block size it runs with. When it can't do the rate
+	// init() asked for they differ from sampleRate and preferredSize, which everything past the
+	// converter sees, and the driver's halves are converted to and from that rate
+	ASIOSampleRate deviceRate;
+	long deviceSize;
+	bool resample;			// convert rather than fail when the device can't do the rate
 
 	// ASIOOutputReady() true-if supported by the card
 	bool postOutput;
@@ -56,10 +89,13 @@ typedef struct DriverInfo{
 	long inputBuffers;	// becomes number of actual created input buffers
 	long outputBuffers;	// becomes number of actual created output buffers
 	//holds various information about buffer, Input/ouput, ChannelNum, buffer address
-	ASIOBufferInfo bufferInfos[kMaxInputChannels + kMaxOutputChannels];
+	std::vector<ASIOBufferInfo> bufferInfos;
 	// ASIOGetChannelInfo() get information about a specific channel (sample type, name, word clock group)
-	ASIOChannelInfo channelInfos[kMaxInputChannels + kMaxOutputChannels];
-	// The above two arrays share the same indexing, as the data in them are linked together
+	std::vector<ASIOChannelInfo> channelInfos;
+	// The above two arrays share the same indexing, as the data in them are linked together,
+	// inputs first. The callback works off the same data split up per direction instead:
+	ChannelSet inputs;
+	ChannelSet outputs;
 
 	// Information from ASIOGetSamplePosition() Inquires the sample position/time stamp pair. 
 	// data is converted to double floats for easier use, however 64 bit integer can be used, too
@@ -73,90 +109,173 @@ typedef struct DriverInfo{
 
 	Persistent<Function> callback;
 	Isolate * isolate;
+	// the isolate that called init(), main thread or a Worker, the only one that may start,
+	// stop and deInit; blocks get delivered on its loop. Any isolate can read stats and send
+	// control messages.
+	Isolate * owner;
+	uv_loop_t * loop;
+
+	// input blocks are filled once into a slot of this pool and published to every subscriber,
+	// the start() callback is one of them (primary, -1 without a callback), subscribe() adds more.
+	// The driver thread only copies into a preallocated slot and pokes blockAsync
+	BlockPool inputPool;
+	int primary;
+	char *inputSlot;	// slot being filled, NULL until the next acquire
+	long ringBlocks;	// blocks queued for the start() callback before they get dropped
+	long poolBlocks;
+	// JS is called once per callbackBlocks driver blocks, each slot collects that many,
+	// the driver thread fills (and plays) them one driver block at a time
+	long callbackBlocks;
+	long inputFill;		// driver blocks already in the slot being filled
+	long lostBlocks;	// driver blocks that found no free slot, callbackBlocks of them are a dropped slot
+	long outputPlayed;	// driver blocks already played from the oldest output slot
+	// with floatSamples JS sees normalized Float32 instead of the driver's native format,
+	// the kernels are picked per channel once so the callback doesn't switch on the type
+	bool floatSamples;
+	// gain, mix matrix and limiter running on the driver thread, JS only sends it commands
+	DspGraph dsp;
+	// false when start() got no callback, then only the graph feeds the outputs
+	bool jsTaps;
+	// rendered outputs go the other way, JS writes straight into a slot and the
+	// driver copies the oldest one into its half on the next bufferSwitch
+	BlockRing outputRing;
+	char *outputSpare;	// handed to JS when the output ring is full, never played
+	// up to outputDepth rendered slots queue for the driver. It starts playing them once outputPrefill
+	// are there, at start() and again after running dry, and plays the fallback meanwhile: silence,
+	// or with outputRepeat the last block played once and then silence
+	long outputDepth;
+	long outputPrefill;
+	bool outputRepeat;
+	bool outputPriming;		// driver thread, waiting for outputPrefill slots
+	char *repeatBlock;		// one driver block of every output laid out like a slot, the last one played
+	bool repeatValid;		// driver thread, repeatBlock may be played once
+	uv_async_t *blockAsync;	// from start() to stop(), see openAsync()
+	bool running;
+	// streams inputs to disk on its own thread, see record()
+	Recorder recorder;
+	// plays a file into the outputs from a prefetch thread, see openPlayback()
+	Player player;
+	// plays a stream JS writes with its own clock, drift compensated, see openBridge()
+	Bridge bridge;
+	// blocks other processes read inputs from and write outputs to, see openShared()
+	SharedRing sharedInputs;
+	SharedRing sharedOutputs;
+	// between the driver's halves and everything else when deviceRate isn't sampleRate
+	RateConverter converter;
+	long hostIndex;				// host half the next converted block goes through
+	double hostSamples;			// host frames processed since start(), the converted blocks' position
+	// meters and spectra on their own thread, snapshots land in one Float32Array, see analyze()
+	Analyzer analyzer;
+	uv_async_t *analysisAsync;	// from analyze() to stopAnalysis(), see openAsync()
+	Persistent<Float32Array> analysisSnapshot;
+	Persistent<Function> analysisCallback;
+	// counters and latency histograms, see stats()
+	AudioStats stats;
+	std::atomic<uint64_t> overflows;	// droppedBlocks since start(), resetStats() leaves it alone
+	uint64_t reportedOverflows;	// overflows the callback has already been told about
+	// resetStats() while running, the driver thread and the owner's loop each clear the counters they write
+	std::atomic<bool> statsResetPending;
+	std::atomic<bool> hostStatsResetPending;
+	unsigned long blockSequence;
+	uint64_t blockPeriod;		// nanoseconds one callback's worth of blocks lasts, JS has that long to render it
+	double lastSamples;			// sample position of the previous block, for spotting jumps
+	bool lastSamplesValid;
+	// scheduling, pinning and memory locking from the init() realtime options. The driver
+	// thread sets itself up in its first callback after start(), JS reads what it got once
+	// driverThreadDone says so; the loop thread does it in start() and goes back in stop()
+	RealtimeConfig realtime;
+	std::atomic<bool> realtimePending;
+	std::atomic<bool> driverThreadDone;
+	ThreadSettings driverThread;
+	ThreadSettings loopThread;
+	SavedThread loopSaved;
+	MemoryLock memoryLock;	// under controlMutex
+	// the virtual device rendering offline: the driver thread waits for JS after every block
+	// instead of JS racing a clock, until stopping says stop() is waiting for the driver thread
+	bool offline;
+	std::atomic<bool> stopping;
+	uv_mutex_t hostMutex;	// the driver thread sleeps on hostDone until the loop released the blocks
+	uv_cond_t hostDone;
+	uv_async_t *renderAsync;	// offline from start() to stop(), see openAsync()
+	Persistent<Function> renderCallback;
 	
 }DriverInfo;
-typedef struct Work{
-	uv_work_t request;
-	int index; // index for double asio buffers
-}Work;
+// every ring slot starts with this, followed by the channels
+typedef struct BlockHeader{
+	long index; // index for double asio buffers
+	unsigned long sequence;
+	double samples;
+	double nanoSeconds;
+	uint64_t entryTime; // monotonicNanos() when the driver callback for the block started
+}BlockHeader;
+#define BLOCK_HEADER_BYTES alignUp(sizeof(BlockHeader))
 
 DriverInfo asioDriverInfo = { 0 };
-//struct hold all the asioCallbacks function addresses 
-ASIOCallbacks asioCallbacks;
-// some external references
-extern AsioDrivers* asioDrivers;
-bool loadAsioDriver(char *name);
 
-// making getDriverNames a bit more global like loadAsioDriver
-long getDriverNames(char **names, long maxDrivers, AsioDrivers* asiodrivers){
-	if(!asiodrivers){
-		asiodrivers = new AsioDrivers();
-	}
-	if(asiodrivers){
-		return asiodrivers->getDriverNames(names,maxDrivers);
-	}
-	return false;
-}
-// quick dirty function overload
-long getDriverNames(char **names, long maxDrivers){
-	return getDriverNames(names,maxDrivers,asioDrivers);
+// JS threads queueing into the single producer command rings or opening and closing the
+// recorder and player take turns here, the driver thread never touches it
+static uv_mutex_t controlMutex;
+static uv_once_t processOnce = UV_ONCE_INIT;
+static void initProcess(){
+	// pick the conversion kernels for this cpu before any driver shows up
+	initSampleConvert();
+	initDeviceProbe();
+	uv_mutex_init(&controlMutex);
+	uv_mutex_init(&asioDriverInfo.hostMutex);
+	uv_cond_init(&asioDriverInfo.hostDone);
 }
+class ControlLock{
+public:
+	ControlLock() { uv_mutex_lock(&controlMutex); }
+	~ControlLock() { uv_mutex_unlock(&controlMutex); }
+};
 
-// unfortunately there was no nice function to get the number of devices
-// so I wrote this~, we're taking advantage of the preprocessor conditions
-// used in the SDK to switch the function we're returning here...
-long getNumOfAsioDevices(AsioDrivers* asiodrivers){
-	if(!asiodrivers){
-		asiodrivers = new AsioDrivers();
-	}
-	if(asiodrivers){
-		#if WINDOWS 
-		return asiodrivers->asioGetNumDev();
-		#elif MAC
-		return asiodrivers->getNumFragments();
-		#elif SGI || BEOS
-		return 0; /* not implemented by SDK :( */
-		#endif
-	}
-	return false;
+// the loop of whichever thread the isolate runs on
+static uv_loop_t *eventLoop(Isolate *isolate){
+#if NODE_MODULE_VERSION >= 64
+	return node::GetCurrentEventLoop(isolate);
+#else
+	return uv_default_loop();
+#endif
+}
+// whether the device gets released if the thread dies without deInit(): the main thread's loop is
+// the process's, a Worker only has the environment cleanup hook, and that's Node 11 and newer
+static bool releasedOnExit(Isolate *isolate){
+#if NODE_MODULE_VERSION >= 67
+	return true;
+#else
+	return eventLoop(isolate) == uv_default_loop();
+#endif
 }
-// quick dirty function overload
-long getNumOfAsioDevices(){
-	return getNumOfAsioDevices(asioDrivers);
+// stop() closes the handles start() opened, and a start() in the same tick may come before libuv
+// got around to the close; every open gets a handle of its own, freed once the close is done
+static void freeAsync(uv_handle_t *handle){
+	delete (uv_async_t *)handle;
 }
-
-// returns to us an array of c strings with the device driver names in them...and plays it safe memory wise
-char ** getDeviceDrivers(AsioDrivers* asiodrivers, long maxDrivers = 256){
-	long numDevices = getNumOfAsioDevices(asiodrivers);
-	//fail fast, we don't have drivers, return null pointer
-	if( numDevices < 1 ){
-		return NULL;
-	}
-	//size our string array appropriately
-	maxDrivers = ( numDevices < maxDrivers ) ? ( numDevices ) : ( maxDrivers );
-	char **nameArray = new char*[maxDrivers];
-	for(long i = 0; i < maxDrivers; i++){
-		//looking through ASIO's SDK all references to device driver names are 32 characters including /0
-		nameArray[i] = new char[32];
-	}
-	//MAC implementation used unsafe strcpy as part of it's method...I assumed it was safe from the docs because of
-	//the references to 32 characters*, however MAC devices might have a higher upper limit to device names...I don't know
-	//TLDR; on a MAC it may be possible the device driver may be longer than 32 characters...then ?
-	getDriverNames(nameArray,numDevices);
-	return nameArray;
+static uv_async_t *openAsync(uv_loop_t *loop, uv_async_cb callback){
+	uv_async_t *handle = new uv_async_t;
+	uv_async_init(loop, handle, callback);
+	return handle;
 }
-// yet another quick dirty function overload
-char ** getDeviceDrivers(long maxDrivers = 256){
-	return getDeviceDrivers(asioDrivers,maxDrivers); 
+static void closeAsync(uv_async_t **handle){
+	if (*handle)
+		uv_close((uv_handle_t *)*handle, freeAsync);
+	*handle = NULL;
 }
+//struct hold all the asioCallbacks function addresses 
+ASIOCallbacks asioCallbacks;
+// the driver we talk to, a real one through the SDK or the virtual device
+const AsioBackend *asioBackend = NULL;
+
 
 // internal prototypes (required for the Metrowerks CodeWarrior compiler)
 int main(int argc, char* argv[]);
 long initAsioDriverInfo(DriverInfo *asioDriverInfo, int sR, int spb, std::vector<int> iC, std::vector<int> oC);
 ASIOError createAsioBuffers(DriverInfo *asioDriverInfo, int bps, std::string end, std::vector<int> iC, std::vector<int> oC);
 unsigned long getSysReferenceTime();
-static void WorkAsync(uv_work_t *req);
-static void WorkAsyncComplete(uv_work_t *req,int status);
+static void BlockAsyncComplete(uv_async_t *handle);
+static void RenderAsyncComplete(uv_async_t *handle);
+static void releaseSlotPool(Isolate *isolate, Persistent<Array> &slotPool);
 
 // callback prototypes
 void bufferSwitch(long index, ASIOBool processNow);
@@ -164,50 +283,94 @@ ASIOTime *bufferSwitchTimeInfo(ASIOTime *timeInfo, long index, ASIOBool processN
 void sampleRateChanged(ASIOSampleRate sRate);
 long asioMessages(long selector, long value, void* message, double* opt);
 
+// the block size nearest to frames the driver takes, for running it at another rate than the host
+static long deviceBlockSize(DriverInfo *asioDriverInfo, double frames){
+	long minSize = asioDriverInfo->minSize, maxSize = asioDriverInfo->maxSize;
+	long size = (long)(frames + 0.5);
+	if (asioDriverInfo->granularity == -1){
+		// powers of two only
+		long power = minSize > 0 ? minSize : 1;
+		while (power * 2 <= maxSize && power * 2 - size < size - power)
+			power *= 2;
+		size = power;
+	}
+	else if (asioDriverInfo->granularity > 0)
+		size = minSize + (size - minSize + asioDriverInfo->granularity / 2) / asioDriverInfo->granularity * asioDriverInfo->granularity;
+	else
+		return asioDriverInfo->deviceSize;
+	return size < minSize ? minSize : size > maxSize ? maxSize : size;
+}
+// the rates a device that can't do the one asked for gets tried with, when it doesn't say its own
+static const double fallbackRates[] = { 48000., 44100., 96000., 88200. };
+
 long initAsioDriverInfo(DriverInfo *asioDriverInfo, int sR, int spb, std::vector<int> iC, std::vector<int> oC){	
 	// collect the informational data of the driver
 	// get the number of available channels
 	
-	if (ASIOGetChannels(&asioDriverInfo->inputChannels, &asioDriverInfo->outputChannels) == ASE_OK)
+	if (asioBackend->getChannels(&asioDriverInfo->inputChannels, &asioDriverInfo->outputChannels) == ASE_OK)
 	{
 		printf("Availible audio channels (inputs: %d, outputs: %d);\n", asioDriverInfo->inputChannels, asioDriverInfo->outputChannels);
 		printf("Used audio channels (inputs: %d, outputs: %d);\n", iC.size(), oC.size());
 		asioDriverInfo->outputChannels = (long)oC.size();
 		asioDriverInfo->inputChannels = (long)iC.size();
 		// get the usable buffer sizes
-		if (ASIOGetBufferSize(&asioDriverInfo->minSize, &asioDriverInfo->maxSize, &asioDriverInfo->preferredSize, &asioDriverInfo->granularity) == ASE_OK)
+		if (asioBackend->getBufferSize(&asioDriverInfo->minSize, &asioDriverInfo->maxSize, &asioDriverInfo->preferredSize, &asioDriverInfo->granularity) == ASE_OK)
 		{
 			printf("ASIOGetBufferSize (min: %d, max: %d, preferred: %d, granularity: %d);\n",
 			asioDriverInfo->minSize, asioDriverInfo->maxSize,
 			asioDriverInfo->preferredSize, asioDriverInfo->granularity);
 			printf("we are going to use preferred size: %d\n", spb);
+			asioDriverInfo->deviceSize = asioDriverInfo->preferredSize;
 			asioDriverInfo->preferredSize = spb;
 			
 			// get the currently selected sample rate
-			if (ASIOGetSampleRate(&asioDriverInfo->sampleRate) == ASE_OK)
+			ASIOSampleRate current = 0;
+			if (asioBackend->getSampleRate(&current) == ASE_OK)
 			{
-				printf("ASIOGetSampleRate (sampleRate: %f);\n", asioDriverInfo->sampleRate);
+				printf("ASIOGetSampleRate (sampleRate: %f);\n", current);
 				printf("Used sample rate (sampleRate: %d);\n", sR);
 				asioDriverInfo->sampleRate = sR;
-				if (asioDriverInfo->sampleRate <= 0.0 || asioDriverInfo->sampleRate > 96000.0)
+				asioDriverInfo->deviceRate = current;
+				if (asioBackend->canSampleRate((ASIOSampleRate)sR) == ASE_OK)
 				{
-					// Driver does not store it's internal sample rate, so set it to a know one.
-					// Usually you should check beforehand, that the selected sample rate is valid
-					// with ASIOCanSampleRate().
-					if (ASIOSetSampleRate((float)sR) == ASE_OK)
+					// the device can run at the rate asked for, switch it over unless it is there already
+					if (current != sR)
 					{
-						if (ASIOGetSampleRate(&asioDriverInfo->sampleRate) == ASE_OK)
-							printf("ASIOGetSampleRate (sampleRate: %f);\n", asioDriverInfo->sampleRate);
+						if (asioBackend->setSampleRate((ASIOSampleRate)sR) != ASE_OK)
+							return -5;
+						if (asioBackend->getSampleRate(&asioDriverInfo->deviceRate) == ASE_OK)
+							printf("ASIOGetSampleRate (sampleRate: %f);\n", asioDriverInfo->deviceRate);
 						else
 							return -6;
 					}
-					else
-						return -5;
 				}
+				else if (asioDriverInfo->resample)
+				{
+					// it can't, so it keeps its own clock and the blocks get converted. A driver that
+					// doesn't store its rate gets the first common one it takes
+					if (current <= 0.0 || asioBackend->canSampleRate(current) != ASE_OK)
+					{
+						current = 0;
+						for (size_t i = 0; i < sizeof(fallbackRates) / sizeof(fallbackRates[0]) && !current; i++)
+							if (asioBackend->canSampleRate(fallbackRates[i]) == ASE_OK && asioBackend->setSampleRate(fallbackRates[i]) == ASE_OK)
+								current = fallbackRates[i];
+						if (!current || asioBackend->getSampleRate(&current) != ASE_OK)
+							return -5;
+					}
+					asioDriverInfo->deviceRate = current;
+					printf("Converting between %f (device) and %d (host);\n", current, sR);
+				}
+				else
+					return -5;
+				// a device block lasts about as long as a host block, they only match when the rates do
+				if (fabs(asioDriverInfo->deviceRate - asioDriverInfo->sampleRate) < 0.5)
+					asioDriverInfo->deviceSize = spb;
+				else
+					asioDriverInfo->deviceSize = deviceBlockSize(asioDriverInfo, spb * asioDriverInfo->deviceRate / asioDriverInfo->sampleRate);
 
 				// check wether the driver requires the ASIOOutputReady() optimization
 				// (can be used by the driver to reduce output latency by one block)
-				if (ASIOOutputReady() == ASE_OK)
+				if (asioBackend->outputReady() == ASE_OK)
 					asioDriverInfo->postOutput = true;
 				else
 					asioDriverInfo->postOutput = false;
@@ -227,14 +390,19 @@ ASIOError createAsioBuffers(DriverInfo *asioDriverInfo, int bps, std::string end
 	long i;
 	ASIOError result;
 
+	// one entry for every channel asked for, as many as the driver has
+	asioDriverInfo->inputBuffers = asioDriverInfo->inputChannels;
+	asioDriverInfo->outputBuffers = asioDriverInfo->outputChannels;
+	long numBuffers = asioDriverInfo->inputBuffers + asioDriverInfo->outputBuffers;
+	asioDriverInfo->bufferInfos.assign(numBuffers, ASIOBufferInfo());
+	asioDriverInfo->channelInfos.assign(numBuffers, ASIOChannelInfo());
+	if (!asioDriverInfo->inputs.allocate(asioDriverInfo->inputBuffers) || !asioDriverInfo->outputs.allocate(asioDriverInfo->outputBuffers))
+		return ASE_NoMemory;
+
 	// fill the bufferInfos from the start without a gap
-	ASIOBufferInfo *info = asioDriverInfo->bufferInfos;
+	ASIOBufferInfo *info = asioDriverInfo->bufferInfos.data();
 	
 	// prepare inputs (Though this is not necessaily required, no opened inputs will work, too
-	if (asioDriverInfo->inputChannels > kMaxInputChannels)
-		asioDriverInfo->inputBuffers = kMaxInputChannels;
-	else
-		asioDriverInfo->inputBuffers = asioDriverInfo->inputChannels;
 	for (i = 0; i < asioDriverInfo->inputBuffers; i++, info++)
 	{
 		info->isInput = ASIOTrue;
@@ -243,10 +411,6 @@ ASIOError createAsioBuffers(DriverInfo *asioDriverInfo, int bps, std::string end
 	}
 	
 	// prepare outputs
-	if (asioDriverInfo->outputChannels > kMaxOutputChannels)
-		asioDriverInfo->outputBuffers = kMaxOutputChannels;
-	else
-		asioDriverInfo->outputBuffers = asioDriverInfo->outputChannels;
 	for (i = 0; i < asioDriverInfo->outputBuffers; i++, info++)
 	{
 		info->isInput = ASIOFalse;
@@ -255,25 +419,39 @@ ASIOError createAsioBuffers(DriverInfo *asioDriverInfo, int bps, std::string end
 	}
 
 	// create and activate buffers
-	result = ASIOCreateBuffers(asioDriverInfo->bufferInfos,
-		asioDriverInfo->inputBuffers + asioDriverInfo->outputBuffers,
-		asioDriverInfo->preferredSize, &asioCallbacks);
+	result = asioBackend->createBuffers(asioDriverInfo->bufferInfos.data(), numBuffers,
+		asioDriverInfo->deviceSize, &asioCallbacks);
 	
 	if (result == ASE_OK)
 	{
 		
 		// now get all the buffer details, sample word length, name, word clock group and activation
-		for (i = 0; i < asioDriverInfo->inputBuffers + asioDriverInfo->outputBuffers; i++)
+		for (i = 0; i < numBuffers; i++)
 		{
 			asioDriverInfo->channelInfos[i].channel = asioDriverInfo->bufferInfos[i].channelNum;
 			asioDriverInfo->channelInfos[i].isInput = asioDriverInfo->bufferInfos[i].isInput;
-			result = ASIOGetChannelInfo(&asioDriverInfo->channelInfos[i]);
+			result = asioBackend->getChannelInfo(&asioDriverInfo->channelInfos[i]);
 			if (result != ASE_OK)
 				break;
+			// and split it up per direction for the callback
+			ChannelSet &set = i < asioDriverInfo->inputBuffers ? asioDriverInfo->inputs : asioDriverInfo->outputs;
+			long c = i < asioDriverInfo->inputBuffers ? i : i - asioDriverInfo->inputBuffers;
+			ASIOSampleType type = asioDriverInfo->channelInfos[i].type;
+			set.half[0][c] = asioDriverInfo->bufferInfos[i].buffers[0];
+			set.half[1][c] = asioDriverInfo->bufferInfos[i].buffers[1];
+			set.type[c] = type;
+			set.nativeBytes[c] = asioDriverInfo->deviceSize * sampleBytes(type);
+			set.toFloat[c] = getToFloat(type);
+			set.fromFloat[c] = getFromFloat(type);
 		}
+		// a device at another rate keeps its halves to the converter, the sets get host ones
+		if (result == ASE_OK && numBuffers && fabs(asioDriverInfo->deviceRate - asioDriverInfo->sampleRate) >= 0.5
+			&& !asioDriverInfo->converter.allocate(asioDriverInfo->inputs, asioDriverInfo->outputs,
+				asioDriverInfo->deviceSize, asioDriverInfo->deviceRate, asioDriverInfo->preferredSize, asioDriverInfo->sampleRate))
+			result = ASE_NoMemory;
 		//check if supported endianess and bitsPerSample
 		
-		switch(asioDriverInfo->channelInfos[0].type){
+		switch(numBuffers ? asioDriverInfo->channelInfos[0].type : -1){
 			case 16:
 				printf("Supported type is 16 bits per sample, little endianess\n");
 				printf("Requested type is %d bits per sample, %s endianess\n", bps, end);
@@ -295,7 +473,7 @@ ASIOError createAsioBuffers(DriverInfo *asioDriverInfo, int bps, std::string end
 			// Latencies often are only valid after ASIOCreateBuffers()
 			// (input latency is the age of the first sample in the currently returned audio block)
 			// (output latency is the time the first sample in the currently returned audio block requires to get to the output)
-			result = ASIOGetLatencies(&asioDriverInfo->inputLatency, &asioDriverInfo->outputLatency);
+			result = asioBackend->getLatencies(&asioDriverInfo->inputLatency, &asioDriverInfo->outputLatency);
 			if (result == ASE_OK)
 				printf("ASIOGetLatencies (input: %d, output: %d);\n", asioDriverInfo->inputLatency, asioDriverInfo->outputLatency);
 		}
@@ -311,9 +489,11 @@ const double twoRaisedTo32 = 4294967296.;
 #endif
 
 long asioMessages(long selector, long value, void* message, double* opt){
+	traceInstant("asioMessage", "selector", selector);
 	return 0;
 }
 void sampleRateChanged(ASIOSampleRate sRate){
+	traceInstant("sampleRateChanged", "rate", (int64_t)sRate);
 	// do whatever you need to do if the sample rate changed
 	// usually this only happens during external sync.
 	// Audio processing is not stopped by the driver, actual sample rate
@@ -323,62 +503,469 @@ void sampleRateChanged(ASIOSampleRate sRate){
 }
 void buffer_delete_callback(char* data, void* hint) {  }
 
-static void WorkAsync(uv_work_t *req) { 
-//worker thread
-//we don't do anythign here because this thread dosent have access to v8
+static char *viewData(Local<Value> value, size_t *length){
+	// works for Buffers as well as any other typed array JS hands back
+	if (!value->IsArrayBufferView()){
+		*length = 0;
+		return NULL;
+	}
+	Local<ArrayBufferView> view = Local<ArrayBufferView>::Cast(value);
+	*length = view->ByteLength();
+	return (char *)view->Buffer()->GetContents().Data() + view->ByteOffset();
+}
+static void deliverToSubscribers(Isolate *isolate, Local<Array> pool);
+// the loop released blocks or stop() is on its way, an offline driver thread in waitForHost() looks again
+static void wakeDriverThread(){
+	if (!asioDriverInfo.offline)
+		return;
+	uv_mutex_lock(&asioDriverInfo.hostMutex);
+	uv_cond_signal(&asioDriverInfo.hostDone);
+	uv_mutex_unlock(&asioDriverInfo.hostMutex);
 }
-static void WorkAsyncComplete(uv_work_t *req, int status){
-	Isolate * isolate = Isolate::GetCurrent(); 
+static void BlockAsyncComplete(uv_async_t *handle){
+	// runs on the loop, drains every block the driver queued since the last wakeup
+	traceThreadName("js loop");
+	TraceSpan span("dispatch");
+	if (asioDriverInfo.hostStatsResetPending.exchange(false, std::memory_order_acquire))
+		resetHostStats(&asioDriverInfo.stats);
+	Isolate * isolate = asioDriverInfo.isolate;
 	v8::HandleScope handleScope(isolate);
-	Work * work = static_cast<Work *>(req->data);
-	long index = work->index;
-	long buffSize = asioDriverInfo.preferredSize;
-	
-	Local<Array> inputArr = Array::New(asioDriverInfo.isolate, buffSize*4);
+	Local<Array> pool = Local<Array>::New(isolate, buffersForInput);
+	Local<Array> outputPool = Local<Array>::New(isolate, buffersForOutput);
+	ChannelSet &outputs = asioDriverInfo.outputs;
+	BlockPool &inputPool = asioDriverInfo.inputPool;
+	long slotIndex;
 	
-	for (int i = 0; i < asioDriverInfo.inputBuffers + asioDriverInfo.outputBuffers; i++){
-		if(asioDriverInfo.bufferInfos[i].isInput == true){
-			switch (asioDriverInfo.channelInfos[i].type){
-				case ASIOSTInt16LSB:
-					inputArr->Set(i, Nan::NewBuffer((char *)asioDriverInfo.bufferInfos[i].buffers[index], buffSize * 2, buffer_delete_callback, 0).ToLocalChecked());
-					break;
-				case ASIOSTInt24LSB:		// used for 20 bits as well
-					inputArr->Set(i, Nan::NewBuffer((char *)asioDriverInfo.bufferInfos[i].buffers[index], buffSize * 3, buffer_delete_callback, 0).ToLocalChecked());
-					break;
-				case ASIOSTInt32LSB:
-					inputArr->Set(i, Nan::NewBuffer((char *)asioDriverInfo.bufferInfos[i].buffers[index], buffSize * 4, buffer_delete_callback, 0).ToLocalChecked());
-					break;
-			}				
+	// the start() callback renders the outputs, it goes first
+	while (asioDriverInfo.primary >= 0 && (slotIndex = inputPool.take(asioDriverInfo.primary)) >= 0){
+		v8::HandleScope blockScope(isolate);
+		Local<Function> callback = Local<Function>::New(isolate, asioDriverInfo.callback);
+		BlockHeader *header = (BlockHeader *)inputPool.slot(slotIndex);
+		
+		// the Buffers of this slot were made at start(), nothing gets allocated per block.
+		// they stay valid until the callback returns, after that the slot is reused
+		Local<Value> inputArr = pool->Get((uint32_t)slotIndex);
+		
+		// JS renders the outputs in place, into the next free output slot
+		char *outSlot = asioDriverInfo.outputRing.pending() < (size_t)asioDriverInfo.outputDepth ? asioDriverInfo.outputRing.writeSlot() : NULL;
+		Local<Value> outputArr;
+		if (outSlot)
+			outputArr = outputPool->Get((uint32_t)asioDriverInfo.outputRing.writePosition());
+		else{
+			// nowhere to put it, let JS render into the spare slot and throw it away
+			outSlot = asioDriverInfo.outputSpare;
+			outputArr = outputPool->Get((uint32_t)asioDriverInfo.outputRing.capacity());
+			if (asioDriverInfo.outputBuffers)
+				asioDriverInfo.stats.outputOverflows.fetch_add(1, std::memory_order_relaxed);
+		}
+		// a channel JS leaves alone plays silence, not what this slot held the last time around
+		for (long i = 0; i < asioDriverInfo.outputBuffers; i++)
+			memset(outSlot + outputs.slotOffset[i], 0, outputs.slotBytes[i]);
+		
+		// blocks lost since the last call, only non zero when JS falls behind
+		uint64_t overflows = asioDriverInfo.overflows.load(std::memory_order_relaxed);
+		Local<Integer> dropped = Integer::NewFromUnsigned(isolate, (uint32_t)(overflows - asioDriverInfo.reportedOverflows));
+		asioDriverInfo.reportedOverflows = overflows;
+		// tells JS which block it is looking at, as the Buffer objects themselves are reused
+		Local<Integer> generation = Integer::NewFromUnsigned(isolate, (uint32_t)header->sequence);
+		
+		//pack argv
+		Local<Value> argv[] = {inputArr, dropped, generation, outputArr};
+		uint64_t dispatchTime = monotonicNanos();
+		asioDriverInfo.stats.dispatch.record(dispatchTime - header->entryTime);
+		// from the callback that completed the block to JS picking it up
+		if (traceOn())
+			traceRecord(kTraceAsync, "queued", header->entryTime, dispatchTime - header->entryTime, "sequence", header->sequence);
+		Local<Value> result;
+		{
+			TraceSpan callbackSpan("jsCallback", "sequence", header->sequence);
+			result = callback->Call(isolate->GetCurrentContext()->Global(), 4, argv);
 		}
+		
+		// returning an array of Buffers still works, channel i of it goes to output i
+		if (!result.IsEmpty() && result->IsArray()){
+			Local<Array> returned = Local<Array>::Cast(result);
+			for (uint32_t i = 0; i < (uint32_t)asioDriverInfo.outputBuffers && i < returned->Length(); i++){
+				size_t length;
+				char *data = viewData(returned->Get(i), &length);
+				if (data)
+					memcpy(outSlot + outputs.slotOffset[i], data, length < (size_t)outputs.slotBytes[i] ? length : outputs.slotBytes[i]);
+			}
+		}
+		
+		uint64_t doneTime = monotonicNanos();
+		asioDriverInfo.stats.jsCallback.record(doneTime - dispatchTime);
+		// the driver wants this block's output outputPrefill bufferSwitches on, that's what the queue holds
+		if (doneTime > header->entryTime + asioDriverInfo.blockPeriod * asioDriverInfo.outputPrefill)
+			asioDriverInfo.stats.missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+		if (outSlot != asioDriverInfo.outputSpare){
+			((BlockHeader *)outSlot)->entryTime = header->entryTime;
+			asioDriverInfo.outputRing.commit();
+		}
+		inputPool.release(slotIndex);
 	}
-	
-	//pack argv
-	Local<Value> argv[] = {inputArr};
-	Local<Array> outputArr = Local<Array>::Cast(Local<Function>::New(asioDriverInfo.isolate, asioDriverInfo.callback)->Call(asioDriverInfo.isolate->GetCurrentContext()->Global(), 1, argv));
-	// OK do processing for the outputs only
-	
-	for (int i = 0; i < asioDriverInfo.inputBuffers + asioDriverInfo.outputBuffers; i++){
-		if(asioDriverInfo.bufferInfos[i].isInput == false){
-			switch (asioDriverInfo.channelInfos[i].type){
-				case ASIOSTInt16LSB:
-					memcpy(asioDriverInfo.bufferInfos[i].buffers[index], (char*) node::Buffer::Data(outputArr->Get(0)), buffSize * 2);
-					break;
-				case ASIOSTInt24LSB:		// used for 20 bits as well
-					memcpy(asioDriverInfo.bufferInfos[i].buffers[index], (char*) node::Buffer::Data(outputArr->Get(0)), buffSize * 3);
-					break;
-				case ASIOSTInt32LSB:
-					memcpy(asioDriverInfo.bufferInfos[i].buffers[index], (char*) node::Buffer::Data(outputArr->Get(0)), buffSize * 4);
-					break;
-			}				
+	deliverToSubscribers(isolate, pool);
+	wakeDriverThread();
+}
+static void deliverToSubscribers(Isolate *isolate, Local<Array> pool){
+	// every subscriber sees the same pooled Buffers, read only and valid until its callback returns
+	BlockPool &inputPool = asioDriverInfo.inputPool;
+	for (int id = 0; id < POOL_MAX_SUBSCRIBERS; id++){
+		if (subscriberCallbacks[id].IsEmpty())
+			continue;
+		v8::HandleScope subscriberScope(isolate);
+		Local<Function> callback = Local<Function>::New(isolate, subscriberCallbacks[id]);
+		long slotIndex;
+		while ((slotIndex = inputPool.take(id)) >= 0){
+			v8::HandleScope blockScope(isolate);
+			BlockHeader *header = (BlockHeader *)inputPool.slot(slotIndex);
+			PoolSubscriberStats stats;
+			inputPool.stats(id, &stats);
+			Local<Value> argv[] = {
+				pool->Get((uint32_t)slotIndex),
+				Integer::NewFromUnsigned(isolate, (uint32_t)header->sequence),
+				Integer::NewFromUnsigned(isolate, (uint32_t)(stats.lost - subscriberReportedLost[id]))
+			};
+			subscriberReportedLost[id] = stats.lost;
+			TraceSpan subscriberSpan("subscriber", "id", id);
+			callback->Call(isolate->GetCurrentContext()->Global(), 3, argv);
+			inputPool.release(slotIndex);
+			// the callback may have unsubscribed itself
+			if (subscriberCallbacks[id].IsEmpty())
+				break;
+		}
+		// cut off for falling behind, it gets told once with null and is gone
+		if (!subscriberCallbacks[id].IsEmpty() && inputPool.dropped(id)){
+			{
+				ControlLock lock;
+				inputPool.detach(id);
+			}
+			subscriberCallbacks[id].Reset();
+			Local<Value> argv[] = {Null(isolate)};
+			callback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+		}
+	}
+}
+static bool writeOutputs(long index, bool dspActive, bool playing, bool bridging, bool sharing){
+	// runs on the driver thread, plays the oldest rendered block or the fallback if there is none,
+	// with the graph active, a file playing, a stream bridged or a block from another process
+	// everything is mixed in the graph's outputs.
+	// false when JS renders the outputs and this block got the fallback
+	TraceSpan span("writeOutputs", "index", index);
+	long buffSize = asioDriverInfo.preferredSize;
+	DspGraph &dsp = asioDriverInfo.dsp;
+	Player &player = asioDriverInfo.player;
+	Bridge &bridge = asioDriverInfo.bridge;
+	SharedRing &shared = asioDriverInfo.sharedOutputs;
+	ChannelSet &outputs = asioDriverInfo.outputs;
+	BlockRing &outputRing = asioDriverInfo.outputRing;
+	char *slot = NULL;
+	char *repeat = NULL;
+	if (asioDriverInfo.jsTaps){
+		// nothing plays until the queue holds outputPrefill slots, that's the headroom JS gets
+		if (asioDriverInfo.outputPriming && outputRing.pending() >= (size_t)asioDriverInfo.outputPrefill)
+			asioDriverInfo.outputPriming = false;
+		slot = asioDriverInfo.outputPriming ? NULL : outputRing.readSlot();
+		if (!slot && asioDriverInfo.outputRepeat && asioDriverInfo.repeatValid){
+			repeat = asioDriverInfo.repeatBlock;
+			asioDriverInfo.repeatValid = false;
 		}
 	}
 	
+	void **halves = outputs.half[index];
+	for (long i = 0; i < outputs.count; i++){
+		void *out = halves[i];
+		char *rendered = slot ? slot + outputs.slotOffset[i] + asioDriverInfo.outputPlayed * outputs.blockBytes[i]
+			: repeat ? repeat + outputs.slotOffset[i] : NULL;
+		// kept for the next block in case that one has nothing
+		if (slot && asioDriverInfo.outputRepeat)
+			memcpy(asioDriverInfo.repeatBlock + outputs.slotOffset[i], rendered, outputs.blockBytes[i]);
+		if (dspActive || playing || bridging || sharing){
+			float *y = dsp.output(i);
+			if (!dspActive)
+				memset(y, 0, buffSize * sizeof(float));
+			const float *file = playing ? player.output(i) : NULL;
+			if (file){
+				for (long n = 0; n < buffSize; n++)
+					y[n] += file[n];
+			}
+			const float *stream = bridging ? bridge.output(i) : NULL;
+			if (stream){
+				for (long n = 0; n < buffSize; n++)
+					y[n] += stream[n];
+			}
+			const float *other = sharing ? shared.output(i) : NULL;
+			if (other){
+				for (long n = 0; n < buffSize; n++)
+					y[n] += other[n];
+			}
+			const float *x = (const float *)rendered;
+			if (rendered && !asioDriverInfo.floatSamples){
+				x = NULL;
+				if (outputs.toFloat[i]){
+					outputs.toFloat[i](rendered, dsp.scratch(), buffSize);
+					x = dsp.scratch();
+				}
+			}
+			if (x){
+				for (long n = 0; n < buffSize; n++)
+					y[n] += x[n];
+			}
+			dsp.finish(i);
+			if (outputs.fromFloat[i])
+				outputs.fromFloat[i](y, out, buffSize);
+			else
+				memset(out, 0, outputs.nativeBytes[i]);
+		}
+		else if (!rendered)
+			memset(out, 0, outputs.nativeBytes[i]);
+		else if (!asioDriverInfo.floatSamples)
+			memcpy(out, rendered, outputs.blockBytes[i]);
+		else if (outputs.fromFloat[i])
+			outputs.fromFloat[i]((float *)rendered, out, buffSize);
+		else
+			memset(out, 0, outputs.nativeBytes[i]);
+	}
+	if (slot){
+		asioDriverInfo.repeatValid = asioDriverInfo.outputRepeat;
+		// a slot is done once all of its driver blocks have played
+		if (++asioDriverInfo.outputPlayed == asioDriverInfo.callbackBlocks){
+			asioDriverInfo.stats.roundTrip.record(monotonicNanos() - ((BlockHeader *)slot)->entryTime);
+			outputRing.consume();
+			asioDriverInfo.outputPlayed = 0;
+		}
+		return true;
+	}
+	if (!asioDriverInfo.jsTaps || !outputs.count)
+		return true;
+	if (asioDriverInfo.outputPriming)
+		asioDriverInfo.stats.primingBlocks.fetch_add(1, std::memory_order_relaxed);
+	else{
+		// ran dry, it fills up to outputPrefill again before it plays
+		asioDriverInfo.stats.outputUnderruns.fetch_add(1, std::memory_order_relaxed);
+		traceInstant("outputUnderrun", "index", index);
+		asioDriverInfo.outputPriming = true;
+	}
+	if (repeat)
+		asioDriverInfo.stats.repeatedBlocks.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+static Local<Array> makeSlotPool(Isolate *isolate, char *memory, size_t count, size_t stride, char *spare, const ChannelSet &channels){
+	// wrap every slot once, JS gets the same objects back each time the slot comes around
+	uint32_t slots = (uint32_t)count + (spare ? 1 : 0);
+	Local<Array> pool = Array::New(isolate, slots);
+	for (uint32_t s = 0; s < slots; s++){
+		char *slot = s < count ? memory + s * stride : spare;
+		Local<Array> views = Array::New(isolate, channels.count);
+		for (long i = 0; i < channels.count; i++){
+			char *data = slot + channels.slotOffset[i];
+			long bytes = channels.slotBytes[i];
+			if (asioDriverInfo.floatSamples){
+				Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, data, bytes);
+				views->Set(i, Float32Array::New(buffer, 0, bytes / sizeof(float)));
+			}
+			else
+				views->Set(i, Nan::NewBuffer(data, bytes, buffer_delete_callback, 0).ToLocalChecked());
+		}
+		pool->Set(s, views);
+	}
+	return pool;
+}
+static void releaseSubscribers(){
+	// the pool is about to go, so are its subscribers
+	for (int id = 0; id < POOL_MAX_SUBSCRIBERS; id++){
+		subscriberCallbacks[id].Reset();
+		subscriberReportedLost[id] = 0;
+	}
+	asioDriverInfo.inputPool.release();
+}
+static void releaseSlotPool(Isolate *isolate, Persistent<Array> &slotPool){
+	// detach the pooled Buffers before their ring memory goes away,
+	// so a Buffer JS held on to reads as empty instead of freed memory
+	if (slotPool.IsEmpty())
+		return;
+	v8::HandleScope handleScope(isolate);
+	Local<Array> pool = Local<Array>::New(isolate, slotPool);
+	for (uint32_t s = 0; s < pool->Length(); s++){
+		Local<Array> views = Local<Array>::Cast(pool->Get(s));
+		for (uint32_t i = 0; i < views->Length(); i++){
+			Local<ArrayBuffer> buffer = Local<ArrayBufferView>::Cast(views->Get(i))->Buffer();
+			if (buffer->IsNeuterable())
+				buffer->Neuter();
+		}
+	}
+	slotPool.Reset();
+}
+static bool processBlock(long index, uint64_t entryTime){
+	// one block at the host rate in the halves of index: the graph, the taps on the inputs,
+	// everything that feeds the outputs. Straight from the callback, or once per converted block;
+	// false when the outputs only got the fallback
+	long buffSize = asioDriverInfo.preferredSize;
+
+	// apply whatever JS changed in the graph since the last block, then run it
+	DspGraph &dsp = asioDriverInfo.dsp;
+	ChannelSet &inputs = asioDriverInfo.inputs;
+	void **halves = inputs.half[index];
+	dsp.applyCommands();
+	bool dspActive = dsp.active();
+	if (dspActive){
+		{
+			TraceSpan span("convertInputs");
+			for (long i = 0; i < inputs.count; i++){
+				if (inputs.toFloat[i])
+					inputs.toFloat[i](halves[i], dsp.input(i), buffSize);
+				else
+					memset(dsp.input(i), 0, buffSize * sizeof(float));
+			}
+		}
+		TraceSpan span("graph");
+		dsp.process();
+	}
+
+	// the recorder and the analyzer take their own copy, they never wait for JS
+	asioDriverInfo.recorder.capture(halves);
+	asioDriverInfo.analyzer.capture(halves);
+	{
+		TraceSpan span("sharedInputs");
+		AsioTimeInfo &timeInfo = asioDriverInfo.tInfo.timeInfo;
+		uint32_t flags = (timeInfo.flags & kSystemTimeValid ? kSharedSystemTime : 0)
+			| (timeInfo.flags & kSamplePositionValid ? kSharedSamplePosition : 0)
+			| (asioDriverInfo.tInfo.timeCode.flags & kTcValid ? kSharedTimeCode : 0);
+		asioDriverInfo.sharedInputs.publish(halves, asioDriverInfo.samples, asioDriverInfo.nanoSeconds,
+			asioDriverInfo.tcSamples, flags, entryTime);
+	}
+
+	// processing for inputs, copy the recorded halves into the slot being filled,
+	// it goes to every subscriber once it holds callbackBlocks of them
+	if (asioDriverInfo.inputPool.subscriberCount()){
+		TraceSpan span("queue");
+		BlockPool &inputPool = asioDriverInfo.inputPool;
+		if (!asioDriverInfo.inputSlot)
+			asioDriverInfo.inputSlot = inputPool.acquire();
+		char *slot = asioDriverInfo.inputSlot;
+		if (slot){
+			long fill = asioDriverInfo.inputFill;
+			BlockHeader *header = (BlockHeader *)slot;
+			if (fill == 0){
+				header->index = index;
+				header->sequence = asioDriverInfo.blockSequence++;
+				header->samples = asioDriverInfo.samples;
+				header->nanoSeconds = asioDriverInfo.nanoSeconds;
+			}
+			for (long i = 0; i < inputs.count; i++){
+				char *dst = slot + inputs.slotOffset[i] + fill * inputs.blockBytes[i];
+				if (!asioDriverInfo.floatSamples)
+					memcpy(dst, halves[i], inputs.blockBytes[i]);
+				else if (dspActive)
+					memcpy(dst, dsp.input(i), inputs.blockBytes[i]);	// already converted for the graph
+				else if (inputs.toFloat[i])
+					inputs.toFloat[i](halves[i], (float *)dst, buffSize);
+				else
+					memset(dst, 0, inputs.blockBytes[i]);
+			}
+			if (++asioDriverInfo.inputFill == asioDriverInfo.callbackBlocks){
+				// latencies count from the block that completed the slot
+				header->entryTime = entryTime;
+				// the start() callback missing it is what droppedBlocks counts
+				if (asioDriverInfo.primary >= 0 && !inputPool.hasRoom(asioDriverInfo.primary)){
+					asioDriverInfo.stats.droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+					asioDriverInfo.overflows.fetch_add(1, std::memory_order_relaxed);
+					traceInstant("droppedBlock", "sequence", header->sequence);
+				}
+				inputPool.publish();
+				asioDriverInfo.inputSlot = NULL;
+				asioDriverInfo.inputFill = 0;
+				// wake up the loop, sends that pile up before it runs collapse into a single wakeup
+				uv_async_send(asioDriverInfo.blockAsync);
+			}
+		}
+		else if (++asioDriverInfo.lostBlocks == asioDriverInfo.callbackBlocks){
+			asioDriverInfo.stats.droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+			asioDriverInfo.overflows.fetch_add(1, std::memory_order_relaxed);
+			asioDriverInfo.lostBlocks = 0;
+		}
+	}
+
+	// outputs JS rendered for an earlier block, whatever the graph made of this one, the file playing,
+	// the bridged stream, which measures the device clock off the same time stamps, and the block
+	// another process wrote, read in place until it's mixed in
+	bool playing = asioDriverInfo.player.process(asioDriverInfo.samples);
+	bool bridging = asioDriverInfo.bridge.process(asioDriverInfo.samples, asioDriverInfo.nanoSeconds);
+	bool sharing = asioDriverInfo.sharedOutputs.acquire();
+	bool rendered = writeOutputs(index, dspActive, playing, bridging, sharing);
+	if (sharing)
+		asioDriverInfo.sharedOutputs.release();
+
+	asioDriverInfo.stats.blocks.fetch_add(1, std::memory_order_relaxed);
+	asioDriverInfo.stats.processedSamples.fetch_add(buffSize, std::memory_order_relaxed);
+	return rendered;
+}
+static void waitForHost(){
+	// offline: every block handed out so far has been through JS (and its outputs are queued)
+	// before the device gets to go on, so where a block's outputs land never depends on timing
+	TraceSpan span("waitForHost");
+	BlockPool &inputPool = asioDriverInfo.inputPool;
+	uv_mutex_lock(&asioDriverInfo.hostMutex);
+	while (!inputPool.idle() && !asioDriverInfo.stopping.load(std::memory_order_acquire))
+		uv_cond_wait(&asioDriverInfo.hostDone, &asioDriverInfo.hostMutex);
+	uv_mutex_unlock(&asioDriverInfo.hostMutex);
+}
+static bool convertBlocks(long index, uint64_t entryTime){
+	// the device runs at another rate: its inputs go into the converter, then as many host blocks
+	// as it takes to have the device's next outputs ready, each at the position it has on the host side.
+	// false when the converter ran dry or a host block got the fallback
+	RateConverter &converter = asioDriverInfo.converter;
+	bool rendered = true;
+	{
+		TraceSpan span("resampleInputs");
+		converter.input(index);
+	}
+	while (converter.nextBlock()){
+		long hostIndex = asioDriverInfo.hostIndex;
+		asioDriverInfo.hostIndex ^= 1;
+		{
+			TraceSpan span("resampleInputs", "hostIndex", hostIndex);
+			converter.pullInputs(hostIndex);
+		}
+		asioDriverInfo.samples = asioDriverInfo.hostSamples;
+		if (!processBlock(hostIndex, entryTime))
+			rendered = false;
+		{
+			TraceSpan span("resampleOutputs", "hostIndex", hostIndex);
+			converter.pushOutputs(hostIndex);
+		}
+		asioDriverInfo.hostSamples += asioDriverInfo.preferredSize;
+	}
+	TraceSpan span("resampleOutputs", "index", index);
+	if (!converter.output(index) && asioDriverInfo.outputs.count){
+		asioDriverInfo.stats.outputUnderruns.fetch_add(1, std::memory_order_relaxed);
+		traceInstant("outputUnderrun", "index", index);
+		return false;
+	}
+	return rendered;
 }
 ASIOTime *bufferSwitchTimeInfo(ASIOTime *timeInfo, long index, ASIOBool processNow)
 {	// the actual processing callback.
 	// Beware that this is normally in a seperate thread, hence be sure that you take care
-	// about thread synchronization. This is omitted here for simplicity.
-	static long processedSamples = 0;
+	// about thread synchronization. Inputs are handed to the loop through a pool of
+	// preallocated slots and lock free queues, nothing in here allocates or locks.
+	
+	// the first block since start() puts this thread where it was asked to run, the only syscalls in here
+	if (asioDriverInfo.realtimePending.load(std::memory_order_acquire)){
+		asioDriverInfo.realtimePending.store(false, std::memory_order_relaxed);
+		RealtimeConfig &realtime = asioDriverInfo.realtime;
+		applyThreadRealtime(realtime.priority, realtime.cpus, asioDriverInfo.blockPeriod / asioDriverInfo.callbackBlocks,
+			&asioDriverInfo.driverThread, NULL);
+		asioDriverInfo.driverThreadDone.store(true, std::memory_order_release);
+	}
+	// nothing else writes these, so they can't lose an update to the reset
+	if (asioDriverInfo.statsResetPending.load(std::memory_order_acquire)){
+		asioDriverInfo.statsResetPending.store(false, std::memory_order_relaxed);
+		resetDriverStats(&asioDriverInfo.stats);
+	}
+	uint64_t entryTime = monotonicNanos();
+	traceThreadName("asio driver");
+	TraceSpan span("bufferSwitch", "index", index);
 	
 	// store the timeInfo for later use
 	asioDriverInfo.tInfo = *timeInfo;
@@ -390,8 +977,19 @@ ASIOTime *bufferSwitchTimeInfo(ASIOTime *timeInfo, long index, ASIOBool processN
 	else
 		asioDriverInfo.nanoSeconds = 0;
 
-	if (timeInfo->timeInfo.flags & kSamplePositionValid)
+	// buffer size in samples, the driver's
+	long buffSize = asioDriverInfo.deviceSize;
+
+	if (timeInfo->timeInfo.flags & kSamplePositionValid){
 		asioDriverInfo.samples = ASIO64toDouble(timeInfo->timeInfo.samplePosition);
+		// the position should move on by exactly one block, anything else means lost or repeated audio
+		if (asioDriverInfo.lastSamplesValid && asioDriverInfo.samples != asioDriverInfo.lastSamples + buffSize){
+			asioDriverInfo.stats.discontinuities.fetch_add(1, std::memory_order_relaxed);
+			traceInstant("discontinuity", "samples", (int64_t)asioDriverInfo.samples);
+		}
+		asioDriverInfo.lastSamples = asioDriverInfo.samples;
+		asioDriverInfo.lastSamplesValid = true;
+	}
 	else
 		asioDriverInfo.samples = 0;
 
@@ -402,22 +1000,17 @@ ASIOTime *bufferSwitchTimeInfo(ASIOTime *timeInfo, long index, ASIOBool processN
 
 	// get the system reference time
 	asioDriverInfo.sysRefTime = getSysReferenceTime();
-	
-	// buffer size in samples
-	long buffSize = asioDriverInfo.preferredSize;
 
-	// processing for inputs send recorded data To js
-	Work * work = new Work();
-	work->request.data = work;
-	work->index = index;
-	//kicking of the worker thread
-	uv_queue_work(uv_default_loop(), &work->request, WorkAsync, WorkAsyncComplete);
+	bool rendered = asioDriverInfo.converter.active() ? convertBlocks(index, entryTime) : processBlock(index, entryTime);
 
-	// finally if the driver supports the ASIOOutputReady() optimization, do it here, all data are in place
-	if (asioDriverInfo.postOutput)
-		ASIOOutputReady();
+	// finally if the driver supports the ASIOOutputReady() optimization, do it here, but only once
+	// real data are in place; a fallback block leaves the driver to its normal timing
+	if (asioDriverInfo.postOutput && rendered)
+		asioBackend->outputReady();
 
-	processedSamples += buffSize;
+	asioDriverInfo.stats.driverCallback.record(monotonicNanos() - entryTime);
+	if (asioDriverInfo.offline)
+		waitForHost();
 
 	return 0L;
 }
@@ -435,14 +1028,132 @@ void bufferSwitch(long index, ASIOBool processNow)
 	
 	// get the time stamp of the buffer, not necessary if no
 	// synchronization to other media is required
-	if (ASIOGetSamplePosition(&timeInfo.timeInfo.samplePosition, &timeInfo.timeInfo.systemTime) == ASE_OK)
+	if (asioBackend->getSamplePosition(&timeInfo.timeInfo.samplePosition, &timeInfo.timeInfo.systemTime) == ASE_OK)
 		timeInfo.timeInfo.flags = kSystemTimeValid | kSamplePositionValid;
 
 	bufferSwitchTimeInfo(&timeInfo, index, processNow);
 }
 unsigned long getSysReferenceTime()
-{	// get the system reference time
-	return 0;
+{	// get the system reference time, in milliseconds like the SDK samples
+	return (unsigned long)(monotonicNanos() / 1000000);
+}
+// the little endian ASIO types by name, fallback for anything else
+static ASIOSampleType sampleTypeByName(const std::string &name, ASIOSampleType fallback){
+	if (name == "int16")
+		return ASIOSTInt16LSB;
+	if (name == "int24")
+		return ASIOSTInt24LSB;
+	if (name == "int32")
+		return ASIOSTInt32LSB;
+	if (name == "float32")
+		return ASIOSTFloat32LSB;
+	return fallback;
+}
+static void readVirtualConfig(Isolate *isolate, Local<Value> value, VirtualConfig *config){
+	// virtual: {inputs, outputs, sampleType, source: 'sine'|'loopback'|'file'|'silence', frequency, file,
+	// sampleRate, fixedRate, outputReady, offline, seconds, outputFile}
+	if (!value->IsObject())
+		return;
+	Local<Object> options = value->ToObject();
+	Local<Value> inputs = options->Get(String::NewFromUtf8(isolate, "inputs"));
+	Local<Value> outputs = options->Get(String::NewFromUtf8(isolate, "outputs"));
+	Local<Value> sampleType = options->Get(String::NewFromUtf8(isolate, "sampleType"));
+	Local<Value> source = options->Get(String::NewFromUtf8(isolate, "source"));
+	Local<Value> frequency = options->Get(String::NewFromUtf8(isolate, "frequency"));
+	Local<Value> file = options->Get(String::NewFromUtf8(isolate, "file"));
+	Local<Value> sampleRate = options->Get(String::NewFromUtf8(isolate, "sampleRate"));
+	Local<Value> fixedRate = options->Get(String::NewFromUtf8(isolate, "fixedRate"));
+	if (inputs->IsNumber())
+		config->inputs = inputs->Int32Value();
+	if (outputs->IsNumber())
+		config->outputs = outputs->Int32Value();
+	// either an ASIOSampleType number or one of the common little endian names
+	if (sampleType->IsNumber())
+		config->sampleType = sampleType->Int32Value();
+	else if (sampleType->IsString()){
+		v8::String::Utf8Value name(sampleType);
+		config->sampleType = sampleTypeByName(*name, config->sampleType);
+	}
+	if (source->IsString()){
+		v8::String::Utf8Value name(source);
+		std::string kind(*name);
+		if (kind == "sine")
+			config->source = kVirtualSine;
+		else if (kind == "loopback")
+			config->source = kVirtualLoopback;
+		else if (kind == "file")
+			config->source = kVirtualFile;
+		else
+			config->source = kVirtualSilence;
+	}
+	if (frequency->IsNumber())
+		config->frequency = frequency->NumberValue();
+	if (file->IsString()){
+		v8::String::Utf8Value path(file);
+		config->file = *path;
+	}
+	// the device's own rate, with fixedRate the only one it runs at
+	if (sampleRate->IsNumber() && sampleRate->NumberValue() > 0)
+		config->sampleRate = sampleRate->NumberValue();
+	config->fixedRate = fixedRate->IsTrue();
+	// on by default, false takes the path for drivers without ASIOOutputReady()
+	Local<Value> outputReady = options->Get(String::NewFromUtf8(isolate, "outputReady"));
+	if (outputReady->IsBoolean())
+		config->outputReady = outputReady->IsTrue();
+	config->offline = options->Get(String::NewFromUtf8(isolate, "offline"))->IsTrue();
+	Local<Value> seconds = options->Get(String::NewFromUtf8(isolate, "seconds"));
+	if (seconds->IsNumber() && seconds->NumberValue() > 0)
+		config->seconds = seconds->NumberValue();
+	Local<Value> outputFile = options->Get(String::NewFromUtf8(isolate, "outputFile"));
+	if (outputFile->IsString()){
+		v8::String::Utf8Value path(outputFile);
+		config->outputFile = *path;
+	}
+}
+static void renderFinished(void *arg){
+	// the device thread, start() opened the handle before it ran and stop() waits for it
+	uv_async_send(asioDriverInfo.renderAsync);
+}
+static void readCpus(Local<Value> value, std::vector<int> *cpus){
+	cpus->clear();
+	if (!value->IsArray())
+		return;
+	Local<Array> list = Local<Array>::Cast(value);
+	for (unsigned int i = 0; i < list->Length(); i++)
+		cpus->push_back(list->Get(i)->Int32Value());
+}
+static void readRealtimeConfig(Isolate *isolate, Local<Value> value, RealtimeConfig *config){
+	// realtime: {priority, cpus, js, jsCpus, lockMemory}
+	if (!value->IsObject())
+		return;
+	Local<Object> options = value->ToObject();
+	Local<Value> priority = options->Get(String::NewFromUtf8(isolate, "priority"));
+	if (priority->IsNumber())
+		config->priority = priority->Int32Value() > 0 ? priority->Int32Value() : 0;
+	readCpus(options->Get(String::NewFromUtf8(isolate, "cpus")), &config->cpus);
+	config->jsThread = options->Get(String::NewFromUtf8(isolate, "js"))->BooleanValue();
+	readCpus(options->Get(String::NewFromUtf8(isolate, "jsCpus")), &config->jsCpus);
+	config->lockMemory = options->Get(String::NewFromUtf8(isolate, "lockMemory"))->BooleanValue();
+}
+// a failed init() leaves nothing behind, so it can be retried, from this thread or another one.
+// loaded and initialized say how far it got with the driver
+static void abandonInit(bool loaded, bool initialized){
+	if (initialized){
+		asioBackend->disposeBuffers();
+		asioBackend->exit();
+	}
+	if (loaded){
+		asioBackend->unload();
+		driverUnloaded();
+	}
+	asioDriverInfo.converter.release();
+	asioDriverInfo.inputs.release();
+	asioDriverInfo.outputs.release();
+	asioDriverInfo.renderCallback.Reset();
+	asioDriverInfo.offline = false;
+	asioBackend = NULL;
+	asioDriverInfo.loop = NULL;
+	asioDriverInfo.owner = NULL;
 }
 void AsioInit(const FunctionCallbackInfo<Value>& args){
 	Isolate * isolate = args.GetIsolate(); 
@@ -456,7 +1167,20 @@ void AsioInit(const FunctionCallbackInfo<Value>& args){
 	Local<String> e_prop = String::NewFromUtf8(isolate, "endianess");
 	Local<String> ic_prop = String::NewFromUtf8(isolate, "inputChannels");
 	Local<String> oc_prop = String::NewFromUtf8(isolate, "outputChannels");
+	Local<String> rb_prop = String::NewFromUtf8(isolate, "ringBlocks");
+	Local<String> sf_prop = String::NewFromUtf8(isolate, "sampleFormat");
 	
+	// probe() loads drivers on the thread pool, wait for it to put them back. Held from here on,
+	// so two threads in init() at once can't both take the device
+	DriverLock drivers;
+	// one device per process, whichever thread got it first keeps it until deInit()
+	if (asioDriverInfo.owner && asioDriverInfo.owner != isolate){
+		args.GetReturnValue().Set(Int32::New(isolate, -6));
+		return;
+	}
+	asioDriverInfo.owner = isolate;
+	asioDriverInfo.loop = eventLoop(isolate);
+
 	//std::string = target->Get(prop)->
 	v8::String::Utf8Value s(target->Get(prop));
 	std::string driverName(*s);
@@ -465,6 +1189,29 @@ void AsioInit(const FunctionCallbackInfo<Value>& args){
 	int samplesPerBlock = target->Get(spb_prop)->Int32Value();
 	v8::String::Utf8Value s2(target->Get(e_prop));
 	std::string endianess(*s2);
+	// how many blocks may be queued for JS before we start dropping them
+	int ringBlocks = target->Get(rb_prop)->Int32Value();
+	asioDriverInfo.ringBlocks = ringBlocks > 0 ? ringBlocks : DEFAULT_RING_BLOCKS;
+	// blocks shared by the start() callback and every subscribe()r
+	int poolBlocks = target->Get(String::NewFromUtf8(isolate, "poolBlocks"))->Int32Value();
+	asioDriverInfo.poolBlocks = poolBlocks > 0 ? poolBlocks : 2 * asioDriverInfo.ringBlocks + 2;
+	// how many samples JS gets per call, rounded up to whole driver blocks once we know their size
+	int samplesPerCallback = target->Get(String::NewFromUtf8(isolate, "samplesPerCallback"))->Int32Value();
+	// 'native' hands out the driver's own sample format, 'float32' converts to normalized floats
+	v8::String::Utf8Value s3(target->Get(sf_prop));
+	asioDriverInfo.floatSamples = std::string(*s3) == "float32";
+	// thread priority, pinning and memory locking, they take effect at start()
+	defaultRealtimeConfig(&asioDriverInfo.realtime);
+	readRealtimeConfig(isolate, target->Get(String::NewFromUtf8(isolate, "realtime")), &asioDriverInfo.realtime);
+	// the output queue: how deep, how full before it plays, and what plays when it runs dry
+	int outputBlocks = target->Get(String::NewFromUtf8(isolate, "outputBlocks"))->Int32Value();
+	asioDriverInfo.outputDepth = outputBlocks > 0 ? (outputBlocks < MAX_OUTPUT_BLOCKS ? outputBlocks : MAX_OUTPUT_BLOCKS) : OUTPUT_RING_BLOCKS;
+	int outputPrefill = target->Get(String::NewFromUtf8(isolate, "outputPrefill"))->Int32Value();
+	asioDriverInfo.outputPrefill = outputPrefill > 0 ? (outputPrefill < asioDriverInfo.outputDepth ? outputPrefill : asioDriverInfo.outputDepth) : 1;
+	v8::String::Utf8Value fallback(target->Get(String::NewFromUtf8(isolate, "outputFallback")));
+	asioDriverInfo.outputRepeat = std::string(*fallback) == "repeat";
+	// a device that can't run at sampleRate gets converted to it, unless resample is false
+	asioDriverInfo.resample = !target->Get(String::NewFromUtf8(isolate, "resample"))->IsFalse();
 	
 	//input channels
 	Local<Array> inChan = Local<Array>::Cast(target->Get(ic_prop));
@@ -475,19 +1222,60 @@ void AsioInit(const FunctionCallbackInfo<Value>& args){
 	}
 	
 	//outputChannels
-	Local<Array> outChan = Local<Array>::Cast(target->Get(ic_prop));
+	Local<Array> outChan = Local<Array>::Cast(target->Get(oc_prop));
 	std::vector<int> outputChannels;
 	for(unsigned int i = 0; i < outChan->Length(); i++){
 		outputChannels.push_back(outChan->Get(i)->Int32Value());
 	}
+	// the virtual device stands in for a driver, configured from the "virtual" options
+	if (driverName == VIRTUAL_DRIVER_NAME){
+		VirtualConfig config;
+		defaultVirtualConfig(&config);
+		// enough channels for the highest index asked for, unless the options say otherwise
+		config.inputs = 0;
+		for (size_t i = 0; i < inputChannels.size(); i++)
+			if (inputChannels[i] + 1 > config.inputs)
+				config.inputs = inputChannels[i] + 1;
+		config.outputs = 0;
+		for (size_t i = 0; i < outputChannels.size(); i++)
+			if (outputChannels[i] + 1 > config.outputs)
+				config.outputs = outputChannels[i] + 1;
+		config.sampleRate = sampleRate;
+		Local<Value> virtualValue = target->Get(String::NewFromUtf8(isolate, "virtual"));
+		readVirtualConfig(isolate, virtualValue, &config);
+		// offline the device says when it rendered everything, done gets told on the loop
+		asioDriverInfo.renderCallback.Reset();
+		if (config.offline && virtualValue->IsObject()){
+			Local<Value> done = virtualValue->ToObject()->Get(String::NewFromUtf8(isolate, "done"));
+			if (done->IsFunction())
+				asioDriverInfo.renderCallback.Reset(isolate, Local<Function>::Cast(done));
+			config.finished = renderFinished;
+		}
+		asioDriverInfo.offline = config.offline;
+		configureVirtualDevice(config);
+		asioBackend = &virtualBackend;
+	}
+	else{
+		asioDriverInfo.offline = false;
+#if HAVE_HARDWARE_BACKEND
+		asioBackend = &hardwareBackend;
+#else
+		// no SDK host code on this platform, only the virtual device
+		abandonInit(false, false);
+		Local<Number> retval = Int32::New(isolate, -5);
+		args.GetReturnValue().Set(retval);
+		return;
+#endif
+	}
 	// load the driver, this will setup all the necessary internal data structures
 	
 	char * cstrDriverName = new char[driverName.length()+1];
 	strcpy(cstrDriverName, driverName.c_str());
 	
-	if(loadAsioDriver(cstrDriverName)){
+	if(asioBackend->load(cstrDriverName)){
+		driverLoaded(driverName);
 		
-		if(ASIOInit(&asioDriverInfo.driverInfo) == ASE_OK){
+		if(asioBackend->init(&asioDriverInfo.driverInfo) == ASE_OK){
 			printf("asioVersion:   %d\n"
 				"driverVersion: %d\n"
 				"Name:          %s\n"
@@ -502,85 +1290,1161 @@ void AsioInit(const FunctionCallbackInfo<Value>& args){
 				asioCallbacks.asioMessage = &asioMessages;
 				asioCallbacks.bufferSwitchTimeInfo = &bufferSwitchTimeInfo;
 				
-				if(createAsioBuffers(&asioDriverInfo, bitsPerSample, endianess, inputChannels, outputChannels) == ASE_OK){
+				// the graph is there from now on, so it can be patched before start(); without it the buffers failed as well
+				if(createAsioBuffers(&asioDriverInfo, bitsPerSample, endianess, inputChannels, outputChannels) == ASE_OK
+					&& asioDriverInfo.dsp.allocate(asioDriverInfo.inputBuffers, asioDriverInfo.outputBuffers,
+						asioDriverInfo.preferredSize, asioDriverInfo.sampleRate)){
+					asioDriverInfo.callbackBlocks = samplesPerCallback > asioDriverInfo.preferredSize ?
+						(samplesPerCallback + asioDriverInfo.preferredSize - 1) / asioDriverInfo.preferredSize : 1;
 
 					Local<Number> retval = Int32::New(isolate, -1);
 					args.GetReturnValue().Set(retval);
 					return;
 				}
+				abandonInit(true, true);
 				Local<Number> retval = Int32::New(isolate, -2);
 				args.GetReturnValue().Set(retval);
 				return;
 			}
+			abandonInit(true, true);
 			Local<Number> retval = Int32::New(isolate, -3);
 			args.GetReturnValue().Set(retval);
 			return;
 		}
+		abandonInit(true, false);
 		Local<Number> retval = Int32::New(isolate, -4);
 		args.GetReturnValue().Set(retval);
 		return;
 	}
+	abandonInit(false, false);
 	Local<Number> retval = Int32::New(isolate, -5);
 	args.GetReturnValue().Set(retval);
 	return;	
 
 }
 
+// locks a ring another thread may be using already, mlock faults it in without writing to it
+static void lockRing(const BlockRing &ring){
+	if (asioDriverInfo.realtime.lockMemory)
+		asioDriverInfo.memoryLock.lock(ring.slot(0), ring.capacity() * ring.blockBytes(), false);
+}
+static void lockAudioMemory(long outputSlotBytes){
+	ControlLock lock;
+	MemoryLock &memoryLock = asioDriverInfo.memoryLock;
+	// the pools and the graph aren't in use yet, they get written once as well
+	BlockPool &inputPool = asioDriverInfo.inputPool;
+	BlockRing &outputRing = asioDriverInfo.outputRing;
+	DspGraph &dsp = asioDriverInfo.dsp;
+	memoryLock.lock(inputPool.slot(0), inputPool.capacity() * inputPool.blockBytes(), true);
+	memoryLock.lock(outputRing.slot(0), outputRing.capacity() * outputRing.blockBytes(), true);
+	memoryLock.lock(asioDriverInfo.outputSpare, outputSlotBytes, true);
+	memoryLock.lock(asioDriverInfo.repeatBlock, outputSlotBytes, true);
+	memoryLock.lock(dsp.buffer(), dsp.bufferBytes(), true);
+	// the driver's own halves are its business, they are only locked
+	for (int half = 0; half < 2; half++){
+		for (size_t i = 0; i < asioDriverInfo.bufferInfos.size(); i++)
+			memoryLock.lock(asioDriverInfo.bufferInfos[i].buffers[half],
+				asioDriverInfo.deviceSize * sampleBytes(asioDriverInfo.channelInfos[i].type), false);
+	}
+	// with a converter the channel sets point at its host halves
+	memoryLock.lock(asioDriverInfo.converter.buffer(), asioDriverInfo.converter.bufferBytes(), true);
+	lockRing(asioDriverInfo.recorder.blocks());
+	lockRing(asioDriverInfo.player.blocks());
+	lockRing(asioDriverInfo.analyzer.blocks());
+	memoryLock.lock(asioDriverInfo.bridge.buffer(), asioDriverInfo.bridge.bufferBytes(), false);
+	memoryLock.lock(asioDriverInfo.sharedInputs.buffer(), asioDriverInfo.sharedInputs.bufferBytes(), false);
+	memoryLock.lock(asioDriverInfo.sharedOutputs.buffer(), asioDriverInfo.sharedOutputs.bufferBytes(), false);
+}
 void AsioStart(const FunctionCallbackInfo<Value>& args){
 	Isolate* isolate = args.GetIsolate();
 	
-	Local<Function> callback = Local<Function>::Cast(args[1]); 
 	Local<Array> recordedBuffers = Local<Array>::Cast(args[0]);
+	if (isolate != asioDriverInfo.owner){
+		args.GetReturnValue().Set(Int32::New(isolate, -2));
+		return;
+	}
+	// the driver thread is using the pools and the rings, they can't be swapped under it
+	if (asioDriverInfo.running){
+		args.GetReturnValue().Set(Int32::New(isolate, -3));
+		return;
+	}
+	// a driver thread calling into a Worker's loop after it's gone takes the process down with it
+	if (!releasedOnExit(isolate)){
+		args.GetReturnValue().Set(Int32::New(isolate, -4));
+		return;
+	}
 	
-	asioDriverInfo.callback.Reset(isolate, callback);
+	// the callback is optional, without it only the native graph produces output
+	asioDriverInfo.jsTaps = args[1]->IsFunction();
+	if (asioDriverInfo.jsTaps)
+		asioDriverInfo.callback.Reset(isolate, Local<Function>::Cast(args[1]));
+	else
+		asioDriverInfo.callback.Reset();
 	asioDriverInfo.isolate = isolate;
 	
-	ASIOControlPanel();
-	ASIOStart();
+	// lay out the ring slots: header first, then every input channel on its own cache line
+	ChannelSet &inputs = asioDriverInfo.inputs;
+	long slotBytes = BLOCK_HEADER_BYTES;
+	for (long i = 0; i < inputs.count; i++){
+		inputs.slotOffset[i] = slotBytes;
+		inputs.blockBytes[i] = asioDriverInfo.floatSamples ? asioDriverInfo.preferredSize * sizeof(float) : inputs.nativeBytes[i];
+		inputs.slotBytes[i] = inputs.blockBytes[i] * asioDriverInfo.callbackBlocks;
+		slotBytes += alignUp(inputs.slotBytes[i]);
+	}
+	// output slots get a header too, in the same format JS gets its inputs in
+	ChannelSet &outputs = asioDriverInfo.outputs;
+	long outputSlotBytes = BLOCK_HEADER_BYTES;
+	for (long i = 0; i < outputs.count; i++){
+		outputs.slotOffset[i] = outputSlotBytes;
+		outputs.blockBytes[i] = asioDriverInfo.floatSamples ? asioDriverInfo.preferredSize * sizeof(float) : outputs.nativeBytes[i];
+		outputs.slotBytes[i] = outputs.blockBytes[i] * asioDriverInfo.callbackBlocks;
+		outputSlotBytes += alignUp(outputs.slotBytes[i]);
+	}
+	
+	{
+		// nothing of the old pools may stay locked once they are freed
+		ControlLock lock;
+		asioDriverInfo.memoryLock.unlockAll();
+	}
+	releaseSlotPool(isolate, buffersForInput);
+	releaseSlotPool(isolate, buffersForOutput);
+	releaseSubscribers();
+	if (asioDriverInfo.outputSpare)
+		alignedFree(asioDriverInfo.outputSpare);
+	if (asioDriverInfo.repeatBlock)
+		alignedFree(asioDriverInfo.repeatBlock);
+	asioDriverInfo.outputSpare = (char *)alignedAlloc(outputSlotBytes);
+	asioDriverInfo.repeatBlock = (char *)alignedAlloc(outputSlotBytes);
+	// the start() callback may queue ringBlocks of the pool, subscribe() shares the rest
+	long poolBlocks = asioDriverInfo.poolBlocks;
+	if (poolBlocks < asioDriverInfo.ringBlocks + 2)
+		poolBlocks = asioDriverInfo.ringBlocks + 2;
+	if (!asioDriverInfo.outputSpare || !asioDriverInfo.repeatBlock
+		|| !asioDriverInfo.inputPool.allocate(poolBlocks, slotBytes)
+		|| !asioDriverInfo.outputRing.allocate(asioDriverInfo.outputDepth, outputSlotBytes)){
+		args.GetReturnValue().Set(Int32::New(isolate, -1));
+		return;
+	}
+	asioDriverInfo.primary = asioDriverInfo.jsTaps ? asioDriverInfo.inputPool.attach(asioDriverInfo.ringBlocks, false) : -1;
+	asioDriverInfo.inputSlot = NULL;
+	
+	BlockPool &inputPool = asioDriverInfo.inputPool;
+	BlockRing &outputRing = asioDriverInfo.outputRing;
+	buffersForInput.Reset(isolate, makeSlotPool(isolate, inputPool.slot(0), inputPool.capacity(), inputPool.blockBytes(), NULL, inputs));
+	buffersForOutput.Reset(isolate, makeSlotPool(isolate, outputRing.slot(0), outputRing.capacity(), outputRing.blockBytes(),
+		asioDriverInfo.outputSpare, outputs));
+	resetStats(&asioDriverInfo.stats);
+	asioDriverInfo.statsResetPending.store(false);
+	asioDriverInfo.hostStatsResetPending.store(false);
+	asioDriverInfo.overflows.store(0);
+	asioDriverInfo.reportedOverflows = 0;
+	asioDriverInfo.blockSequence = 0;
+	asioDriverInfo.blockPeriod = (uint64_t)(asioDriverInfo.callbackBlocks * asioDriverInfo.preferredSize / asioDriverInfo.sampleRate * 1e9);
+	asioDriverInfo.inputFill = asioDriverInfo.lostBlocks = asioDriverInfo.outputPlayed = 0;
+	asioDriverInfo.outputPriming = true;
+	asioDriverInfo.repeatValid = false;
+	asioDriverInfo.lastSamplesValid = false;
+	asioDriverInfo.converter.reset();
+	asioDriverInfo.hostIndex = 0;
+	asioDriverInfo.hostSamples = 0;
+	// blocks are delivered on the loop of the thread that owns the device
+	asioDriverInfo.blockAsync = openAsync(asioDriverInfo.loop, BlockAsyncComplete);
+	asioDriverInfo.running = true;
+	asioDriverInfo.stopping.store(false);
+	if (asioDriverInfo.offline)
+		asioDriverInfo.renderAsync = openAsync(asioDriverInfo.loop, RenderAsyncComplete);
+	
+	// everything the driver thread touches is in place, page it in before it runs
+	if (asioDriverInfo.realtime.lockMemory)
+		lockAudioMemory(outputSlotBytes);
+	// the driver thread sets itself up in its first callback, the loop thread right here
+	RealtimeConfig &realtime = asioDriverInfo.realtime;
+	clearThreadSettings(&asioDriverInfo.driverThread);
+	asioDriverInfo.driverThreadDone.store(false);
+	asioDriverInfo.realtimePending.store(realtime.priority > 0 || !realtime.cpus.empty(), std::memory_order_release);
+	restoreThread(&asioDriverInfo.loopSaved);
+	clearThreadSettings(&asioDriverInfo.loopThread);
+	if (realtime.jsThread)
+		applyThreadRealtime(realtime.priority > 1 ? realtime.priority - 1 : realtime.priority, realtime.jsCpus,
+			asioDriverInfo.blockPeriod, &asioDriverInfo.loopThread, &asioDriverInfo.loopSaved);
+	
+	asioBackend->controlPanel();
+	asioBackend->start();
 }
 
+static void stopDevice(){
+	if (!asioDriverInfo.running || !asioBackend)
+		return;
+	// once ASIOStop() returns the driver will not call us anymore, so the ring is ours.
+	// Offline the driver thread may be waiting for this thread, it mustn't anymore
+	asioDriverInfo.stopping.store(true, std::memory_order_release);
+	wakeDriverThread();
+	asioBackend->stop();
+	asioDriverInfo.running = false;
+	// a resetStats() the driver thread or the loop didn't get to anymore
+	if (asioDriverInfo.statsResetPending.exchange(false))
+		resetDriverStats(&asioDriverInfo.stats);
+	if (asioDriverInfo.hostStatsResetPending.exchange(false))
+		resetHostStats(&asioDriverInfo.stats);
+	closeAsync(&asioDriverInfo.blockAsync);
+	closeAsync(&asioDriverInfo.renderAsync);
+	// stop() and deInit() only come from the owner, the thread start() raised
+	restoreThread(&asioDriverInfo.loopSaved);
+}
+static void closeAnalysis();
+static void deInitDevice(Isolate *isolate){
+	if (!asioBackend)
+		return;
+	stopDevice();
+	closeAnalysis();
+	{
+		ControlLock lock;
+		asioDriverInfo.memoryLock.unlockAll();
+		asioDriverInfo.recorder.close();
+		asioDriverInfo.player.close();
+		asioDriverInfo.bridge.close();
+		asioDriverInfo.sharedInputs.close();
+		asioDriverInfo.sharedOutputs.close();
+	}
+	asioBackend->disposeBuffers();
+	releaseSlotPool(isolate, buffersForInput);
+	releaseSlotPool(isolate, buffersForOutput);
+	asioDriverInfo.callback.Reset();
+	asioDriverInfo.renderCallback.Reset();
+	releaseSubscribers();
+	asioDriverInfo.primary = -1;
+	asioDriverInfo.outputRing.release();
+	asioDriverInfo.dsp.release();
+	asioDriverInfo.converter.release();
+	asioDriverInfo.inputs.release();
+	asioDriverInfo.outputs.release();
+	if (asioDriverInfo.outputSpare)
+		alignedFree(asioDriverInfo.outputSpare);
+	asioDriverInfo.outputSpare = NULL;
+	if (asioDriverInfo.repeatBlock)
+		alignedFree(asioDriverInfo.repeatBlock);
+	asioDriverInfo.repeatBlock = NULL;
+	{
+		DriverLock drivers;
+		asioBackend->exit();
+		asioBackend->unload();
+		driverUnloaded();
+		// free for the next init(), from any thread
+		asioBackend = NULL;
+		asioDriverInfo.owner = NULL;
+	}
+}
 void AsioStop(const FunctionCallbackInfo<Value>& args){
-	ASIOStop();
+	if (args.GetIsolate() != asioDriverInfo.owner)
+		return;
+	stopDevice();
 	return;
 }
 void AsioDeInit(const FunctionCallbackInfo<Value>& args){
-	ASIODisposeBuffers();
-	ASIOExit();
-	asioDrivers->removeCurrentDriver();
+	if (args.GetIsolate() != asioDriverInfo.owner)
+		return;
+	deInitDevice(args.GetIsolate());
 	return;
 }
+#if NODE_MODULE_VERSION >= 67
+// a Worker that owns the device can go away without calling deInit(), don't leave the
+// driver calling into a dead isolate
+static void cleanupEnvironment(void *arg){
+	Isolate *isolate = (Isolate *)arg;
+	if (asioDriverInfo.owner == isolate)
+		deInitDevice(isolate);
+}
+#endif
+// the graph setters only queue a command, the driver thread picks it up at the next block
+static void pushDspCommand(const FunctionCallbackInfo<Value>& args, int type, int a, int b, double value, double value2){
+	DspCommand command;
+	command.type = type;
+	command.a = a;
+	command.b = b;
+	command.value = (float)value;
+	command.value2 = (float)value2;
+	ControlLock lock;
+	args.GetReturnValue().Set(asioDriverInfo.dsp.push(command));
+}
+// inputGain(input, gain)
+void AsioInputGain(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspInputGain, args[0]->Int32Value(), 0, args[1]->NumberValue(), 0);
+}
+// outputGain(output, gain)
+void AsioOutputGain(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspOutputGain, args[0]->Int32Value(), 0, args[1]->NumberValue(), 0);
+}
+// mix(input, output, gain), adds input to output at gain, 0 takes it out again
+void AsioMix(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspMix, args[1]->Int32Value(), args[0]->Int32Value(), args[2]->NumberValue(), 0);
+}
+// route(input, output), output plays input and nothing else from the graph
+void AsioRoute(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspRoute, args[1]->Int32Value(), args[0]->Int32Value(), 1.0, 0);
+}
+void AsioClearMix(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspClear, 0, 0, 0, 0);
+}
+// limiter(ceiling, releaseMs), ceiling is linear, 0 turns the limiter off
+void AsioLimiter(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspLimiter, 0, 0, args[0]->NumberValue(), args[1]->NumberValue());
+}
+// smoothing(ms), how long gain and mix changes take to settle
+void AsioSmoothing(const FunctionCallbackInfo<Value>& args){
+	pushDspCommand(args, kDspSmoothing, 0, 0, args[0]->NumberValue(), 0);
+}
+static Local<Object> histogramObject(Isolate *isolate, const LatencyHistogram &histogram){
+	// microseconds read better than nanoseconds for audio blocks
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "count"), Number::New(isolate, (double)histogram.count()));
+	result->Set(String::NewFromUtf8(isolate, "min"), Number::New(isolate, histogram.min() / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "mean"), Number::New(isolate, histogram.mean() / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "p50"), Number::New(isolate, histogram.percentile(0.5) / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "p90"), Number::New(isolate, histogram.percentile(0.9) / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "p99"), Number::New(isolate, histogram.percentile(0.99) / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "p999"), Number::New(isolate, histogram.percentile(0.999) / 1000.));
+	result->Set(String::NewFromUtf8(isolate, "max"), Number::New(isolate, histogram.max() / 1000.));
+	return result;
+}
+#define SET_COUNTER(obj, name, value) (obj)->Set(String::NewFromUtf8(isolate, name), Number::New(isolate, (double)(value)))
+static Local<Object> recorderObject(Isolate *isolate){
+	RecorderStats recorder;
+	asioDriverInfo.recorder.stats(&recorder);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "recording"), Boolean::New(isolate, recorder.recording));
+	SET_COUNTER(result, "framesWritten", recorder.framesWritten);
+	SET_COUNTER(result, "bytesWritten", recorder.bytesWritten);
+	SET_COUNTER(result, "overruns", recorder.overruns);
+	SET_COUNTER(result, "writeErrors", recorder.writeErrors);
+	SET_COUNTER(result, "bufferBlocks", recorder.bufferBlocks);
+	SET_COUNTER(result, "highWater", recorder.highWater);
+	return result;
+}
+static Local<Object> playerObject(Isolate *isolate){
+	PlayerStats player;
+	asioDriverInfo.player.stats(&player);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "open"), Boolean::New(isolate, player.open));
+	result->Set(String::NewFromUtf8(isolate, "playing"), Boolean::New(isolate, player.playing));
+	result->Set(String::NewFromUtf8(isolate, "ended"), Boolean::New(isolate, player.ended));
+	SET_COUNTER(result, "position", player.position);
+	SET_COUNTER(result, "frames", player.frames);
+	SET_COUNTER(result, "clock", player.clock);
+	SET_COUNTER(result, "underruns", player.underruns);
+	SET_COUNTER(result, "bufferBlocks", player.bufferBlocks);
+	SET_COUNTER(result, "buffered", player.buffered);
+	return result;
+}
+static Local<Object> bridgeObject(Isolate *isolate){
+	BridgeStats bridge;
+	asioDriverInfo.bridge.stats(&bridge);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "open"), Boolean::New(isolate, bridge.open));
+	result->Set(String::NewFromUtf8(isolate, "running"), Boolean::New(isolate, bridge.running));
+	SET_COUNTER(result, "fill", bridge.fill);
+	SET_COUNTER(result, "target", bridge.target);
+	SET_COUNTER(result, "latency", bridge.latency);
+	SET_COUNTER(result, "deviceRate", bridge.deviceRate);
+	SET_COUNTER(result, "devicePpm", bridge.devicePpm);
+	SET_COUNTER(result, "streamRate", bridge.streamRate);
+	SET_COUNTER(result, "streamPpm", bridge.streamPpm);
+	SET_COUNTER(result, "driftPpm", bridge.driftPpm);
+	SET_COUNTER(result, "ratio", bridge.ratio);
+	SET_COUNTER(result, "framesWritten", bridge.framesWritten);
+	SET_COUNTER(result, "framesDropped", bridge.framesDropped);
+	SET_COUNTER(result, "underruns", bridge.underruns);
+	return result;
+}
+static Local<Object> sharedObject(Isolate *isolate, const SharedRing &ring){
+	SharedRingStats shared;
+	ring.stats(&shared);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "open"), Boolean::New(isolate, shared.open));
+	result->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, shared.name.c_str()));
+	SET_COUNTER(result, "channels", shared.channels);
+	SET_COUNTER(result, "frames", shared.frames);
+	SET_COUNTER(result, "slots", shared.slots);
+	SET_COUNTER(result, "bytes", shared.bytes);
+	SET_COUNTER(result, "blocks", shared.blocks);
+	SET_COUNTER(result, "queued", shared.queued);
+	SET_COUNTER(result, "underruns", shared.underruns);
+	return result;
+}
+static Local<Object> resamplingObject(Isolate *isolate){
+	RateConverterStats converter;
+	asioDriverInfo.converter.stats(&converter);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "active"), Boolean::New(isolate, converter.active));
+	SET_COUNTER(result, "deviceRate", asioDriverInfo.deviceRate);
+	SET_COUNTER(result, "sampleRate", asioDriverInfo.sampleRate);
+	SET_COUNTER(result, "deviceBlock", asioDriverInfo.deviceSize);
+	// microseconds, like addedLatency; nothing is added without a converter
+	SET_COUNTER(result, "inputLatency", converter.inputLatency * 1e6);
+	SET_COUNTER(result, "outputLatency", converter.outputLatency * 1e6);
+	SET_COUNTER(result, "addedLatency", (converter.inputLatency + converter.outputLatency) * 1e6);
+	SET_COUNTER(result, "underruns", converter.underruns);
+	return result;
+}
+static Local<Array> subscribersArray(Isolate *isolate){
+	Local<Array> result = Array::New(isolate);
+	uint32_t n = 0;
+	for (int id = 0; id < POOL_MAX_SUBSCRIBERS; id++){
+		if (id == asioDriverInfo.primary || !asioDriverInfo.inputPool.attached(id))
+			continue;
+		PoolSubscriberStats subscriber;
+		asioDriverInfo.inputPool.stats(id, &subscriber);
+		Local<Object> entry = Object::New(isolate);
+		SET_COUNTER(entry, "id", id);
+		entry->Set(String::NewFromUtf8(isolate, "dropped"), Boolean::New(isolate, subscriber.dropped));
+		SET_COUNTER(entry, "delivered", subscriber.delivered);
+		SET_COUNTER(entry, "lost", subscriber.lost);
+		SET_COUNTER(entry, "pending", subscriber.pending);
+		result->Set(n++, entry);
+	}
+	return result;
+}
+static Local<Object> analyzerObject(Isolate *isolate){
+	AnalyzerStats analyzer;
+	asioDriverInfo.analyzer.stats(&analyzer);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "running"), Boolean::New(isolate, analyzer.running));
+	SET_COUNTER(result, "snapshots", analyzer.snapshots);
+	SET_COUNTER(result, "overruns", analyzer.overruns);
+	SET_COUNTER(result, "bufferBlocks", analyzer.bufferBlocks);
+	return result;
+}
+static Local<Object> threadObject(Isolate *isolate, const ThreadSettings &thread){
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "applied"), Boolean::New(isolate, thread.applied));
+	result->Set(String::NewFromUtf8(isolate, "policy"), String::NewFromUtf8(isolate, thread.policy));
+	SET_COUNTER(result, "priority", thread.priority);
+	Local<Array> cpus = Array::New(isolate, thread.cpuCount);
+	for (int i = 0; i < thread.cpuCount; i++)
+		cpus->Set(i, Number::New(isolate, thread.cpus[i]));
+	result->Set(String::NewFromUtf8(isolate, "cpus"), cpus);
+	SET_COUNTER(result, "schedulingError", thread.schedulingError);
+	SET_COUNTER(result, "affinityError", thread.affinityError);
+	result->Set(String::NewFromUtf8(isolate, "message"), String::NewFromUtf8(isolate, thread.message));
+	return result;
+}
+static Local<Object> renderObject(Isolate *isolate){
+	VirtualRenderStats render;
+	virtualRenderStats(&render);
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "offline"), Boolean::New(isolate, asioDriverInfo.offline));
+	result->Set(String::NewFromUtf8(isolate, "finished"), Boolean::New(isolate, asioDriverInfo.offline && render.finished));
+	SET_COUNTER(result, "blocks", render.blocks);
+	SET_COUNTER(result, "frames", render.frames);
+	SET_COUNTER(result, "seconds", render.seconds);
+	SET_COUNTER(result, "blocksPerSecond", render.blocksPerSecond);
+	SET_COUNTER(result, "speed", render.speed);
+	SET_COUNTER(result, "framesWritten", render.framesWritten);
+	SET_COUNTER(result, "writeErrors", render.writeErrors);
+	return result;
+}
+static void RenderAsyncComplete(uv_async_t *handle){
+	// the device rendered everything and closed the output file
+	Isolate *isolate = asioDriverInfo.owner;
+	if (!isolate || asioDriverInfo.renderCallback.IsEmpty())
+		return;
+	v8::HandleScope handleScope(isolate);
+	Local<Function> callback = Local<Function>::New(isolate, asioDriverInfo.renderCallback);
+	Local<Value> argv[] = {renderObject(isolate)};
+	callback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+}
+static Local<Object> realtimeObject(Isolate *isolate){
+	// with the control lock held
+	Local<Object> result = Object::New(isolate);
+	ThreadSettings driverThread;
+	clearThreadSettings(&driverThread);
+	if (asioDriverInfo.driverThreadDone.load(std::memory_order_acquire))
+		driverThread = asioDriverInfo.driverThread;
+	result->Set(String::NewFromUtf8(isolate, "driver"), threadObject(isolate, driverThread));
+	result->Set(String::NewFromUtf8(isolate, "js"), threadObject(isolate, asioDriverInfo.loopThread));
+	MemoryLockStats memory;
+	asioDriverInfo.memoryLock.stats(&memory);
+	Local<Object> memoryObject = Object::New(isolate);
+	SET_COUNTER(memoryObject, "regions", memory.regions);
+	SET_COUNTER(memoryObject, "lockedBytes", memory.lockedBytes);
+	SET_COUNTER(memoryObject, "prefaultedBytes", memory.prefaultedBytes);
+	SET_COUNTER(memoryObject, "failedBytes", memory.failedBytes);
+	SET_COUNTER(memoryObject, "error", memory.error);
+	result->Set(String::NewFromUtf8(isolate, "memory"), memoryObject);
+	return result;
+}
+// stats() - counters since start() or the last resetStats(), latencies in microseconds
+void AsioStats(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	AudioStats &stats = asioDriverInfo.stats;
+	Local<Object> result = Object::New(isolate);
+	SET_COUNTER(result, "blocks", stats.blocks.load());
+	SET_COUNTER(result, "processedSamples", stats.processedSamples.load());
+	SET_COUNTER(result, "droppedBlocks", stats.droppedBlocks.load());
+	SET_COUNTER(result, "outputUnderruns", stats.outputUnderruns.load());
+	SET_COUNTER(result, "outputOverflows", stats.outputOverflows.load());
+	SET_COUNTER(result, "primingBlocks", stats.primingBlocks.load());
+	SET_COUNTER(result, "repeatedBlocks", stats.repeatedBlocks.load());
+	// the output queue: slots it holds, slots it waits for before playing, slots in it right now
+	SET_COUNTER(result, "outputDepth", asioDriverInfo.outputDepth);
+	SET_COUNTER(result, "outputPrefill", asioDriverInfo.outputPrefill);
+	SET_COUNTER(result, "outputQueued", asioDriverInfo.outputRing.capacity() ? asioDriverInfo.outputRing.pending() : 0);
+	SET_COUNTER(result, "missedDeadlines", stats.missedDeadlines.load());
+	SET_COUNTER(result, "discontinuities", stats.discontinuities.load());
+	SET_COUNTER(result, "blockPeriod", asioDriverInfo.blockPeriod / 1000.);
+	// re-blocking: samples per JS call and the latency it adds on top of the driver's,
+	// JS sees a sample that much later and its output plays that much later
+	long callbackSamples = asioDriverInfo.callbackBlocks * asioDriverInfo.preferredSize;
+	long addedSamples = callbackSamples - asioDriverInfo.preferredSize;
+	SET_COUNTER(result, "samplesPerCallback", callbackSamples);
+	SET_COUNTER(result, "addedLatencySamples", addedSamples);
+	SET_COUNTER(result, "addedLatency", asioDriverInfo.sampleRate > 0 ? addedSamples / asioDriverInfo.sampleRate * 1e6 : 0);
+	result->Set(String::NewFromUtf8(isolate, "convert"), String::NewFromUtf8(isolate, convertLevelName(convertLevel())));
+	Local<Object> latency = Object::New(isolate);
+	latency->Set(String::NewFromUtf8(isolate, "driverCallback"), histogramObject(isolate, stats.driverCallback));
+	latency->Set(String::NewFromUtf8(isolate, "dispatch"), histogramObject(isolate, stats.dispatch));
+	latency->Set(String::NewFromUtf8(isolate, "jsCallback"), histogramObject(isolate, stats.jsCallback));
+	latency->Set(String::NewFromUtf8(isolate, "roundTrip"), histogramObject(isolate, stats.roundTrip));
+	result->Set(String::NewFromUtf8(isolate, "latency"), latency);
+	ControlLock lock;
+	result->Set(String::NewFromUtf8(isolate, "recorder"), recorderObject(isolate));
+	result->Set(String::NewFromUtf8(isolate, "player"), playerObject(isolate));
+	result->Set(String::NewFromUtf8(isolate, "analyzer"), analyzerObject(isolate));
+	result->Set(String::NewFromUtf8(isolate, "bridge"), bridgeObject(isolate));
+	result->Set(String::NewFromUtf8(isolate, "resampling"), resamplingObject(isolate));
+	Local<Object> shared = Object::New(isolate);
+	shared->Set(String::NewFromUtf8(isolate, "capture"), sharedObject(isolate, asioDriverInfo.sharedInputs));
+	shared->Set(String::NewFromUtf8(isolate, "playback"), sharedObject(isolate, asioDriverInfo.sharedOutputs));
+	result->Set(String::NewFromUtf8(isolate, "shared"), shared);
+	result->Set(String::NewFromUtf8(isolate, "offline"), renderObject(isolate));
+	result->Set(String::NewFromUtf8(isolate, "subscribers"), subscribersArray(isolate));
+	result->Set(String::NewFromUtf8(isolate, "realtime"), realtimeObject(isolate));
+	args.GetReturnValue().Set(result);
+}
+void AsioResetStats(const FunctionCallbackInfo<Value>& args){
+	// only the owner starts and stops, so for it running can't change under us
+	if (args.GetIsolate() == asioDriverInfo.owner && !asioDriverInfo.running){
+		resetStats(&asioDriverInfo.stats);
+		return;
+	}
+	// otherwise every counter is reset by the thread that writes it, the driver's at its next block and
+	// the loop's at its next delivery (stop() does what is left). The start() callback's dropped
+	// count isn't one of them
+	asioDriverInfo.hostStatsResetPending.store(true, std::memory_order_release);
+	asioDriverInfo.statsResetPending.store(true, std::memory_order_release);
+}
+// record({path, channels, format, bufferSeconds}) - streams input channels (indices into the
+// inputChannels given to init, all of them by default) to a WAV file on a native thread.
+// format is 'native' (the default), 'int16', 'int24', 'int32' or 'float32'.
+// 0 when recording, -1 already recording, -2 bad channels, -3 bad format,
+// -4 out of memory, -5 can't create the file, -6 no writer thread, -7 not initialized
+void AsioRecord(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioBackend || !asioDriverInfo.preferredSize){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	Local<Object> options = args[0]->ToObject();
+	v8::String::Utf8Value path(options->Get(String::NewFromUtf8(isolate, "path")));
+	Local<Value> channelsValue = options->Get(String::NewFromUtf8(isolate, "channels"));
+	Local<Value> formatValue = options->Get(String::NewFromUtf8(isolate, "format"));
+	Local<Value> secondsValue = options->Get(String::NewFromUtf8(isolate, "bufferSeconds"));
+
+	std::vector<int> channels;
+	if (channelsValue->IsArray()){
+		Local<Array> list = Local<Array>::Cast(channelsValue);
+		for (unsigned int i = 0; i < list->Length(); i++)
+			channels.push_back(list->Get(i)->Int32Value());
+	}
+	else{
+		for (int i = 0; i < asioDriverInfo.inputBuffers; i++)
+			channels.push_back(i);
+	}
+	ASIOSampleType format = kRecordNative;
+	if (formatValue->IsString()){
+		v8::String::Utf8Value name(formatValue);
+		if (std::string(*name) != "native")
+			format = sampleTypeByName(*name, -1);
+	}
+	// a few seconds of slack for the disk
+	double bufferSeconds = secondsValue->IsNumber() ? secondsValue->NumberValue() : 4.;
+
+	ControlLock lock;
+	int result = asioDriverInfo.recorder.open(*path, channels, format, asioDriverInfo.inputs.type,
+		asioDriverInfo.inputs.count, asioDriverInfo.preferredSize, asioDriverInfo.sampleRate, bufferSeconds);
+	if (result == 0)
+		lockRing(asioDriverInfo.recorder.blocks());
+	args.GetReturnValue().Set(Int32::New(isolate, result));
+}
+// stopRecording() - flushes and closes the file, returns the recorder's stats
+void AsioStopRecording(const FunctionCallbackInfo<Value>& args){
+	ControlLock lock;
+	asioDriverInfo.memoryLock.unlock(asioDriverInfo.recorder.blocks().slot(0));
+	asioDriverInfo.recorder.close();
+	args.GetReturnValue().Set(recorderObject(args.GetIsolate()));
+}
+// openPlayback({path, outputs, loop, readAheadSeconds, raw: {channels, format}}) - opens a WAV/RF64
+// (or a headerless file when raw is given) and starts reading ahead, playbackStart() plays it.
+// outputs has an output index (into outputChannels) for every file channel, -1 leaves one out.
+// 0 when open, -1 already open, -2 can't open the file, -3 can't play its format, -4 bad outputs,
+// -5 out of memory, -6 no prefetch thread, -7 not initialized
+void AsioOpenPlayback(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioBackend || !asioDriverInfo.preferredSize){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	Local<Object> options = args[0]->ToObject();
+	v8::String::Utf8Value path(options->Get(String::NewFromUtf8(isolate, "path")));
+	Local<Value> outputsValue = options->Get(String::NewFromUtf8(isolate, "outputs"));
+	Local<Value> rawValue = options->Get(String::NewFromUtf8(isolate, "raw"));
+	Local<Value> secondsValue = options->Get(String::NewFromUtf8(isolate, "readAheadSeconds"));
+
+	PlayerOptions playerOptions;
+	if (outputsValue->IsArray()){
+		Local<Array> list = Local<Array>::Cast(outputsValue);
+		for (unsigned int i = 0; i < list->Length(); i++)
+			playerOptions.outputs.push_back(list->Get(i)->Int32Value());
+	}
+	playerOptions.loop = options->Get(String::NewFromUtf8(isolate, "loop"))->BooleanValue();
+	playerOptions.readAheadSeconds = secondsValue->IsNumber() ? secondsValue->NumberValue() : 4.;
+	playerOptions.raw = rawValue->IsObject();
+	playerOptions.rawChannels = 0;
+	playerOptions.rawType = -1;
+	if (playerOptions.raw){
+		Local<Object> raw = rawValue->ToObject();
+		playerOptions.rawChannels = raw->Get(String::NewFromUtf8(isolate, "channels"))->Int32Value();
+		v8::String::Utf8Value format(raw->Get(String::NewFromUtf8(isolate, "format")));
+		playerOptions.rawType = sampleTypeByName(*format, -1);
+	}
+
+	ControlLock lock;
+	int result = asioDriverInfo.player.open(*path, playerOptions, asioDriverInfo.outputBuffers,
+		asioDriverInfo.preferredSize, asioDriverInfo.sampleRate);
+	if (result == 0)
+		lockRing(asioDriverInfo.player.blocks());
+	args.GetReturnValue().Set(Int32::New(isolate, result));
+}
+void AsioClosePlayback(const FunctionCallbackInfo<Value>& args){
+	ControlLock lock;
+	asioDriverInfo.memoryLock.unlock(asioDriverInfo.player.blocks().slot(0));
+	asioDriverInfo.player.close();
+}
+// playbackStart(at)/playbackStop(at) - at is a driver sample position (stats().player.clock is the
+// latest), the change lands on exactly that sample; without it, at the next block
+static void pushPlayerCommand(const FunctionCallbackInfo<Value>& args, int type){
+	PlayerCommand command;
+	command.type = type;
+	command.at = args[0]->IsNumber() ? (int64_t)args[0]->NumberValue() : -1;
+	ControlLock lock;
+	args.GetReturnValue().Set(asioDriverInfo.player.push(command));
+}
+void AsioPlaybackStart(const FunctionCallbackInfo<Value>& args){
+	pushPlayerCommand(args, kPlayerStart);
+}
+void AsioPlaybackStop(const FunctionCallbackInfo<Value>& args){
+	pushPlayerCommand(args, kPlayerStop);
+}
+// playbackSeek(frame) - continues from that file frame once it has been read ahead
+void AsioPlaybackSeek(const FunctionCallbackInfo<Value>& args){
+	ControlLock lock;
+	asioDriverInfo.player.seek((uint64_t)args[0]->NumberValue());
+}
+// openBridge({channels, outputs, sampleRate, latency, bufferSeconds}) - plays a stream with a clock of its
+// own (network audio) on the outputs, bridgeWrite() feeds it. outputs has an output index for every stream
+// channel, -1 leaves one out; sampleRate is the stream's nominal rate (the device's by default), latency
+// the milliseconds to hold buffered (40 by default), bufferSeconds how much write() may get ahead (1).
+// 0 when open, -1 already open, -2 bad channels or outputs, -3 bad rate or latency, -4 out of memory,
+// -7 not initialized
+void AsioOpenBridge(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioBackend || !asioDriverInfo.preferredSize){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	Local<Object> options = args[0]->IsObject() ? args[0]->ToObject() : Object::New(isolate);
+	Local<Value> channelsValue = options->Get(String::NewFromUtf8(isolate, "channels"));
+	Local<Value> outputsValue = options->Get(String::NewFromUtf8(isolate, "outputs"));
+	Local<Value> rateValue = options->Get(String::NewFromUtf8(isolate, "sampleRate"));
+	Local<Value> latencyValue = options->Get(String::NewFromUtf8(isolate, "latency"));
+	Local<Value> secondsValue = options->Get(String::NewFromUtf8(isolate, "bufferSeconds"));
+
+	BridgeOptions bridgeOptions;
+	if (outputsValue->IsArray()){
+		Local<Array> list = Local<Array>::Cast(outputsValue);
+		for (unsigned int i = 0; i < list->Length(); i++)
+			bridgeOptions.outputs.push_back(list->Get(i)->Int32Value());
+	}
+	bridgeOptions.channels = channelsValue->IsNumber() ? channelsValue->Int32Value() :
+		bridgeOptions.outputs.empty() ? 2 : (int)bridgeOptions.outputs.size();
+	bridgeOptions.sampleRate = rateValue->IsNumber() ? rateValue->NumberValue() : 0;
+	bridgeOptions.latencyMs = latencyValue->IsNumber() ? latencyValue->NumberValue() : 40.;
+	bridgeOptions.bufferSeconds = secondsValue->IsNumber() ? secondsValue->NumberValue() : 1.;
+
+	ControlLock lock;
+	Bridge &bridge = asioDriverInfo.bridge;
+	int result = bridge.open(bridgeOptions, asioDriverInfo.outputBuffers, asioDriverInfo.preferredSize, asioDriverInfo.sampleRate);
+	if (result == 0 && asioDriverInfo.realtime.lockMemory)
+		asioDriverInfo.memoryLock.lock(bridge.buffer(), bridge.bufferBytes(), false);
+	args.GetReturnValue().Set(Int32::New(isolate, result));
+}
+// bridgeWrite(samples) - interleaved frames of every stream channel as a Float32Array, Int16Array or
+// Int32Array, returns how many frames fit (the rest counts as dropped), -1 for anything else
+void AsioBridgeWrite(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	size_t length;
+	char *data = viewData(args[0], &length);
+	ToFloatKernel convert = NULL;
+	long bytes = sizeof(float);
+	if (args[0]->IsInt16Array()){
+		convert = getToFloat(ASIOSTInt16LSB);
+		bytes = 2;
+	}
+	else if (args[0]->IsInt32Array()){
+		convert = getToFloat(ASIOSTInt32LSB);
+		bytes = 4;
+	}
+	else if (!args[0]->IsFloat32Array())
+		data = NULL;
+	if (!data){
+		args.GetReturnValue().Set(Int32::New(isolate, -1));
+		return;
+	}
+	ControlLock lock;
+	Bridge &bridge = asioDriverInfo.bridge;
+	long frames = bridge.channels() > 0 ? (long)(length / bytes) / bridge.channels() : 0;
+	args.GetReturnValue().Set(Number::New(isolate, (double)bridge.write(data, convert, bytes, frames, (double)monotonicNanos())));
+}
+void AsioCloseBridge(const FunctionCallbackInfo<Value>& args){
+	ControlLock lock;
+	asioDriverInfo.memoryLock.unlock(asioDriverInfo.bridge.buffer());
+	asioDriverInfo.bridge.close();
+}
+static int sharedDirection(Local<Value> value){
+	if (!value->IsString())
+		return kSharedCapture;
+	v8::String::Utf8Value name(value);
+	return strcmp(*name, "playback") == 0 ? kSharedPlayback : strcmp(*name, "capture") == 0 ? kSharedCapture : -1;
+}
+// openShared({name, direction, blocks}) - a ring in named shared memory (see SharedRing.h for the layout)
+// that other processes map: 'capture' (the default) publishes every input block there, float32 at the
+// host rate, 'playback' mixes the blocks a producer writes there into the outputs. blocks is the ring's
+// length, 32 for capture and 8 for playback by default. The name is the shm_open() name without the
+// slash on Linux and macOS, a Local\ mapping name on Windows; a ring left behind under it is taken over.
+// 0 when open, -1 already open, -2 bad name, direction or blocks, -3 the memory couldn't be mapped,
+// -7 not initialized
+void AsioOpenShared(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioBackend || !asioDriverInfo.preferredSize){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	Local<Object> options = args[0]->IsObject() ? args[0]->ToObject() : Object::New(isolate);
+	v8::String::Utf8Value name(options->Get(String::NewFromUtf8(isolate, "name")));
+	int direction = sharedDirection(options->Get(String::NewFromUtf8(isolate, "direction")));
+	Local<Value> blocksValue = options->Get(String::NewFromUtf8(isolate, "blocks"));
+	long blocks = blocksValue->IsNumber() ? (long)blocksValue->IntegerValue() : direction == kSharedPlayback ? 8 : 32;
+	if (direction < 0 || !*name){
+		args.GetReturnValue().Set(Int32::New(isolate, -2));
+		return;
+	}
+
+	ControlLock lock;
+	SharedRing &ring = direction == kSharedPlayback ? asioDriverInfo.sharedOutputs : asioDriverInfo.sharedInputs;
+	ChannelSet &channels = direction == kSharedPlayback ? asioDriverInfo.outputs : asioDriverInfo.inputs;
+	int result = ring.open(*name, direction, channels, asioDriverInfo.preferredSize, blocks, asioDriverInfo.sampleRate);
+	if (result == 0 && asioDriverInfo.realtime.lockMemory)
+		asioDriverInfo.memoryLock.lock(ring.buffer(), ring.bufferBytes(), false);
+	args.GetReturnValue().Set(Int32::New(isolate, result));
+}
+// closeShared(direction) - readers that still have the ring mapped keep it, its open flag drops to 0
+void AsioCloseShared(const FunctionCallbackInfo<Value>& args){
+	int direction = sharedDirection(args[0]);
+	if (direction < 0)
+		return;
+	ControlLock lock;
+	SharedRing &ring = direction == kSharedPlayback ? asioDriverInfo.sharedOutputs : asioDriverInfo.sharedInputs;
+	asioDriverInfo.memoryLock.unlock(ring.buffer());
+	ring.close();
+}
+typedef struct SharedView{
+	Persistent<SharedArrayBuffer> buffer;
+	SharedMapping mapping;
+}SharedView;
+static void sharedViewCollected(const v8::WeakCallbackInfo<SharedView> &info){
+	SharedView *view = info.GetParameter();
+	view->buffer.Reset();
+	unmapSharedMemory(&view->mapping, false);
+	delete view;
+}
+// mapShared(name) - the whole of a ring some process opened as a SharedArrayBuffer, for a reader in
+// another Node process (or a Worker); null when there is none. Atomics work on it, the mapping goes
+// when the buffer gets collected
+void AsioMapShared(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	v8::String::Utf8Value name(args[0]);
+	SharedView *view = new SharedView;
+	if (!*name || !mapSharedMemory(*name, false, 0, &view->mapping) || view->mapping.bytes < SHARED_HEADER_BYTES){
+		unmapSharedMemory(&view->mapping, false);
+		delete view;
+		args.GetReturnValue().Set(Null(isolate));
+		return;
+	}
+	Local<SharedArrayBuffer> buffer = SharedArrayBuffer::New(isolate, view->mapping.data, view->mapping.bytes);
+	view->buffer.Reset(isolate, buffer);
+	view->buffer.SetWeak(view, sharedViewCollected, v8::WeakCallbackType::kParameter);
+	args.GetReturnValue().Set(buffer);
+}
+static void analysisPublished(void *arg){
+	uv_async_send(asioDriverInfo.analysisAsync);
+}
+// the analysis thread finished a snapshot, copy it into the Float32Array JS holds on to
+static void AnalysisAsyncComplete(uv_async_t *handle){
+	Isolate *isolate = asioDriverInfo.owner;
+	if (!isolate || asioDriverInfo.analysisSnapshot.IsEmpty())
+		return;
+	v8::HandleScope handleScope(isolate);
+	Local<Float32Array> snapshot = Local<Float32Array>::New(isolate, asioDriverInfo.analysisSnapshot);
+	size_t length;
+	float *data = (float *)viewData(snapshot, &length);
+	// wakeups that pile up collapse into one, JS only ever sees the latest snapshot
+	if (!data || !asioDriverInfo.analyzer.read(data) || asioDriverInfo.analysisCallback.IsEmpty())
+		return;
+	Local<Function> callback = Local<Function>::New(isolate, asioDriverInfo.analysisCallback);
+	Local<Value> argv[] = {snapshot};
+	callback->Call(isolate->GetCurrentContext()->Global(), 1, argv);
+}
+static void closeAnalysis(){
+	{
+		ControlLock lock;
+		asioDriverInfo.memoryLock.unlock(asioDriverInfo.analyzer.blocks().slot(0));
+		asioDriverInfo.analyzer.close();
+	}
+	closeAsync(&asioDriverInfo.analysisAsync);
+	asioDriverInfo.analysisSnapshot.Reset();
+	asioDriverInfo.analysisCallback.Reset();
+}
+// analyze({channels, rate, fftSize, weights, bufferSeconds}, callback) - meters and spectra of input
+// channels (indices into the inputChannels given to init, all of them by default) computed on a native
+// thread. rate snapshots a second (30 by default) are copied into the one Float32Array this returns, and
+// callback, if given, gets it every time; the layout is in Analyzer.h. fftSize is a power of two
+// (2048 by default), weights the loudness weight of every channel (1 by default).
+// -1 already analyzing, -2 bad channels, -3 bad rate or fftSize, -4 out of memory, -5 no analysis thread,
+// -6 not the thread that called init(), -7 not initialized
+void AsioAnalyze(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioBackend || !asioDriverInfo.preferredSize){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	// snapshots are delivered on the owner's loop
+	if (isolate != asioDriverInfo.owner){
+		args.GetReturnValue().Set(Int32::New(isolate, -6));
+		return;
+	}
+	if (asioDriverInfo.analysisAsync){
+		args.GetReturnValue().Set(Int32::New(isolate, -1));
+		return;
+	}
+	Local<Object> options = args[0]->IsObject() ? args[0]->ToObject() : Object::New(isolate);
+	Local<Value> channelsValue = options->Get(String::NewFromUtf8(isolate, "channels"));
+	Local<Value> weightsValue = options->Get(String::NewFromUtf8(isolate, "weights"));
+	Local<Value> rateValue = options->Get(String::NewFromUtf8(isolate, "rate"));
+	Local<Value> fftValue = options->Get(String::NewFromUtf8(isolate, "fftSize"));
+	Local<Value> secondsValue = options->Get(String::NewFromUtf8(isolate, "bufferSeconds"));
+
+	AnalyzerOptions analyzerOptions;
+	if (channelsValue->IsArray()){
+		Local<Array> list = Local<Array>::Cast(channelsValue);
+		for (unsigned int i = 0; i < list->Length(); i++)
+			analyzerOptions.channels.push_back(list->Get(i)->Int32Value());
+	}
+	else{
+		for (int i = 0; i < asioDriverInfo.inputBuffers; i++)
+			analyzerOptions.channels.push_back(i);
+	}
+	if (weightsValue->IsArray()){
+		Local<Array> list = Local<Array>::Cast(weightsValue);
+		for (unsigned int i = 0; i < list->Length(); i++)
+			analyzerOptions.weights.push_back(list->Get(i)->NumberValue());
+	}
+	analyzerOptions.rate = rateValue->IsNumber() ? rateValue->NumberValue() : 30.;
+	analyzerOptions.fftSize = fftValue->IsNumber() ? (long)fftValue->Int32Value() : 2048;
+	analyzerOptions.bufferSeconds = secondsValue->IsNumber() ? secondsValue->NumberValue() : 1.;
+
+	// the handle has to be there before the analysis thread can poke it
+	asioDriverInfo.analysisAsync = openAsync(asioDriverInfo.loop, AnalysisAsyncComplete);
+	int result;
+	{
+		ControlLock lock;
+		result = asioDriverInfo.analyzer.open(analyzerOptions, asioDriverInfo.inputs.type, asioDriverInfo.inputs.count,
+			asioDriverInfo.preferredSize, asioDriverInfo.sampleRate, analysisPublished, NULL);
+		if (result == 0)
+			lockRing(asioDriverInfo.analyzer.blocks());
+	}
+	if (result != 0){
+		closeAnalysis();
+		args.GetReturnValue().Set(Int32::New(isolate, result));
+		return;
+	}
+	long length = asioDriverInfo.analyzer.snapshotLength();
+	Local<ArrayBuffer> memory = ArrayBuffer::New(isolate, length * sizeof(float));
+	Local<Float32Array> snapshot = Float32Array::New(memory, 0, length);
+	asioDriverInfo.analysisSnapshot.Reset(isolate, snapshot);
+	if (args[1]->IsFunction())
+		asioDriverInfo.analysisCallback.Reset(isolate, Local<Function>::Cast(args[1]));
+	args.GetReturnValue().Set(snapshot);
+}
+// stopAnalysis() - stops the analysis thread, the last snapshot stays in the Float32Array
+void AsioStopAnalysis(const FunctionCallbackInfo<Value>& args){
+	if (args.GetIsolate() != asioDriverInfo.owner)
+		return;
+	closeAnalysis();
+}
+// resetLoudness() - integrated loudness starts over with the next block
+void AsioResetLoudness(const FunctionCallbackInfo<Value>& args){
+	asioDriverInfo.analyzer.resetLoudness();
+}
+// subscribe(callback, {pending}) - callback(buffers, generation, lost) gets every input block the
+// start() callback gets, the same Buffers in the same memory, to read only and only until it returns.
+// pending blocks may wait for it (4 by default), a subscriber that falls further behind is cut off
+// and called once with null. The id for unsubscribe() on success, -1 when the pool has no room
+// for that many more blocks (see poolBlocks), -2 when there are too many subscribers,
+// -6 not the thread that called init(), -7 not started
+void AsioSubscribe(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	if (!asioDriverInfo.inputPool.capacity()){
+		args.GetReturnValue().Set(Int32::New(isolate, -7));
+		return;
+	}
+	// blocks are delivered on the owner's loop
+	if (isolate != asioDriverInfo.owner){
+		args.GetReturnValue().Set(Int32::New(isolate, -6));
+		return;
+	}
+	if (!args[0]->IsFunction()){
+		args.GetReturnValue().Set(Int32::New(isolate, -2));
+		return;
+	}
+	long pending = 4;
+	if (args[1]->IsObject()){
+		Local<Value> pendingValue = args[1]->ToObject()->Get(String::NewFromUtf8(isolate, "pending"));
+		if (pendingValue->IsNumber() && pendingValue->Int32Value() > 0)
+			pending = pendingValue->Int32Value();
+	}
+	ControlLock lock;
+	int id = asioDriverInfo.inputPool.attach(pending, true);
+	if (id >= 0){
+		subscriberCallbacks[id].Reset(isolate, Local<Function>::Cast(args[0]));
+		subscriberReportedLost[id] = 0;
+	}
+	args.GetReturnValue().Set(Int32::New(isolate, id));
+}
+// unsubscribe(id) - no more blocks for it, including those already queued
+void AsioUnsubscribe(const FunctionCallbackInfo<Value>& args){
+	int id = args[0]->Int32Value();
+	if (args.GetIsolate() != asioDriverInfo.owner || id < 0 || id >= POOL_MAX_SUBSCRIBERS || subscriberCallbacks[id].IsEmpty())
+		return;
+	ControlLock lock;
+	asioDriverInfo.inputPool.detach(id);
+	subscriberCallbacks[id].Reset();
+	wakeDriverThread();
+}
+// trace(enable) - starts (over) or stops recording spans and events on every thread of the
+// audio path, any thread may call it. 0, -1 when the trace buffers can't be allocated
+void AsioTrace(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	args.GetReturnValue().Set(Int32::New(isolate, enableTrace(args[0]->BooleanValue()) ? 0 : -1));
+}
+// dumpTrace([path]) - what the trace buffers hold as Chrome trace JSON, recording goes on.
+// Returned as a string, or written to path: the bytes written then, -1 when it can't be
+void AsioDumpTrace(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	std::string json = dumpTrace();
+	if (!args[0]->IsString()){
+		args.GetReturnValue().Set(String::NewFromUtf8(isolate, json.c_str(), v8::String::kNormalString, (int)json.size()));
+		return;
+	}
+	v8::String::Utf8Value path(args[0]);
+	FILE *file = fopen(*path, "wb");
+	size_t written = file ? fwrite(json.data(), 1, json.size(), file) : 0;
+	if (file && fclose(file) != 0)
+		written = 0;
+	args.GetReturnValue().Set(Number::New(isolate, file && written == json.size() ? (double)written : -1.));
+}
 //Returns an array of strings for javascript of each driver name
 void AsioList(const FunctionCallbackInfo<Value>& args){
 	Isolate* isolate = args.GetIsolate();
-	/*programmed this synchronously...perhaps best not? idk..., don't care about parameters*/
-	//making the array
-	Local<Array> result_list = Array::New(isolate);
-	//getting the number of devices~
-	long numOfDevices = getNumOfAsioDevices(asioDrivers);
-	printf("ASIO Devices: %ld\n",numOfDevices);
-	//returning a c array of strings with a char **
-	char** names = getDeviceDrivers();
-	//make sure the thing's not empty
-	if(names == NULL){
-		//return null or empty array? let's go with empty array
-		args.GetReturnValue().Set(result_list);
-		return;
-	}
-	//set each index of the array by casting the char*'s with Nan::New<string>()
-	for(long i = 0; i < numOfDevices; i++){
-		printf("Driver[%ld]: %s\n",i,names[i]);
-		result_list->Set(i,Nan::New<String>(names[i]).ToLocalChecked());
+	// the virtual device comes first, then whatever the SDK finds; probe() tells more about each
+	std::vector<std::string> names = driverNames();
+	Local<Array> result_list = Array::New(isolate, (int)names.size());
+	printf("ASIO Devices: %ld\n", (long)names.size() - 1);
+	for (size_t i = 0; i < names.size(); i++){
+		if (i > 0)
+			printf("Driver[%ld]: %s\n", (long)i - 1, names[i].c_str());
+		result_list->Set((uint32_t)i, String::NewFromUtf8(isolate, names[i].c_str()));
 	}
 	//return the array
 	args.GetReturnValue().Set(result_list);
 }
-
+// one probe() call, travels through the thread pool and back to the loop it came from
+typedef struct ProbeRequest{
+	uv_work_t work;
+	Isolate *isolate;
+	Persistent<Function> callback;
+	std::vector<std::string> names;	// empty for every driver there is
+	bool refresh;
+	std::vector<DriverCapabilities> results;
+	std::vector<bool> cached;
+}ProbeRequest;
+static void probeWork(uv_work_t *work){
+	// a pool thread, this is where the slow part happens
+	ProbeRequest *request = (ProbeRequest *)work->data;
+	if (request->names.empty())
+		request->names = driverNames();
+	for (size_t i = 0; i < request->names.size(); i++){
+		DriverCapabilities capabilities;
+		bool cached = !request->refresh && cachedCapabilities(request->names[i], &capabilities);
+		if (!cached)
+			probeDriver(request->names[i], &capabilities);
+		request->results.push_back(capabilities);
+		request->cached.push_back(cached);
+	}
+}
+static Local<Array> channelsArray(Isolate *isolate, const std::vector<ChannelCapabilities> &channels){
+	Local<Array> result = Array::New(isolate, (int)channels.size());
+	for (size_t c = 0; c < channels.size(); c++){
+		Local<Object> channel = Object::New(isolate);
+		channel->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, channels[c].name.c_str()));
+		channel->Set(String::NewFromUtf8(isolate, "type"), String::NewFromUtf8(isolate, sampleTypeName(channels[c].type)));
+		channel->Set(String::NewFromUtf8(isolate, "group"), Number::New(isolate, (double)channels[c].group));
+		result->Set((uint32_t)c, channel);
+	}
+	return result;
+}
+static Local<Object> capabilitiesObject(Isolate *isolate, const DriverCapabilities &driver, bool cached){
+	Local<Object> result = Object::New(isolate);
+	result->Set(String::NewFromUtf8(isolate, "name"), String::NewFromUtf8(isolate, driver.name.c_str()));
+	SET_COUNTER(result, "error", driver.error);
+	result->Set(String::NewFromUtf8(isolate, "message"), String::NewFromUtf8(isolate, driver.message.c_str()));
+	result->Set(String::NewFromUtf8(isolate, "cached"), Boolean::New(isolate, cached));
+	SET_COUNTER(result, "probedAt", driver.probedAt);
+	if (driver.error != kProbeOk)
+		return result;
+	SET_COUNTER(result, "asioVersion", driver.asioVersion);
+	SET_COUNTER(result, "driverVersion", driver.driverVersion);
+	SET_COUNTER(result, "inputs", driver.inputs);
+	SET_COUNTER(result, "outputs", driver.outputs);
+	Local<Object> bufferSize = Object::New(isolate);
+	SET_COUNTER(bufferSize, "min", driver.minSize);
+	SET_COUNTER(bufferSize, "max", driver.maxSize);
+	SET_COUNTER(bufferSize, "preferred", driver.preferredSize);
+	SET_COUNTER(bufferSize, "granularity", driver.granularity);
+	result->Set(String::NewFromUtf8(isolate, "bufferSize"), bufferSize);
+	SET_COUNTER(result, "sampleRate", driver.sampleRate);
+	Local<Array> rates = Array::New(isolate, (int)driver.sampleRates.size());
+	for (size_t i = 0; i < driver.sampleRates.size(); i++)
+		rates->Set((uint32_t)i, Number::New(isolate, driver.sampleRates[i]));
+	result->Set(String::NewFromUtf8(isolate, "sampleRates"), rates);
+	SET_COUNTER(result, "inputLatency", driver.inputLatency);
+	SET_COUNTER(result, "outputLatency", driver.outputLatency);
+	result->Set(String::NewFromUtf8(isolate, "inputChannels"), channelsArray(isolate, driver.inputChannels));
+	result->Set(String::NewFromUtf8(isolate, "outputChannels"), channelsArray(isolate, driver.outputChannels));
+	return result;
+}
+static void probeDone(uv_work_t *work, int status){
+	// back on the loop of the thread that asked
+	ProbeRequest *request = (ProbeRequest *)work->data;
+	Isolate *isolate = request->isolate;
+	{
+		v8::HandleScope handleScope(isolate);
+		Local<Array> results = Array::New(isolate, (int)request->results.size());
+		for (size_t i = 0; i < request->results.size(); i++)
+			results->Set((uint32_t)i, capabilitiesObject(isolate, request->results[i], request->cached[i]));
+		Local<Function> callback = Local<Function>::New(isolate, request->callback);
+		Local<Value> argv[] = {Null(isolate), results};
+		callback->Call(isolate->GetCurrentContext()->Global(), 2, argv);
+	}
+	request->callback.Reset();
+	delete request;
+}
+// probe({drivers, refresh}, callback) - callback(null, [capabilities]) with what every driver (or the
+// named ones) can do, probed on the thread pool without init(). Results are cached per driver, refresh
+// probes again. error is 0, -1 while a driver is loaded (init() holds the SDK), -2 can't load it,
+// -3 it failed to initialize (message says why), -4 no SDK on this platform; the rest is only there
+// when it's 0. Works from any thread, the callback runs on the caller's loop
+void AsioProbe(const FunctionCallbackInfo<Value>& args){
+	Isolate* isolate = args.GetIsolate();
+	Local<Value> callbackValue = args[0]->IsFunction() ? args[0] : args[1];
+	if (!callbackValue->IsFunction())
+		return;
+	ProbeRequest *request = new ProbeRequest();
+	request->isolate = isolate;
+	request->callback.Reset(isolate, Local<Function>::Cast(callbackValue));
+	request->refresh = false;
+	if (args[0]->IsObject() && !args[0]->IsFunction()){
+		Local<Object> options = args[0]->ToObject();
+		Local<Value> driversValue = options->Get(String::NewFromUtf8(isolate, "drivers"));
+		if (driversValue->IsArray()){
+			Local<Array> list = Local<Array>::Cast(driversValue);
+			for (unsigned int i = 0; i < list->Length(); i++){
+				v8::String::Utf8Value name(list->Get(i));
+				request->names.push_back(*name);
+			}
+		}
+		request->refresh = options->Get(String::NewFromUtf8(isolate, "refresh"))->BooleanValue();
+	}
+	request->work.data = request;
+	uv_queue_work(eventLoop(isolate), &request->work, probeWork, probeDone);
+}
 void init(Local<Object> exports){
+	// every thread that loads us gets here, the process wide setup only happens once
+	uv_once(&processOnce, initProcess);
+#if NODE_MODULE_VERSION >= 67
+	Isolate *isolate = exports->GetIsolate();
+	node::AddEnvironmentCleanupHook(isolate, cleanupEnvironment, isolate);
+#endif
 //we can limit access to list with the preprocessor directives*...may be good idea
 	NODE_SET_METHOD(exports, "list", AsioList);
+	NODE_SET_METHOD(exports, "probe", AsioProbe);
+	NODE_SET_METHOD(exports, "openBridge", AsioOpenBridge);
+	NODE_SET_METHOD(exports, "bridgeWrite", AsioBridgeWrite);
+	NODE_SET_METHOD(exports, "closeBridge", AsioCloseBridge);
+	NODE_SET_METHOD(exports, "openShared", AsioOpenShared);
+	NODE_SET_METHOD(exports, "closeShared", AsioCloseShared);
+	NODE_SET_METHOD(exports, "mapShared", AsioMapShared);
 	NODE_SET_METHOD(exports, "init", AsioInit);
 	NODE_SET_METHOD(exports, "stop", AsioStop);
 	NODE_SET_METHOD(exports, "deInit", AsioDeInit);
 	NODE_SET_METHOD(exports, "start", AsioStart);
+	NODE_SET_METHOD(exports, "stats", AsioStats);
+	NODE_SET_METHOD(exports, "resetStats", AsioResetStats);
+	NODE_SET_METHOD(exports, "record", AsioRecord);
+	NODE_SET_METHOD(exports, "stopRecording", AsioStopRecording);
+	NODE_SET_METHOD(exports, "openPlayback", AsioOpenPlayback);
+	NODE_SET_METHOD(exports, "closePlayback", AsioClosePlayback);
+	NODE_SET_METHOD(exports, "playbackStart", AsioPlaybackStart);
+	NODE_SET_METHOD(exports, "playbackStop", AsioPlaybackStop);
+	NODE_SET_METHOD(exports, "playbackSeek", AsioPlaybackSeek);
+	NODE_SET_METHOD(exports, "subscribe", AsioSubscribe);
+	NODE_SET_METHOD(exports, "unsubscribe", AsioUnsubscribe);
+	NODE_SET_METHOD(exports, "analyze", AsioAnalyze);
+	NODE_SET_METHOD(exports, "stopAnalysis", AsioStopAnalysis);
+	NODE_SET_METHOD(exports, "resetLoudness", AsioResetLoudness);
+	NODE_SET_METHOD(exports, "inputGain", AsioInputGain);
+	NODE_SET_METHOD(exports, "outputGain", AsioOutputGain);
+	NODE_SET_METHOD(exports, "mix", AsioMix);
+	NODE_SET_METHOD(exports, "route", AsioRoute);
+	NODE_SET_METHOD(exports, "clearMix", AsioClearMix);
+	NODE_SET_METHOD(exports, "limiter", AsioLimiter);
+	NODE_SET_METHOD(exports, "smoothing", AsioSmoothing);
+	NODE_SET_METHOD(exports, "trace", AsioTrace);
+	NODE_SET_METHOD(exports, "dumpTrace", AsioDumpTrace);
+}
+// context aware where node supports it, so the addon loads in Worker threads too
+#ifdef NODE_MODULE_INIT
+NODE_MODULE_INIT(){
+	init(exports);
 }
+#else
 NODE_MODULE(nodeAudioAsio, init);
+#endif
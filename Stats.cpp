@@ -0,0 +1,101 @@
+#include "Stats.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t monotonicNanos(){
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER now;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	// split up so the multiplication doesn't overflow after a few days of uptime
+	uint64_t seconds = now.QuadPart / frequency.QuadPart;
+	uint64_t rest = now.QuadPart % frequency.QuadPart;
+	return seconds * 1000000000ull + rest * 1000000000ull / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+void LatencyHistogram::reset(){
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+		buckets[i].store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	minimum.store(UINT64_MAX, std::memory_order_relaxed);
+	maximum.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketOf(uint64_t nanos){
+	if (nanos < HISTOGRAM_SUB_BUCKETS)
+		return (int)nanos;
+	int msb = 63;
+	while (!(nanos >> msb))
+		msb--;
+	int shift = msb - HISTOGRAM_SUB_BITS;
+	int bucket = (shift + 1) * HISTOGRAM_SUB_BUCKETS + (int)((nanos >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+	return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::valueOf(int bucket){
+	// middle of the range the bucket covers
+	if (bucket < HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+	int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+	return low + ((1ull << shift) >> 1);
+}
+
+double LatencyHistogram::mean() const{
+	uint64_t n = count();
+	return n ? (double)sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const{
+	uint64_t n = count();
+	if (!n)
+		return 0;
+	uint64_t rank = (uint64_t)(fraction * n);
+	if (rank >= n)
+		rank = n - 1;
+	uint64_t seen = 0;
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++){
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen > rank){
+			// never report past what was actually recorded
+			uint64_t value = valueOf(i);
+			return value < max() ? value : max();
+		}
+	}
+	return max();
+}
+
+void resetStats(AudioStats *stats){
+	resetDriverStats(stats);
+	resetHostStats(stats);
+}
+
+void resetDriverStats(AudioStats *stats){
+	stats->driverCallback.reset();
+	stats->roundTrip.reset();
+	stats->blocks = 0;
+	stats->processedSamples = 0;
+	stats->discontinuities = 0;
+	stats->droppedBlocks = 0;
+	stats->outputUnderruns = 0;
+	stats->primingBlocks = 0;
+	stats->repeatedBlocks = 0;
+}
+
+void resetHostStats(AudioStats *stats){
+	stats->dispatch.reset();
+	stats->jsCallback.reset();
+	stats->missedDeadlines = 0;
+	stats->outputOverflows = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef __Stats__
+#define __Stats__
+
+#include <stdint.h>
+#include <atomic>
+
+// monotonic clock in nanoseconds, cheap enough to read a few times per block
+uint64_t monotonicNanos();
+
+// HDR style histogram: 16 linear sub buckets per power of two, so every value is
+// kept to within ~6% from nanoseconds up to minutes, in a fixed array of counters.
+// One thread records and resets it, any thread may read it; all of it is relaxed
+// atomics, a read racing a record is off by at most that one sample.
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS * 40)
+
+class LatencyHistogram{
+public:
+	LatencyHistogram() { reset(); }
+
+	void record(uint64_t nanos){
+		buckets[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(nanos, std::memory_order_relaxed);
+		if (nanos > maximum.load(std::memory_order_relaxed))
+			maximum.store(nanos, std::memory_order_relaxed);
+		if (nanos < minimum.load(std::memory_order_relaxed))
+			minimum.store(nanos, std::memory_order_relaxed);
+	}
+	void reset();
+
+	uint64_t count() const { return total.load(std::memory_order_relaxed); }
+	uint64_t min() const { return count() ? minimum.load(std::memory_order_relaxed) : 0; }
+	uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+	double mean() const;
+	// value at the given fraction (0.99 for p99), in nanoseconds
+	uint64_t percentile(double fraction) const;
+
+private:
+	static int bucketOf(uint64_t nanos);
+	static uint64_t valueOf(int bucket);
+
+	std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> minimum;
+	std::atomic<uint64_t> maximum;
+};
+
+// everything we know about how the audio path is doing, read by stats(). Each field has
+// a single writer, the driver thread or the JS thread (host) that delivers the blocks
+typedef struct AudioStats{
+	LatencyHistogram driverCallback;	// driver, time spent inside bufferSwitchTimeInfo
+	LatencyHistogram dispatch;		// host, driver callback entry until JS gets the block
+	LatencyHistogram jsCallback;		// host, time spent in the JS callback
+	LatencyHistogram roundTrip;		// driver, callback entry until its output is written back
+
+	std::atomic<uint64_t> blocks;			// driver callbacks seen
+	std::atomic<uint64_t> processedSamples;	// driver
+	std::atomic<uint64_t> missedDeadlines;	// host, JS finished a block after the driver needed its output
+	std::atomic<uint64_t> discontinuities;	// driver, sample position didn't advance by one block
+	std::atomic<uint64_t> droppedBlocks;		// driver, input blocks lost because JS fell behind
+	std::atomic<uint64_t> outputUnderruns;	// driver blocks without rendered output
+	std::atomic<uint64_t> primingBlocks;		// driver blocks of fallback while the output queue filled up
+	std::atomic<uint64_t> repeatedBlocks;	// driver, underruns that repeated the block before
+	std::atomic<uint64_t> outputOverflows;	// host, rendered blocks thrown away
+}AudioStats;
+
+// all of it, only while neither side records
+void resetStats(AudioStats *stats);
+// the fields one side writes, on that side's thread while running
+void resetDriverStats(AudioStats *stats);
+void resetHostStats(AudioStats *stats);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <uv.h>
+#include "Trace.h"
+#include "RingBuffer.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#define TRACE_MASK (TRACE_THREAD_EVENTS - 1)
+
+std::atomic<bool> traceActive(false);
+
+typedef struct TraceThread{
+	std::atomic<bool> ready;			// events is set, the dump may look at it
+	std::atomic<uint64_t> head;			// events written, only the owner moves it
+	std::atomic<uint64_t> from;			// where the current recording starts
+	std::atomic<const char *> name;
+	TraceEvent *events;
+}TraceThread;
+
+static TraceThread threads[TRACE_MAX_THREADS];
+static std::atomic<int> claimed(0);
+static TraceEvent *rings = NULL;
+static uv_once_t allocateOnce = UV_ONCE_INIT;
+
+// the thread's ring, or NULL once they are all taken
+static thread_local TraceThread *current = NULL;
+static thread_local bool noRing = false;
+
+static void allocateRings(){
+	rings = (TraceEvent *)alignedAlloc((size_t)TRACE_MAX_THREADS * TRACE_THREAD_EVENTS * sizeof(TraceEvent));
+}
+
+bool enableTrace(bool enable){
+	if (!enable){
+		traceActive.store(false, std::memory_order_relaxed);
+		return true;
+	}
+	uv_once(&allocateOnce, allocateRings);
+	if (!rings)
+		return false;
+	// whatever was recorded before is left out of the next dump
+	int count = claimed.load(std::memory_order_acquire);
+	for (int i = 0; i < count && i < TRACE_MAX_THREADS; i++)
+		threads[i].from.store(threads[i].head.load(std::memory_order_acquire), std::memory_order_relaxed);
+	traceActive.store(true, std::memory_order_release);
+	return true;
+}
+
+static TraceThread *self(){
+	if (current || noRing)
+		return current;
+	int i = claimed.fetch_add(1, std::memory_order_acq_rel);
+	if (i >= TRACE_MAX_THREADS){
+		noRing = true;
+		return NULL;
+	}
+	TraceThread *thread = &threads[i];
+	thread->events = rings + (size_t)i * TRACE_THREAD_EVENTS;
+	thread->ready.store(true, std::memory_order_release);
+	current = thread;
+	return thread;
+}
+
+void traceThreadName(const char *name){
+	if (!traceOn())
+		return;
+	TraceThread *thread = self();
+	const char *none = NULL;
+	if (thread)
+		thread->name.compare_exchange_strong(none, name, std::memory_order_relaxed);
+}
+
+void traceRecord(int kind, const char *name, uint64_t start, uint64_t duration, const char *argName, int64_t arg){
+	TraceThread *thread = self();
+	if (!thread)
+		return;
+	uint64_t head = thread->head.load(std::memory_order_relaxed);
+	TraceEvent &event = thread->events[head & TRACE_MASK];
+	event.name = name;
+	event.argName = argName;
+	event.start = start;
+	event.duration = duration;
+	event.arg = arg;
+	event.kind = kind;
+	thread->head.store(head + 1, std::memory_order_release);
+}
+
+static void appendEvent(std::string &json, const TraceEvent &event, int pid, int tid){
+	char line[320];
+	char args[96] = "";
+	if (event.argName)
+		snprintf(args, sizeof(args), ",\"args\":{\"%s\":%lld}", event.argName, (long long)event.arg);
+	double ts = event.start / 1000.;
+	switch (event.kind){
+		case kTraceSpan:
+			snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f%s}",
+				event.name, pid, tid, ts, event.duration / 1000., args);
+			break;
+		case kTraceAsync:
+			// a begin and an end with the same id, Perfetto draws them on a track of their own
+			snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"audio\",\"ph\":\"b\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%.3f%s}"
+				",\n{\"name\":\"%s\",\"cat\":\"audio\",\"ph\":\"e\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%.3f}",
+				event.name, (long long)event.arg, pid, tid, ts, args,
+				event.name, (long long)event.arg, pid, tid, (event.start + event.duration) / 1000.);
+			break;
+		default:
+			snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f%s}",
+				event.name, pid, tid, ts, args);
+			break;
+	}
+	json += line;
+}
+
+std::string dumpTrace(){
+#if defined(_WIN32)
+	int pid = (int)GetCurrentProcessId();
+#else
+	int pid = (int)getpid();
+#endif
+	char line[160];
+	std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"node-asio\"}}", pid);
+	json += line;
+	std::vector<TraceEvent> copy;
+	int count = claimed.load(std::memory_order_acquire);
+	for (int i = 0; i < count && i < TRACE_MAX_THREADS; i++){
+		TraceThread &thread = threads[i];
+		if (!thread.ready.load(std::memory_order_acquire))
+			continue;
+		int tid = i + 1;
+		const char *name = thread.name.load(std::memory_order_relaxed);
+		snprintf(line, sizeof(line), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			pid, tid, name ? name : "thread");
+		json += line;
+		uint64_t head = thread.head.load(std::memory_order_acquire);
+		uint64_t from = thread.from.load(std::memory_order_relaxed);
+		if (head - from > TRACE_THREAD_EVENTS)
+			from = head - TRACE_THREAD_EVENTS;
+		copy.resize((size_t)(head - from));
+		for (uint64_t n = from; n < head; n++)
+			copy[(size_t)(n - from)] = thread.events[n & TRACE_MASK];
+		// the owner kept going, whatever it wrapped over meanwhile is torn, and so is the slot of
+		// the event it may be writing right now, after. The fence keeps the copy before the re-read
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = thread.head.load(std::memory_order_relaxed);
+		uint64_t valid = after >= TRACE_THREAD_EVENTS ? after - TRACE_THREAD_EVENTS + 1 : 0;
+		for (uint64_t n = from; n < head; n++)
+			if (n >= valid)
+				appendEvent(json, copy[(size_t)(n - from)], pid, tid);
+	}
+	json += "\n]}\n";
+	return json;
+}
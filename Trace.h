@@ -0,0 +1,72 @@
+#ifndef __Trace__
+#define __Trace__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "Stats.h"
+
+// Flight recorder for the audio path. Every thread that records gets a ring of its own the
+// first time, events go in with a plain store and a release of the ring's head, no locks and
+// no allocation; the oldest get overwritten. Spans time a piece of work on one thread, async
+// spans something that starts on one thread and ends on another (a block waiting for JS),
+// instants mark a moment. Off, a span costs a relaxed load. dumpTrace() turns whatever the
+// rings hold into Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+
+#define TRACE_MAX_THREADS 16
+// events per thread, a power of two
+#define TRACE_THREAD_EVENTS 16384
+
+enum {
+	kTraceSpan = 0,
+	kTraceAsync,
+	kTraceInstant
+};
+
+typedef struct TraceEvent{
+	const char *name;			// string literals only, the pointer is all that's kept
+	const char *argName;		// NULL without an argument
+	uint64_t start;				// monotonicNanos()
+	uint64_t duration;
+	int64_t arg;				// the async span's id too
+	int kind;
+}TraceEvent;
+
+extern std::atomic<bool> traceActive;
+
+static inline bool traceOn(){
+	return traceActive.load(std::memory_order_relaxed);
+}
+// JS thread. The rings are allocated the first time and kept, enabling again starts them over
+bool enableTrace(bool enable);
+// names the calling thread in the dump, the first name sticks
+void traceThreadName(const char *name);
+void traceRecord(int kind, const char *name, uint64_t start, uint64_t duration, const char *argName, int64_t arg);
+static inline void traceInstant(const char *name, const char *argName, int64_t arg){
+	if (traceOn())
+		traceRecord(kTraceInstant, name, monotonicNanos(), 0, argName, arg);
+}
+// any thread, while the others keep recording; events overwritten while it copies are left out
+std::string dumpTrace();
+
+// times its scope
+class TraceSpan{
+public:
+	TraceSpan(const char *name) : name(name), argName(NULL), arg(0), start(traceOn() ? monotonicNanos() : 0) {}
+	TraceSpan(const char *name, const char *argName, int64_t arg) : name(name), argName(argName), arg(arg),
+		start(traceOn() ? monotonicNanos() : 0) {}
+	~TraceSpan(){
+		if (start && traceOn())
+			traceRecord(kTraceSpan, name, start, monotonicNanos() - start, argName, arg);
+	}
+
+private:
+	TraceSpan(const TraceSpan &);
+	TraceSpan &operator=(const TraceSpan &);
+	const char *name;
+	const char *argName;
+	int64_t arg;
+	uint64_t start;
+};
+
+#endif
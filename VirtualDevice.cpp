@@ -0,0 +1,580 @@
+#include <uv.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include "VirtualDevice.h"
+#include "SampleConvert.h"
+#include "RingBuffer.h"
+#include "WavFile.h"
+#include "Stats.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define VIRTUAL_MIN_BUFFER 16
+#define VIRTUAL_MAX_BUFFER 8192
+#define VIRTUAL_PREFERRED_BUFFER 256
+#define VIRTUAL_MAX_CHANNELS 256
+// a file source gets loaded completely, keep it to something sane
+#define VIRTUAL_MAX_FILE_FRAMES (1 << 26)
+
+typedef struct VirtualDevice{
+	VirtualConfig config;
+	bool initialized;
+	ASIOSampleRate sampleRate;
+	long bufferSize;
+	ASIOCallbacks *callbacks;
+
+	// both halves of every created channel, in the order createBuffers got them
+	char *memory;
+	long numChannels;
+	std::vector<ASIOBufferInfo> channels;
+
+	// file source, decoded to float, interleaved
+	std::vector<float> fileData;
+	long fileChannels;
+	uint64_t fileFrames;
+	uint64_t filePosition;
+	std::vector<double> phase;
+	float *scratch;
+
+	uv_thread_t thread;
+	std::atomic<bool> running;
+	std::atomic<uint64_t> samplePosition;
+	std::atomic<uint64_t> systemTime;
+
+	// offline rendering, the outputs interleaved into a WAV
+	uint64_t renderFrames;		// 0 until stop()
+	FILE *output;
+	WavInfo outputInfo;
+	char *interleaved;
+	std::atomic<bool> finished;
+	std::atomic<uint64_t> blocksRendered;
+	std::atomic<uint64_t> renderStart;
+	std::atomic<uint64_t> renderEnd;
+	std::atomic<uint64_t> framesWritten;
+	std::atomic<uint64_t> writeErrors;
+}VirtualDevice;
+
+static VirtualDevice device;
+static bool configured = false;
+
+void defaultVirtualConfig(VirtualConfig *config){
+	config->inputs = 2;
+	config->outputs = 2;
+	config->sampleType = ASIOSTInt24LSB;
+	config->source = kVirtualSine;
+	config->frequency = 440.;
+	config->file = "";
+	config->sampleRate = 44100.;
+	config->fixedRate = false;
+	config->outputReady = true;
+	config->offline = false;
+	config->seconds = 0;
+	config->outputFile = "";
+	config->finished = NULL;
+	config->finishedArg = NULL;
+}
+
+void configureVirtualDevice(const VirtualConfig &config){
+	device.config = config;
+	if (device.config.inputs > VIRTUAL_MAX_CHANNELS)
+		device.config.inputs = VIRTUAL_MAX_CHANNELS;
+	if (device.config.outputs > VIRTUAL_MAX_CHANNELS)
+		device.config.outputs = VIRTUAL_MAX_CHANNELS;
+	configured = true;
+}
+
+static void sleepUntil(uint64_t deadline){
+#if defined(_WIN32)
+	// Sleep() is only good to a millisecond, yield for the rest
+	for (;;){
+		uint64_t now = monotonicNanos();
+		if (now >= deadline)
+			return;
+		if (deadline - now > 2000000)
+			Sleep(1);
+		else
+			SwitchToThread();
+	}
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)(deadline / 1000000000ull);
+	ts.tv_nsec = (long)(deadline % 1000000000ull);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+#endif
+}
+
+static bool loadFileSource(){
+	FILE *file = fopen(device.config.file.c_str(), "rb");
+	WavInfo info;
+	if (!file)
+		return false;
+	ToFloatKernel convert = NULL;
+	if (wavReadHeader(file, &info))
+		convert = getToFloat(info.type);
+	if (!convert || info.frames == 0 || info.frames > VIRTUAL_MAX_FILE_FRAMES){
+		fclose(file);
+		return false;
+	}
+	long bytes = sampleBytes(info.type);
+	std::vector<char> raw((size_t)(info.frames * info.channels * bytes));
+	size_t got = fread(raw.data(), 1, raw.size(), file);
+	fclose(file);
+	device.fileChannels = info.channels;
+	device.fileFrames = got / (info.channels * bytes);
+	device.fileData.resize((size_t)(device.fileFrames * info.channels));
+	convert(raw.data(), device.fileData.data(), (long)device.fileData.size());
+	device.filePosition = 0;
+	return device.fileFrames > 0;
+}
+
+static void fillInputs(long index, long lastIndex){
+	// produce this block's input halves from the configured source
+	long frames = device.bufferSize;
+	long inputs = 0, outputs = 0;
+	for (long c = 0; c < device.numChannels; c++)
+		(device.channels[c].isInput ? inputs : outputs)++;
+	FromFloatKernel fromFloat = getFromFloat(device.config.sampleType);
+	long bytes = frames * sampleBytes(device.config.sampleType);
+
+	long input = 0;
+	for (long c = 0; c < device.numChannels; c++){
+		ASIOBufferInfo &info = device.channels[c];
+		if (!info.isInput)
+			continue;
+		void *dst = info.buffers[index];
+		switch (device.config.source){
+			case kVirtualSine:{
+				double step = 2. * 3.14159265358979323846 * device.config.frequency * (1 << (input % 4)) / device.sampleRate;
+				double phase = device.phase[c];
+				for (long n = 0; n < frames; n++){
+					device.scratch[n] = (float)(0.5 * sin(phase));
+					phase += step;
+				}
+				device.phase[c] = fmod(phase, 2. * 3.14159265358979323846);
+				fromFloat(device.scratch, dst, frames);
+				break;
+			}
+			case kVirtualLoopback:{
+				// output number input % outputs, as the host last wrote it
+				long wanted = outputs ? input % outputs : -1;
+				const void *src = NULL;
+				for (long o = 0, seen = 0; o < device.numChannels && wanted >= 0; o++){
+					if (device.channels[o].isInput)
+						continue;
+					if (seen++ == wanted){
+						src = device.channels[o].buffers[lastIndex];
+						break;
+					}
+				}
+				if (src)
+					memcpy(dst, src, bytes);
+				else
+					memset(dst, 0, bytes);
+				break;
+			}
+			case kVirtualFile:{
+				long fileChannel = input % device.fileChannels;
+				uint64_t position = device.filePosition;
+				for (long n = 0; n < frames; n++){
+					// offline the file plays once, silence after it
+					device.scratch[n] = position < device.fileFrames ?
+						device.fileData[(size_t)(position * device.fileChannels + fileChannel)] : 0.f;
+					if (++position == device.fileFrames && !device.config.offline)
+						position = 0;
+				}
+				fromFloat(device.scratch, dst, frames);
+				break;
+			}
+			default:
+				memset(dst, 0, bytes);
+		}
+		input++;
+	}
+	if (device.config.source == kVirtualFile)
+		device.filePosition = device.config.offline ? device.filePosition + frames : (device.filePosition + frames) % device.fileFrames;
+}
+
+// types a WAV holds as they are, the others get written as float
+static bool wavType(ASIOSampleType type){
+	return type == ASIOSTInt16LSB || type == ASIOSTInt24LSB || type == ASIOSTInt32LSB || type == ASIOSTFloat32LSB;
+}
+
+static void interleave(char *dst, const char *src, long frames, long bytes, long stride){
+	// the common widths get a fixed size copy the compiler can inline
+	switch (bytes){
+		case 2:
+			for (long n = 0; n < frames; n++, dst += stride, src += 2)
+				memcpy(dst, src, 2);
+			break;
+		case 3:
+			for (long n = 0; n < frames; n++, dst += stride, src += 3)
+				memcpy(dst, src, 3);
+			break;
+		case 4:
+			for (long n = 0; n < frames; n++, dst += stride, src += 4)
+				memcpy(dst, src, 4);
+			break;
+		default:
+			for (long n = 0; n < frames; n++, dst += stride, src += bytes)
+				memcpy(dst, src, bytes);
+	}
+}
+
+static void writeOutputFile(long index, long frames){
+	// what the host just left in the output halves of index, frames of it
+	if (!device.output)
+		return;
+	long bytes = sampleBytes(device.outputInfo.type);
+	long stride = bytes * device.outputInfo.channels;
+	ToFloatKernel toFloat = device.outputInfo.type == device.config.sampleType ? NULL : getToFloat(device.config.sampleType);
+	long output = 0;
+	for (long c = 0; c < device.numChannels; c++){
+		ASIOBufferInfo &info = device.channels[c];
+		if (info.isInput)
+			continue;
+		const char *src = (const char *)info.buffers[index];
+		if (toFloat){
+			toFloat(src, device.scratch, frames);
+			src = (const char *)device.scratch;
+		}
+		interleave(device.interleaved + output++ * bytes, src, frames, bytes, stride);
+	}
+	size_t size = (size_t)(frames * stride);
+	if (fwrite(device.interleaved, 1, size, device.output) != size)
+		device.writeErrors.fetch_add(1, std::memory_order_relaxed);
+	else{
+		device.outputInfo.dataBytes += size;
+		device.framesWritten.fetch_add(frames, std::memory_order_relaxed);
+	}
+}
+
+static bool openOutputFile(){
+	if (device.config.outputFile.empty())
+		return true;
+	device.output = fopen(device.config.outputFile.c_str(), "wb");
+	if (!device.output)
+		return false;
+	long outputs = 0;
+	for (long c = 0; c < device.numChannels; c++)
+		if (!device.channels[c].isInput)
+			outputs++;
+	memset(&device.outputInfo, 0, sizeof(device.outputInfo));
+	device.outputInfo.channels = (int)outputs;
+	device.outputInfo.sampleRate = device.sampleRate;
+	device.outputInfo.type = wavType(device.config.sampleType) ? device.config.sampleType : (ASIOSampleType)ASIOSTFloat32LSB;
+	device.interleaved = (char *)alignedAlloc(device.bufferSize * (outputs ? outputs : 1) * sampleBytes(device.outputInfo.type));
+	if (!device.interleaved || !wavWriteHeader(device.output, &device.outputInfo)){
+		fclose(device.output);
+		device.output = NULL;
+		return false;
+	}
+	return true;
+}
+
+static void closeOutputFile(){
+	if (device.output){
+		device.outputInfo.frames = device.framesWritten.load(std::memory_order_relaxed);
+		if (!wavFinishHeader(device.output, &device.outputInfo))
+			device.writeErrors.fetch_add(1, std::memory_order_relaxed);
+		fclose(device.output);
+		device.output = NULL;
+	}
+	if (device.interleaved)
+		alignedFree(device.interleaved);
+	device.interleaved = NULL;
+}
+
+static void switchBuffers(long index, uint64_t now){
+	device.systemTime.store(now, std::memory_order_relaxed);
+	ASIOTime timeInfo;
+	memset(&timeInfo, 0, sizeof(timeInfo));
+	UInt64toASIO64(device.samplePosition.load(std::memory_order_relaxed), timeInfo.timeInfo.samplePosition);
+	UInt64toASIO64(now, timeInfo.timeInfo.systemTime);
+	timeInfo.timeInfo.sampleRate = device.sampleRate;
+	timeInfo.timeInfo.flags = kSystemTimeValid | kSamplePositionValid | kSampleRateValid;
+	device.callbacks->bufferSwitchTimeInfo(&timeInfo, index, ASIOTrue);
+}
+
+static void timerThread(void *){
+	// the "hardware clock", one bufferSwitchTimeInfo per block period on absolute deadlines
+	uint64_t period = (uint64_t)(device.bufferSize / device.sampleRate * 1e9);
+	uint64_t next = monotonicNanos();
+	long index = 0, lastIndex = 1;
+	while (device.running.load(std::memory_order_acquire)){
+		fillInputs(index, lastIndex);
+		switchBuffers(index, monotonicNanos());
+		device.samplePosition.fetch_add(device.bufferSize, std::memory_order_relaxed);
+		lastIndex = index;
+		index ^= 1;
+		next += period;
+		// a real clock doesn't wait for us either, if we fell far behind start over from now
+		uint64_t now = monotonicNanos();
+		if (now > next + 4 * period)
+			next = now;
+		sleepUntil(next);
+	}
+}
+
+static void renderThread(void *){
+	// offline: the next block goes as soon as the host returned from the last one, for as long as the
+	// host keeps up. The system time is the sample position's, nothing depends on the wall clock
+	long index = 0, lastIndex = 1;
+	uint64_t position = 0;
+	device.renderStart.store(monotonicNanos(), std::memory_order_relaxed);
+	while (device.running.load(std::memory_order_acquire) && (!device.renderFrames || position < device.renderFrames)){
+		fillInputs(index, lastIndex);
+		switchBuffers(index, (uint64_t)(position / device.sampleRate * 1e9 + 0.5));
+		long frames = device.renderFrames && device.renderFrames - position < (uint64_t)device.bufferSize ?
+			(long)(device.renderFrames - position) : device.bufferSize;
+		writeOutputFile(index, frames);
+		position = device.samplePosition.fetch_add(device.bufferSize, std::memory_order_relaxed) + device.bufferSize;
+		device.blocksRendered.fetch_add(1, std::memory_order_relaxed);
+		device.renderEnd.store(monotonicNanos(), std::memory_order_relaxed);
+		lastIndex = index;
+		index ^= 1;
+	}
+	if (!device.renderFrames || position < device.renderFrames)
+		return;
+	// all there, the file is complete before anybody hears about it
+	closeOutputFile();
+	device.finished.store(true, std::memory_order_release);
+	if (device.config.finished)
+		device.config.finished(device.config.finishedArg);
+}
+
+void virtualRenderStats(VirtualRenderStats *out){
+	out->offline = device.config.offline;
+	out->finished = device.finished.load(std::memory_order_acquire);
+	out->blocks = device.blocksRendered.load(std::memory_order_relaxed);
+	out->frames = device.renderFrames;
+	uint64_t start = device.renderStart.load(std::memory_order_relaxed);
+	uint64_t end = device.renderEnd.load(std::memory_order_relaxed);
+	out->seconds = end > start ? (end - start) / 1e9 : 0;
+	out->blocksPerSecond = out->seconds > 0 ? out->blocks / out->seconds : 0;
+	out->speed = out->seconds > 0 && device.sampleRate > 0 ? out->blocks * device.bufferSize / device.sampleRate / out->seconds : 0;
+	out->framesWritten = device.framesWritten.load(std::memory_order_relaxed);
+	out->writeErrors = device.writeErrors.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------------
+// the ASIO surface
+
+static bool virtualLoad(char *){
+	if (!configured)
+		defaultVirtualConfig(&device.config);
+	return true;
+}
+static void virtualUnload(){
+	configured = false;
+}
+static ASIOError virtualInit(ASIODriverInfo *info){
+	info->asioVersion = 2;
+	info->driverVersion = 1;
+	strcpy(info->name, VIRTUAL_DRIVER_NAME);
+	info->errorMessage[0] = 0;
+	device.sampleRate = device.config.sampleRate > 0 ? device.config.sampleRate : 44100.;
+	device.bufferSize = VIRTUAL_PREFERRED_BUFFER;
+	device.memory = NULL;
+	device.numChannels = 0;
+	device.scratch = NULL;
+	device.running = false;
+	device.samplePosition = 0;
+	device.output = NULL;
+	device.interleaved = NULL;
+	if (device.config.source == kVirtualFile && !loadFileSource()){
+		strcpy(info->errorMessage, "can't read the source file");
+		return ASE_NotPresent;
+	}
+	// found out now rather than at start(), which has no way to say
+	if (device.config.offline && !device.config.outputFile.empty()){
+		FILE *file = fopen(device.config.outputFile.c_str(), "wb");
+		if (!file){
+			strcpy(info->errorMessage, "can't write the output file");
+			return ASE_NotPresent;
+		}
+		fclose(file);
+	}
+	if (!getFromFloat(device.config.sampleType))
+		return ASE_InvalidMode;
+	device.initialized = true;
+	return ASE_OK;
+}
+static ASIOError virtualDisposeBuffers();
+static ASIOError virtualStop();
+static ASIOError virtualExit(){
+	virtualStop();
+	virtualDisposeBuffers();
+	device.fileData.clear();
+	device.initialized = false;
+	return ASE_OK;
+}
+static ASIOError virtualStart(){
+	if (!device.memory)
+		return ASE_InvalidMode;
+	if (device.running)
+		return ASE_OK;
+	if (device.config.offline){
+		// every render starts from the same place
+		device.samplePosition = 0;
+		device.filePosition = 0;
+		device.phase.assign(device.numChannels, 0.);
+		// loopback reads the outputs of the block before, the last render's are still there
+		memset(device.memory, 0, alignUp(device.bufferSize * sampleBytes(device.config.sampleType)) * 2 * (device.numChannels ? device.numChannels : 1));
+		double seconds = device.config.seconds;
+		device.renderFrames = seconds > 0 ? (uint64_t)(seconds * device.sampleRate + 0.5) :
+			device.config.source == kVirtualFile ? device.fileFrames : 0;
+		device.finished = false;
+		device.blocksRendered = 0;
+		device.renderStart = device.renderEnd = 0;
+		device.framesWritten = 0;
+		device.writeErrors = 0;
+		if (!openOutputFile())
+			return ASE_HWMalfunction;
+	}
+	device.running = true;
+	if (uv_thread_create(&device.thread, device.config.offline ? renderThread : timerThread, NULL) != 0){
+		device.running = false;
+		closeOutputFile();
+		return ASE_HWMalfunction;
+	}
+	return ASE_OK;
+}
+static ASIOError virtualStop(){
+	if (!device.running)
+		return ASE_OK;
+	// the host relies on no callbacks arriving after this returns
+	device.running.store(false, std::memory_order_release);
+	uv_thread_join(&device.thread);
+	// stopped before the end, the file has what was rendered so far
+	closeOutputFile();
+	return ASE_OK;
+}
+static ASIOError virtualGetChannels(long *numInputChannels, long *numOutputChannels){
+	*numInputChannels = device.config.inputs;
+	*numOutputChannels = device.config.outputs;
+	return ASE_OK;
+}
+static ASIOError virtualGetLatencies(long *inputLatency, long *outputLatency){
+	*inputLatency = *outputLatency = device.bufferSize;
+	return ASE_OK;
+}
+static ASIOError virtualGetBufferSize(long *minSize, long *maxSize, long *preferredSize, long *granularity){
+	*minSize = VIRTUAL_MIN_BUFFER;
+	*maxSize = VIRTUAL_MAX_BUFFER;
+	*preferredSize = VIRTUAL_PREFERRED_BUFFER;
+	*granularity = 1;
+	return ASE_OK;
+}
+static ASIOError virtualCanSampleRate(ASIOSampleRate sampleRate){
+	if (device.config.fixedRate)
+		return sampleRate == device.sampleRate ? ASE_OK : ASE_NoClock;
+	return (sampleRate >= 8000. && sampleRate <= 384000.) ? ASE_OK : ASE_NoClock;
+}
+static ASIOError virtualGetSampleRate(ASIOSampleRate *currentRate){
+	*currentRate = device.sampleRate;
+	return ASE_OK;
+}
+static ASIOError virtualSetSampleRate(ASIOSampleRate sampleRate){
+	if (virtualCanSampleRate(sampleRate) != ASE_OK)
+		return ASE_NoClock;
+	if (device.running)
+		return ASE_InvalidMode;
+	device.sampleRate = sampleRate;
+	return ASE_OK;
+}
+static ASIOError virtualGetSamplePosition(ASIOSamples *sPos, ASIOTimeStamp *tStamp){
+	UInt64toASIO64(device.samplePosition.load(std::memory_order_relaxed), *sPos);
+	UInt64toASIO64(device.systemTime.load(std::memory_order_relaxed), *tStamp);
+	return ASE_OK;
+}
+static ASIOError virtualGetChannelInfo(ASIOChannelInfo *info){
+	long count = info->isInput ? device.config.inputs : device.config.outputs;
+	if (info->channel < 0 || info->channel >= count)
+		return ASE_InvalidParameter;
+	info->isActive = ASIOFalse;
+	for (long c = 0; c < device.numChannels; c++){
+		if (device.channels[c].isInput == info->isInput && device.channels[c].channelNum == info->channel)
+			info->isActive = ASIOTrue;
+	}
+	info->channelGroup = 0;
+	info->type = device.config.sampleType;
+	snprintf(info->name, sizeof(info->name), "Virtual %s %ld", info->isInput ? "In" : "Out", info->channel + 1);
+	return ASE_OK;
+}
+static ASIOError virtualCreateBuffers(ASIOBufferInfo *bufferInfos, long numChannels, long bufferSize, ASIOCallbacks *callbacks){
+	if (!device.initialized || device.memory)
+		return ASE_InvalidMode;
+	if (bufferSize < VIRTUAL_MIN_BUFFER || bufferSize > VIRTUAL_MAX_BUFFER)
+		return ASE_InvalidMode;
+	for (long c = 0; c < numChannels; c++){
+		long count = bufferInfos[c].isInput ? device.config.inputs : device.config.outputs;
+		if (bufferInfos[c].channelNum < 0 || bufferInfos[c].channelNum >= count)
+			return ASE_InvalidParameter;
+	}
+	long halfBytes = (long)alignUp(bufferSize * sampleBytes(device.config.sampleType));
+	device.memory = (char *)alignedAlloc(halfBytes * 2 * (numChannels ? numChannels : 1));
+	device.scratch = (float *)alignedAlloc(bufferSize * sizeof(float));
+	if (!device.memory || !device.scratch){
+		virtualDisposeBuffers();
+		return ASE_NoMemory;
+	}
+	memset(device.memory, 0, halfBytes * 2 * (numChannels ? numChannels : 1));
+	device.channels.assign(bufferInfos, bufferInfos + numChannels);
+	device.phase.assign(numChannels, 0.);
+	for (long c = 0; c < numChannels; c++){
+		bufferInfos[c].buffers[0] = device.channels[c].buffers[0] = device.memory + halfBytes * 2 * c;
+		bufferInfos[c].buffers[1] = device.channels[c].buffers[1] = device.memory + halfBytes * (2 * c + 1);
+	}
+	device.numChannels = numChannels;
+	device.bufferSize = bufferSize;
+	device.callbacks = callbacks;
+	return ASE_OK;
+}
+static ASIOError virtualDisposeBuffers(){
+	virtualStop();
+	if (device.memory)
+		alignedFree(device.memory);
+	if (device.scratch)
+		alignedFree(device.scratch);
+	device.memory = NULL;
+	device.scratch = NULL;
+	device.numChannels = 0;
+	device.channels.clear();
+	return ASE_OK;
+}
+static ASIOError virtualControlPanel(){
+	return ASE_NotPresent;
+}
+static ASIOError virtualOutputReady(){
+	// outputs are read at the next block anyway, it only tells the host which path to take
+	return device.config.outputReady ? ASE_OK : ASE_NotPresent;
+}
+
+const AsioBackend virtualBackend = {
+	"virtual",
+	virtualLoad,
+	virtualUnload,
+	virtualInit,
+	virtualExit,
+	virtualStart,
+	virtualStop,
+	virtualGetChannels,
+	virtualGetLatencies,
+	virtualGetBufferSize,
+	virtualCanSampleRate,
+	virtualGetSampleRate,
+	virtualSetSampleRate,
+	virtualGetSamplePosition,
+	virtualGetChannelInfo,
+	virtualCreateBuffers,
+	virtualDisposeBuffers,
+	virtualControlPanel,
+	virtualOutputReady
+};
@@ -0,0 +1,59 @@
+#ifndef __VirtualDevice__
+#define __VirtualDevice__
+
+#include <string>
+#include "AsioBackend.h"
+
+// init() picks the virtual device with this driver name
+#define VIRTUAL_DRIVER_NAME "Virtual"
+
+// what the virtual device feeds into its inputs
+enum {
+	kVirtualSilence = 0,
+	kVirtualSine,		// a sine per channel, one octave apart
+	kVirtualLoopback,	// input i plays back what was written to output i one block ago
+	kVirtualFile		// a WAV file, looped, file channels wrap around the inputs
+};
+
+typedef struct VirtualConfig{
+	long inputs;
+	long outputs;
+	ASIOSampleType sampleType;
+	int source;
+	double frequency;	// of the first channel's sine
+	std::string file;
+	double sampleRate;	// until the host sets one
+	bool fixedRate;		// runs at sampleRate only, like a device on an external clock
+	bool outputReady;	// supports ASIOOutputReady(), like most drivers do
+	// offline rendering: no clock, every block follows the last one as soon as the host returns
+	bool offline;
+	double seconds;		// how much to render, 0 for the file source once or until stop()
+	std::string outputFile;	// a WAV the outputs are written to, none when empty
+	void (*finished)(void *arg);	// device thread, after the last block and the file are done
+	void *finishedArg;
+}VirtualConfig;
+
+typedef struct VirtualRenderStats{
+	bool offline;
+	bool finished;
+	uint64_t blocks;			// since start()
+	uint64_t frames;			// to render, 0 until stop()
+	double seconds;				// wall clock from start() to the latest block
+	double blocksPerSecond;
+	double speed;				// audio seconds rendered per second
+	uint64_t framesWritten;		// to the output file
+	uint64_t writeErrors;
+}VirtualRenderStats;
+
+// A software ASIO device: buffers in memory and a high resolution timer thread that calls
+// bufferSwitchTimeInfo at the configured rate and block size, like a driver would.
+// Offline the thread doesn't wait for a clock, time stamps follow the sample position and the
+// sources start over at every start(), so the same input renders the same blocks every time.
+// Set it up before init() loads it.
+void configureVirtualDevice(const VirtualConfig &config);
+void defaultVirtualConfig(VirtualConfig *config);
+// any thread
+void virtualRenderStats(VirtualRenderStats *out);
+extern const AsioBackend virtualBackend;
+
+#endif
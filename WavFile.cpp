@@ -0,0 +1,194 @@
+#include <string.h>
+#include "WavFile.h"
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+int fileSeek(FILE *file, uint64_t offset){
+#if defined(_WIN32)
+	return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+uint64_t fileSize(FILE *file){
+#if defined(_WIN32)
+	if (_fseeki64(file, 0, SEEK_END) != 0)
+		return 0;
+	return (uint64_t)_ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0)
+		return 0;
+	return (uint64_t)ftello(file);
+#endif
+}
+
+static uint32_t le32(const unsigned char *p){
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static uint64_t le64(const unsigned char *p){
+	return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+static void put16(unsigned char *p, uint32_t v){
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+static void put32(unsigned char *p, uint32_t v){
+	put16(p, v & 0xffff);
+	put16(p + 2, v >> 16);
+}
+static void put64(unsigned char *p, uint64_t v){
+	put32(p, (uint32_t)v);
+	put32(p + 4, (uint32_t)(v >> 32));
+}
+
+// RIFF/RF64 + WAVE, JUNK/ds64, fmt (extensible), data
+#define WAV_DS64_OFFSET 12
+#define WAV_FMT_OFFSET (WAV_DS64_OFFSET + 8 + 28)
+#define WAV_DATA_OFFSET (WAV_FMT_OFFSET + 8 + 40)
+#define WAV_HEADER_BYTES (WAV_DATA_OFFSET + 8)
+// KSDATAFORMAT_SUBTYPE_PCM/IEEE_FLOAT minus the first two bytes
+static const unsigned char subFormatTail[14] = {
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+static void buildHeader(unsigned char *header, const WavInfo *info){
+	uint64_t riffBytes = WAV_HEADER_BYTES - 8 + info->dataBytes + (info->dataBytes & 1);
+	bool rf64 = riffBytes > 0xFFFFFFFFull;
+	int blockAlign = info->channels * (info->bitsPerSample / 8);
+	memset(header, 0, WAV_HEADER_BYTES);
+
+	memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+	put32(header + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)riffBytes);
+	memcpy(header + 8, "WAVE", 4);
+
+	// a JUNK chunk the size of ds64, so a file that grows past 4GB can be turned into RF64 in place
+	unsigned char *ds64 = header + WAV_DS64_OFFSET;
+	memcpy(ds64, rf64 ? "ds64" : "JUNK", 4);
+	put32(ds64 + 4, 28);
+	if (rf64){
+		put64(ds64 + 8, riffBytes);
+		put64(ds64 + 16, info->dataBytes);
+		put64(ds64 + 24, info->frames);
+	}
+
+	unsigned char *fmt = header + WAV_FMT_OFFSET;
+	memcpy(fmt, "fmt ", 4);
+	put32(fmt + 4, 40);
+	put16(fmt + 8, WAVE_FORMAT_EXTENSIBLE);
+	put16(fmt + 10, info->channels);
+	put32(fmt + 12, (uint32_t)info->sampleRate);
+	put32(fmt + 16, (uint32_t)(info->sampleRate * blockAlign));
+	put16(fmt + 20, blockAlign);
+	put16(fmt + 22, info->bitsPerSample);
+	put16(fmt + 24, 22);
+	put16(fmt + 26, info->bitsPerSample);	// valid bits
+	put32(fmt + 28, 0);	// no speaker positions
+	put16(fmt + 32, info->isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	memcpy(fmt + 34, subFormatTail, sizeof(subFormatTail));
+
+	unsigned char *data = header + WAV_DATA_OFFSET;
+	memcpy(data, "data", 4);
+	put32(data + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)info->dataBytes);
+}
+
+bool wavWriteHeader(FILE *file, WavInfo *info){
+	switch (info->type){
+		case ASIOSTInt16LSB: info->bitsPerSample = 16; info->isFloat = false; break;
+		case ASIOSTInt24LSB: info->bitsPerSample = 24; info->isFloat = false; break;
+		case ASIOSTInt32LSB: info->bitsPerSample = 32; info->isFloat = false; break;
+		case ASIOSTFloat32LSB: info->bitsPerSample = 32; info->isFloat = true; break;
+		default: return false;
+	}
+	if (info->channels <= 0 || info->channels > 0xFFFF)
+		return false;
+	unsigned char header[WAV_HEADER_BYTES];
+	info->dataOffset = WAV_HEADER_BYTES;
+	info->dataBytes = 0;
+	info->frames = 0;
+	buildHeader(header, info);
+	return fileSeek(file, 0) == 0 && fwrite(header, 1, WAV_HEADER_BYTES, file) == WAV_HEADER_BYTES;
+}
+
+bool wavFinishHeader(FILE *file, const WavInfo *info){
+	unsigned char header[WAV_HEADER_BYTES];
+	buildHeader(header, info);
+	// the data chunk gets padded to an even size
+	if (info->dataBytes & 1){
+		unsigned char pad = 0;
+		if (fileSeek(file, info->dataOffset + info->dataBytes) != 0 || fwrite(&pad, 1, 1, file) != 1)
+			return false;
+	}
+	return fileSeek(file, 0) == 0 && fwrite(header, 1, WAV_HEADER_BYTES, file) == WAV_HEADER_BYTES && fflush(file) == 0;
+}
+
+bool wavReadHeader(FILE *file, WavInfo *info){
+	unsigned char chunk[12];
+	memset(info, 0, sizeof(WavInfo));
+	info->type = -1;
+	if (fileSeek(file, 0) != 0 || fread(chunk, 1, 12, file) != 12)
+		return false;
+	bool rf64 = memcmp(chunk, "RF64", 4) == 0;
+	if ((!rf64 && memcmp(chunk, "RIFF", 4) != 0) || memcmp(chunk + 8, "WAVE", 4) != 0)
+		return false;
+
+	uint64_t offset = 12;
+	uint64_t dataSize64 = 0;
+	bool haveFormat = false;
+	for (;;){
+		unsigned char header[8];
+		if (fileSeek(file, offset) != 0 || fread(header, 1, 8, file) != 8)
+			return false;
+		uint64_t size = le32(header + 4);
+		if (memcmp(header, "ds64", 4) == 0){
+			// RF64 keeps the real sizes here, the 32 bit fields are all 0xFFFFFFFF
+			unsigned char ds64[24];
+			if (fread(ds64, 1, 24, file) != 24)
+				return false;
+			dataSize64 = le64(ds64 + 8);
+		}
+		else if (memcmp(header, "fmt ", 4) == 0){
+			unsigned char fmt[40];
+			size_t want = size < sizeof(fmt) ? (size_t)size : sizeof(fmt);
+			if (want < 16 || fread(fmt, 1, want, file) != want)
+				return false;
+			int tag = fmt[0] | (fmt[1] << 8);
+			// extensible keeps the real format in the first two bytes of the sub format GUID
+			if (tag == WAVE_FORMAT_EXTENSIBLE && want >= 26)
+				tag = fmt[24] | (fmt[25] << 8);
+			info->channels = fmt[2] | (fmt[3] << 8);
+			info->sampleRate = le32(fmt + 4);
+			info->bitsPerSample = fmt[14] | (fmt[15] << 8);
+			info->isFloat = tag == WAVE_FORMAT_IEEE_FLOAT;
+			if (tag != WAVE_FORMAT_PCM && tag != WAVE_FORMAT_IEEE_FLOAT)
+				return false;
+			haveFormat = true;
+		}
+		else if (memcmp(header, "data", 4) == 0){
+			if (!haveFormat || info->channels <= 0)
+				return false;
+			info->dataOffset = offset + 8;
+			info->dataBytes = (rf64 && size == 0xFFFFFFFFu) ? dataSize64 : size;
+			break;
+		}
+		// chunks are padded to an even size
+		offset += 8 + size + (size & 1);
+	}
+
+	if (info->isFloat && info->bitsPerSample == 32)
+		info->type = ASIOSTFloat32LSB;
+	else if (info->isFloat && info->bitsPerSample == 64)
+		info->type = ASIOSTFloat64LSB;
+	else if (!info->isFloat && info->bitsPerSample == 16)
+		info->type = ASIOSTInt16LSB;
+	else if (!info->isFloat && info->bitsPerSample == 24)
+		info->type = ASIOSTInt24LSB;
+	else if (!info->isFloat && info->bitsPerSample == 32)
+		info->type = ASIOSTInt32LSB;
+	else
+		return false;
+	info->frames = info->dataBytes / (info->channels * (info->bitsPerSample / 8));
+	return fileSeek(file, info->dataOffset) == 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __WavFile__
+#define __WavFile__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "asiosys.h"
+#include "asio.h"
+
+// What we need to know about a WAV (or RF64, for files past 4GB) to stream its samples.
+// Samples are always interleaved little endian, so they map onto an LSB ASIO type
+// and the conversion kernels can read them directly.
+typedef struct WavInfo{
+	int channels;
+	double sampleRate;
+	int bitsPerSample;
+	bool isFloat;
+	ASIOSampleType type;	// matching ASIO type, -1 if we can't convert it
+	uint64_t dataOffset;	// where the first sample starts
+	uint64_t dataBytes;
+	uint64_t frames;
+}WavInfo;
+
+// parses the header and leaves the file at the first sample, false if it isn't a WAV we can read
+bool wavReadHeader(FILE *file, WavInfo *info);
+
+// Writing: wavWriteHeader() puts a header for info's format with room to become RF64
+// and leaves the file at the first sample (dataOffset gets set), wavFinishHeader()
+// fills in the sizes for info->dataBytes afterwards, switching to RF64 past 4GB.
+// type must be one of Int16/24/32LSB or Float32LSB.
+bool wavWriteHeader(FILE *file, WavInfo *info);
+bool wavFinishHeader(FILE *file, const WavInfo *info);
+
+// 64 bit safe seeking
+int fileSeek(FILE *file, uint64_t offset);
+uint64_t fileSize(FILE *file);
+
+#endif
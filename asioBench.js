@@ -0,0 +1,164 @@
+// End to end benchmark of the init -> start -> callback -> output path on the virtual device,
+// no hardware needed. Sweeps block sizes, channel counts and sample types and prints JSON.
+// With --offline every run renders --seconds of audio as fast as it goes instead, and reports
+// blocks per second.
+//
+//   node --expose-gc asioBench.js [--blocks 32,64,...] [--channels 1,2,...] [--types int16,...]
+//                                 [--seconds 2] [--rate 48000] [--format native|float32]
+//                                 [--source loopback] [--offline] [--out results.json]
+const nodeAsio = require('./build/Release/nodeAudioAsio'),
+      fs       = require('fs'),
+      os       = require('os')
+
+let perfHooks = null
+try { perfHooks = require('perf_hooks') } catch (e) {}
+
+const bitsOf = { int16: 16, int24: 24, int32: 32, float32: 32 }
+
+function option (name, fallback) {
+  const i = process.argv.indexOf('--' + name)
+  return i > 0 && i + 1 < process.argv.length ? process.argv[i + 1] : fallback
+}
+function listOption (name, fallback) {
+  return option(name, fallback).split(',').filter(v => v.length)
+}
+
+const settings = {
+  blocks: listOption('blocks', '32,64,128,256,512,1024,2048,4096').map(Number),
+  channels: listOption('channels', '1,2,8,32,128').map(Number),
+  types: listOption('types', 'int16,int24,int32,float32'),
+  seconds: Number(option('seconds', '2')),
+  sampleRate: Number(option('rate', '48000')),
+  format: option('format', 'native'),
+  source: option('source', 'loopback'),
+  offline: process.argv.indexOf('--offline') > 0
+}
+
+function range (n) {
+  const r = []
+  for (let i = 0; i < n; i++) r.push(i)
+  return r
+}
+
+function heapUsed () {
+  return process.memoryUsage().heapUsed
+}
+
+// one init/start/stop/deInit cycle, resolves with what we measured
+function run (samplesPerBlock, channels, type) {
+  return new Promise(resolve => {
+    const result = { samplesPerBlock, channels, type }
+    let finish = null
+    const virtual = { source: settings.source, sampleType: type }
+    if (settings.offline) {
+      virtual.offline = true
+      virtual.seconds = settings.seconds
+      virtual.done = () => finish()
+    }
+    const err = nodeAsio.init({
+      driver: 'Virtual',
+      sampleRate: settings.sampleRate,
+      bitsPerSample: bitsOf[type],
+      samplesPerBlock,
+      endianess: 'little',
+      inputChannels: range(channels),
+      outputChannels: range(channels),
+      sampleFormat: settings.format,
+      virtual
+    })
+    if (err !== -1) {
+      result.error = err
+      nodeAsio.deInit()
+      return resolve(result)
+    }
+
+    let callbacks = 0,
+        gcCount = 0,
+        gcMillis = 0,
+        allocated = 0,
+        lastHeap = 0
+    const observer = perfHooks && perfHooks.PerformanceObserver ? new perfHooks.PerformanceObserver(list => {
+      list.getEntries().forEach(entry => { gcCount++; gcMillis += entry.duration })
+    }) : null
+
+    // the heap only shrinks in a GC, so summing the growth between samples
+    // gives (an upper bound of) what got allocated, sampling included
+    const sampleHeap = () => {
+      const now = heapUsed()
+      if (now > lastHeap) allocated += now - lastHeap
+      lastHeap = now
+    }
+
+    if (global.gc) global.gc()
+    if (observer) observer.observe({ entryTypes: ['gc'] })
+    lastHeap = heapUsed()
+    const heapTimer = setInterval(sampleHeap, 20)
+    const cpuStart = process.cpuUsage()
+
+    nodeAsio.start(null, function (bufs, dropped, generation, outs) {
+      for (let i = 0; i < outs.length; i++) outs[i].set(bufs[i])
+      callbacks++
+    })
+    nodeAsio.resetStats()
+
+    finish = () => {
+      const stats = nodeAsio.stats()
+      const cpu = process.cpuUsage(cpuStart)
+      nodeAsio.stop()
+      clearInterval(heapTimer)
+      sampleHeap()
+      if (observer) observer.disconnect()
+      nodeAsio.deInit()
+
+      const blocks = stats.blocks || 1
+      result.blocks = stats.blocks
+      result.callbacks = callbacks
+      result.droppedBlocks = stats.droppedBlocks
+      result.missedDeadlines = stats.missedDeadlines
+      result.outputUnderruns = stats.outputUnderruns
+      result.outputOverflows = stats.outputOverflows
+      result.blockPeriodMicros = stats.blockPeriod
+      result.convert = stats.convert
+      result.cpuMicrosPerBlock = {
+        user: cpu.user / blocks,
+        system: cpu.system / blocks
+      }
+      result.allocatedBytesPerBlock = allocated / blocks
+      result.gc = observer ? { count: gcCount, millis: gcMillis } : null
+      result.latency = stats.latency
+      result.offline = stats.offline
+      resolve(result)
+    }
+    if (!settings.offline) setTimeout(finish, settings.seconds * 1000)
+  })
+}
+
+function main () {
+  const report = {
+    node: process.version,
+    platform: os.platform() + ' ' + os.arch(),
+    cpu: os.cpus()[0] ? os.cpus()[0].model : '',
+    exposedGc: !!global.gc,
+    settings,
+    results: []
+  }
+  const configs = []
+  settings.types.forEach(type => settings.channels.forEach(channels =>
+    settings.blocks.forEach(samplesPerBlock => configs.push([samplesPerBlock, channels, type]))))
+
+  // one after the other, there's only one device
+  configs.reduce((previous, config) => previous.then(() => run.apply(null, config).then(result => {
+    process.stderr.write(`${result.type} ${result.channels}ch ${result.samplesPerBlock} frames: ` +
+      (result.error !== undefined ? `init failed (${result.error})` : settings.offline
+        ? `${result.offline.blocksPerSecond.toFixed(0)} blocks/s, ${result.offline.speed.toFixed(1)}x real time`
+        : `p99 dispatch ${result.latency.dispatch.p99.toFixed(1)}us, dropped ${result.droppedBlocks}`) + '\n')
+    report.results.push(result)
+  })), Promise.resolve()).then(() => {
+    const json = JSON.stringify(report, null, 2)
+    const out = option('out', '')
+    if (out) fs.writeFileSync(out, json)
+    else process.stdout.write(json + '\n')
+  })
+}
+
+main()
@@ -2,9 +2,18 @@
 	"targets": [
 		{
 			"target_name": "nodeAudioAsio",
-			"sources": [ "./host/pc/asiolist.cpp", "./host/asiodrivers.cpp", "./common/asio.cpp", "Source.cpp" ],
+			"sources": [ "AsioBackend.cpp", "WavFile.cpp", "VirtualDevice.cpp", "Recorder.cpp", "Player.cpp", "Analyzer.cpp", "Resampler.cpp", "Bridge.cpp", "RateConverter.cpp", "SharedRing.cpp", "BlockPool.cpp", "DeviceProbe.cpp", "Realtime.cpp", "Trace.cpp", "SampleConvert.cpp", "DspGraph.cpp", "Stats.cpp", "Source.cpp" ],
 			"include_dirs": [ "asio", "build", "common", "driver", "host", "host/pc", "<!(node -e \"require('nan')\")"],
-		
+			"conditions": [
+				[ "OS=='win'", {
+					"sources": [ "./host/pc/asiolist.cpp", "./host/asiodrivers.cpp", "./common/asio.cpp" ],
+					"libraries": [ "avrt.lib" ]
+				}],
+				[ "OS=='linux'", {
+					"defines": [ "LINUX=1" ],
+					"libraries": [ "-lpthread", "-lrt" ]
+				}]
+			]
 		}
 	],
 
@@ -0,0 +1,125 @@
+#include <uv.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+#include "Check.h"
+#include "Analyzer.h"
+
+// Meters, spectrum and loudness of a known signal, fed the way the driver thread does: one
+// capture() per block with the current halves. A 1kHz sine, BS.1770's reference, on the first
+// channel and silence on the second. 1kHz is in the middle of an FFT bin at this rate.
+
+#define RATE 32000.
+#define FRAMES 256
+#define FFT 1024
+#define BIN 32
+#define AMPLITUDE 0.5
+#define SECONDS 4
+#define TWO_PI (2. * 3.14159265358979323846)
+
+static std::atomic<int> published(0);
+
+static void countSnapshot(void *){
+	published.fetch_add(1);
+}
+
+static void testErrors(){
+	Analyzer analyzer;
+	ASIOSampleType types[2] = { ASIOSTFloat32LSB, ASIOSTDSDInt8LSB1 };
+	AnalyzerOptions options;
+	options.rate = 10;
+	options.fftSize = FFT;
+	options.bufferSeconds = 1;
+	options.channels.push_back(2);
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, NULL, NULL) == -2);
+	// nothing to convert DSD with
+	options.channels[0] = 1;
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, NULL, NULL) == -2);
+	options.channels[0] = 0;
+	options.fftSize = 1000;
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, NULL, NULL) == -3);
+	options.fftSize = FFT;
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, NULL, NULL) == 0);
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, NULL, NULL) == -1);
+	analyzer.close();
+	CHECK(analyzer.snapshotLength() == 0);
+}
+
+static void testSine(){
+	Analyzer analyzer;
+	ASIOSampleType types[2] = { ASIOSTFloat32LSB, ASIOSTFloat32LSB };
+	AnalyzerOptions options;
+	options.channels.push_back(0);
+	options.channels.push_back(1);
+	options.rate = 10;
+	options.fftSize = FFT;
+	options.bufferSeconds = SECONDS + 2;	// room for all of it, however slow the analysis thread is
+	CHECK(analyzer.open(options, types, 2, FRAMES, RATE, countSnapshot, NULL) == 0);
+	long length = analyzer.snapshotLength();
+	CHECK(length == ANALYSIS_HEADER + 2 * ANALYSIS_METERS + 2 * FFT / 2);
+
+	std::vector<float> sine(FRAMES), silence(FRAMES, 0.f);
+	void *halves[2] = { &sine[0], &silence[0] };
+	double frequency = BIN * RATE / FFT;
+	long blocks = (long)(SECONDS * RATE / FRAMES);
+	for (long b = 0; b < blocks; b++){
+		for (long n = 0; n < FRAMES; n++)
+			sine[n] = (float)(AMPLITUDE * sin(TWO_PI * frequency * (b * FRAMES + n) / RATE));
+		analyzer.capture(halves);
+	}
+	// one after every block that makes RATE / rate samples since the last
+	int expected = (int)(blocks / (long)ceil(RATE / options.rate / FRAMES));
+	for (int wait = 0; wait < 5000 && published.load() < expected; wait++)
+		usleep(1000);
+	CHECK(published.load() == expected);
+
+	std::vector<float> snapshot(length);
+	CHECK(analyzer.read(&snapshot[0]));
+	AnalyzerStats stats;
+	analyzer.stats(&stats);
+	CHECK(stats.running);
+	CHECK(stats.snapshots == (uint64_t)expected);
+	CHECK(stats.overruns == 0);
+	analyzer.close();
+
+	CHECK(snapshot[0] == expected);
+	CHECK(snapshot[1] == 2);
+	CHECK(snapshot[2] == FFT / 2);
+	CHECK(snapshot[6] == (float)(RATE / FFT));
+	CHECK(snapshot[7] == 0);
+	// BS.1770: a full scale sine on one channel is -3.01 LUFS, this one is 6.02 dB below that
+	double lufs = -3.01 + 20 * log10(AMPLITUDE);
+	CHECK_NEAR(snapshot[3], lufs, 0.1);
+	CHECK_NEAR(snapshot[4], lufs, 0.1);
+	CHECK_NEAR(snapshot[5], lufs, 0.1);
+
+	const float *meters = &snapshot[ANALYSIS_HEADER];
+	CHECK_NEAR(meters[0], AMPLITUDE, 0.001);
+	// between the samples it doesn't get any higher, the oversampled peak finds the same
+	CHECK(meters[1] >= meters[0] * 0.999f);
+	CHECK_NEAR(meters[1], AMPLITUDE, 0.01);
+	CHECK_NEAR(meters[2], AMPLITUDE / sqrt(2.), 0.001);
+	CHECK(meters[3] == 0 && meters[4] == 0 && meters[5] == 0);
+
+	// all of it in one bin, scaled so a full scale sine is 1
+	const float *bins = &snapshot[ANALYSIS_HEADER + 2 * ANALYSIS_METERS];
+	long loudest = 0;
+	for (long k = 1; k < FFT / 2; k++)
+		if (bins[k] > bins[loudest])
+			loudest = k;
+	CHECK(loudest == BIN);
+	CHECK_NEAR(bins[BIN], AMPLITUDE, 0.01);
+	CHECK(bins[BIN + 4] < AMPLITUDE * 0.01f);
+	float silent = 0;
+	for (long k = 0; k < FFT / 2; k++)
+		silent = fmaxf(silent, bins[FFT / 2 + k]);
+	CHECK(silent == 0);
+}
+
+int main(){
+	testErrors();
+	testSine();
+	return checkResult("AnalyzerTest");
+}
@@ -0,0 +1,234 @@
+#include <uv.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <vector>
+#include "Check.h"
+#include "RingBuffer.h"
+#include "BlockPool.h"
+
+// A synthetic producer thread standing in for the driver: it fills blocks with a sequence number
+// and hands them over the way bufferSwitchTimeInfo does, the loop takes them out on uv_async
+// wakeups the way BlockAsyncComplete does.
+
+#define BLOCKS 20000
+#define BURST 8
+
+//----------------------------------------------------------------------------------
+// BlockRing, one producer and one consumer
+
+typedef struct RingRun{
+	BlockRing ring;
+}RingRun;
+
+static void ringProducer(void *arg){
+	RingRun *run = (RingRun *)arg;
+	for (uint64_t n = 0; n < BLOCKS; n++){
+		char *slot;
+		while (!(slot = run->ring.writeSlot()))
+			sched_yield();
+		// the whole slot, so a torn block shows up as well as a lost one
+		uint64_t *words = (uint64_t *)slot;
+		for (size_t i = 0; i < run->ring.blockBytes() / sizeof(uint64_t); i++)
+			words[i] = n;
+		run->ring.commit();
+	}
+}
+
+static void testRingOrder(){
+	RingRun run;
+	CHECK(run.ring.allocate(5, 256));
+	CHECK(run.ring.capacity() == 8);
+	uv_thread_t thread;
+	uv_thread_create(&thread, ringProducer, &run);
+	uint64_t expected = 0;
+	bool ordered = true, whole = true;
+	while (expected < BLOCKS){
+		char *slot = run.ring.readSlot();
+		if (!slot){
+			// on a single core the producer only gets on when we let go
+			sched_yield();
+			continue;
+		}
+		const uint64_t *words = (const uint64_t *)slot;
+		ordered = ordered && words[0] == expected;
+		for (size_t i = 1; i < run.ring.blockBytes() / sizeof(uint64_t); i++)
+			whole = whole && words[i] == words[0];
+		run.ring.consume();
+		expected++;
+	}
+	uv_thread_join(&thread);
+	CHECK(ordered);
+	CHECK(whole);
+	CHECK(run.ring.pending() == 0);
+	CHECK(run.ring.readSlot() == NULL);
+}
+
+static void testRingFull(){
+	// a consumer that doesn't read: the producer finds no slot once all of them wait, the driver
+	// drops the block then
+	BlockRing ring;
+	ring.allocate(4, 64);
+	uint64_t dropped = 0;
+	for (uint64_t n = 0; n < 10; n++){
+		char *slot = ring.writeSlot();
+		if (!slot){
+			dropped++;
+			continue;
+		}
+		*(uint64_t *)slot = n;
+		ring.commit();
+	}
+	CHECK(dropped == 6);
+	CHECK(ring.pending() == 4);
+	// the oldest four are there, in order
+	for (uint64_t n = 0; n < 4; n++){
+		char *slot = ring.readSlot();
+		CHECK(slot && *(uint64_t *)slot == n);
+		ring.consume();
+	}
+	CHECK(ring.writeSlot() != NULL);
+}
+
+//----------------------------------------------------------------------------------
+// BlockPool, a producer thread publishing to two subscribers the loop drains on wakeups
+
+typedef struct PoolRun{
+	BlockPool pool;
+	uv_async_t async;
+	int fast;					// takes everything on every wakeup
+	int slow;					// takes one block per wakeup, falls behind
+	std::atomic<bool> done;
+	std::atomic<uint64_t> published;
+	uint64_t noSlot;			// blocks the producer found no free slot for
+	uint64_t wakeups;
+	std::vector<uint64_t> seen[2];
+}PoolRun;
+
+static void poolProducer(void *arg){
+	PoolRun *run = (PoolRun *)arg;
+	for (uint64_t n = 0; n < BLOCKS; n++){
+		char *slot = run->pool.acquire();
+		if (!slot){
+			run->noSlot++;
+			continue;
+		}
+		*(uint64_t *)slot = n;
+		run->pool.publish();
+		run->published.fetch_add(1, std::memory_order_relaxed);
+		// bursts of BURST blocks a wakeup, more than the slow subscriber's queue holds
+		if (n % BURST == BURST - 1){
+			uv_async_send(&run->async);
+			sched_yield();
+		}
+	}
+	run->done.store(true, std::memory_order_release);
+	uv_async_send(&run->async);
+}
+
+static void drain(PoolRun *run, int id, int index, long most){
+	long slot;
+	for (long taken = 0; (most < 0 || taken < most) && (slot = run->pool.take(id)) >= 0; taken++){
+		run->seen[index].push_back(*(uint64_t *)run->pool.slot(slot));
+		run->pool.release(slot);
+	}
+}
+
+static void poolWakeup(uv_async_t *handle){
+	PoolRun *run = (PoolRun *)handle->data;
+	run->wakeups++;
+	bool done = run->done.load(std::memory_order_acquire);
+	drain(run, run->fast, 0, -1);
+	drain(run, run->slow, 1, done ? -1 : 1);
+	if (done && run->pool.idle())
+		uv_close((uv_handle_t *)handle, NULL);
+}
+
+static bool ascending(const std::vector<uint64_t> &sequence){
+	for (size_t i = 1; i < sequence.size(); i++)
+		if (sequence[i] <= sequence[i - 1])
+			return false;
+	return true;
+}
+
+static void testPool(){
+	uv_loop_t loop;
+	uv_loop_init(&loop);
+	PoolRun run;
+	run.done = false;
+	run.published = 0;
+	run.noSlot = 0;
+	run.wakeups = 0;
+	CHECK(run.pool.allocate(16, 128));
+	run.fast = run.pool.attach(8, false);
+	run.slow = run.pool.attach(4, false);
+	CHECK(run.fast >= 0 && run.slow >= 0);
+	// there is no room for a third one this size
+	CHECK(run.pool.attach(8, false) == -1);
+	uv_async_init(&loop, &run.async, poolWakeup);
+	run.async.data = &run;
+
+	uv_thread_t thread;
+	uv_thread_create(&thread, poolProducer, &run);
+	uv_run(&loop, UV_RUN_DEFAULT);
+	uv_thread_join(&thread);
+	uv_loop_close(&loop);
+
+	PoolSubscriberStats fast, slow;
+	run.pool.stats(run.fast, &fast);
+	run.pool.stats(run.slow, &slow);
+	// the loop got woken up, sends piling up before it ran collapsed into fewer wakeups
+	CHECK(run.wakeups > 0);
+	CHECK(run.wakeups <= run.published.load() + 1);
+	// attach() keeps enough slots back that the producer always found one
+	CHECK(run.noSlot == 0);
+	CHECK(run.published.load() == BLOCKS);
+	// every block either arrived, in order, or is counted as lost
+	CHECK(ascending(run.seen[0]));
+	CHECK(ascending(run.seen[1]));
+	CHECK(fast.delivered + fast.lost == BLOCKS);
+	CHECK(slow.delivered + slow.lost == BLOCKS);
+	CHECK(run.seen[0].size() == fast.delivered);
+	CHECK(run.seen[1].size() == slow.delivered);
+	// taking one block a wakeup doesn't keep up with bursts twice its queue
+	CHECK(slow.lost > 0);
+	CHECK(!slow.dropped);
+	CHECK(run.pool.idle());
+}
+
+static void testDropSlow(){
+	// a dropSlow subscriber that stops taking is cut off, the other one keeps getting everything
+	BlockPool pool;
+	pool.allocate(12, 64);
+	int keeper = pool.attach(4, false);
+	int stuck = pool.attach(2, true);
+	for (uint64_t n = 0; n < 100; n++){
+		char *slot = pool.acquire();
+		CHECK(slot != NULL);
+		if (!slot)
+			break;
+		*(uint64_t *)slot = n;
+		pool.publish();
+		long taken = pool.take(keeper);
+		CHECK(taken >= 0 && *(uint64_t *)pool.slot(taken) == n);
+		if (taken >= 0)
+			pool.release(taken);
+	}
+	CHECK(pool.dropped(stuck));
+	CHECK(!pool.dropped(keeper));
+	PoolSubscriberStats stats;
+	pool.stats(stuck, &stats);
+	CHECK(stats.delivered == 2);
+	// what it still held goes back with detach()
+	CHECK(!pool.idle());
+	pool.detach(stuck);
+	CHECK(pool.idle());
+}
+
+int main(){
+	testRingOrder();
+	testRingFull();
+	testPool();
+	testDropSlow();
+	return checkResult("BlockRingTest");
+}
@@ -0,0 +1,130 @@
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Check.h"
+#include "Bridge.h"
+
+// A stream and a device on clocks that drift apart, both simulated on one system clock so a
+// minute and a half of it runs in well under a second: the device calls process() with its
+// sample position and time stamp every block, the stream write()s 10ms packets whenever its
+// own clock has made one. The ratio has to follow the drift with nothing dropped, repeated
+// or run dry, and the fill has to stay at the target.
+
+#define RATE 48000.
+#define FRAMES 256
+#define PACKET 480
+#define LATENCY_MS 50.
+#define SECONDS 90
+#define LEVEL 0.5f
+
+static void run(double streamPpm, double devicePpm){
+	Bridge bridge;
+	BridgeOptions options;
+	options.channels = 1;
+	options.sampleRate = 0;
+	options.latencyMs = LATENCY_MS;
+	options.bufferSeconds = 1;
+	CHECK(bridge.open(options, 2, FRAMES, RATE) == 0);
+	CHECK(bridge.open(options, 2, FRAMES, RATE) == -1);
+
+	// DC, what comes out of the resampler is the same level
+	std::vector<float> packet(PACKET, LEVEL);
+	double streamRate = RATE * (1. + streamPpm * 1e-6);
+	double deviceRate = RATE * (1. + devicePpm * 1e-6);
+	uint64_t streamFrames = 0;
+	long blocks = (long)(SECONDS * deviceRate / FRAMES);
+	long played = 0;
+	bool accepted = true, level = true, silent = true;
+	// start a bit in, a time of 0 means the driver didn't say
+	double start = 1e9;
+	for (long b = 0; b < blocks; b++){
+		double position = (double)b * FRAMES;
+		double nanos = start + position / deviceRate * 1e9;
+		// every packet the stream's clock has made by now
+		while ((streamFrames + PACKET) / streamRate * 1e9 <= nanos - start){
+			streamFrames += PACKET;
+			accepted = accepted && bridge.write(&packet[0], NULL, sizeof(float), PACKET, start + streamFrames / streamRate * 1e9) == PACKET;
+		}
+		if (!bridge.process(position, nanos))
+			continue;
+		played++;
+		const float *out = bridge.output(0);
+		// once the filter has filled, and the second output isn't played on at all
+		for (long n = 0; played > 2 && n < FRAMES; n++)
+			level = level && fabsf(out[n] - LEVEL) < 1e-3f;
+		silent = silent && bridge.output(1) == NULL;
+	}
+	CHECK(accepted);
+	CHECK(level);
+	CHECK(silent);
+
+	BridgeStats stats;
+	bridge.stats(&stats);
+	// buffered up to the target once and played from then on
+	CHECK(stats.open && stats.running);
+	CHECK(stats.underruns == 0);
+	CHECK(stats.framesDropped == 0);
+	CHECK(stats.framesWritten == streamFrames);
+	CHECK(played > blocks - (long)(LATENCY_MS / 1000. * deviceRate / FRAMES) - 2);
+	// both clocks measured, to within what the packets quantize
+	CHECK_NEAR(stats.streamPpm, streamPpm, 5);
+	CHECK_NEAR(stats.devicePpm, devicePpm, 5);
+	// the ratio follows the drift, the loop only trims what the fill is off
+	CHECK_NEAR(stats.driftPpm, (streamRate / deviceRate - 1.) * 1e6, 30);
+	CHECK_NEAR(stats.fill, LATENCY_MS, LATENCY_MS * 0.1);
+	CHECK(stats.target == LATENCY_MS);
+	printf("  %+.0f/%+.0f ppm: drift %+.1f ppm, fill %.2f ms\n", streamPpm, devicePpm, stats.driftPpm, stats.fill);
+	bridge.close();
+	bridge.stats(&stats);
+	CHECK(!stats.open && !stats.running);
+}
+
+static void testUnderrun(){
+	// a stream that stops: silence, one underrun, then buffering up to the target again
+	Bridge bridge;
+	BridgeOptions options;
+	options.channels = 2;
+	options.outputs.push_back(1);
+	options.outputs.push_back(-1);
+	options.sampleRate = 0;
+	options.latencyMs = LATENCY_MS;
+	options.bufferSeconds = 1;
+	CHECK(bridge.open(options, 2, FRAMES, RATE) == 0);
+	std::vector<float> packet(PACKET * 2, LEVEL);
+	double nanos = 1e9;
+	for (int p = 0; p < 10; p++)
+		bridge.write(&packet[0], NULL, sizeof(float), PACKET, nanos);
+	long played = 0;
+	for (long b = 0; b < 40; b++)
+		if (bridge.process((double)b * FRAMES, nanos + b * FRAMES / RATE * 1e9)){
+			played++;
+			CHECK(bridge.output(0) == NULL && bridge.output(1) != NULL);
+		}
+	BridgeStats stats;
+	bridge.stats(&stats);
+	// 4800 frames is 18 blocks and a bit, the filter keeps back half its taps
+	CHECK(played == 18);
+	CHECK(stats.underruns == 1);
+	CHECK(!stats.running);
+	// bad options
+	Bridge other;
+	options.channels = 0;
+	CHECK(other.open(options, 2, FRAMES, RATE) == -2);
+	options.channels = 1;
+	options.outputs.clear();
+	options.outputs.push_back(2);
+	CHECK(other.open(options, 2, FRAMES, RATE) == -2);
+	options.outputs.clear();
+	options.latencyMs = 0;
+	CHECK(other.open(options, 2, FRAMES, RATE) == -3);
+}
+
+int main(){
+	initSampleConvert();
+	// a stream 300ppm fast, one 250ppm slow on a device 100ppm fast, and both exactly nominal
+	run(300, 0);
+	run(-250, 100);
+	run(0, 0);
+	testUnderrun();
+	return checkResult("BridgeTest");
+}
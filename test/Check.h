@@ -0,0 +1,40 @@
+#ifndef __Check__
+#define __Check__
+
+#include <stdio.h>
+#include <math.h>
+
+// Just enough of a test framework for the native parts. CHECK() counts a failure, says where it
+// happened and goes on, so one run shows everything that's off; main() returns checkResult().
+
+static int checkCount = 0;
+static int checkFailures = 0;
+
+static inline bool checkThat(bool ok, const char *what, const char *file, int line){
+	checkCount++;
+	if (!ok){
+		checkFailures++;
+		printf("%s:%d: failed: %s\n", file, line, what);
+	}
+	return ok;
+}
+
+static inline bool checkNear(double a, double b, double tolerance, const char *what, const char *file, int line){
+	checkCount++;
+	if (!(fabs(a - b) <= tolerance)){
+		checkFailures++;
+		printf("%s:%d: failed: %s (%g and %g, more than %g apart)\n", file, line, what, a, b, tolerance);
+		return false;
+	}
+	return true;
+}
+
+#define CHECK(condition) checkThat((condition), #condition, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tolerance) checkNear((double)(a), (double)(b), (double)(tolerance), #a " ~ " #b, __FILE__, __LINE__)
+
+static inline int checkResult(const char *name){
+	printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+	return checkFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <uv.h>
+#include <string.h>
+#include <unistd.h>
+#include "Check.h"
+#include "DeviceProbe.h"
+#include "VirtualDevice.h"
+
+// Capability probing of the virtual driver, and the cache in front of it the way probe() uses
+// it: a cached result unless refresh is set, a fresh probe otherwise. A probe that finds the
+// device loaded says busy and leaves the cache alone.
+
+static void configure(long inputs, long outputs, ASIOSampleType type, bool fixedRate){
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.inputs = inputs;
+	config.outputs = outputs;
+	config.sampleType = type;
+	config.fixedRate = fixedRate;
+	config.sampleRate = 44100.;
+	configureVirtualDevice(config);
+}
+
+// what probeWork() does for one name
+static bool capabilities(const std::string &name, bool refresh, DriverCapabilities *out){
+	bool cached = !refresh && cachedCapabilities(name, out);
+	if (!cached)
+		probeDriver(name, out);
+	return cached;
+}
+
+static void testNames(){
+	std::vector<std::string> names = driverNames();
+	CHECK(!names.empty() && names[0] == VIRTUAL_DRIVER_NAME);
+}
+
+static void testProbe(){
+	clearCapabilities();
+	DriverCapabilities probed;
+	CHECK(!cachedCapabilities(VIRTUAL_DRIVER_NAME, &probed));
+	configure(4, 6, ASIOSTInt32LSB, false);
+	CHECK(!capabilities(VIRTUAL_DRIVER_NAME, false, &probed));
+	CHECK(probed.error == kProbeOk);
+	CHECK(probed.name == VIRTUAL_DRIVER_NAME);
+	CHECK(probed.inputs == 4 && probed.outputs == 6);
+	CHECK(probed.inputChannels.size() == 4 && probed.outputChannels.size() == 6);
+	bool typed = true;
+	for (size_t c = 0; c < probed.inputChannels.size(); c++)
+		typed = typed && probed.inputChannels[c].type == ASIOSTInt32LSB;
+	for (size_t c = 0; c < probed.outputChannels.size(); c++)
+		typed = typed && probed.outputChannels[c].type == ASIOSTInt32LSB;
+	CHECK(typed);
+	CHECK(probed.minSize > 0 && probed.minSize <= probed.preferredSize && probed.preferredSize <= probed.maxSize);
+	CHECK(probed.sampleRate == 44100.);
+	// any of the common rates, 8k to 384k
+	CHECK(probed.sampleRates.size() == 13);
+	CHECK(probed.probedAt > 0);
+
+	// the driver changed, without refresh the cache still says what it was
+	configure(1, 2, ASIOSTFloat32LSB, true);
+	usleep(2000);
+	DriverCapabilities cached;
+	CHECK(capabilities(VIRTUAL_DRIVER_NAME, false, &cached));
+	CHECK(cached.probedAt == probed.probedAt);
+	CHECK(cached.inputs == 4 && cached.outputs == 6);
+
+	// refresh probes again and the cache keeps the new result
+	DriverCapabilities refreshed;
+	CHECK(!capabilities(VIRTUAL_DRIVER_NAME, true, &refreshed));
+	CHECK(refreshed.error == kProbeOk);
+	CHECK(refreshed.probedAt > probed.probedAt);
+	CHECK(refreshed.inputs == 1 && refreshed.outputs == 2);
+	CHECK(refreshed.outputChannels.size() == 2 && refreshed.outputChannels[1].type == ASIOSTFloat32LSB);
+	// locked to its own clock
+	CHECK(refreshed.sampleRates.size() == 1 && refreshed.sampleRates[0] == 44100.);
+	CHECK(cachedCapabilities(VIRTUAL_DRIVER_NAME, &cached));
+	CHECK(cached.probedAt == refreshed.probedAt && cached.inputs == 1);
+}
+
+static void testBusy(){
+	configure(2, 2, ASIOSTInt24LSB, false);
+	DriverCapabilities probed, busy, cached;
+	CHECK(probeDriver(VIRTUAL_DRIVER_NAME, &probed) == kProbeOk);
+	{
+		// init() has the virtual device loaded
+		DriverLock lock;
+		driverLoaded(VIRTUAL_DRIVER_NAME);
+	}
+	CHECK(probeDriver(VIRTUAL_DRIVER_NAME, &busy) == kProbeBusy);
+	CHECK(busy.error == kProbeBusy && busy.inputs == 0);
+	// the earlier result is still there, not the busy one
+	CHECK(cachedCapabilities(VIRTUAL_DRIVER_NAME, &cached));
+	CHECK(cached.error == kProbeOk && cached.probedAt == probed.probedAt);
+	// and with nothing cached, busy doesn't get cached either
+	clearCapabilities();
+	CHECK(probeDriver(VIRTUAL_DRIVER_NAME, &busy) == kProbeBusy);
+	CHECK(!cachedCapabilities(VIRTUAL_DRIVER_NAME, &cached));
+	{
+		DriverLock lock;
+		driverUnloaded();
+	}
+	CHECK(probeDriver(VIRTUAL_DRIVER_NAME, &probed) == kProbeOk);
+	CHECK(cachedCapabilities(VIRTUAL_DRIVER_NAME, &cached) && cached.error == kProbeOk);
+}
+
+static void testUnsupported(){
+	// no SDK host code on Linux, answered without loading anything so there's nothing to keep
+	clearCapabilities();
+	DriverCapabilities probed, cached;
+	CHECK(probeDriver("Some Interface", &probed) == kProbeUnsupported);
+	CHECK(probed.name == "Some Interface" && probed.probedAt > 0);
+	CHECK(!cachedCapabilities("Some Interface", &cached));
+}
+
+int main(){
+	initDeviceProbe();
+	testNames();
+	testProbe();
+	testBusy();
+	testUnsupported();
+	return checkResult("DeviceProbeTest");
+}
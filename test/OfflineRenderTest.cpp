@@ -0,0 +1,259 @@
+#include <uv.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+#include "Check.h"
+#include "VirtualDevice.h"
+#include "SampleConvert.h"
+#include "WavFile.h"
+#include "Stats.h"
+
+// The headless render harness: a WAV goes in through the virtual device's file source, a chain
+// processes it block by block the way the host callback does (native inputs to float, the chain,
+// float back into the native outputs) and the device writes the outputs to a WAV, as fast as it
+// goes. Two renders have to come out byte for byte the same, and the same as the chain run over
+// the whole file at once. The end of the render arrives on the loop through a uv_async, the way
+// start()'s done callback gets it.
+
+#define RATE 48000.
+#define FRAMES 256
+#define CHANNELS 2
+#define INPUT_FRAMES (1875 * FRAMES + 37)	// ten seconds and the start of a block
+
+//----------------------------------------------------------------------------------
+// the chain under test: a gain and a one pole low pass per channel, state carried across blocks
+
+typedef struct Chain{
+	float state[CHANNELS];
+}Chain;
+
+static void resetChain(Chain *chain){
+	for (int c = 0; c < CHANNELS; c++)
+		chain->state[c] = 0.f;
+}
+
+static void runChain(Chain *chain, int c, float *samples, long frames){
+	float state = chain->state[c];
+	for (long n = 0; n < frames; n++){
+		state += (0.5f * samples[n] - state) * 0.25f;
+		samples[n] = state;
+	}
+	chain->state[c] = state;
+}
+
+//----------------------------------------------------------------------------------
+// the host side
+
+typedef struct Host{
+	ASIOBufferInfo buffers[2 * CHANNELS];	// the inputs, then the outputs
+	ToFloatKernel toFloat;
+	FromFloatKernel fromFloat;
+	Chain chain;
+	float scratch[FRAMES];
+	long blocks;
+	bool timesFollow;
+	uv_async_t *done;
+	uv_timer_t timeout;		// a render that never finishes fails instead of hanging the run
+}Host;
+
+static Host host;
+
+static ASIOTime *bufferSwitchTimeInfo(ASIOTime *params, long index, ASIOBool){
+	uint64_t position = ASIO64toUInt64(params->timeInfo.samplePosition);
+	uint64_t nanos = ASIO64toUInt64(params->timeInfo.systemTime);
+	// no clock, time follows the samples and every block follows the last one
+	host.timesFollow = host.timesFollow && nanos == (uint64_t)(position / RATE * 1e9 + 0.5)
+		&& position == (uint64_t)host.blocks * FRAMES;
+	for (int c = 0; c < CHANNELS; c++){
+		host.toFloat(host.buffers[c].buffers[index], host.scratch, FRAMES);
+		runChain(&host.chain, c, host.scratch, FRAMES);
+		host.fromFloat(host.scratch, host.buffers[CHANNELS + c].buffers[index], FRAMES);
+	}
+	host.blocks++;
+	return params;
+}
+
+static ASIOCallbacks callbacks = { NULL, NULL, NULL, bufferSwitchTimeInfo };
+
+// the device thread, once the last block is through and the file is complete
+static void renderFinished(void *){
+	uv_async_send(host.done);
+}
+
+static void closeDone(uv_handle_t *handle){
+	delete (uv_async_t *)handle;
+}
+
+static void renderDone(uv_async_t *handle){
+	uv_close((uv_handle_t *)handle, closeDone);
+	uv_close((uv_handle_t *)&host.timeout, NULL);
+}
+
+static void renderTimeout(uv_timer_t *){
+	printf("  render didn't finish\n");
+	// nothing sends to the handle once the device thread is gone
+	virtualBackend.stop();
+	renderDone(host.done);
+}
+
+//----------------------------------------------------------------------------------
+
+static uint32_t seed = 1;
+static uint32_t nextRandom(){
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// noise on the first channel, a sine on the second, in 24 bits
+static bool writeInput(const char *path, std::vector<float> *samples){
+	samples->resize((size_t)INPUT_FRAMES * CHANNELS);
+	for (size_t i = 0; i < (size_t)INPUT_FRAMES; i++){
+		(*samples)[i * CHANNELS] = ((float)(nextRandom() >> 8) / (float)(1 << 24)) * 1.6f - 0.8f;
+		(*samples)[i * CHANNELS + 1] = (float)(0.7 * sin(2. * 3.14159265358979323846 * 1000. * i / RATE));
+	}
+	std::vector<unsigned char> native(samples->size() * 3);
+	getFromFloat(ASIOSTInt24LSB)(&(*samples)[0], &native[0], (long)samples->size());
+	// what the device reads back out of it
+	getToFloat(ASIOSTInt24LSB)(&native[0], &(*samples)[0], (long)samples->size());
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+	WavInfo info;
+	memset(&info, 0, sizeof(info));
+	info.channels = CHANNELS;
+	info.sampleRate = RATE;
+	info.type = ASIOSTInt24LSB;
+	bool written = wavWriteHeader(file, &info) && fwrite(&native[0], 1, native.size(), file) == native.size();
+	info.dataBytes = native.size();
+	info.frames = INPUT_FRAMES;
+	written = written && wavFinishHeader(file, &info);
+	fclose(file);
+	return written;
+}
+
+static bool readOutput(const char *path, WavInfo *info, std::vector<unsigned char> *data){
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+	bool read = wavReadHeader(file, info);
+	if (read){
+		data->resize((size_t)info->dataBytes);
+		read = fileSeek(file, info->dataOffset) == 0 && fread(&(*data)[0], 1, data->size(), file) == data->size();
+	}
+	fclose(file);
+	return read;
+}
+
+static bool render(const char *input, const char *output, VirtualRenderStats *stats){
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.inputs = CHANNELS;
+	config.outputs = CHANNELS;
+	config.sampleType = ASIOSTInt24LSB;
+	config.source = kVirtualFile;
+	config.file = input;
+	config.offline = true;
+	config.outputFile = output;
+	config.finished = renderFinished;
+	configureVirtualDevice(config);
+	char name[] = VIRTUAL_DRIVER_NAME;
+	ASIODriverInfo info;
+	memset(&info, 0, sizeof(info));
+	if (!virtualBackend.load(name) || virtualBackend.init(&info) != ASE_OK)
+		return false;
+	bool rendered = virtualBackend.setSampleRate(RATE) == ASE_OK;
+	for (int c = 0; c < 2 * CHANNELS; c++){
+		host.buffers[c].isInput = c < CHANNELS ? ASIOTrue : ASIOFalse;
+		host.buffers[c].channelNum = c % CHANNELS;
+		host.buffers[c].buffers[0] = host.buffers[c].buffers[1] = NULL;
+	}
+	rendered = rendered && virtualBackend.createBuffers(host.buffers, 2 * CHANNELS, FRAMES, &callbacks) == ASE_OK;
+	host.toFloat = getToFloat(ASIOSTInt24LSB);
+	host.fromFloat = getFromFloat(ASIOSTInt24LSB);
+	resetChain(&host.chain);
+	host.blocks = 0;
+	host.timesFollow = true;
+
+	uv_loop_t loop;
+	uv_loop_init(&loop);
+	host.done = new uv_async_t;
+	uv_async_init(&loop, host.done, renderDone);
+	uv_timer_init(&loop, &host.timeout);
+	if (rendered && virtualBackend.start() == ASE_OK)
+		uv_timer_start(&host.timeout, renderTimeout, 30000, 0);
+	else{
+		rendered = false;
+		renderDone(host.done);
+	}
+	uv_run(&loop, UV_RUN_DEFAULT);
+	// the device thread is done with the handle once stop() returned
+	virtualBackend.stop();
+	uv_loop_close(&loop);
+	virtualRenderStats(stats);
+	virtualBackend.disposeBuffers();
+	virtualBackend.exit();
+	virtualBackend.unload();
+	return rendered;
+}
+
+int main(){
+	initSampleConvert();
+	char input[] = "/tmp/OfflineRenderInXXXXXX", first[] = "/tmp/OfflineRenderOutXXXXXX", second[] = "/tmp/OfflineRenderOutXXXXXX";
+	char *paths[3] = { input, first, second };
+	for (int i = 0; i < 3; i++){
+		int fd = mkstemp(paths[i]);
+		if (fd >= 0)
+			close(fd);
+	}
+	std::vector<float> samples;
+	CHECK(writeInput(input, &samples));
+
+	VirtualRenderStats stats;
+	CHECK(render(input, first, &stats));
+	long blocks = (INPUT_FRAMES + FRAMES - 1) / FRAMES;
+	CHECK(stats.offline && stats.finished);
+	CHECK(stats.frames == INPUT_FRAMES && stats.framesWritten == INPUT_FRAMES);
+	CHECK(stats.blocks == (uint64_t)blocks && host.blocks == blocks);
+	CHECK(stats.writeErrors == 0);
+	CHECK(host.timesFollow);
+	// no clock to wait for, ten seconds render in a fraction of that even on a loaded machine
+	CHECK(stats.speed > 1.);
+	printf("  %ld blocks, %.0f blocks/s, %.1fx real time\n", blocks, stats.blocksPerSecond, stats.speed);
+
+	// a second render is the same, byte for byte
+	CHECK(render(input, second, &stats));
+	CHECK(stats.finished && host.timesFollow);
+	WavInfo info, again;
+	std::vector<unsigned char> data, dataAgain;
+	CHECK(readOutput(first, &info, &data));
+	CHECK(readOutput(second, &again, &dataAgain));
+	CHECK(info.channels == CHANNELS && info.sampleRate == RATE && info.type == ASIOSTInt24LSB);
+	CHECK(info.frames == INPUT_FRAMES && data.size() == (size_t)INPUT_FRAMES * CHANNELS * 3);
+	CHECK(data == dataAgain && info.frames == again.frames && info.dataOffset == again.dataOffset);
+
+	// and the same as the chain over the whole file, the blocks don't show
+	Chain chain;
+	resetChain(&chain);
+	std::vector<float> plane(INPUT_FRAMES);
+	std::vector<unsigned char> expected(data.size()), native((size_t)INPUT_FRAMES * 3);
+	for (int c = 0; c < CHANNELS; c++){
+		for (size_t i = 0; i < plane.size(); i++)
+			plane[i] = samples[i * CHANNELS + c];
+		runChain(&chain, c, &plane[0], INPUT_FRAMES);
+		getFromFloat(ASIOSTInt24LSB)(&plane[0], &native[0], INPUT_FRAMES);
+		for (size_t i = 0; i < plane.size(); i++)
+			memcpy(&expected[(i * CHANNELS + c) * 3], &native[i * 3], 3);
+	}
+	CHECK(data == expected);
+
+	for (int i = 0; i < 3; i++)
+		unlink(paths[i]);
+	return checkResult("OfflineRenderTest");
+}
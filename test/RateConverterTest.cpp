@@ -0,0 +1,121 @@
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "Check.h"
+#include "RateConverter.h"
+
+// The converter the way convertBlocks() in Source.cpp drives it, with a host side that plays its
+// inputs straight back out: device inputs in, host blocks for as long as nextBlock() says,
+// device outputs out. A band limited click on the device input has to come back out where the
+// latency the converter reports says, with the same energy, and the host has to run at its rate.
+
+#define CLICK_AT 8000				// device frames in, well past the start
+#define CLICK_HALF_WIDTH 32
+#define TWO_PI (2. * 3.14159265358979323846)
+
+typedef struct Device{
+	std::vector<float> memory;		// both halves of one input and one output
+	ChannelSet inputs;
+	ChannelSet outputs;
+}Device;
+
+// windowed sinc with the cutoff at 8k, below either Nyquist
+static float click(double t){
+	if (fabs(t) >= CLICK_HALF_WIDTH)
+		return 0.f;
+	double x = TWO_PI * 8000. / 48000. * t;
+	double sinc = t == 0 ? 1. : sin(x) / x;
+	double window = 0.5 + 0.5 * cos(TWO_PI * t / (2. * CLICK_HALF_WIDTH));
+	return (float)(0.5 * sinc * window);
+}
+
+static void setUp(Device *device, long frames){
+	device->memory.assign(4 * frames, 0.f);
+	ChannelSet *sets[2] = { &device->inputs, &device->outputs };
+	for (int d = 0; d < 2; d++){
+		ChannelSet &set = *sets[d];
+		set.allocate(1);
+		set.type[0] = ASIOSTFloat32LSB;
+		set.nativeBytes[0] = frames * sizeof(float);
+		set.toFloat[0] = getToFloat(ASIOSTFloat32LSB);
+		set.fromFloat[0] = getFromFloat(ASIOSTFloat32LSB);
+		for (int h = 0; h < 2; h++)
+			set.half[h][0] = &device->memory[(2 * d + h) * frames];
+	}
+}
+
+static void run(double deviceRate, long deviceFrames, double hostRate, long hostFrames){
+	Device device;
+	setUp(&device, deviceFrames);
+	RateConverter converter;
+	CHECK(converter.allocate(device.inputs, device.outputs, deviceFrames, deviceRate, hostFrames, hostRate));
+	// the sets got host halves, hostFrames long
+	CHECK(device.inputs.nativeBytes[0] == (long)(hostFrames * sizeof(float)));
+	CHECK(device.inputs.half[0][0] != &device.memory[0]);
+
+	long callbacks = (long)(4. * deviceRate / deviceFrames);
+	std::vector<float> played;
+	long hostBlocks = 0, hostIndex = 0;
+	bool steady = true, fed = true;
+	for (long b = 0; b < callbacks; b++){
+		long index = b & 1;
+		float *in = &device.memory[index * deviceFrames];
+		for (long n = 0; n < deviceFrames; n++)
+			in[n] = click((double)(b * deviceFrames + n - CLICK_AT));
+		converter.input(index);
+		long blocks = 0;
+		while (converter.nextBlock()){
+			converter.pullInputs(hostIndex);
+			memcpy(device.outputs.half[hostIndex][0], device.inputs.half[hostIndex][0], hostFrames * sizeof(float));
+			converter.pushOutputs(hostIndex);
+			hostIndex ^= 1;
+			blocks++;
+		}
+		hostBlocks += blocks;
+		// one more or one less than the ratio now and then, never a run of them
+		steady = steady && fabs(blocks - deviceFrames * hostRate / deviceRate / hostFrames) < 1.5;
+		fed = converter.output(index) && fed;
+		const float *out = &device.memory[(2 + index) * deviceFrames];
+		played.insert(played.end(), out, out + deviceFrames);
+	}
+	CHECK(steady);
+	CHECK(fed);
+
+	RateConverterStats stats;
+	converter.stats(&stats);
+	CHECK(stats.active);
+	CHECK(stats.underruns == 0);
+	// the host ran at its rate, give or take the block the slack holds
+	double expected = (double)callbacks * deviceFrames * hostRate / deviceRate / hostFrames;
+	CHECK(fabs(hostBlocks - expected) <= 2);
+
+	// the click comes back at the latency the stats say, a sample either way for rounding
+	long peak = 0;
+	for (long n = 1; n < (long)played.size(); n++)
+		if (fabsf(played[n]) > fabsf(played[peak]))
+			peak = n;
+	double delay = (peak - CLICK_AT) / deviceRate;
+	double reported = stats.inputLatency + stats.outputLatency;
+	printf("  %.0f/%ld to %.0f/%ld: %ld host blocks of %.1f, delay %.3f ms, reported %.3f ms\n", deviceRate, deviceFrames,
+		hostRate, hostFrames, hostBlocks, expected, delay * 1e3, reported * 1e3);
+	CHECK(reported > 0);
+	CHECK_NEAR(delay, reported, 1.5 / deviceRate);
+	// between two samples the peak is lower, the click's energy is all there though
+	double sent = 0, received = 0;
+	for (long n = -CLICK_HALF_WIDTH; n <= CLICK_HALF_WIDTH; n++)
+		sent += click((double)n) * click((double)n);
+	for (long n = peak - 2 * CLICK_HALF_WIDTH; n <= peak + 2 * CLICK_HALF_WIDTH; n++)
+		received += played[n] * played[n];
+	CHECK_NEAR(received / sent, 1., 0.01);
+	converter.release();
+	CHECK(!converter.active());
+}
+
+int main(){
+	initSampleConvert();
+	run(48000., 256, 44100., 256);
+	run(44100., 256, 48000., 256);
+	run(96000., 512, 48000., 128);
+	run(48000., 64, 44100., 441);
+	return checkResult("RateConverterTest");
+}
@@ -0,0 +1,187 @@
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <vector>
+#include "Check.h"
+#include "Realtime.h"
+#include "RingBuffer.h"
+#include "VirtualDevice.h"
+
+// Realtime settings the way start() uses them: the virtual device's timer thread sets itself up
+// in its first callback and reads back what it got, then goes back to what it had. Without the
+// permission for SCHED_FIFO that's EPERM and the old policy, the pinning works either way. And
+// the memory lock on rings, counted as locked, prefaulted or failed.
+
+#define RATE 48000.
+#define FRAMES 64
+#define PRIORITY 10
+#define SETTLE_BLOCKS 4
+
+typedef struct DriverThread{
+	ASIOBufferInfo buffers[2];
+	std::atomic<long> blocks;
+	int cpu;
+	ThreadSettings applied;
+	ThreadSettings restored;	// what it reads back after restoreThread()
+	SavedThread saved;
+	std::atomic<bool> done;
+}DriverThread;
+
+static DriverThread driver;
+
+static ASIOTime *bufferSwitchTimeInfo(ASIOTime *params, long, ASIOBool){
+	long block = driver.blocks.load();
+	if (block == 0){
+		std::vector<int> cpus(1, driver.cpu);
+		applyThreadRealtime(PRIORITY, cpus, (uint64_t)(FRAMES / RATE * 1e9), &driver.applied, &driver.saved);
+	}
+	else if (block == SETTLE_BLOCKS){
+		restoreThread(&driver.saved);
+		// priority 0 and no cores only reads back
+		applyThreadRealtime(0, std::vector<int>(), 0, &driver.restored, NULL);
+		driver.done.store(true);
+	}
+	driver.blocks.store(block + 1);
+	return params;
+}
+
+static ASIOCallbacks callbacks = { NULL, NULL, NULL, bufferSwitchTimeInfo };
+
+// the cores this process may run on, the thread starts out with all of them
+static std::vector<int> allowedCpus(){
+	std::vector<int> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		for (int c = 0; c < CPU_SETSIZE; c++)
+			if (CPU_ISSET(c, &set))
+				cpus.push_back(c);
+	return cpus;
+}
+
+static void testDriverThread(){
+	std::vector<int> allowed = allowedCpus();
+	CHECK(!allowed.empty());
+	if (allowed.empty())
+		return;
+	driver.cpu = allowed.back();
+	driver.blocks = 0;
+	driver.done = false;
+	clearThreadSettings(&driver.applied);
+	clearThreadSettings(&driver.restored);
+
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.inputs = 1;
+	config.outputs = 1;
+	config.sampleType = ASIOSTFloat32LSB;
+	configureVirtualDevice(config);
+	char name[] = VIRTUAL_DRIVER_NAME;
+	ASIODriverInfo info;
+	memset(&info, 0, sizeof(info));
+	CHECK(virtualBackend.load(name) && virtualBackend.init(&info) == ASE_OK);
+	CHECK(virtualBackend.setSampleRate(RATE) == ASE_OK);
+	for (int c = 0; c < 2; c++){
+		driver.buffers[c].isInput = c == 0 ? ASIOTrue : ASIOFalse;
+		driver.buffers[c].channelNum = 0;
+		driver.buffers[c].buffers[0] = driver.buffers[c].buffers[1] = NULL;
+	}
+	CHECK(virtualBackend.createBuffers(driver.buffers, 2, FRAMES, &callbacks) == ASE_OK);
+	CHECK(virtualBackend.start() == ASE_OK);
+	// a few milliseconds of blocks, two seconds before giving up on it
+	for (int waited = 0; waited < 2000 && !driver.done.load(); waited++)
+		usleep(1000);
+	virtualBackend.stop();
+	virtualBackend.disposeBuffers();
+	virtualBackend.exit();
+	virtualBackend.unload();
+	CHECK(driver.done.load());
+	if (!driver.done.load())
+		return;
+
+	const ThreadSettings &applied = driver.applied;
+	CHECK(applied.applied);
+	// pinned to the one core, read back from the thread itself
+	CHECK(applied.affinityError == 0);
+	CHECK(applied.cpuCount == 1 && applied.cpus[0] == driver.cpu);
+	if (applied.schedulingError == 0){
+		CHECK(strcmp(applied.policy, "fifo") == 0 && applied.priority == PRIORITY);
+		CHECK(applied.message[0] == 0);
+	}
+	else{
+		// unprivileged: the error and why, the thread still runs as it did
+		CHECK(applied.schedulingError == EPERM);
+		CHECK(strncmp(applied.message, "SCHED_FIFO", 10) == 0);
+		CHECK(strcmp(applied.policy, "other") == 0 && applied.priority == 0);
+	}
+	printf("  driver thread: %s %d on cpu %d%s%s\n", applied.policy, applied.priority, driver.cpu,
+		applied.message[0] ? ", " : "", applied.message);
+
+	// and back to the policy and the cores it had
+	const ThreadSettings &restored = driver.restored;
+	CHECK(restored.schedulingError == 0 && restored.affinityError == 0);
+	CHECK(strcmp(restored.policy, "other") == 0 && restored.priority == 0);
+	bool cores = restored.cpuCount == (int)allowed.size() || (allowed.size() > REALTIME_MAX_CPUS && restored.cpuCount == REALTIME_MAX_CPUS);
+	for (int c = 0; cores && c < restored.cpuCount; c++)
+		cores = restored.cpus[c] == allowed[c];
+	CHECK(cores);
+}
+
+static void testMemoryLock(){
+	MemoryLock memory;
+	MemoryLockStats stats;
+	memory.stats(&stats);
+	CHECK(stats.regions == 0 && stats.lockedBytes == 0 && stats.prefaultedBytes == 0 && stats.failedBytes == 0);
+
+	// a ring nothing uses yet gets written, one another thread has is only locked
+	BlockRing fresh, busy;
+	CHECK(fresh.allocate(8, 4096) && busy.allocate(4, 1000));
+	size_t freshBytes = fresh.capacity() * fresh.blockBytes(), busyBytes = busy.capacity() * busy.blockBytes();
+	memory.lock(fresh.slot(0), freshBytes, true);
+	memory.lock(busy.slot(0), busyBytes, false);
+	// nothing to lock
+	memory.lock(NULL, 4096, true);
+	memory.stats(&stats);
+	CHECK(stats.regions == 2);
+	CHECK(stats.prefaultedBytes == freshBytes);
+	// well under any RLIMIT_MEMLOCK
+	CHECK(stats.lockedBytes == freshBytes + busyBytes && stats.failedBytes == 0 && stats.error == 0);
+
+	// more than the limit: without CAP_IPC_LOCK the lock fails, the pages are faulted in anyway
+	struct rlimit limit;
+	BlockRing large;
+	if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY
+		&& large.allocate(16, (size_t)limit.rlim_cur / 8)){
+		size_t largeBytes = large.capacity() * large.blockBytes();
+		memory.lock(large.slot(0), largeBytes, true);
+		memory.stats(&stats);
+		CHECK(stats.regions == 3 && stats.prefaultedBytes == freshBytes + largeBytes);
+		if (stats.failedBytes){
+			CHECK(stats.failedBytes == largeBytes && stats.lockedBytes == freshBytes + busyBytes);
+			CHECK(stats.error == ENOMEM || stats.error == EPERM);
+		}
+		else
+			CHECK(stats.lockedBytes == freshBytes + busyBytes + largeBytes && stats.error == 0);
+		printf("  %zu bytes over RLIMIT_MEMLOCK: %s\n", largeBytes, stats.failedBytes ? strerror(stats.error) : "locked");
+		memory.unlock(large.slot(0));
+		memory.stats(&stats);
+		CHECK(stats.regions == 2 && stats.lockedBytes == freshBytes + busyBytes && stats.failedBytes == 0);
+	}
+
+	memory.unlock(busy.slot(0));
+	memory.stats(&stats);
+	CHECK(stats.regions == 1 && stats.lockedBytes == freshBytes);
+	memory.unlockAll();
+	memory.stats(&stats);
+	CHECK(stats.regions == 0 && stats.lockedBytes == 0 && stats.prefaultedBytes == 0 && stats.error == 0);
+}
+
+int main(){
+	testDriverThread();
+	testMemoryLock();
+	return checkResult("RealtimeTest");
+}
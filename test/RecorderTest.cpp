@@ -0,0 +1,112 @@
+#include <uv.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include "Check.h"
+#include "Recorder.h"
+#include "SampleConvert.h"
+
+// A recording the way the driver thread makes one: capture() from a thread of its own with the
+// current input halves, in bursts that fill the ring faster than the writer empties it, then a
+// pause for it to catch up. Every block has to end up in the file where it was captured, the ones
+// the ring had no room for as silence, so the file keeps its timing.
+
+#define RATE 48000.
+#define FRAMES 64
+#define INPUTS 3
+#define BURSTS 20
+#define BURST_BLOCKS 100
+#define BLOCKS (BURSTS * BURST_BLOCKS)
+
+// sample i of input c in block n, never 0 so a block can't pass for silence
+static int16_t sampleAt(long n, long c, long i){
+	return (int16_t)((n * 5 + c * 11 + i) % 30000 + 1);
+}
+
+typedef struct Producer{
+	Recorder recorder;
+	std::vector<int16_t> inputs[INPUTS];
+}Producer;
+
+static void producerThread(void *arg){
+	Producer *producer = (Producer *)arg;
+	void *halves[INPUTS];
+	for (long n = 0; n < BLOCKS; n++){
+		for (long c = 0; c < INPUTS; c++){
+			for (long i = 0; i < FRAMES; i++)
+				producer->inputs[c][i] = sampleAt(n, c, i);
+			halves[c] = &producer->inputs[c][0];
+		}
+		producer->recorder.capture(halves);
+		if (n % BURST_BLOCKS == BURST_BLOCKS - 1)
+			usleep(20000);
+	}
+}
+
+int main(){
+	initSampleConvert();
+	char path[] = "/tmp/RecorderTestXXXXXX";
+	int fd = mkstemp(path);
+	if (fd >= 0)
+		close(fd);
+
+	Producer producer;
+	for (long c = 0; c < INPUTS; c++)
+		producer.inputs[c].assign(FRAMES, 0);
+	ASIOSampleType types[INPUTS] = { ASIOSTInt16LSB, ASIOSTInt16LSB, ASIOSTInt16LSB };
+	// the last and the first input, in that order
+	std::vector<int> channels;
+	channels.push_back(2);
+	channels.push_back(0);
+	CHECK(producer.recorder.open(path, std::vector<int>(), kRecordNative, types, INPUTS, FRAMES, RATE, 0.) == -2);
+	CHECK(producer.recorder.open(path, channels, kRecordNative, types, INPUTS, FRAMES, RATE, 0.) == 0);
+	CHECK(producer.recorder.open(path, channels, kRecordNative, types, INPUTS, FRAMES, RATE, 0.) == -1);
+
+	uv_thread_t thread;
+	uv_thread_create(&thread, producerThread, &producer);
+	uv_thread_join(&thread);
+	RecorderStats stats;
+	producer.recorder.stats(&stats);
+	CHECK(stats.recording);
+	// the smallest ring there is, a burst doesn't fit
+	CHECK(stats.bufferBlocks == 8 && stats.highWater == 8);
+	CHECK(stats.overruns > 0 && stats.overruns < BLOCKS);
+	producer.recorder.close();
+	producer.recorder.stats(&stats);
+	CHECK(!stats.recording && stats.writeErrors == 0);
+	CHECK(stats.framesWritten == (uint64_t)BLOCKS * FRAMES);
+
+	FILE *file = fopen(path, "rb");
+	WavInfo info;
+	CHECK(file && wavReadHeader(file, &info));
+	if (!file)
+		return checkResult("RecorderTest");
+	CHECK(info.channels == 2 && info.sampleRate == RATE && info.type == ASIOSTInt16LSB);
+	CHECK(info.frames == (uint64_t)BLOCKS * FRAMES && info.dataBytes == info.frames * 2 * sizeof(int16_t));
+	std::vector<int16_t> samples((size_t)info.frames * 2);
+	CHECK(fread(&samples[0], sizeof(int16_t), samples.size(), file) == samples.size());
+	fclose(file);
+
+	// every block is either what was captured, interleaved, or silence where it was dropped
+	uint64_t silent = 0;
+	bool kept = true;
+	for (long n = 0; n < BLOCKS; n++){
+		const int16_t *block = &samples[(size_t)n * FRAMES * 2];
+		bool silence = true, captured = true;
+		for (long i = 0; i < FRAMES; i++){
+			silence = silence && block[2 * i] == 0 && block[2 * i + 1] == 0;
+			captured = captured && block[2 * i] == sampleAt(n, 2, i) && block[2 * i + 1] == sampleAt(n, 0, i);
+		}
+		kept = kept && (silence || captured);
+		if (silence)
+			silent++;
+	}
+	printf("  %d blocks, %llu dropped and written as silence\n", BLOCKS, (unsigned long long)silent);
+	CHECK(kept);
+	CHECK(silent == stats.overruns);
+	unlink(path);
+	return checkResult("RecorderTest");
+}
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "SampleConvert.h"
+
+// Nanoseconds per sample of every conversion kernel at every level this cpu runs, a block of
+// FRAMES samples at a time the way the driver thread calls them. One line per type:
+//
+//   type         direction  scalar    sse2    avx2
+//
+// build/SampleConvertBench [frames] [milliseconds per kernel]
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanosPerSample(ToFloatKernel toFloat, FromFloatKernel fromFloat, void *native, float *floats,
+	long frames, double millis)
+{
+	long rounds = 0;
+	double elapsed = 0;
+	Clock::time_point start = Clock::now();
+	// in batches so reading the clock doesn't show up in the numbers
+	while (elapsed < millis * 1e6){
+		for (int i = 0; i < 64; i++){
+			if (toFloat)
+				toFloat(native, floats, frames);
+			else
+				fromFloat(floats, native, frames);
+		}
+		rounds += 64;
+		elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+	return elapsed / ((double)rounds * frames);
+}
+
+int main(int argc, char **argv){
+	long frames = argc > 1 ? atol(argv[1]) : 512;
+	double millis = argc > 2 ? atof(argv[2]) : 50;
+	if (frames <= 0 || millis <= 0){
+		fprintf(stderr, "usage: %s [frames] [milliseconds per kernel]\n", argv[0]);
+		return 1;
+	}
+	initSampleConvert();
+	std::vector<float> floats(frames);
+	std::vector<unsigned char> native(frames * 8);
+	for (long i = 0; i < frames; i++)
+		floats[i] = (float)((i * 7919) % 2001 - 1000) / 1000.f;
+	memset(&native[0], 0, native.size());
+
+	printf("%ld frames a block, ns per sample\n%-12s %-5s", frames, "type", "dir");
+	for (int level = kConvertScalar; level <= convertLevel(); level++)
+		printf(" %8s", convertLevelName(level));
+	printf("\n");
+	for (int type = 0; type < ASIOSTLastEntry; type++){
+		if (!getToFloat((ASIOSampleType)type, kConvertScalar))
+			continue;
+		for (int direction = 0; direction < 2; direction++){
+			printf("%-12s %-5s", sampleTypeName((ASIOSampleType)type), direction ? "out" : "in");
+			for (int level = kConvertScalar; level <= convertLevel(); level++){
+				ToFloatKernel toFloat = direction ? NULL : getToFloat((ASIOSampleType)type, level);
+				FromFloatKernel fromFloat = direction ? getFromFloat((ASIOSampleType)type, level) : NULL;
+				printf(" %8.3f", nanosPerSample(toFloat, fromFloat, &native[0], &floats[0], frames, millis));
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
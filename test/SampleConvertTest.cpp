@@ -0,0 +1,163 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "Check.h"
+#include "SampleConvert.h"
+
+// Every vector kernel against the scalar reference, bit for bit, for every sample type at every
+// level this cpu runs. Lengths around the vector widths so the tails get covered, and buffers a
+// byte off alignment since drivers hand out whatever they like.
+
+static const long lengths[] = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 255, 1023 };
+#define MAX_LENGTH 1023
+
+static uint32_t seed = 1;
+static uint32_t nextRandom(){
+	// xorshift, the same bits on every run
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+// floats the outputs see: mostly in range, some past full scale, the edges and the odd ones
+static void fillFloats(float *dst, long count){
+	static const float special[] = { 0.f, -0.f, 1.f, -1.f, 0.99999994f, -0.99999994f, 1.0000001f, -1.0000001f,
+		0.5f / 32768.f, -0.5f / 32768.f, 1.5f / 32768.f, 1e-30f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN };
+	const long specials = sizeof(special) / sizeof(special[0]);
+	for (long i = 0; i < count; i++){
+		uint32_t r = nextRandom();
+		if (r % 8 == 0)
+			dst[i] = special[(r >> 3) % specials];
+		else
+			dst[i] = ((float)(r >> 8) / (float)(1 << 24)) * 3.f - 1.5f;
+	}
+}
+
+static void fillBytes(unsigned char *dst, long count){
+	for (long i = 0; i < count; i++)
+		dst[i] = (unsigned char)nextRandom();
+}
+
+static void testToFloat(ASIOSampleType type, int level){
+	ToFloatKernel reference = getToFloat(type, kConvertScalar);
+	ToFloatKernel kernel = getToFloat(type, level);
+	CHECK(kernel != NULL);
+	if (!kernel)
+		return;
+	long bytes = sampleBytes(type);
+	std::vector<unsigned char> src(MAX_LENGTH * bytes + 1);
+	std::vector<float> expected(MAX_LENGTH), actual(MAX_LENGTH + 1);
+	for (size_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++){
+		long count = lengths[n];
+		fillBytes(&src[0], (long)src.size());
+		// the source a byte in, the destination a float in
+		reference(&src[1], &expected[0], count);
+		memset(&actual[0], 0x55, actual.size() * sizeof(float));
+		kernel(&src[1], &actual[1], count);
+		if (!checkThat(memcmp(&expected[0], &actual[1], count * sizeof(float)) == 0, "to float matches scalar", __FILE__, __LINE__))
+			printf("  %s, %s, %ld samples\n", sampleTypeName(type), convertLevelName(level), count);
+		uint32_t guard;
+		memcpy(&guard, &actual[1 + count], 4);
+		CHECK(count == MAX_LENGTH || guard == 0x55555555);
+	}
+}
+
+static void testFromFloat(ASIOSampleType type, int level){
+	FromFloatKernel reference = getFromFloat(type, kConvertScalar);
+	FromFloatKernel kernel = getFromFloat(type, level);
+	CHECK(kernel != NULL);
+	if (!kernel)
+		return;
+	long bytes = sampleBytes(type);
+	std::vector<float> src(MAX_LENGTH + 1);
+	std::vector<unsigned char> expected(MAX_LENGTH * bytes), actual(MAX_LENGTH * bytes + 1 + bytes);
+	for (size_t n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++){
+		long count = lengths[n];
+		fillFloats(&src[0], (long)src.size());
+		reference(&src[1], &expected[0], count);
+		memset(&actual[0], 0x55, actual.size());
+		kernel(&src[1], &actual[1], count);
+		if (!checkThat(memcmp(&expected[0], &actual[1], count * bytes) == 0, "from float matches scalar", __FILE__, __LINE__))
+			printf("  %s, %s, %ld samples\n", sampleTypeName(type), convertLevelName(level), count);
+		// nothing written past the last sample
+		bool untouched = true;
+		for (long i = 1 + count * bytes; i < (long)actual.size(); i++)
+			untouched = untouched && actual[i] == 0x55;
+		CHECK(untouched);
+	}
+}
+
+static void testRoundTrip(ASIOSampleType type){
+	// every 16 and 24 bit value comes back the same through float
+	long bytes = sampleBytes(type);
+	long count = 4096;
+	std::vector<unsigned char> src(count * bytes), back(count * bytes);
+	std::vector<float> floats(count);
+	fillBytes(&src[0], (long)src.size());
+	// the extremes are in there for sure
+	memset(&src[0], 0x7f, bytes);
+	memset(&src[bytes], 0x80, bytes);
+	for (int level = kConvertScalar; level <= convertLevel(); level++){
+		getToFloat(type, level)(&src[0], &floats[0], count);
+		bool inRange = true;
+		for (long i = 0; i < count; i++)
+			inRange = inRange && floats[i] >= -1.f && floats[i] < 1.f;
+		CHECK(inRange);
+		getFromFloat(type, level)(&floats[0], &back[0], count);
+		if (!checkThat(memcmp(&src[0], &back[0], src.size()) == 0, "round trip is lossless", __FILE__, __LINE__))
+			printf("  %s, %s\n", sampleTypeName(type), convertLevelName(level));
+	}
+}
+
+static void testScale(){
+	// full scale means 2^(bits-1) in both directions
+	int16_t i16 = -32768;
+	float f;
+	getToFloat(ASIOSTInt16LSB)(&i16, &f, 1);
+	CHECK(f == -1.f);
+	f = 0.5f;
+	getFromFloat(ASIOSTInt16LSB)(&f, &i16, 1);
+	CHECK(i16 == 16384);
+	// clamped to the type
+	f = 2.f;
+	int32_t i32;
+	getFromFloat(ASIOSTInt32LSB24)(&f, &i32, 1);
+	CHECK(i32 == 8388607);
+	f = -2.f;
+	getFromFloat(ASIOSTInt32LSB)(&f, &i32, 1);
+	CHECK(i32 == INT32_MIN);
+	// MSB types are byte swapped
+	unsigned char msb[2];
+	f = 0.5f;
+	getFromFloat(ASIOSTInt16MSB)(&f, msb, 1);
+	CHECK(msb[0] == 0x40 && msb[1] == 0x00);
+	// and DSD isn't converted at all
+	CHECK(getToFloat(ASIOSTDSDInt8LSB1) == NULL);
+	CHECK(getFromFloat(ASIOSTDSDInt8MSB1) == NULL);
+}
+
+int main(){
+	initSampleConvert();
+	printf("SampleConvertTest: kernels up to %s\n", convertLevelName(convertLevel()));
+	int types = 0;
+	for (int type = 0; type < ASIOSTLastEntry; type++){
+		if (!getToFloat((ASIOSampleType)type, kConvertScalar))
+			continue;
+		types++;
+		for (int level = kConvertScalar; level <= convertLevel(); level++){
+			testToFloat((ASIOSampleType)type, level);
+			testFromFloat((ASIOSampleType)type, level);
+		}
+	}
+	// every PCM type in the SDK, only DSD is left out
+	CHECK(types == 18);
+	testRoundTrip(ASIOSTInt16LSB);
+	testRoundTrip(ASIOSTInt16MSB);
+	testRoundTrip(ASIOSTInt24LSB);
+	testRoundTrip(ASIOSTInt24MSB);
+	testScale();
+	return checkResult("SampleConvertTest");
+}
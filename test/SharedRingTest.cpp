@@ -0,0 +1,292 @@
+#include <uv.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <vector>
+#include "Check.h"
+#include "SharedRing.h"
+
+// Both directions through a second mapping of the same memory, the way another process sees
+// it: capture blocks published by a producer thread and followed by a reader that checks the
+// seqlock on every one, playback blocks written into the mapping and played by acquire() and
+// release() the way the driver does. A name another open ring has is refused, one left behind
+// is taken over.
+
+#define CHANNELS 2
+#define FRAMES 64
+#define SLOTS 4
+#define BLOCKS 20000
+
+static std::string ringName(const char *what){
+	char name[64];
+	snprintf(name, sizeof(name), "SharedRingTest-%s-%d", what, (int)getpid());
+	return name;
+}
+
+// sample i of channel c in block n, exact in int16 and in float
+static int16_t sampleAt(uint64_t n, long c, long i){
+	return (int16_t)(((n * 7 + c * 3 + i) % 2000) * 16 - 16000);
+}
+
+static SharedSlot *slotAt(const SharedMapping &view, uint64_t n){
+	const SharedHeader *header = (const SharedHeader *)view.data;
+	return (SharedSlot *)(view.data + header->headerBytes + (n % header->slotCount) * header->slotBytes);
+}
+
+static const float *planeAt(const SharedMapping &view, SharedSlot *slot, long c){
+	const SharedHeader *header = (const SharedHeader *)view.data;
+	return (const float *)((char *)slot + SHARED_SLOT_HEADER_BYTES + c * header->channelBytes);
+}
+
+//----------------------------------------------------------------------------------
+// capture
+
+typedef struct CaptureRun{
+	SharedRing ring;
+	std::vector<int16_t> halves[CHANNELS];
+	std::atomic<bool> done;
+}CaptureRun;
+
+static void captureProducer(void *arg){
+	CaptureRun *run = (CaptureRun *)arg;
+	void *halves[CHANNELS];
+	for (uint64_t n = 0; n < BLOCKS; n++){
+		for (long c = 0; c < CHANNELS; c++){
+			for (long i = 0; i < FRAMES; i++)
+				run->halves[c][i] = sampleAt(n, c, i);
+			halves[c] = &run->halves[c][0];
+		}
+		run->ring.publish(halves, (double)(n * FRAMES), (double)n * 1e6, 0, kSharedSystemTime | kSharedSamplePosition, n);
+		if (n % 16 == 15)
+			sched_yield();
+	}
+	run->done.store(true);
+}
+
+static void testCapture(){
+	ChannelSet set;
+	set.allocate(CHANNELS);
+	for (long c = 0; c < CHANNELS; c++){
+		set.type[c] = ASIOSTInt16LSB;
+		set.toFloat[c] = getToFloat(ASIOSTInt16LSB);
+	}
+	CaptureRun run;
+	run.done = false;
+	for (long c = 0; c < CHANNELS; c++)
+		run.halves[c].assign(FRAMES, 0);
+	std::string name = ringName("capture");
+	CHECK(run.ring.open("a/b", kSharedCapture, set, FRAMES, SLOTS, 48000.) == -2);
+	CHECK(run.ring.open(name, kSharedCapture, set, FRAMES, 1, 48000.) == -2);
+	CHECK(run.ring.open(name, kSharedCapture, set, FRAMES, SLOTS, 48000.) == 0);
+	CHECK(run.ring.open(name, kSharedCapture, set, FRAMES, SLOTS, 48000.) == -1);
+
+	SharedMapping view;
+	CHECK(mapSharedMemory(name, false, 0, &view));
+	if (!view.data)
+		return;
+	const SharedHeader *header = (const SharedHeader *)view.data;
+	CHECK(header->magic == SHARED_MAGIC && header->version == SHARED_VERSION);
+	CHECK(header->headerBytes == SHARED_HEADER_BYTES && header->direction == kSharedCapture);
+	CHECK(header->channels == CHANNELS && header->frames == FRAMES && header->slotCount == SLOTS);
+	CHECK(header->channelBytes >= FRAMES * sizeof(float) && header->format == kSharedFloat32);
+	CHECK(header->sampleRate == 48000. && header->pid == (uint32_t)getpid() && header->open.load() == 1);
+	CHECK(view.bytes >= SHARED_HEADER_BYTES + SLOTS * (size_t)header->slotBytes);
+	CHECK(header->writeSequence.load() == 0);
+
+	// a reader the way SharedRing.h tells one to: follow writeSequence, check the slot's sequence
+	// before and after, skip what got lapped
+	uv_thread_t thread;
+	uv_thread_create(&thread, captureProducer, &run);
+	uint64_t next = 0, read = 0, torn = 0, skipped = 0;
+	bool matches = true, timed = true;
+	std::vector<float> copy(CHANNELS * FRAMES);
+	while (!run.done.load() || next < header->writeSequence.load(std::memory_order_acquire)){
+		uint64_t written = header->writeSequence.load(std::memory_order_acquire);
+		if (next >= written){
+			sched_yield();
+			continue;
+		}
+		if (written - next > SLOTS){
+			skipped += written - SLOTS - next;
+			next = written - SLOTS;
+		}
+		SharedSlot *slot = slotAt(view, next);
+		uint64_t before = slot->sequence.load(std::memory_order_acquire);
+		double position = slot->samplePosition, nanos = slot->systemTime;
+		uint32_t flags = slot->flags, frames = slot->frames;
+		for (long c = 0; c < CHANNELS; c++)
+			memcpy(&copy[c * FRAMES], planeAt(view, slot, c), FRAMES * sizeof(float));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = slot->sequence.load(std::memory_order_relaxed);
+		if (before != next + 1 || after != next + 1){
+			torn++;
+			next++;
+			continue;
+		}
+		timed = timed && position == (double)(next * FRAMES) && nanos == (double)next * 1e6
+			&& flags == (kSharedSystemTime | kSharedSamplePosition) && frames == FRAMES;
+		for (long c = 0; c < CHANNELS; c++)
+			for (long i = 0; i < FRAMES; i++)
+				matches = matches && copy[c * FRAMES + i] == sampleAt(next, c, i) / 32768.f;
+		read++;
+		next++;
+	}
+	uv_thread_join(&thread);
+	printf("  capture: %llu read, %llu torn, %llu lapped\n", (unsigned long long)read, (unsigned long long)torn,
+		(unsigned long long)skipped);
+	// everything the reader took for whole was the block it wanted
+	CHECK(matches);
+	CHECK(timed);
+	CHECK(read > 0);
+	CHECK(read + torn + skipped == BLOCKS);
+
+	// the last SLOTS blocks are all there, complete
+	CHECK(header->writeSequence.load() == BLOCKS);
+	bool kept = true;
+	for (uint64_t n = BLOCKS - SLOTS; n < BLOCKS; n++)
+		kept = kept && slotAt(view, n)->sequence.load() == n + 1 && planeAt(view, slotAt(view, n), 1)[5] == sampleAt(n, 1, 5) / 32768.f;
+	CHECK(kept);
+	SharedRingStats stats;
+	run.ring.stats(&stats);
+	CHECK(stats.open && stats.direction == kSharedCapture && stats.name == name);
+	CHECK(stats.blocks == BLOCKS && stats.queued == 0 && stats.underruns == 0);
+
+	// closing says so in the header, the name is gone but this mapping stays valid
+	run.ring.close();
+	CHECK(header->open.load() == 0);
+	SharedMapping again;
+	CHECK(!mapSharedMemory(name, false, 0, &again));
+	unmapSharedMemory(&view, false);
+}
+
+//----------------------------------------------------------------------------------
+// playback
+
+static void produce(const SharedMapping &view, uint64_t w){
+	SharedHeader *header = (SharedHeader *)view.data;
+	SharedSlot *slot = slotAt(view, w);
+	float *plane = (float *)planeAt(view, slot, 0);
+	for (long i = 0; i < FRAMES; i++)
+		plane[i] = (float)(w * FRAMES + i) / 65536.f;
+	slot->sequence.store(w + 1, std::memory_order_release);
+	header->writeSequence.store(w + 1, std::memory_order_release);
+}
+
+static bool play(SharedRing &ring, uint64_t n){
+	if (!ring.acquire())
+		return false;
+	bool same = ring.output(1) == NULL;
+	for (long i = 0; i < FRAMES; i++)
+		same = same && ring.output(0)[i] == (float)(n * FRAMES + i) / 65536.f;
+	ring.release();
+	return same;
+}
+
+static void testPlayback(){
+	ChannelSet set;
+	set.allocate(1);
+	set.type[0] = ASIOSTFloat32LSB;
+	set.toFloat[0] = getToFloat(ASIOSTFloat32LSB);
+	SharedRing ring;
+	std::string name = ringName("playback");
+	CHECK(ring.open(name, kSharedPlayback, set, FRAMES, SLOTS, 48000.) == 0);
+	SharedMapping view;
+	CHECK(mapSharedMemory(name, false, 0, &view));
+	if (!view.data)
+		return;
+	SharedHeader *header = (SharedHeader *)view.data;
+	CHECK(header->direction == kSharedPlayback && header->channels == 1);
+	// capture doesn't apply to it
+	void *halves[1] = { NULL };
+	ring.publish(halves, 0, 0, 0, 0, 0);
+	CHECK(header->writeSequence.load() == 0);
+
+	// a producer that hasn't started isn't an underrun
+	CHECK(!ring.acquire());
+	CHECK(header->underruns.load() == 0);
+	// the producer stays up to SLOTS ahead of what was played, the driver plays them in order
+	bool played = true;
+	uint64_t written = 0;
+	for (uint64_t n = 0; n < 1000; n++){
+		while (written - header->readSequence.load(std::memory_order_acquire) < SLOTS)
+			produce(view, written++);
+		played = played && play(ring, n) && header->readSequence.load() == n + 1;
+	}
+	CHECK(played);
+	SharedRingStats stats;
+	ring.stats(&stats);
+	CHECK(stats.blocks == 1000 && stats.queued == SLOTS - 1);
+	// played out, the next one it doesn't have is an underrun
+	for (uint64_t n = 1000; n < written; n++)
+		played = played && play(ring, n);
+	CHECK(played);
+	CHECK(!ring.acquire());
+	CHECK(!ring.acquire());
+	ring.stats(&stats);
+	CHECK(stats.underruns == 2 && stats.queued == 0 && stats.blocks == written);
+	// and it picks up again where the producer does
+	produce(view, written);
+	CHECK(play(ring, written));
+	ring.close();
+	unmapSharedMemory(&view, false);
+}
+
+//----------------------------------------------------------------------------------
+// names already taken
+
+// a pid nothing runs under anymore
+static uint32_t deadPid(){
+	pid_t child = fork();
+	if (child == 0)
+		_exit(0);
+	waitpid(child, NULL, 0);
+	return (uint32_t)child;
+}
+
+static void testTakeOver(){
+	ChannelSet set;
+	set.allocate(1);
+	set.type[0] = ASIOSTFloat32LSB;
+	set.toFloat[0] = getToFloat(ASIOSTFloat32LSB);
+	SharedRing first, second, third;
+	std::string name = ringName("taken");
+	CHECK(first.open(name, kSharedCapture, set, FRAMES, SLOTS, 48000.) == 0);
+	// open in a process that's alive, this one
+	CHECK(second.open(name, kSharedPlayback, set, FRAMES, SLOTS, 48000.) == -3);
+	SharedMapping view;
+	CHECK(mapSharedMemory(name, false, 0, &view));
+	if (!view.data)
+		return;
+	SharedHeader *header = (SharedHeader *)view.data;
+	CHECK(header->direction == kSharedCapture);
+
+	// closed, the way a process that crashed between close() and the unlink leaves it
+	header->open.store(0);
+	CHECK(second.open(name, kSharedPlayback, set, 2 * FRAMES, SLOTS, 48000.) == 0);
+	// in place, whoever has it mapped sees it start over
+	CHECK(header->magic == SHARED_MAGIC && header->direction == kSharedPlayback && header->frames == 2 * FRAMES);
+	CHECK(header->open.load() == 1 && header->pid == (uint32_t)getpid());
+
+	// still open, but the process that had it is gone
+	header->pid = deadPid();
+	CHECK(third.open(name, kSharedCapture, set, FRAMES, SLOTS, 48000.) == 0);
+	CHECK(header->direction == kSharedCapture && header->pid == (uint32_t)getpid());
+	unmapSharedMemory(&view, false);
+
+	third.close();
+	CHECK(!mapSharedMemory(name, false, 0, &view));
+	second.close();
+	first.close();
+}
+
+int main(){
+	initSampleConvert();
+	testCapture();
+	testPlayback();
+	testTakeOver();
+	return checkResult("SharedRingTest");
+}
@@ -0,0 +1,245 @@
+#include <uv.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+#include "Check.h"
+#include "VirtualDevice.h"
+#include "SampleConvert.h"
+#include "WavFile.h"
+#include "Stats.h"
+
+// The virtual device the way Source.cpp drives it, through the backend table: channels, buffer
+// halves, the clock, what the sources put on the inputs, ASIOOutputReady() and stop().
+
+#define RATE 48000.
+#define FRAMES 64
+#define TWO_PI (2. * 3.14159265358979323846)
+
+// what the host callback saw
+typedef struct HostRun{
+	ASIOBufferInfo buffers[4];				// 2 inputs, then 2 outputs
+	std::atomic<long> blocks;
+	long lastIndex;
+	uint64_t lastPosition;
+	bool alternating;
+	bool positionsFollow;
+	bool timesFollow;						// offline: systemTime is the sample position's
+	bool loopbackMatches;
+	float firstInput[FRAMES];
+}HostRun;
+
+static HostRun host;
+
+static ASIOTime *bufferSwitchTimeInfo(ASIOTime *params, long index, ASIOBool){
+	long block = host.blocks.load();
+	uint64_t position = ASIO64toUInt64(params->timeInfo.samplePosition);
+	uint64_t nanos = ASIO64toUInt64(params->timeInfo.systemTime);
+	if (block){
+		host.alternating = host.alternating && index == (host.lastIndex ^ 1);
+		host.positionsFollow = host.positionsFollow && position == host.lastPosition + FRAMES;
+	}
+	else{
+		host.positionsFollow = host.positionsFollow && position == 0;
+		memcpy(host.firstInput, host.buffers[0].buffers[index], sizeof(host.firstInput));
+	}
+	host.timesFollow = host.timesFollow && nanos == (uint64_t)(position / RATE * 1e9 + 0.5);
+	// loopback: input 0 has what output 0 got a block ago, which is the block number
+	const float *in = (const float *)host.buffers[0].buffers[index];
+	host.loopbackMatches = host.loopbackMatches && in[0] == (float)(block ? block - 1 : 0) && in[FRAMES - 1] == in[0];
+	for (int o = 2; o < 4; o++){
+		float *out = (float *)host.buffers[o].buffers[index];
+		for (long n = 0; n < FRAMES; n++)
+			out[n] = o == 2 ? (float)block : (float)n / FRAMES;
+	}
+	host.lastIndex = index;
+	host.lastPosition = position;
+	host.blocks.store(block + 1);
+	return params;
+}
+
+static ASIOCallbacks callbacks = { NULL, NULL, NULL, bufferSwitchTimeInfo };
+
+static void resetHost(){
+	host.blocks = 0;
+	host.lastIndex = -1;
+	host.lastPosition = 0;
+	host.alternating = host.positionsFollow = host.timesFollow = host.loopbackMatches = true;
+	memset(host.firstInput, 0, sizeof(host.firstInput));
+}
+
+static bool openDevice(const VirtualConfig &config){
+	const AsioBackend &backend = virtualBackend;
+	configureVirtualDevice(config);
+	char name[] = VIRTUAL_DRIVER_NAME;
+	ASIODriverInfo info;
+	memset(&info, 0, sizeof(info));
+	if (!backend.load(name) || backend.init(&info) != ASE_OK)
+		return false;
+	if (backend.setSampleRate(RATE) != ASE_OK)
+		return false;
+	for (int c = 0; c < 4; c++){
+		host.buffers[c].isInput = c < 2 ? ASIOTrue : ASIOFalse;
+		host.buffers[c].channelNum = c % 2;
+		host.buffers[c].buffers[0] = host.buffers[c].buffers[1] = NULL;
+	}
+	resetHost();
+	return backend.createBuffers(host.buffers, 4, FRAMES, &callbacks) == ASE_OK;
+}
+
+static void closeDevice(){
+	virtualBackend.disposeBuffers();
+	virtualBackend.exit();
+	virtualBackend.unload();
+}
+
+static void sleepMillis(int ms){
+	usleep(ms * 1000);
+}
+
+static void testSurface(){
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.inputs = 4;
+	config.outputs = 6;
+	config.sampleType = ASIOSTFloat32LSB;
+	CHECK(openDevice(config));
+	long inputs = 0, outputs = 0;
+	virtualBackend.getChannels(&inputs, &outputs);
+	CHECK(inputs == 4 && outputs == 6);
+	ASIOChannelInfo channel;
+	memset(&channel, 0, sizeof(channel));
+	channel.channel = 1;
+	channel.isInput = ASIOTrue;
+	CHECK(virtualBackend.getChannelInfo(&channel) == ASE_OK);
+	CHECK(channel.isActive == ASIOTrue && channel.type == ASIOSTFloat32LSB);
+	channel.channel = 4;
+	CHECK(virtualBackend.getChannelInfo(&channel) == ASE_InvalidParameter);
+	// supported unless configured otherwise
+	CHECK(virtualBackend.outputReady() == ASE_OK);
+	// no second set of buffers, and no start without any
+	ASIOBufferInfo more[1];
+	more[0].isInput = ASIOTrue;
+	more[0].channelNum = 0;
+	CHECK(virtualBackend.createBuffers(more, 1, FRAMES, &callbacks) == ASE_InvalidMode);
+	closeDevice();
+	CHECK(virtualBackend.start() == ASE_InvalidMode);
+
+	config.outputReady = false;
+	config.fixedRate = true;
+	config.sampleRate = 44100.;
+	configureVirtualDevice(config);
+	char name[] = VIRTUAL_DRIVER_NAME;
+	ASIODriverInfo info;
+	memset(&info, 0, sizeof(info));
+	CHECK(virtualBackend.load(name) && virtualBackend.init(&info) == ASE_OK);
+	CHECK(virtualBackend.outputReady() == ASE_NotPresent);
+	// locked to its own clock
+	CHECK(virtualBackend.canSampleRate(44100.) == ASE_OK);
+	CHECK(virtualBackend.canSampleRate(RATE) == ASE_NoClock);
+	virtualBackend.exit();
+	virtualBackend.unload();
+}
+
+static void testClock(){
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.sampleType = ASIOSTFloat32LSB;
+	config.source = kVirtualSine;
+	config.frequency = 375.;		// 128 samples a period at 48k
+	CHECK(openDevice(config));
+	uint64_t start = monotonicNanos();
+	CHECK(virtualBackend.start() == ASE_OK);
+	sleepMillis(200);
+	CHECK(virtualBackend.stop() == ASE_OK);
+	double seconds = (monotonicNanos() - start) / 1e9;
+	long blocks = host.blocks.load();
+	// nothing after stop() returned
+	sleepMillis(20);
+	CHECK(host.blocks.load() == blocks);
+	// about as many blocks as the clock has in that time, a loaded machine may lose a few
+	double expected = seconds * RATE / FRAMES;
+	CHECK(blocks > expected * 0.5 && blocks <= expected + 2);
+	CHECK(host.alternating);
+	CHECK(host.positionsFollow);
+	ASIOSamples position;
+	ASIOTimeStamp stamp;
+	virtualBackend.getSamplePosition(&position, &stamp);
+	CHECK(ASIO64toUInt64(position) == (uint64_t)blocks * FRAMES);
+	// the first input block is the sine from phase 0, half scale
+	float sineError = 0;
+	for (long n = 0; n < FRAMES; n++)
+		sineError = fmaxf(sineError, fabsf(host.firstInput[n] - (float)(0.5 * sin(TWO_PI * 375. * n / RATE))));
+	CHECK_NEAR(sineError, 0, 1e-6);
+	closeDevice();
+}
+
+static void testOffline(const char *path){
+	VirtualConfig config;
+	defaultVirtualConfig(&config);
+	config.sampleType = ASIOSTFloat32LSB;
+	config.source = kVirtualLoopback;
+	config.offline = true;
+	config.seconds = 1000 * FRAMES / RATE + 10 / RATE;	// 1000 blocks and a bit of one
+	config.outputFile = path;
+	// a longer file from before is replaced, not appended to
+	FILE *old = fopen(path, "wb");
+	std::vector<char> junk(1 << 20, 'x');
+	fwrite(&junk[0], 1, junk.size(), old);
+	fclose(old);
+	CHECK(openDevice(config));
+	CHECK(virtualBackend.start() == ASE_OK);
+	VirtualRenderStats stats;
+	for (int wait = 0; wait < 5000; wait++){
+		virtualRenderStats(&stats);
+		if (stats.finished)
+			break;
+		sleepMillis(1);
+	}
+	virtualBackend.stop();
+	virtualRenderStats(&stats);
+	CHECK(stats.offline && stats.finished);
+	CHECK(stats.frames == 1000 * FRAMES + 10);
+	CHECK(stats.blocks == 1001);
+	CHECK(host.blocks.load() == 1001);
+	CHECK(stats.framesWritten == stats.frames);
+	CHECK(stats.writeErrors == 0);
+	CHECK(host.alternating && host.positionsFollow);
+	// no clock, time follows the samples
+	CHECK(host.timesFollow);
+	CHECK(host.loopbackMatches);
+	closeDevice();
+
+	FILE *file = fopen(path, "rb");
+	WavInfo info;
+	CHECK(file && wavReadHeader(file, &info));
+	if (!file)
+		return;
+	CHECK(info.channels == 2 && info.sampleRate == RATE && info.type == ASIOSTFloat32LSB);
+	CHECK(info.frames == stats.frames);
+	CHECK(fileSize(file) == info.dataOffset + info.frames * 2 * sizeof(float));
+	fileSeek(file, info.dataOffset);
+	// output 0 is the block number, output 1 a ramp, interleaved
+	std::vector<float> samples((size_t)info.frames * 2);
+	CHECK(fread(&samples[0], sizeof(float), samples.size(), file) == samples.size());
+	fclose(file);
+	bool written = true;
+	for (size_t i = 0; i < info.frames; i++)
+		written = written && samples[2 * i] == (float)(i / FRAMES) && samples[2 * i + 1] == (float)(i % FRAMES) / FRAMES;
+	CHECK(written);
+}
+
+int main(){
+	char path[] = "/tmp/VirtualDeviceTestXXXXXX";
+	int fd = mkstemp(path);
+	if (fd >= 0)
+		close(fd);
+	testSurface();
+	testClock();
+	testOffline(path);
+	unlink(path);
+	return checkResult("VirtualDeviceTest");
+}
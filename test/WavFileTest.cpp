@@ -0,0 +1,92 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "Check.h"
+#include "WavFile.h"
+
+// The header the recorder writes: a plain RIFF with a JUNK chunk the size of ds64 while the data
+// fits in 4GB, turned into RF64 in place past that, the 32 bit sizes all 0xFFFFFFFF and the real
+// ones in ds64. The sizes past 4GB are only written into the header, not the file.
+
+#define CHANNELS 2
+#define FRAME_BYTES (CHANNELS * 4)
+#define LARGE_BYTES (5ull << 30)
+
+static uint32_t le32(const unsigned char *p){
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const unsigned char *p){
+	return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static bool readBytes(FILE *file, unsigned char *bytes, size_t count){
+	return fileSeek(file, 0) == 0 && fread(bytes, 1, count, file) == count;
+}
+
+int main(){
+	char path[] = "/tmp/WavFileTestXXXXXX";
+	int fd = mkstemp(path);
+	if (fd >= 0)
+		close(fd);
+	FILE *file = fopen(path, "w+b");
+	CHECK(file != NULL);
+	if (!file)
+		return checkResult("WavFileTest");
+
+	WavInfo info;
+	memset(&info, 0, sizeof(info));
+	info.channels = CHANNELS;
+	info.sampleRate = 96000.;
+	info.type = ASIOSTFloat32LSB;
+	CHECK(wavWriteHeader(file, &info));
+	CHECK(info.bitsPerSample == 32 && info.isFloat && info.dataBytes == 0);
+	uint64_t dataOffset = info.dataOffset;
+	// the JUNK chunk and the extensible fmt chunk come before the data
+	CHECK(dataOffset == 104);
+
+	// a small file stays RIFF
+	unsigned char data[1000];
+	memset(data, 0x3f, sizeof(data));
+	CHECK(fwrite(data, 1, sizeof(data), file) == sizeof(data));
+	info.dataBytes = sizeof(data);
+	info.frames = sizeof(data) / FRAME_BYTES;
+	CHECK(wavFinishHeader(file, &info));
+	unsigned char header[104];
+	CHECK(readBytes(file, header, sizeof(header)));
+	CHECK(memcmp(header, "RIFF", 4) == 0 && le32(header + 4) == 96 + sizeof(data));
+	CHECK(memcmp(header + 8, "WAVE", 4) == 0 && memcmp(header + 12, "JUNK", 4) == 0 && le32(header + 16) == 28);
+	CHECK(memcmp(header + 96, "data", 4) == 0 && le32(header + 100) == sizeof(data));
+	WavInfo read;
+	CHECK(wavReadHeader(file, &read));
+	CHECK(read.channels == CHANNELS && read.sampleRate == 96000. && read.type == ASIOSTFloat32LSB);
+	CHECK(read.dataOffset == dataOffset && read.dataBytes == sizeof(data) && read.frames == sizeof(data) / FRAME_BYTES);
+
+	// past 4GB: the JUNK chunk becomes ds64, nothing moves
+	info.dataBytes = LARGE_BYTES;
+	info.frames = LARGE_BYTES / FRAME_BYTES;
+	CHECK(wavFinishHeader(file, &info));
+	CHECK(readBytes(file, header, sizeof(header)));
+	CHECK(memcmp(header, "RF64", 4) == 0 && le32(header + 4) == 0xFFFFFFFFu && memcmp(header + 8, "WAVE", 4) == 0);
+	CHECK(memcmp(header + 12, "ds64", 4) == 0 && le32(header + 16) == 28);
+	CHECK(le64(header + 20) == 96 + LARGE_BYTES && le64(header + 28) == LARGE_BYTES && le64(header + 36) == LARGE_BYTES / FRAME_BYTES);
+	CHECK(memcmp(header + 48, "fmt ", 4) == 0);
+	CHECK(memcmp(header + 96, "data", 4) == 0 && le32(header + 100) == 0xFFFFFFFFu);
+	CHECK(wavReadHeader(file, &read));
+	CHECK(read.channels == CHANNELS && read.type == ASIOSTFloat32LSB && read.dataOffset == dataOffset);
+	CHECK(read.dataBytes == LARGE_BYTES && read.frames == LARGE_BYTES / FRAME_BYTES);
+	// the file is as long as what was written, only the header says more
+	CHECK(fileSize(file) == dataOffset + sizeof(data));
+
+	// and back under 4GB it's RIFF again
+	info.dataBytes = sizeof(data);
+	info.frames = sizeof(data) / FRAME_BYTES;
+	CHECK(wavFinishHeader(file, &info));
+	CHECK(wavReadHeader(file, &read) && read.dataBytes == sizeof(data));
+	CHECK(readBytes(file, header, sizeof(header)) && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 12, "JUNK", 4) == 0);
+
+	fclose(file);
+	unlink(path);
+	return checkResult("WavFileTest");
+}